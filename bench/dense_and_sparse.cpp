@@ -0,0 +1,83 @@
+// Copyright (c) 2021, Aalto University, developed by Erik Schultheis
+// All rights reserved.
+//
+// SPDX-License-Identifier: MIT
+
+#include "objective/dense_and_sparse.h"
+#include "utils/eigen_generic.h"
+#include "utils/test_utils.h"
+#include "nanobench.h"
+
+using namespace dismec;
+using namespace dismec::objective;
+
+namespace {
+    /*!
+     * \brief Runs the operations of a Newton step on a combined dense/sparse objective.
+     * \details The dense part mimics a 768-dimensional (non-negative) embedding, as used in cascade training. The
+     * weights are drawn uniformly around `offset`, which determines how many instances are inside the margin, and
+     * thus how many rows contribute to gradient and Hessian products.
+     */
+    void bench_objective(ankerl::nanobench::Bench& bench, DenseAndSparseLinearBase& objective,
+                         const std::string& name, real_t weight_scale, real_t offset) {
+        HashVector weights{(DenseRealVector::Random(objective.num_variables()) * weight_scale).array() + offset};
+        DenseRealVector direction = DenseRealVector::Random(objective.num_variables());
+        DenseRealVector gradient(objective.num_variables());
+        DenseRealVector pre(objective.num_variables());
+        DenseRealVector target(objective.num_variables());
+
+        bench.run(name + " gradient", [&]() {
+            weights.modify().coeffRef(0) += 1e-5;
+            objective.gradient(weights, gradient);
+            ankerl::nanobench::doNotOptimizeAway(gradient.coeff(0));
+        });
+
+        bench.run(name + " hessian-times-direction", [&]() {
+            objective.hessian_times_direction(weights, direction, target);
+            ankerl::nanobench::doNotOptimizeAway(target.coeff(0));
+        });
+
+        bench.run(name + " gradient+pre", [&]() {
+            weights.modify().coeffRef(0) += 1e-5;
+            objective.gradient_and_pre_conditioner(weights, gradient, pre);
+            ankerl::nanobench::doNotOptimizeAway(gradient.coeff(0));
+        });
+    }
+}
+
+int main() {
+    constexpr int NUM_INSTANCES = 20'000;
+    DenseFeatures dense = (DenseFeatures::Random(NUM_INSTANCES, 768).array() + 1) / 2;
+    auto objective = make_sp_dense_squared_hinge(
+            std::make_shared<const GenericFeatureMatrix>(std::move(dense)), 1.0,
+            std::make_shared<const GenericFeatureMatrix>(make_uniform_sparse_matrix(NUM_INSTANCES, 20'000, 50)), 1.0);
+
+    auto& labels = objective->get_label_ref();
+    for(int i = 0; i < labels.size(); ++i) {
+        labels.coeffRef(i) = i % 10 == 0 ? 1 : -1;
+    }
+
+    ankerl::nanobench::Bench bench;
+    bench.title("768-d dense + sparse objective").unit("eval").relative(true).minEpochIterations(10);
+
+    // small weights: all instances are inside the margin
+    bench_objective(bench, *objective, "all-active", 1e-4, 0.0);
+    // negative weights: only the positives (10%) and a few negatives contribute
+    bench_objective(bench, *objective, "few-active", 1e-3, -0.01);
+
+    // per-label setup and gradient for a shortlist of 10% of the instances, as in cascade training
+    auto shortlist = std::make_shared<std::vector<long>>();
+    for(long i = 0; i < NUM_INSTANCES; i += 10) {
+        shortlist->push_back(i);
+    }
+    HashVector weights{DenseRealVector::Random(objective->num_variables()) * 1e-4};
+    DenseRealVector gradient(objective->num_variables());
+    bench.run("shortlist setup+gradient", [&]() {
+        objective->select_instances(shortlist);
+        objective->get_label_ref().setConstant(-1);
+        objective->update_costs(1.0, 1.0);
+        weights.modify().coeffRef(0) += 1e-5;
+        objective->gradient(weights, gradient);
+        ankerl::nanobench::doNotOptimizeAway(gradient.coeff(0));
+    });
+}
@@ -0,0 +1,93 @@
+// Copyright (c) 2021, Aalto University, developed by Erik Schultheis
+// All rights reserved.
+//
+// SPDX-License-Identifier: MIT
+
+#include "utils/sparse_kernels.h"
+#include "utils/test_utils.h"
+#include "nanobench.h"
+
+using namespace dismec;
+using namespace dismec::kernels;
+
+namespace {
+    /*!
+     * \brief Runs the three sparse row kernels of the given ISA over all rows of the matrix.
+     * \details The benchmarks use the same matrix and dense vectors for all ISAs, so that the results
+     * can be compared directly.
+     */
+    void bench_isa(ankerl::nanobench::Bench& bench, const SparseFeatures& matrix, KernelISA isa) {
+        const SparseKernels& k = get_kernels(isa);
+        DenseRealVector dense = DenseRealVector::Random(matrix.cols());
+        const auto* values = matrix.valuePtr();
+        const auto* indices = matrix.innerIndexPtr();
+        const auto* outer = matrix.outerIndexPtr();
+
+        bench.run(std::string("dot ") + to_string(isa), [&]() {
+            real_t sum = 0;
+            for(long row = 0; row < matrix.rows(); ++row) {
+                sum += k.dot(values + outer[row], indices + outer[row], outer[row + 1] - outer[row], dense.data());
+            }
+            ankerl::nanobench::doNotOptimizeAway(sum);
+        });
+
+        bench.run(std::string("axpy ") + to_string(isa), [&]() {
+            for(long row = 0; row < matrix.rows(); ++row) {
+                k.axpy(1e-3, values + outer[row], indices + outer[row], outer[row + 1] - outer[row], dense.data());
+            }
+            ankerl::nanobench::doNotOptimizeAway(dense.coeff(0));
+        });
+
+        bench.run(std::string("sq_axpy ") + to_string(isa), [&]() {
+            for(long row = 0; row < matrix.rows(); ++row) {
+                k.sq_axpy(1e-3, values + outer[row], indices + outer[row], outer[row + 1] - outer[row], dense.data());
+            }
+            ankerl::nanobench::doNotOptimizeAway(dense.coeff(0));
+        });
+    }
+
+    void bench_matrix(const std::string& title, const SparseFeatures& matrix) {
+        ankerl::nanobench::Bench bench;
+        bench.title(title).unit("row").batch(matrix.rows()).relative(true).minEpochIterations(20);
+        for(auto isa : {KernelISA::SCALAR, KernelISA::AVX2, KernelISA::AVX512}) {
+            if(is_supported(isa)) {
+                bench_isa(bench, matrix, isa);
+            }
+        }
+    }
+
+    /// Runs the margin violator compaction of all ISAs on `n` instances, of which roughly `fraction` violate the margin.
+    void bench_margin_violators(long n, real_t fraction) {
+        DenseRealVector scores = DenseRealVector::Random(n);
+        BinaryLabelVector labels(n);
+        for(long i = 0; i < n; ++i) {
+            labels.coeffRef(i) = i % 10 == 0 ? 1 : -1;
+            // with s = y (r + 2 - 2 fraction), the margin 1 - y s is positive iff r < 2 fraction - 1, where r is uniform in [-1, 1]
+            scores.coeffRef(i) = labels.coeff(i) * (scores.coeff(i) + real_t{2} - 2 * fraction);
+        }
+        std::vector<int> positions(n);
+        std::vector<real_t> values(n);
+
+        ankerl::nanobench::Bench bench;
+        bench.title("Margin violators: " + std::to_string(static_cast<int>(100 * fraction)) + "% active")
+             .unit("instance").batch(n).relative(true).minEpochIterations(20);
+        for(auto isa : {KernelISA::SCALAR, KernelISA::AVX2, KernelISA::AVX512}) {
+            if(is_supported(isa)) {
+                const SparseKernels& k = get_kernels(isa);
+                bench.run(to_string(isa), [&]() {
+                    long count = k.margin_violators(scores.data(), labels.data(), n, positions.data(), values.data());
+                    ankerl::nanobench::doNotOptimizeAway(count);
+                });
+            }
+        }
+    }
+}
+
+int main() {
+    // a short-row setting (similar to tf-idf features of short texts) and a long-row setting
+    bench_matrix("Sparse row kernels: 20 nnz/row", make_uniform_sparse_matrix(100'000, 100'000, 20));
+    bench_matrix("Sparse row kernels: 200 nnz/row", make_uniform_sparse_matrix(10'000, 100'000, 200));
+
+    bench_margin_violators(1'000'000, 0.1);
+    bench_margin_violators(1'000'000, 0.5);
+}
@@ -0,0 +1,77 @@
+// Copyright (c) 2021, Aalto University, developed by Erik Schultheis
+// All rights reserved.
+//
+// SPDX-License-Identifier: MIT
+
+#include "objective/generic_linear.h"
+#include "objective/margin_losses.h"
+#include "objective/regularizers_imp.h"
+#include "utils/eigen_generic.h"
+#include "utils/test_utils.h"
+#include "nanobench.h"
+
+using namespace dismec;
+using namespace dismec::objective;
+
+namespace {
+    struct BenchSetup {
+        std::shared_ptr<const GenericFeatureMatrix> Features;
+        BinaryLabelVector Labels;
+    };
+
+    BenchSetup make_setup(int rows, int cols, int nnz_per_row) {
+        auto features = std::make_shared<GenericFeatureMatrix>(make_uniform_sparse_matrix(rows, cols, nnz_per_row));
+        BinaryLabelVector labels(rows);
+        for(int i = 0; i < rows; ++i) {
+            labels.coeffRef(i) = i % 10 == 0 ? 1 : -1;
+        }
+        return {features, labels};
+    }
+
+    /*!
+     * \brief Compares the generic (buffer-based) with the fused implementation for the given margin function.
+     * \details The benchmark mimics the access pattern of a Newton iteration: The weight vector is changed, then the
+     * value, gradient and preconditioner are calculated. The `x_times_w` calculation is included in the timings,
+     * because the fused implementation can combine it with the gradient accumulation.
+     */
+    template<class Phi>
+    void bench_margin_function(ankerl::nanobench::Bench& bench, const BenchSetup& setup, const std::string& name, Phi phi) {
+        auto run = [&](Objective& objective, const std::string& variant) {
+            HashVector weights{DenseRealVector::Random(setup.Features->cols()) * 0.1};
+            DenseRealVector gradient(setup.Features->cols());
+            DenseRealVector pre(setup.Features->cols());
+
+            bench.run(name + " gradient " + variant, [&]() {
+                weights.modify().coeffRef(0) += 1e-5;
+                objective.gradient(weights, gradient);
+                ankerl::nanobench::doNotOptimizeAway(gradient.coeff(0));
+            });
+
+            bench.run(name + " value+grad+pre " + variant, [&]() {
+                weights.modify().coeffRef(0) += 1e-5;
+                real_t value = objective.value(weights);
+                objective.gradient_and_pre_conditioner(weights, gradient, pre);
+                ankerl::nanobench::doNotOptimizeAway(value);
+            });
+        };
+
+        GenericMarginClassifier<Phi> generic{setup.Features, std::make_unique<SquaredNormRegularizer>(), phi};
+        generic.get_label_ref() = setup.Labels;
+        run(generic, "generic");
+
+        FusedMarginClassifier<Phi> fused{setup.Features, std::make_unique<SquaredNormRegularizer>(), phi};
+        fused.get_label_ref() = setup.Labels;
+        run(fused, "fused");
+    }
+}
+
+int main() {
+    auto setup = make_setup(50'000, 20'000, 50);
+
+    ankerl::nanobench::Bench bench;
+    bench.title("Margin losses: generic vs fused").unit("eval").relative(true).minEpochIterations(20);
+
+    bench_margin_function(bench, setup, "squared-hinge", SquaredHingePhi{});
+    bench_margin_function(bench, setup, "huber", HuberPhi{0.1});
+    bench_margin_function(bench, setup, "logistic", LogisticPhi{});
+}
@@ -6,11 +6,38 @@
 #include "app.h"
 #include "io/xmc.h"
 #include "io/slice.h"
+#include "io/numpy.h"
+#include "io/common.h"
 #include "data/data.h"
 #include <spdlog/spdlog.h>
+#include <fstream>
 
 using namespace dismec;
 
+namespace {
+    /// Reads a vector of `size` elements from either a npy or a text file.
+    DenseRealVector load_instance_weights(const std::string& source, long size) {
+        DenseRealVector weights(size);
+        std::fstream file(source, std::fstream::in);
+        if(!file.is_open()) {
+            THROW_ERROR("Could not open file {}", source);
+        }
+        if(io::is_npy(file)) {
+            auto header = io::parse_npy_header(*file.rdbuf());
+            if(header.DataType != io::data_type_string<real_t>()) {
+                THROW_ERROR("Unsupported data type {}", header.DataType);
+            }
+            if(header.Rows * header.Cols != size || (header.Rows != 1 && header.Cols != 1)) {
+                THROW_ERROR("Expected a vector of {} instance weights, got a {}x{} matrix", size, header.Rows, header.Cols);
+            }
+            io::binary_load(*file.rdbuf(), weights.data(), weights.data() + size);
+        } else {
+            io::read_vector_from_text(file, weights);
+        }
+        return weights;
+    }
+}
+
 void DataProcessing::setup_data_args(CLI::App& app) {
     app.add_option("data-file", DataSetFile,
                    "The file from which the data will be loaded.")->required()->check(CLI::ExistingFile);
@@ -32,6 +59,9 @@ void DataProcessing::setup_data_args(CLI::App& app) {
         },CLI::ignore_case));
 
     app.add_option("--label-file", LabelFile, "For SLICE-type datasets, this specifies where the labels can be found")->check(CLI::ExistingFile);
+    app.add_option("--instance-weights", InstanceWeightsFile,
+                   "File (npy or txt) with one weight for each training instance. The weights are multiplied into the "
+                   "costs of the training objective.")->check(CLI::ExistingFile);
 
 
     auto* hash_option = app.add_flag("--hash-features", "If this Flag is given, then feature hashing is performed.");
@@ -84,6 +114,13 @@ std::shared_ptr<MultiLabelData> DataProcessing::load(int verbose) {
         augment_features_with_bias(*data, Bias);
     }
 
+    if(!InstanceWeightsFile.empty()) {
+        if(verbose >= 0)
+            spdlog::info("Loading instance weights from file '{}'", InstanceWeightsFile);
+        data->set_instance_weights(
+            std::make_shared<const DenseRealVector>(load_instance_weights(InstanceWeightsFile, data->num_examples())));
+    }
+
     if(verbose >= 0) {
         if(data->get_features()->is_sparse()) {
             double total = data->num_features() * data->num_examples();
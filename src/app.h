@@ -22,6 +22,7 @@ namespace dismec {
         /// The file from which the dataset should be read.
         std::string DataSetFile;
         std::string LabelFile;
+        std::string InstanceWeightsFile;
         bool OneBasedIndex = false;
         bool NormalizeInstances = false;
         DatasetTransform TransformData = DatasetTransform::IDENTITY;
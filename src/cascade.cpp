@@ -454,18 +454,20 @@ int TrainingProgram::run(int argc, const char** argv)
     config.DenseReg = RegScaleDense;
     config.SparseReg = RegScaleSparse;
 
+    // shared by all batches, so that the thread-local objectives and minimizers are only set up once
+    std::shared_ptr<TrainingSpec> train_spec = create_cascade_training(data, dense_data, shortlist, hps, config);
+    if(Verbose >= 0) {
+        train_spec->set_logger(spdlog::default_logger());
+    }
+    TrainingTaskGenerator task(train_spec, first_label, next_label);
+
     while(true) {
         spdlog::info("Starting batch {} - {}", first_label.to_index(), next_label.to_index());
 
         // update time limit to respect remaining time
         runner.set_time_limit(std::chrono::duration_cast<std::chrono::milliseconds>(timeout_time - std::chrono::steady_clock::now()));
 
-        std::shared_ptr<TrainingSpec> train_spec = create_cascade_training(data, dense_data, shortlist, hps, config);
-        if(Verbose >= 0) {
-            train_spec->set_logger(spdlog::default_logger());
-        }
-        auto result = run_training(runner, train_spec,
-                                   first_label, next_label);
+        auto result = run_training(runner, task);
 
         /* do async saving. This has some advantages and some drawbacks:
             + all the i/o latency will be interleaved with actual new computation and we don't waste much time
@@ -498,6 +500,7 @@ int TrainingProgram::run(int argc, const char** argv)
         if(next_label + BatchSize/2 > LabelsEnd) {
             next_label = LabelsEnd;
         }
+        task.set_label_range(first_label, next_label);
     }
 
     spdlog::info("program finished after {} seconds", std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - start_time).count() );
@@ -24,21 +24,54 @@ namespace dismec {
     /// The default value for the tolerance parameter of the conjugate gradient optimization
     constexpr const real_t CG_DEFAULT_EPSILON = 0.5;
 
+    /// Number of instances that are processed together in the fused kernels of `FusedMarginClassifier`. The
+    /// corresponding margins and derivatives are kept in fixed-capacity arrays on the stack.
+    constexpr const long FUSED_MARGIN_BLOCK_SIZE = 64;
+
+    /// Number of instances whose dense features are processed together in the objective for combined dense and sparse
+    /// features. The products with a block of the dense feature matrix are done as matrix-vector (GEMV) calls, and the
+    /// block should be small enough to remain in the L2 cache between the two products of a Hessian evaluation.
+    constexpr const long DENSE_GEMV_BLOCK_SIZE = 64;
+
+    /// Minimum fraction of active instances within a block for which the dense part is handled by GEMV. Below this
+    /// fraction, only the rows of the contributing instances are accumulated.
+    constexpr const double DENSE_GEMV_MIN_ACTIVE_FRACTION = 0.25;
+
+    /// Largest smoothing parameter of a Huber or elastic net regularizer that the active set solver accepts. For larger
+    /// values, the regularizer is not close enough to a L1 penalty for weights to be fixed at zero.
+    constexpr const real_t ACTIVE_SET_MAX_L1_SMOOTHING = 0.1;
+
+    /// Memory budget for the cache of finished weight vectors of `similar` initialization, if its size is not given
+    /// explicitly. The number of cached vectors follows from the number of features, up to
+    /// `SIMILAR_CACHE_MAX_DEFAULT_SIZE`.
+    constexpr const long SIMILAR_CACHE_DEFAULT_BYTES = 256l * 1024 * 1024;
+    constexpr const long SIMILAR_CACHE_MAX_DEFAULT_SIZE = 256;
+
     /// If the time needed per chunk of work is less than this, we display a warning
     constexpr const int MIN_TIME_PER_CHUNK_MS = 5;
 
+    /// Target time per chunk of work if the `ParallelRunner` determines the chunk size automatically.
+    constexpr const int ADAPTIVE_CHUNK_TARGET_MS = 10;
+
+    /// Number of measured training durations that are needed before the `LabelCostModel` is fitted to the
+    /// measurements, instead of using its default coefficients.
+    constexpr const int COST_MODEL_MIN_RECORDS = 32;
+
     namespace parallel {
         /// Load balancing cost for placing a thread on a core
         constexpr const int COST_PLACE_THREAD = 10;
 
         /// Load balancing cost for placing a thread on a SMT shared core
         constexpr const int COST_PLACE_HYPER_THREAD = 5;
+
+        /// Number of times a label range of a `LabelRangeQueue` is attempted before it is marked as failed.
+        constexpr const int LABEL_RANGE_MAX_ATTEMPTS = 3;
     }
 
-    /// Default chunk size for predicting scores
+    /// Maximum chunk size for predicting scores. The actual chunk size is adapted at runtime.
     constexpr const int PREDICTION_RUN_CHUNK_SIZE = 1024;
 
-    /// Default chunk size for calculating metrics
+    /// Maximum chunk size for calculating metrics. The actual chunk size is adapted at runtime.
     constexpr const int PREDICTION_METRICS_CHUNK_SIZE = 4096;
 }
 
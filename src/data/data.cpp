@@ -6,6 +6,7 @@
 #include <fstream>
 #include "data.h"
 #include "utils/conversion.h"
+#include "utils/throw_error.h"
 #include "spdlog/spdlog.h"
 
 using namespace dismec;
@@ -53,6 +54,18 @@ long DatasetBase::num_examples() const noexcept {
     return m_Features->rows();
 }
 
+void DatasetBase::set_instance_weights(std::shared_ptr<const DenseRealVector> weights) {
+    if(weights && weights->size() != num_examples()) {
+        THROW_EXCEPTION(std::invalid_argument, "Got {} instance weights for a dataset with {} instances",
+                        weights->size(), num_examples());
+    }
+    m_InstanceWeights = std::move(weights);
+}
+
+const std::shared_ptr<const DenseRealVector>& DatasetBase::get_instance_weights() const {
+    return m_InstanceWeights;
+}
+
 DatasetBase::DatasetBase(SparseFeatures x) : m_Features(std::make_shared<GenericFeatureMatrix>(x.markAsRValue())) {}
 DatasetBase::DatasetBase(DenseFeatures x) : m_Features(std::make_shared<GenericFeatureMatrix>(std::move(x))) {}
 
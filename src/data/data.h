@@ -52,12 +52,27 @@ namespace dismec {
         /// The weights will be put into the given `target` buffer.
         /// Throws std::out_of_bounds, if id is not in `[0, num_labels())`.
         virtual void get_labels(label_id_t id, Eigen::Ref<BinaryLabelVector> target) const = 0;
+
+        /*!
+         * \brief Sets a weight for each instance of the dataset.
+         * \details The weights are multiplied into the (label-dependent) costs of the training objectives, and can
+         * be used e.g. for instance multiplicities after deduplication or for importance weighting. Passing `nullptr`
+         * resets to uniform weights.
+         * Throws std::invalid_argument if the number of weights does not match `num_examples()`.
+         */
+        void set_instance_weights(std::shared_ptr<const DenseRealVector> weights);
+
+        /// Gets the per-instance weights, or `nullptr` if all instances are weighted uniformly.
+        [[nodiscard]] const std::shared_ptr<const DenseRealVector>& get_instance_weights() const;
     protected:
         explicit DatasetBase(SparseFeatures x);
         explicit DatasetBase(DenseFeatures x);
 
         // features
         std::shared_ptr<GenericFeatureMatrix> m_Features;
+
+        // instance weights. nullptr means uniform weights
+        std::shared_ptr<const DenseRealVector> m_InstanceWeights;
     };
 
     /*! \class BinaryData
@@ -5,6 +5,7 @@
 
 #include "transform.h"
 #include "data/data.h"
+#include "utils/conversion.h"
 #include <random>
 
 using namespace dismec;
@@ -217,29 +218,44 @@ void dismec::hash_sparse_features(SparseFeatures& features, unsigned seed, int b
 }
 
 SparseFeatures dismec::shortlist_features(const SparseFeatures& source, const std::vector<long>& shortlist) {
-    SparseFeatures new_features(shortlist.size(), source.cols());
-    new_features.reserve(2 * source.nonZeros() * double(shortlist.size()) / double(source.rows()));
+    SparseFeatures new_features;
+    shortlist_features(source, shortlist, new_features);
+    return new_features;
+}
+
+DenseFeatures dismec::shortlist_features(const DenseFeatures& source, const std::vector<long>& shortlist) {
+    DenseFeatures new_features;
+    shortlist_features(source, shortlist, new_features);
+    return new_features;
+}
+
+void dismec::shortlist_features(const SparseFeatures& source, const std::vector<long>& shortlist, SparseFeatures& target) {
+    // resizing keeps the allocated nonzero storage, so we only need to reserve the exact number of nonzeros
+    target.resize(ssize(shortlist), source.cols());
+    long nnz = 0;
+    for (auto row : shortlist) {
+        nnz += source.innerVector(row).nonZeros();
+    }
+    target.reserve(nnz);
     long new_row = 0;
     for (auto row : shortlist) {
-        new_features.startVec(new_row);
+        target.startVec(new_row);
         for (SparseFeatures::InnerIterator it(source, row); it; ++it)
         {
-            new_features.insertBack(new_row, it.col()) = it.value();
+            target.insertBack(new_row, it.col()) = it.value();
         }
         ++new_row;
     }
-    new_features.finalize();
-    return new_features;
+    target.finalize();
 }
 
-DenseFeatures dismec::shortlist_features(const DenseFeatures& source, const std::vector<long>& shortlist) {
-    DenseFeatures new_features(shortlist.size(), source.cols());
+void dismec::shortlist_features(const DenseFeatures& source, const std::vector<long>& shortlist, DenseFeatures& target) {
+    target.resize(ssize(shortlist), source.cols());
     long new_row = 0;
     for (auto row : shortlist) {
-        new_features.row(new_row) = source.row(row);
+        target.row(new_row) = source.row(row);
         ++new_row;
     }
-    return new_features;
 }
 
 
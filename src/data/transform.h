@@ -34,6 +34,10 @@ namespace dismec {
     SparseFeatures shortlist_features(const SparseFeatures& source, const std::vector<long>& shortlist);
     DenseFeatures shortlist_features(const DenseFeatures& source, const std::vector<long>& shortlist);
 
+    /// Writes the rows `shortlist` of `source` into `target`. The storage of `target` is reused if it is large enough.
+    void shortlist_features(const SparseFeatures& source, const std::vector<long>& shortlist, SparseFeatures& target);
+    void shortlist_features(const DenseFeatures& source, const std::vector<long>& shortlist, DenseFeatures& target);
+
     enum class DatasetTransform {
         IDENTITY,           // x
         ONE_PLUS_LOG,       // 1 + log(x)
@@ -19,11 +19,14 @@ namespace dismec
     class label_id_t;
 
     class WeightingScheme;
+    class NegativeSampler;
+    class LabelCostModel;
     class TrainingSpec;
     class TrainingStatsGatherer;
     class ResultStatsGatherer;
 
     class HashVector;
+    class VectorHash;
     class HyperParameters;
 
     namespace model {
@@ -33,6 +36,7 @@ namespace dismec
 
     namespace objective {
         class Objective;
+        class LinearClassifierBase;
     }
 
     namespace solvers {
@@ -43,6 +47,7 @@ namespace dismec
     namespace init {
         class WeightsInitializer;
         class WeightInitializationStrategy;
+        class LabelSimilarity;
     }
 
     namespace postproc {
@@ -54,6 +59,11 @@ namespace dismec
         class ParallelRunner;
         class thread_id_t;
     }
+
+    namespace io {
+        struct LabelCheckpoint;
+        class LabelCheckpointWriter;
+    }
 }
 
 #endif //DISMEC_SRC_FWD_H
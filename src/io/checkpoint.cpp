@@ -0,0 +1,349 @@
+// Copyright (c) 2021, Aalto University, developed by Erik Schultheis
+// All rights reserved.
+//
+// SPDX-License-Identifier: MIT
+
+#include "io/checkpoint.h"
+#include "io/common.h"
+#include "spdlog/spdlog.h"
+#include <array>
+#include <cstring>
+#include <limits>
+
+using namespace dismec;
+using namespace dismec::io;
+
+namespace {
+    constexpr std::array<char, 8> CHECKPOINT_MAGIC = {'D', 'S', 'M', 'C', 'L', 'C', 'K', '1'};
+    constexpr std::int64_t DENSE_RECORD = 0;
+    constexpr std::int64_t SPARSE_RECORD = 1;
+
+    /// Reads a single value, and returns false if the stream ended before it could be read completely.
+    template<class T>
+    bool try_read(std::streambuf& source, T& target) {
+        return source.sgetn(reinterpret_cast<char*>(&target), sizeof(T)) == static_cast<std::streamsize>(sizeof(T));
+    }
+
+    template<class T>
+    bool try_read(std::streambuf& source, std::vector<T>& target, std::int64_t count) {
+        target.resize(count);
+        auto num_bytes = static_cast<std::streamsize>(count * sizeof(T));
+        return source.sgetn(reinterpret_cast<char*>(target.data()), num_bytes) == num_bytes;
+    }
+
+    /// Checks that the indices of a sparse record are strictly increasing and valid feature indices.
+    bool are_valid_indices(const std::vector<std::int32_t>& indices, std::int64_t num_features) {
+        for(std::size_t i = 0; i < indices.size(); ++i) {
+            if(indices[i] < 0 || indices[i] >= num_features || (i > 0 && indices[i] <= indices[i - 1])) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /*!
+     * \brief Reads the checkpoint log from `source` into `target`.
+     * \details Only records for labels in `[begin, end)` are stored in `target`, but all records are validated.
+     * \return The number of bytes that belong to the header and to complete, valid records.
+     */
+    std::streamoff parse_checkpoints(std::streambuf& source, LabelCheckpoint& target, long begin, long end) {
+        std::array<char, 8> magic{};
+        std::int64_t num_features = 0;
+        std::int64_t num_labels = 0;
+        if(!try_read(source, magic) || magic != CHECKPOINT_MAGIC ||
+           !try_read(source, num_features) || !try_read(source, num_labels)) {
+            THROW_ERROR("Invalid header of label checkpoint log");
+        }
+        target.NumFeatures = num_features;
+        target.NumLabels = num_labels;
+
+        std::streamoff valid_end = source.pubseekoff(0, std::ios_base::cur, std::ios_base::in);
+        while(true) {
+            std::int64_t label = 0;
+            std::int64_t type = 0;
+            std::int64_t count = 0;
+            if(!try_read(source, label) || !try_read(source, type) || !try_read(source, count)) {
+                break;
+            }
+            if(label < 0 || label >= num_labels || count < 0 || count > num_features ||
+               (type == DENSE_RECORD && count != num_features) || (type != DENSE_RECORD && type != SPARSE_RECORD)) {
+                spdlog::warn("Invalid record for label {} in checkpoint log, ignoring all subsequent records.", label);
+                break;
+            }
+
+            LabelCheckpointRecord record;
+            record.Sparse = type == SPARSE_RECORD;
+            if(record.Sparse && !try_read(source, record.Indices, count)) {
+                break;
+            }
+            if(!try_read(source, record.Values, count)) {
+                break;
+            }
+            if(record.Sparse && !are_valid_indices(record.Indices, num_features)) {
+                spdlog::warn("Invalid feature indices for label {} in checkpoint log, ignoring all subsequent records.",
+                             label);
+                break;
+            }
+            if(begin <= label && label < end) {
+                target.Weights.insert_or_assign(label, std::move(record));
+            }
+            valid_end = source.pubseekoff(0, std::ios_base::cur, std::ios_base::in);
+        }
+        return valid_end;
+    }
+}
+
+void LabelCheckpointRecord::to_dense(Eigen::Ref<DenseRealVector> target) const {
+    if(Sparse) {
+        target.setZero();
+        for(std::size_t i = 0; i < Indices.size(); ++i) {
+            target.coeffRef(Indices[i]) = Values[i];
+        }
+    } else {
+        ALWAYS_ASSERT_EQUAL(target.size(), ssize(Values), "Checkpoint has {} features, but target has {}");
+        target = Eigen::Map<const DenseRealVector>(Values.data(), ssize(Values));
+    }
+}
+
+const LabelCheckpointRecord* LabelCheckpoint::find(label_id_t label) const {
+    auto it = Weights.find(label.to_index());
+    if(it == Weights.end()) {
+        return nullptr;
+    }
+    return &it->second;
+}
+
+LabelCheckpoint io::read_label_checkpoints(const std::filesystem::path& file) {
+    return read_label_checkpoints(file, label_id_t{0}, label_id_t{std::numeric_limits<long>::max()});
+}
+
+LabelCheckpoint io::read_label_checkpoints(const std::filesystem::path& file, label_id_t begin, label_id_t end) {
+    std::filebuf source;
+    if(!source.open(file, std::ios_base::in | std::ios_base::binary)) {
+        THROW_ERROR("Could not open label checkpoint log {}", file.string());
+    }
+    LabelCheckpoint result;
+    parse_checkpoints(source, result, begin.to_index(), end.to_index());
+    return result;
+}
+
+LabelCheckpointWriter::LabelCheckpointWriter(std::filesystem::path file, long num_features, long num_labels, bool append) :
+    m_FileName(std::move(file)), m_NumFeatures(num_features)
+{
+    if(append && std::filesystem::exists(m_FileName)) {
+        // remove an incomplete record at the end, so that we can safely append
+        LabelCheckpoint existing;
+        std::streamoff valid_end;
+        {
+            std::filebuf source;
+            if(!source.open(m_FileName, std::ios_base::in | std::ios_base::binary)) {
+                THROW_ERROR("Could not open label checkpoint log {}", m_FileName.string());
+            }
+            valid_end = parse_checkpoints(source, existing, 0, num_labels);
+        }
+        if(existing.NumFeatures != num_features || existing.NumLabels != num_labels) {
+            THROW_ERROR("Label checkpoint log {} is for {} features and {} labels, but training uses {} features and {} labels",
+                        m_FileName.string(), existing.NumFeatures, existing.NumLabels, num_features, num_labels);
+        }
+        std::filesystem::resize_file(m_FileName, valid_end);
+        m_Stream.open(m_FileName, std::ios_base::out | std::ios_base::binary | std::ios_base::app);
+    } else {
+        m_Stream.open(m_FileName, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+        std::int64_t header[2] = {num_features, num_labels};
+        binary_dump(*m_Stream.rdbuf(), CHECKPOINT_MAGIC.data(), CHECKPOINT_MAGIC.data() + CHECKPOINT_MAGIC.size());
+        binary_dump(*m_Stream.rdbuf(), header, header + 2);
+        m_Stream.flush();
+    }
+
+    if(!m_Stream.is_open() || !m_Stream.good()) {
+        THROW_ERROR("Could not open label checkpoint log {} for writing", m_FileName.string());
+    }
+
+    m_Writer = std::thread(&LabelCheckpointWriter::writer_main, this);
+}
+
+LabelCheckpointWriter::~LabelCheckpointWriter() {
+    {
+        std::lock_guard<std::mutex> lock(m_Lock);
+        m_Stop = true;
+    }
+    m_QueueChanged.notify_all();
+    m_Writer.join();
+    if(m_Error) {
+        spdlog::error("Writing the label checkpoint log {} has failed", m_FileName.string());
+    }
+}
+
+void LabelCheckpointWriter::add(label_id_t label, const DenseRealVector& weights) {
+    ALWAYS_ASSERT_EQUAL(weights.size(), m_NumFeatures, "Got weight vector with {} features, expected {}");
+
+    // a sparse entry needs twice the space of a dense one
+    long nnz = (weights.array() != 0).count();
+    LabelCheckpointRecord record;
+    if(2 * nnz < m_NumFeatures) {
+        record.Sparse = true;
+        record.Indices.reserve(nnz);
+        record.Values.reserve(nnz);
+        for(long i = 0; i < weights.size(); ++i) {
+            if(weights.coeff(i) != 0) {
+                record.Indices.push_back(static_cast<std::int32_t>(i));
+                record.Values.push_back(weights.coeff(i));
+            }
+        }
+    } else {
+        record.Values.assign(weights.data(), weights.data() + weights.size());
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_Lock);
+        m_Queue.emplace_back(label.to_index(), std::move(record));
+        ++m_NumAdded;
+    }
+    m_QueueChanged.notify_all();
+}
+
+void LabelCheckpointWriter::flush() {
+    std::unique_lock<std::mutex> lock(m_Lock);
+    long target = m_NumAdded;
+    m_QueueChanged.wait(lock, [&]() { return m_NumWritten >= target || m_Error; });
+    if(m_Error) {
+        std::rethrow_exception(m_Error);
+    }
+}
+
+void LabelCheckpointWriter::write_record(long label, const LabelCheckpointRecord& record) {
+    std::int64_t header[3] = {label, record.Sparse ? SPARSE_RECORD : DENSE_RECORD, ssize(record.Values)};
+    auto& buffer = *m_Stream.rdbuf();
+    binary_dump(buffer, header, header + 3);
+    if(record.Sparse) {
+        binary_dump(buffer, record.Indices.data(), record.Indices.data() + record.Indices.size());
+    }
+    binary_dump(buffer, record.Values.data(), record.Values.data() + record.Values.size());
+}
+
+void LabelCheckpointWriter::writer_main() {
+    std::vector<std::pair<long, LabelCheckpointRecord>> pending;
+    std::unique_lock<std::mutex> lock(m_Lock);
+    while(true) {
+        m_QueueChanged.wait(lock, [&]() { return m_Stop || !m_Queue.empty(); });
+        if(m_Queue.empty()) {
+            // m_Stop is set, and everything has been written
+            return;
+        }
+
+        std::swap(pending, m_Queue);
+        lock.unlock();
+        try {
+            for(const auto& [label, record] : pending) {
+                write_record(label, record);
+            }
+            m_Stream.flush();
+            if(!m_Stream.good()) {
+                THROW_ERROR("Error while writing to label checkpoint log {}", m_FileName.string());
+            }
+        } catch(...) {
+            lock.lock();
+            m_Error = std::current_exception();
+            m_QueueChanged.notify_all();
+            return;
+        }
+        lock.lock();
+        m_NumWritten += ssize(pending);
+        pending.clear();
+        m_QueueChanged.notify_all();
+    }
+}
+
+#include "doctest.h"
+
+TEST_CASE("label checkpoint log") {
+    std::filesystem::create_directory("test");
+    std::filesystem::path file = "test/label-checkpoints.bin";
+
+    DenseRealVector dense = DenseRealVector::Random(10);
+    DenseRealVector sparse = DenseRealVector::Zero(10);
+    sparse.coeffRef(3) = 2.0;
+    sparse.coeffRef(7) = -1.0;
+
+    {
+        LabelCheckpointWriter writer(file, 10, 20, false);
+        writer.add(label_id_t{5}, dense);
+        writer.add(label_id_t{12}, sparse);
+        writer.flush();
+    }
+
+    auto check_content = [&](const LabelCheckpoint& content) {
+        CHECK(content.NumFeatures == 10);
+        CHECK(content.NumLabels == 20);
+        REQUIRE(content.find(label_id_t{5}) != nullptr);
+        REQUIRE(content.find(label_id_t{12}) != nullptr);
+        CHECK(content.find(label_id_t{6}) == nullptr);
+        CHECK_FALSE(content.find(label_id_t{5})->Sparse);
+        CHECK(content.find(label_id_t{12})->Sparse);
+
+        DenseRealVector target(10);
+        content.find(label_id_t{5})->to_dense(target);
+        CHECK(target == dense);
+        content.find(label_id_t{12})->to_dense(target);
+        CHECK(target == sparse);
+    };
+
+    auto content = read_label_checkpoints(file);
+    CHECK(content.Weights.size() == 2);
+    check_content(content);
+
+    // simulate a process that has been killed while writing a record
+    auto complete_size = std::filesystem::file_size(file);
+    {
+        std::ofstream append(file, std::ios_base::binary | std::ios_base::app);
+        std::int64_t header[3] = {3, 0, 10};
+        append.write(reinterpret_cast<const char*>(header), sizeof(header));
+        append.write(reinterpret_cast<const char*>(dense.data()), 5 * sizeof(real_t));
+    }
+    check_content(read_label_checkpoints(file));
+
+    // continuing removes the incomplete record
+    {
+        LabelCheckpointWriter writer(file, 10, 20, true);
+        CHECK(std::filesystem::file_size(file) == complete_size);
+        writer.add(label_id_t{3}, sparse);
+    }
+    content = read_label_checkpoints(file);
+    CHECK(content.Weights.size() == 3);
+    check_content(content);
+
+    // only the requested labels are kept
+    content = read_label_checkpoints(file, label_id_t{4}, label_id_t{20});
+    CHECK(content.Weights.size() == 2);
+    CHECK(content.find(label_id_t{3}) == nullptr);
+    check_content(content);
+
+    // a record with an out-of-range feature index is rejected, together with all later records
+    complete_size = std::filesystem::file_size(file);
+    {
+        std::ofstream append(file, std::ios_base::binary | std::ios_base::app);
+        std::int64_t header[3] = {8, 1, 2};
+        std::int32_t indices[2] = {1, 10};
+        real_t values[2] = {1.0, 2.0};
+        append.write(reinterpret_cast<const char*>(header), sizeof(header));
+        append.write(reinterpret_cast<const char*>(indices), sizeof(indices));
+        append.write(reinterpret_cast<const char*>(values), sizeof(values));
+    }
+    content = read_label_checkpoints(file);
+    CHECK(content.Weights.size() == 3);
+    CHECK(content.find(label_id_t{8}) == nullptr);
+    {
+        LabelCheckpointWriter writer(file, 10, 20, true);
+        CHECK(std::filesystem::file_size(file) == complete_size);
+    }
+
+    // mismatched dimensions
+    CHECK_THROWS(LabelCheckpointWriter(file, 11, 20, true));
+    CHECK_THROWS(read_label_checkpoints("test/does-not-exist.bin"));
+
+    // without appending, the log starts anew
+    {
+        LabelCheckpointWriter writer(file, 11, 20, false);
+    }
+    CHECK(read_label_checkpoints(file).Weights.empty());
+}
@@ -0,0 +1,124 @@
+// Copyright (c) 2021, Aalto University, developed by Erik Schultheis
+// All rights reserved.
+//
+// SPDX-License-Identifier: MIT
+
+#ifndef DISMEC_SRC_IO_CHECKPOINT_H
+#define DISMEC_SRC_IO_CHECKPOINT_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "matrix_types.h"
+#include "data/types.h"
+
+/*! \page label-checkpoints Label checkpoint log
+ * In addition to the weight files that are written after each batch, training can append the weight vector of each
+ * label to a checkpoint log as soon as it is finished. If training is interrupted, the labels in the log do not need to
+ * be trained again.
+ *
+ * The log is a binary file in native byte order. It starts with the magic bytes `DSMCLCK1`, followed by the number of
+ * features and the number of labels as 64-bit integers. Then follows one record per label, consisting of three 64-bit
+ * integers (label id, record type, and number of entries), and the entries. For a dense record (type 0), the entries
+ * are the `NumFeatures` weights as `real_t`. For a sparse record (type 1), all 32-bit indices of the nonzero weights
+ * are followed by the corresponding `real_t` values. The indices are strictly increasing and less than `NumFeatures`.
+ * If the last record is incomplete, e.g. because the process was killed while writing it, it is ignored. A record with
+ * an invalid label id, type, size or index is considered corrupted, and it and all subsequent records are ignored.
+ */
+
+namespace dismec::io {
+    /// The weights of a single label as stored in the checkpoint log.
+    struct LabelCheckpointRecord {
+        bool Sparse = false;
+        std::vector<std::int32_t> Indices;  //!< The indices of the nonzero weights. Empty for dense records.
+        std::vector<real_t> Values;         //!< The weight values.
+
+        /*!
+         * \brief Writes the weights into `target`, which needs to have the size of the number of features.
+         * \details The indices of records that have been read by `read_label_checkpoints()` are known to be valid.
+         */
+        void to_dense(Eigen::Ref<DenseRealVector> target) const;
+    };
+
+    /// The contents of a checkpoint log.
+    struct LabelCheckpoint {
+        long NumFeatures = 0;
+        long NumLabels = 0;
+        std::unordered_map<long, LabelCheckpointRecord> Weights;
+
+        /// Returns the record for `label`, or `nullptr` if the log contains no weights for that label.
+        [[nodiscard]] const LabelCheckpointRecord* find(label_id_t label) const;
+    };
+
+    /*!
+     * \brief Reads all complete records of a checkpoint log.
+     * \throws std::runtime_error if the file cannot be opened or does not contain a valid header.
+     */
+    LabelCheckpoint read_label_checkpoints(const std::filesystem::path& file);
+
+    /*!
+     * \brief Reads the complete records of a checkpoint log for the labels in `[begin, end)`.
+     * \details Records of other labels, e.g. those that are already part of the saved model when continuing a run, are
+     * skipped, so they do not occupy memory.
+     * \throws std::runtime_error if the file cannot be opened or does not contain a valid header.
+     */
+    LabelCheckpoint read_label_checkpoints(const std::filesystem::path& file, label_id_t begin, label_id_t end);
+
+    /*!
+     * \brief Appends the weight vectors of individual labels to a checkpoint log.
+     * \details The records are written by a background thread, so calling `add()` only needs to copy the weights. For
+     * each record, the writer picks the sparse format if it is smaller than the dense one. After each group of records,
+     * the file is flushed, so that all finished labels survive if the process is killed.
+     */
+    class LabelCheckpointWriter {
+    public:
+        /*!
+         * \brief Opens the log and starts the writer thread.
+         * \param file Path to the checkpoint log.
+         * \param num_features Number of features of each weight vector.
+         * \param num_labels Total number of labels of the model.
+         * \param append If true and `file` exists, new records are appended to the existing ones. An incomplete record
+         * at the end of the file is removed. The existing log needs to have the same number of features and labels.
+         * Otherwise, the log is started anew.
+         */
+        LabelCheckpointWriter(std::filesystem::path file, long num_features, long num_labels, bool append);
+        ~LabelCheckpointWriter();
+
+        LabelCheckpointWriter(const LabelCheckpointWriter&) = delete;
+        LabelCheckpointWriter& operator=(const LabelCheckpointWriter&) = delete;
+
+        /// Queues the weights of `label` for writing. Can be called concurrently from multiple threads.
+        void add(label_id_t label, const DenseRealVector& weights);
+
+        /*!
+         * \brief Waits until all records that have been added so far are written to the file.
+         * \throws std::runtime_error if writing has failed.
+         */
+        void flush();
+    private:
+        void writer_main();
+        void write_record(long label, const LabelCheckpointRecord& record);
+
+        std::filesystem::path m_FileName;
+        std::ofstream m_Stream;
+        long m_NumFeatures;
+
+        std::mutex m_Lock;
+        std::condition_variable m_QueueChanged;
+        std::vector<std::pair<long, LabelCheckpointRecord>> m_Queue;
+        long m_NumAdded = 0;
+        long m_NumWritten = 0;
+        bool m_Stop = false;
+        std::exception_ptr m_Error;
+
+        std::thread m_Writer;
+    };
+}
+
+#endif //DISMEC_SRC_IO_CHECKPOINT_H
@@ -90,29 +90,45 @@ const char* io::model::to_string(WeightFormat format) {
     return weight_format_names.at(static_cast<unsigned long>(format));
 }
 
-void PartialModelIO::read_metadata_file(const path& meta_file) {
-    std::fstream source(meta_file, std::fstream::in);
-    if(!source.is_open()) {
-        throw std::runtime_error(fmt::format("Could not open model metadata file '{}'", meta_file.c_str()));
-    }
+namespace {
+    /// Contents of a model metadata file
+    struct ModelMetadata {
+        long NumFeatures;
+        long NumLabels;
+        std::vector<WeightFileEntry> Files;
+    };
+
+    ModelMetadata parse_metadata_file(const path& meta_file) {
+        std::fstream source(meta_file, std::fstream::in);
+        if(!source.is_open()) {
+            throw std::runtime_error(fmt::format("Could not open model metadata file '{}'", meta_file.c_str()));
+        }
 
-    // read and parse the metadata
-    std::string s;
-    getline (source, s,  '\0');
-    json meta = json::parse(s);
+        // read and parse the metadata
+        std::string s;
+        getline (source, s,  '\0');
+        json meta = json::parse(s);
 
-    m_NumFeatures = meta["num-features"];
-    m_TotalLabels = meta["num-labels"];
+        ModelMetadata result{meta["num-features"], meta["num-labels"], {}};
 
-    for(auto& weight_file : meta["files"]) {
-        label_id_t first = label_id_t{weight_file["first"]};
-        long count = weight_file["count"];
-        std::string weight_format = weight_file["weight-format"];
-        auto format = parse_weights_format(weight_format);
-        m_SubFiles.push_back(WeightFileEntry{first, count, weight_file["file"], format});
+        for(auto& weight_file : meta["files"]) {
+            label_id_t first = label_id_t{weight_file["first"]};
+            long count = weight_file["count"];
+            std::string weight_format = weight_file["weight-format"];
+            auto format = parse_weights_format(weight_format);
+            result.Files.push_back(WeightFileEntry{first, count, weight_file["file"], format});
+        }
+        return result;
     }
 }
 
+void PartialModelIO::read_metadata_file(const path& meta_file) {
+    auto meta = parse_metadata_file(meta_file);
+    m_NumFeatures = meta.NumFeatures;
+    m_TotalLabels = meta.NumLabels;
+    m_SubFiles.insert(m_SubFiles.end(), meta.Files.begin(), meta.Files.end());
+}
+
 auto io::model::PartialModelIO::label_lower_bound(label_id_t pos) const -> std::vector<WeightFileEntry>::const_iterator {
     return std::lower_bound(begin(m_SubFiles), end(m_SubFiles), pos,
                             [](const WeightFileEntry& s, label_id_t val) {
@@ -231,6 +247,34 @@ std::future<WeightFileEntry> PartialModelSaver::add_model(const std::shared_ptr<
     });
 }
 
+void PartialModelSaver::merge_partial_model(const path& meta_file) {
+    auto meta = parse_metadata_file(meta_file);
+    if(m_TotalLabels == -1) {
+        m_TotalLabels = meta.NumLabels;
+        m_NumFeatures = meta.NumFeatures;
+    } else {
+        if(m_TotalLabels != meta.NumLabels) {
+            throw std::logic_error(fmt::format("Partial model {} has {} labels, but expected {} labels",
+                                               meta_file.c_str(), meta.NumLabels, m_TotalLabels));
+        }
+        if(m_NumFeatures != meta.NumFeatures) {
+            throw std::logic_error(fmt::format("Partial model {} has {} features, but expected {} features",
+                                               meta_file.c_str(), meta.NumFeatures, m_NumFeatures));
+        }
+    }
+
+    // weight file names are relative to the directory of the metadata file
+    auto as_directory = [](const path& file) {
+        return file.parent_path().empty() ? path(".") : file.parent_path();
+    };
+    path source_dir = as_directory(meta_file);
+    path target_dir = as_directory(m_MetaFileName);
+    for(auto& entry : meta.Files) {
+        entry.FileName = std::filesystem::relative(source_dir / entry.FileName, target_dir).string();
+        insert_sub_file(entry);
+    }
+}
+
 void PartialModelSaver::update_meta_file() {
     json meta;
     meta["num-features"] = m_NumFeatures;
@@ -505,6 +549,35 @@ TEST_CASE("partial model writer verifier") {
     }
 }
 
+TEST_CASE("merge partial models") {
+    SaveOption options;
+    options.Format = WeightFormat::NULL_FORMAT;
+    std::filesystem::create_directories("test/merge-parts");
+    {
+        PartialModelSaver part("test/merge-parts/part-a", options);
+        part.add_model(std::make_shared<DenseModel>(4, PartialModelSpec{label_id_t{0}, 5, 10}));
+        part.update_meta_file();
+    }
+    {
+        PartialModelSaver part("test/merge-parts/part-b", options);
+        part.add_model(std::make_shared<DenseModel>(4, PartialModelSpec{label_id_t{5}, 5, 10}));
+        part.update_meta_file();
+    }
+
+    PartialModelSaver merged("test/merged", options);
+    merged.merge_partial_model("test/merge-parts/part-b");
+    CHECK(merged.num_labels() == 10);
+    CHECK(merged.num_features() == 4);
+    CHECK(merged.get_missing_weights() == std::make_pair(label_id_t{0}, label_id_t{5}));
+    CHECK_THROWS(merged.merge_partial_model("test/merge-parts/part-b"));
+    merged.merge_partial_model("test/merge-parts/part-a");
+    CHECK_NOTHROW(merged.finalize());
+
+    PartialModelLoader loader("test/merged");
+    CHECK(loader.num_weight_files() == 2);
+    CHECK(loader.get_loading_range(label_id_t{0}, label_id_t{5}).FilesBegin->FileName == "merge-parts/part-a.weights-0-4");
+}
+
 TEST_CASE("label lower bound") {
     struct TestModel : public PartialModelIO {
         using PartialModelIO::label_lower_bound;
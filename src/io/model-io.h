@@ -272,6 +272,17 @@ namespace dismec::io
 
             using PartialModelIO::insert_sub_file;
 
+            /*!
+             * \brief Adds all weight files of an existing (partial) model to this model, without copying the weights.
+             * \details This can be used to assemble a model from partial models that have been trained by separate
+             * processes. The weight files are referenced relative to the metadata file of this saver. As with
+             * `add_model`, this does not update the metadata file.
+             * \param meta_file The metadata file of the partial model.
+             * \throw std::logic_error if the partial model has a different number of features/labels than this model,
+             * or if its weights overlap with already existing weights.
+             */
+            void merge_partial_model(const path& meta_file);
+
             /*!
              * \brief Updates the metadata file.
              * \details This ensures that all weight files that have been created due to `add_model` calls will be
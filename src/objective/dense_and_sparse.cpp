@@ -8,6 +8,8 @@
 #include "stats/timer.h"
 #include "margin_losses.h"
 #include "utils/eigen_generic.h"
+#include "utils/conversion.h"
+#include "config.h"
 
 using namespace dismec;
 using namespace dismec::objective;
@@ -37,6 +39,9 @@ DenseAndSparseLinearBase::DenseAndSparseLinearBase(std::shared_ptr<const Generic
 
 
 long DenseAndSparseLinearBase::num_instances() const noexcept {
+    if(m_Instances) {
+        return ssize(*m_Instances);
+    }
     return m_DenseFeatures->rows();
 }
 
@@ -64,15 +69,28 @@ const DenseRealVector& DenseAndSparseLinearBase::x_times_w(const HashVector& w)
         return m_X_times_w;
     }
     auto timer = make_timer(STAT_PERF_MATMUL);
-    m_X_times_w.noalias() = dense_features() * DENSE_PART(w.get());
-    m_X_times_w.noalias() += sparse_features() * SPARSE_PART(w.get());
+    features_times(w.get(), m_X_times_w);
     m_Last_W = w.hash();
     return m_X_times_w;
 }
 
+void DenseAndSparseLinearBase::features_times(const DenseRealVector& weights, DenseRealVector& target) const {
+    if(!m_Instances) {
+        target.noalias() = dense_features() * DENSE_PART(weights);
+        target.noalias() += sparse_features() * SPARSE_PART(weights);
+        return;
+    }
+
+    target.resize(num_instances());
+    for(long i = 0; i < target.size(); ++i) {
+        long row = (*m_Instances)[i];
+        target.coeffRef(i) = dense_features().row(row).dot(DENSE_PART(weights)) +
+                             sparse_features().row(row).dot(SPARSE_PART(weights));
+    }
+}
+
 void DenseAndSparseLinearBase::project_linear_to_line(const HashVector& location, const DenseRealVector& direction) {
-    m_LsCache_xTd.noalias() = dense_features() * DENSE_PART(direction);
-    m_LsCache_xTd.noalias() += sparse_features() * SPARSE_PART(direction);
+    features_times(direction, m_LsCache_xTd);
     m_LsCache_xTw = x_times_w(location);
     m_LineDirection = direction;
     m_LineStart = location.get();
@@ -93,6 +111,13 @@ void DenseAndSparseLinearBase::update_costs(real_t positive, real_t negative) {
             m_Costs.coeffRef(i) = negative;
         }
     }
+    invalidate_labels();
+}
+
+void DenseAndSparseLinearBase::update_costs(real_t positive, real_t negative, const DenseRealVector& instance_weights) {
+    ALWAYS_ASSERT_EQUAL(instance_weights.size(), labels().size(), "Mismatching number of instance weights ({}) and instances ({})");
+    update_costs(positive, negative);
+    m_Costs.array() *= instance_weights.array();
 }
 
 const DenseRealVector& DenseAndSparseLinearBase::costs() const {
@@ -122,18 +147,83 @@ real_t DenseAndSparseLinearBase::value_from_xTw(const DenseRealVector& xTw)
     return m_GenericOutBuffer.dot(costs());
 }
 
+bool DenseAndSparseLinearBase::use_dense_gemv(long active, long length) {
+    return static_cast<double>(active) >= DENSE_GEMV_MIN_ACTIVE_FRACTION * static_cast<double>(length);
+}
+
+void DenseAndSparseLinearBase::add_transposed_block(const DenseRealVector& factors, long start, long length,
+                                                    Eigen::Ref<DenseRealVector> target) {
+    auto active = (factors.segment(start, length).array() != 0).count();
+    if(active == 0) {
+        return;
+    }
+
+    // a subset of the rows is not contiguous in memory, so we cannot use matrix-vector products
+    if(!m_Instances && use_dense_gemv(active, length)) {
+        DENSE_PART(target).noalias() += dense_features().middleRows(start, length).transpose() * factors.segment(start, length);
+    } else {
+        for (long pos = start; pos < start + length; ++pos) {
+            if(real_t d = factors.coeff(pos); d != 0) {
+                DENSE_PART(target) += dense_features().row(instance_row(pos)) * d;
+            }
+        }
+    }
+
+    for (long pos = start; pos < start + length; ++pos) {
+        if(real_t d = factors.coeff(pos); d != 0) {
+            SPARSE_PART(target) += sparse_features().row(instance_row(pos)) * d;
+        }
+    }
+}
+
+void DenseAndSparseLinearBase::add_features_transposed_times(const DenseRealVector& factors,
+                                                             Eigen::Ref<DenseRealVector> target) {
+    for(long start = 0; start < factors.size(); start += DENSE_GEMV_BLOCK_SIZE) {
+        add_transposed_block(factors, start, std::min(DENSE_GEMV_BLOCK_SIZE, factors.size() - start), target);
+    }
+}
+
 void
 DenseAndSparseLinearBase::hessian_times_direction_unchecked(const HashVector& location, const DenseRealVector& direction,
                                                            Eigen::Ref<DenseRealVector> target) {
     regularization_hessian(location.get(), direction, target);
 
     const auto& hessian = cached_2nd_derivative(location);
-    for (int pos = 0; pos < hessian.size(); ++pos) {
-        if(real_t h = hessian.coeff(pos); h != 0) {
-            real_t factor = dense_features().row(pos).dot(DENSE_PART(direction)) +
-                            sparse_features().row(pos).dot(SPARSE_PART(direction));
-            DENSE_PART(target) += dense_features().row(pos) * factor * h;
-            SPARSE_PART(target) += sparse_features().row(pos) * factor * h;
+    m_GenericInBuffer.resize(hessian.size());
+    for(long start = 0; start < hessian.size(); start += DENSE_GEMV_BLOCK_SIZE) {
+        long length = std::min(DENSE_GEMV_BLOCK_SIZE, hessian.size() - start);
+        auto active = (hessian.segment(start, length).array() != 0).count();
+        if(active == 0) {
+            continue;
+        }
+
+        if(!m_Instances && use_dense_gemv(active, length)) {
+            // H d = X^T diag(h) X d. For the dense block, this results in two matrix-vector products. The block of
+            // rows is still in cache for the second product, so we only go through memory once.
+            auto dense_block = dense_features().middleRows(start, length);
+            auto buffer = m_GenericInBuffer.segment(start, length);
+            buffer.noalias() = dense_block * DENSE_PART(direction);
+            for (long i = 0; i < length; ++i) {
+                long pos = start + i;
+                if(real_t h = hessian.coeff(pos); h != 0) {
+                    real_t factor = buffer.coeff(i) + sparse_features().row(pos).dot(SPARSE_PART(direction));
+                    buffer.coeffRef(i) = factor * h;
+                    SPARSE_PART(target) += sparse_features().row(pos) * (factor * h);
+                } else {
+                    buffer.coeffRef(i) = 0;
+                }
+            }
+            DENSE_PART(target).noalias() += dense_block.transpose() * buffer;
+        } else {
+            for (long pos = start; pos < start + length; ++pos) {
+                if(real_t h = hessian.coeff(pos); h != 0) {
+                    long row = instance_row(pos);
+                    real_t factor = dense_features().row(row).dot(DENSE_PART(direction)) +
+                                    sparse_features().row(row).dot(SPARSE_PART(direction));
+                    DENSE_PART(target) += dense_features().row(row) * factor * h;
+                    SPARSE_PART(target) += sparse_features().row(row) * factor * h;
+                }
+            }
         }
     }
 }
@@ -146,29 +236,23 @@ void DenseAndSparseLinearBase::gradient_and_pre_conditioner_unchecked(const Hash
 
     const auto& derivative = cached_derivative(location);
     const auto& hessian = cached_2nd_derivative(location);
-    for (int pos = 0; pos < derivative.size(); ++pos) {
-        if(real_t d = derivative.coeff(pos); d != 0) {
-            DENSE_PART(gradient) += dense_features().row(pos) * d;
-            SPARSE_PART(gradient) += sparse_features().row(pos) * d;
-        }
-        if(real_t h = hessian.coeff(pos); h != 0) {
-            DENSE_PART(pre) += dense_features().row(pos).cwiseAbs2() * h;
-            SPARSE_PART(pre) += sparse_features().row(pos).cwiseAbs2() * h;
+    for(long start = 0; start < derivative.size(); start += DENSE_GEMV_BLOCK_SIZE) {
+        long length = std::min(DENSE_GEMV_BLOCK_SIZE, derivative.size() - start);
+        add_transposed_block(derivative, start, length, gradient);
+        // the preconditioner is accumulated while the block of rows is still in cache
+        for (long pos = start; pos < start + length; ++pos) {
+            if(real_t h = hessian.coeff(pos); h != 0) {
+                long row = instance_row(pos);
+                DENSE_PART(pre) += dense_features().row(row).cwiseAbs2() * h;
+                SPARSE_PART(pre) += sparse_features().row(row).cwiseAbs2() * h;
+            }
         }
     }
-
 }
 
 void DenseAndSparseLinearBase::gradient_unchecked(const HashVector& location, Eigen::Ref<DenseRealVector> target) {
     regularization_gradient(location.get(), target);
-
-    const auto& derivative = cached_derivative(location);
-    for (int pos = 0; pos < derivative.size(); ++pos) {
-        if(real_t d = derivative.coeff(pos); d != 0) {
-            DENSE_PART(target) += dense_features().row(pos) * d;
-            SPARSE_PART(target) += sparse_features().row(pos) * d;
-        }
-    }
+    add_features_transposed_times(cached_derivative(location), target);
 }
 
 void DenseAndSparseLinearBase::gradient_at_zero_unchecked(Eigen::Ref<DenseRealVector> target) {
@@ -177,23 +261,19 @@ void DenseAndSparseLinearBase::gradient_at_zero_unchecked(Eigen::Ref<DenseRealVe
     m_GenericInBuffer = DenseRealVector::Zero(labels().size());
     m_GenericOutBuffer.resize(m_GenericInBuffer.size());
     calculate_derivative(m_GenericInBuffer, labels(), m_GenericOutBuffer);
-    const auto& cost_vector = costs();
-    for (int pos = 0; pos < m_GenericOutBuffer.size(); ++pos) {
-        if(real_t d = m_GenericOutBuffer.coeff(pos); d != 0) {
-            DENSE_PART(target) += dense_features().row(pos) * (cost_vector.coeff(pos) * d);
-            SPARSE_PART(target) += sparse_features().row(pos) * (cost_vector.coeff(pos) * d);
-        }
-    }
+    m_GenericOutBuffer.array() *= costs().array();
+    add_features_transposed_times(m_GenericOutBuffer, target);
 }
 
 void DenseAndSparseLinearBase::diag_preconditioner_unchecked(const HashVector& location, Eigen::Ref<DenseRealVector> target) {
     regularization_preconditioner(location.get(), target);
 
     const auto& hessian = cached_2nd_derivative(location);
-    for (int pos = 0; pos < hessian.size(); ++pos) {
+    for (long pos = 0; pos < hessian.size(); ++pos) {
         if(real_t h = hessian.coeff(pos); h != 0) {
-            DENSE_PART(target) += dense_features().row(pos).cwiseAbs2() * h;
-            SPARSE_PART(target) += sparse_features().row(pos).cwiseAbs2() * h;
+            long row = instance_row(pos);
+            DENSE_PART(target) += dense_features().row(row).cwiseAbs2() * h;
+            SPARSE_PART(target) += sparse_features().row(row).cwiseAbs2() * h;
         }
     }
 }
@@ -223,9 +303,19 @@ void DenseAndSparseLinearBase::project_to_line_unchecked(const HashVector& locat
     project_linear_to_line(location, direction);
 }
 
-void DenseAndSparseLinearBase::update_features(const DenseFeatures& dense, const SparseFeatures& sparse) {
-    m_DenseFeatures = std::make_shared<const GenericFeatureMatrix>(dense);
-    m_SparseFeatures = std::make_shared<const GenericFeatureMatrix>(sparse);
+void DenseAndSparseLinearBase::select_instances(std::shared_ptr<const std::vector<long>> instances) {
+    m_Instances = std::move(instances);
+    m_Last_W = {};
+
+    // consecutive subsets often have the same size, e.g. a fixed number of candidates per label, and then there is no
+    // need to reallocate. The generic buffers are resized where they are used.
+    long n = num_instances();
+    if(m_Y.size() != n) {
+        m_Costs.resize(n);
+        m_Y.resize(n);
+    }
+    m_Costs.setOnes();
+    invalidate_labels();
 }
 
 namespace {
@@ -292,4 +382,131 @@ TEST_CASE("pure-regularization") {
     DenseRealVector expected_grad = 2.0 * weights;
     goal.gradient(hv, out_grad);
     CHECK(expected_grad == out_grad);
-}
\ No newline at end of file
+}
+
+TEST_CASE("blocked dense products") {
+    // three full blocks and a partial one. The second block is mostly inactive so that the row-wise code path is
+    // used there, whereas the others use matrix-vector products.
+    long rows = 3 * DENSE_GEMV_BLOCK_SIZE + 17;
+    auto label = [](long i) { return i % 5 == 0 ? 1 : -1; };
+    DenseFeatures dense = DenseFeatures::Random(rows, 10) * 0.1;
+    for(long i = DENSE_GEMV_BLOCK_SIZE; i < 2 * DENSE_GEMV_BLOCK_SIZE; ++i) {
+        if(i % 8 != 0) {
+            dense.coeffRef(i, 0) = 10.0 * label(i);
+        }
+    }
+    SparseFeatures sparse = DenseFeatures(DenseFeatures::Random(rows, 30)).sparseView(0.5);
+
+    DenseAndSparseMargin<SquaredHingePhi, L2Regularizer, L2Regularizer> objective(
+            std::make_shared<const GenericFeatureMatrix>(dense),
+            std::make_shared<const GenericFeatureMatrix>(sparse),
+            SquaredHingePhi{}, L2Regularizer{}, 0.0, L2Regularizer{}, 0.0);
+    for(long i = 0; i < rows; ++i) {
+        objective.get_label_ref().coeffRef(i) = label(i);
+    }
+
+    // reference calculation with the concatenated feature matrix
+    DenseFeatures full(rows, 40);
+    full << dense, DenseFeatures(sparse);
+    DenseRealVector weights = DenseRealVector::Random(40);
+    weights.coeffRef(0) = 1.0;
+    DenseRealVector direction = DenseRealVector::Random(40);
+
+    DenseRealVector derivative(rows);
+    DenseRealVector hessian(rows);
+    DenseRealVector scores = full * weights;
+    for(long i = 0; i < rows; ++i) {
+        real_t label = objective.get_label_ref().coeff(i);
+        derivative.coeffRef(i) = SquaredHingePhi{}.grad(scores.coeff(i) * label) * label;
+        hessian.coeffRef(i) = SquaredHingePhi{}.quad(scores.coeff(i) * label);
+    }
+    DenseRealVector expected_grad = full.transpose() * derivative;
+    DenseRealVector expected_hess = full.transpose() * (hessian.cwiseProduct(full * direction));
+    DenseRealVector expected_pre = full.cwiseAbs2().transpose() * hessian;
+
+    auto check_close = [](const DenseRealVector& actual, const DenseRealVector& expected) {
+        for(long i = 0; i < expected.size(); ++i) {
+            REQUIRE(actual.coeff(i) == doctest::Approx(expected.coeff(i)).epsilon(1e-4));
+        }
+    };
+
+    HashVector location{weights};
+    DenseRealVector grad(40), pre(40), hess(40);
+    objective.gradient(location, grad);
+    check_close(grad, expected_grad);
+
+    objective.hessian_times_direction(location, direction, hess);
+    check_close(hess, expected_hess);
+
+    objective.gradient_and_pre_conditioner(location, grad, pre);
+    check_close(grad, expected_grad);
+    check_close(pre, expected_pre);
+}
+
+TEST_CASE("instance subset") {
+    long rows = 2 * DENSE_GEMV_BLOCK_SIZE + 5;
+    DenseFeatures dense = DenseFeatures::Random(rows, 10);
+    SparseFeatures sparse = DenseFeatures(DenseFeatures::Random(rows, 30)).sparseView(0.5);
+    auto instances = std::make_shared<std::vector<long>>();
+    for(long i = 0; i < rows; i += 3) {
+        instances->push_back(i);
+    }
+    long n = ssize(*instances);
+
+    // reference: an objective on an explicit copy of the selected rows
+    DenseFeatures sub_dense(n, 10);
+    SparseFeatures sub_sparse(n, 30);
+    for(long i = 0; i < n; ++i) {
+        sub_dense.row(i) = dense.row((*instances)[i]);
+        sub_sparse.row(i) = sparse.row((*instances)[i]);
+    }
+
+    auto view = make_sp_dense_squared_hinge(std::make_shared<const GenericFeatureMatrix>(dense), 1.0,
+                                            std::make_shared<const GenericFeatureMatrix>(sparse), 1.0);
+    auto reference = make_sp_dense_squared_hinge(std::make_shared<const GenericFeatureMatrix>(sub_dense), 1.0,
+                                                 std::make_shared<const GenericFeatureMatrix>(sub_sparse), 1.0);
+
+    HashVector weights{DenseRealVector::Random(40)};
+    DenseRealVector direction = DenseRealVector::Random(40);
+    // make sure that switching invalidates cached results
+    view->get_label_ref().setConstant(-1);
+    CHECK(view->value(weights) >= 0);
+    view->select_instances(instances);
+    REQUIRE(view->num_instances() == n);
+    for(long i = 0; i < n; ++i) {
+        view->get_label_ref().coeffRef(i) = i % 4 == 0 ? 1 : -1;
+        reference->get_label_ref().coeffRef(i) = i % 4 == 0 ? 1 : -1;
+    }
+
+    CHECK(view->value(weights) == doctest::Approx(reference->value(weights)));
+
+    DenseRealVector grad(40), ref_grad(40), pre(40), ref_pre(40);
+    view->gradient_and_pre_conditioner(weights, grad, pre);
+    reference->gradient_and_pre_conditioner(weights, ref_grad, ref_pre);
+    CHECK(grad.isApprox(ref_grad));
+    CHECK(pre.isApprox(ref_pre));
+
+    view->hessian_times_direction(weights, direction, grad);
+    reference->hessian_times_direction(weights, direction, ref_grad);
+    CHECK(grad.isApprox(ref_grad));
+
+    Objective& view_base = *view;
+    Objective& reference_base = *reference;
+    view_base.project_to_line(weights, direction);
+    reference_base.project_to_line(weights, direction);
+    CHECK(view_base.lookup_on_line(0.5) == doctest::Approx(reference_base.lookup_on_line(0.5)));
+
+    // a subset of the same size reuses the buffers, but the costs are reset
+    view->update_costs(2.0, 2.0);
+    const std::int8_t* label_storage = view->get_label_ref().data();
+    view->select_instances(std::make_shared<const std::vector<long>>(*instances));
+    CHECK(view->get_label_ref().data() == label_storage);
+    for(long i = 0; i < n; ++i) {
+        view->get_label_ref().coeffRef(i) = i % 4 == 0 ? 1 : -1;
+    }
+    CHECK(view->value(weights) == doctest::Approx(reference->value(weights)));
+
+    // going back to the full matrix
+    view->select_instances(nullptr);
+    CHECK(view->num_instances() == rows);
+}
@@ -27,7 +27,26 @@ namespace dismec::objective {
 
         [[nodiscard]] BinaryLabelVector& get_label_ref();
         void update_costs(real_t positive, real_t negative);
-        void update_features(const DenseFeatures& dense, const SparseFeatures& sparse);
+
+        /*!
+         * \brief Sets the costs as in `update_costs(real_t, real_t)`, and additionally multiplies the cost of
+         * each instance with its weight.
+         * \param instance_weights Per-instance weights, with one entry for each row of the feature matrix.
+         */
+        void update_costs(real_t positive, real_t negative, const DenseRealVector& instance_weights);
+
+        /*!
+         * \brief Restricts the objective to a subset of the rows of the feature matrices.
+         * \details The rows are not copied; instead, all computations gather the rows given by `instances` from the
+         * full feature matrices. Instance `i` of the objective corresponds to row `instances[i]`, so labels and costs
+         * need to be set (again) after calling this function.
+         * The label and cost buffers are only reallocated if the number of instances changes.
+         * \note This index view only exists for the combined dense and sparse objective. The generic
+         * `LinearClassifierBase` copies the selected rows instead, see `LinearClassifierBase::update_features()`.
+         * \param instances The rows to use, or `nullptr` to use all rows. The indices need to be valid rows of the
+         * feature matrices.
+         */
+        void select_instances(std::shared_ptr<const std::vector<long>> instances);
 
     protected:
         /// actual implementation of `num_variables()`. We need this non-virtual function to be called during the constructor
@@ -79,6 +98,11 @@ namespace dismec::objective {
         [[nodiscard]] const DenseFeatures& dense_features() const;
         [[nodiscard]] const SparseFeatures& sparse_features() const;
 
+        /// Gets the row of the feature matrices that corresponds to the given instance.
+        [[nodiscard]] long instance_row(long instance) const {
+            return m_Instances ? (*m_Instances)[instance] : instance;
+        }
+
         [[nodiscard]] const DenseRealVector& costs() const;
         [[nodiscard]] const BinaryLabelVector& labels() const;
     private:
@@ -115,6 +139,31 @@ namespace dismec::objective {
                                               const BinaryLabelVector& labels,
                                               DenseRealVector& out) const = 0;
 
+        /*!
+         * \brief Checks whether enough instances of a block are active (i.e. have non-zero loss derivative) to
+         * process the dense features of the block with matrix-vector products.
+         * \details If only a few instances contribute, going over the rows individually and skipping all zeros
+         * is cheaper than a full GEMV. The cut-off is given by `DENSE_GEMV_MIN_ACTIVE_FRACTION`.
+         */
+        [[nodiscard]] static bool use_dense_gemv(long active, long length);
+
+        /*!
+         * \brief Adds the product of the transposed feature matrix with `factors` to `target`, restricted to the
+         * instances `[start, start + length)`.
+         * \details For the sparse block, only the rows with non-zero factor are visited. The dense block uses a single
+         * matrix-vector product, which is dispatched to BLAS if the library is built with `EIGEN_USE_BLAS`, unless
+         * `use_dense_gemv()` decides that a row-wise accumulation is cheaper.
+         */
+        void add_transposed_block(const DenseRealVector& factors, long start, long length,
+                                  Eigen::Ref<DenseRealVector> target);
+
+        /// Adds the product of the transposed feature matrix with `factors` to `target`, by calling
+        /// `add_transposed_block()` for blocks of `DENSE_GEMV_BLOCK_SIZE` instances.
+        void add_features_transposed_times(const DenseRealVector& factors, Eigen::Ref<DenseRealVector> target);
+
+        /// Calculates the product of the (selected rows of the) feature matrix with `weights`.
+        void features_times(const DenseRealVector& weights, DenseRealVector& target) const;
+
         const DenseRealVector& cached_derivative(const HashVector& location);
         const DenseRealVector& cached_2nd_derivative(const HashVector& location);
 
@@ -129,6 +178,8 @@ namespace dismec::objective {
         std::shared_ptr<const GenericFeatureMatrix> m_DenseFeatures;
         /// pointer to the sparse part of the feature matrix
         std::shared_ptr<const GenericFeatureMatrix> m_SparseFeatures;
+        /// The rows of the feature matrices that make up the instances, or `nullptr` if all rows are used.
+        std::shared_ptr<const std::vector<long>> m_Instances;
 
         /// cache for the last argument to `x_times_w()`.
         VectorHash m_Last_W{};
@@ -14,7 +14,7 @@ using dismec::objective::GenericLinearClassifier;
 
 namespace {
     using dismec::stats::stat_id_t;
-    constexpr const stat_id_t STAT_GRAD_SPARSITY{8};
+    constexpr const stat_id_t STAT_GRAD_SPARSITY{9};
 }
 
 real_t GenericLinearClassifier::value_unchecked(const HashVector& location) {
@@ -50,6 +50,14 @@ GenericLinearClassifier::hessian_times_direction_unchecked(const HashVector& loc
     }, generic_features());
 }
 
+void GenericLinearClassifier::hessian_times_direction_restricted_unchecked(const HashVector& location,
+                                                                           const std::vector<long>& indices,
+                                                                           const DenseRealVector& direction,
+                                                                           Eigen::Ref<DenseRealVector> target) {
+    m_Regularizer->hessian_times_direction_restricted(location, indices, direction, target);
+    add_restricted_hessian_product(cached_2nd_derivative(location), indices, direction, target);
+}
+
 void GenericLinearClassifier::gradient_and_pre_conditioner_unchecked(const HashVector& location,
                                                                      Eigen::Ref<DenseRealVector> gradient,
                                                                      Eigen::Ref<DenseRealVector> pre) {
@@ -137,6 +145,13 @@ void GenericLinearClassifier::invalidate_labels() {
     m_SecondDerivativeBuffer.invalidate();
 }
 
+void GenericLinearClassifier::on_features_changed() {
+    m_DerivativeBuffer = CacheHelper(num_instances());
+    m_SecondDerivativeBuffer = CacheHelper(num_instances());
+    m_GenericInBuffer.resize(num_instances());
+    m_GenericOutBuffer.resize(num_instances());
+}
+
 GenericLinearClassifier::GenericLinearClassifier(std::shared_ptr<const GenericFeatureMatrix> X,
                                                             std::unique_ptr<Objective> regularizer)
         : LinearClassifierBase(std::move(X)),
@@ -157,17 +172,157 @@ void GenericLinearClassifier::project_to_line_unchecked(const HashVector& locati
 
 
 // ---------------------------------------------------------------------------------------------------------------------
-//                  Some concrete implementations of common loss functions
+//                  Fused kernels for margin-based losses
 // ---------------------------------------------------------------------------------------------------------------------
 
 namespace objective = dismec::objective;
+using objective::FusedMarginClassifier;
+
+namespace {
+    /// Array type for the per-block values in the fused kernels. Has a fixed capacity, so it does not allocate.
+    using block_array_t = Eigen::Array<real_t, Eigen::Dynamic, 1, Eigen::ColMajor, FUSED_MARGIN_BLOCK_SIZE, 1>;
+}
+
+template<class MarginFunction>
+FusedMarginClassifier<MarginFunction>::FusedMarginClassifier(std::shared_ptr<const GenericFeatureMatrix> X,
+                                                             std::unique_ptr<Objective> regularizer,
+                                                             MarginFunction phi) :
+    GenericMarginClassifier<MarginFunction>(std::move(X), std::move(regularizer), std::move(phi)),
+    m_ScoreBuffer(this->num_instances()) {
+}
+
+template<class MarginFunction>
+template<class Derived>
+real_t FusedMarginClassifier<MarginFunction>::fused_loss(const Eigen::MatrixBase<Derived>& scores) const {
+    const auto& labels = this->labels();
+    const auto& costs = this->costs();
+    const long n = scores.size();
+    real_t total = 0;
+    for(long start = 0; start < n; start += FUSED_MARGIN_BLOCK_SIZE) {
+        long len = std::min(FUSED_MARGIN_BLOCK_SIZE, n - start);
+        block_array_t margin = scores.segment(start, len).array() * labels.segment(start, len).template cast<real_t>().array();
+        total += (this->Phi.value(margin) * costs.segment(start, len).array()).sum();
+    }
+    return total;
+}
+
+template<class MarginFunction>
+real_t FusedMarginClassifier<MarginFunction>::value_unchecked(const HashVector& location) {
+    return fused_loss(this->x_times_w(location)) + this->regularizer().value(location);
+}
+
+template<class MarginFunction>
+real_t FusedMarginClassifier<MarginFunction>::lookup_on_line(real_t position) {
+    return fused_loss(this->line_interpolation(position)) + this->regularizer().lookup_on_line(position);
+}
+
+template<class MarginFunction>
+template<bool WithPreconditioner>
+void FusedMarginClassifier<MarginFunction>::fused_gradient(const HashVector& location,
+                                                           Eigen::Ref<DenseRealVector> gradient,
+                                                           Eigen::Ref<DenseRealVector> pre) {
+    const auto& labels = this->labels();
+    const auto& costs = this->costs();
+    const long n = this->num_instances();
+    // if we do not have the scores yet, we calculate them block-wise while the corresponding rows of the feature
+    // matrix are in cache anyway.
+    const bool has_scores = this->is_xtw_cached(location);
+    if(!has_scores) {
+        // the number of instances changes if the features are replaced by `update_features()`
+        m_ScoreBuffer.resize(n);
+    }
+    const DenseRealVector& scores = has_scores ? this->x_times_w(location) : m_ScoreBuffer;
+    long nnz = 0;
+
+    visit([&](const auto& features) {
+        for(long start = 0; start < n; start += FUSED_MARGIN_BLOCK_SIZE) {
+            long len = std::min(FUSED_MARGIN_BLOCK_SIZE, n - start);
+            if(!has_scores) {
+                for(long i = start; i < start + len; ++i) {
+                    m_ScoreBuffer.coeffRef(i) = features.row(i).dot(location.get());
+                }
+            }
+
+            block_array_t label = labels.segment(start, len).template cast<real_t>().array();
+            block_array_t cost = costs.segment(start, len).array();
+            block_array_t margin = scores.segment(start, len).array() * label;
+            block_array_t derivative = this->Phi.grad(margin) * label * cost;
+            block_array_t hessian;
+            if constexpr (WithPreconditioner) {
+                hessian = this->Phi.quad(margin) * cost;
+            }
+
+            for(long i = 0; i < len; ++i) {
+                if(real_t d = derivative.coeff(i); d != 0) {
+                    gradient += features.row(start + i) * d;
+                    ++nnz;
+                }
+                if constexpr (WithPreconditioner) {
+                    if(real_t h = hessian.coeff(i); h != 0) {
+                        pre += features.row(start + i).cwiseAbs2() * h;
+                    }
+                }
+            }
+        }
+    }, this->generic_features());
+
+    if(!has_scores) {
+        this->update_xtw_cache(location, m_ScoreBuffer);
+    }
+    this->record(STAT_GRAD_SPARSITY, [&](){
+        return static_cast<real_t>(static_cast<double>(100*nnz) / n);
+    });
+}
+
+template<class MarginFunction>
+void FusedMarginClassifier<MarginFunction>::gradient_unchecked(const HashVector& location,
+                                                               Eigen::Ref<DenseRealVector> target) {
+    this->regularizer().gradient(location, target);
+    fused_gradient<false>(location, target, target);
+}
+
+template<class MarginFunction>
+void FusedMarginClassifier<MarginFunction>::gradient_and_pre_conditioner_unchecked(const HashVector& location,
+                                                                                   Eigen::Ref<DenseRealVector> gradient,
+                                                                                   Eigen::Ref<DenseRealVector> pre) {
+    this->regularizer().gradient(location, gradient);
+    this->regularizer().diag_preconditioner(location, pre);
+    fused_gradient<true>(location, gradient, pre);
+}
+
+template<class MarginFunction>
+void FusedMarginClassifier<MarginFunction>::gradient_at_zero_unchecked(Eigen::Ref<DenseRealVector> target) {
+    this->regularizer().gradient_at_zero(target);
+
+    // at zero, all margins are zero, so the derivative only depends on label and cost
+    const real_t d_zero = this->Phi.grad(real_t{0});
+    if(d_zero == 0) {
+        return;
+    }
+    const auto& labels = this->labels();
+    const auto& costs = this->costs();
+    visit([&](const auto& features) {
+        for (int pos = 0; pos < labels.size(); ++pos) {
+            target += features.row(pos) * (d_zero * costs.coeff(pos) * real_t(labels.coeff(pos)));
+        }
+    }, this->generic_features());
+}
+
+template class objective::FusedMarginClassifier<objective::SquaredHingePhi>;
+template class objective::FusedMarginClassifier<objective::HuberPhi>;
+template class objective::FusedMarginClassifier<objective::LogisticPhi>;
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+//                  Some concrete implementations of common loss functions
+// ---------------------------------------------------------------------------------------------------------------------
 
 namespace {
     template<class Phi, class... Args>
     std::unique_ptr<GenericLinearClassifier> make_gen_lin_classifier(std::shared_ptr<const GenericFeatureMatrix> X,
                                                                      std::unique_ptr<objective::Objective> regularizer,
                                                                      Args... args) {
-        return std::make_unique<objective::GenericMarginClassifier<Phi>>(std::move(X), std::move(regularizer),
+        return std::make_unique<objective::FusedMarginClassifier<Phi>>(std::move(X), std::move(regularizer),
                 Phi{std::forward<Args>(args)...});
     }
 }
@@ -309,6 +464,65 @@ TEST_CASE("sparse/dense equivalence") {
 }
 
 
+namespace {
+    template<class Phi>
+    void test_fused_equivalence(const GenericFeatureMatrix& features, Phi phi) {
+        auto generic = objective::GenericMarginClassifier<Phi>(std::make_shared<GenericFeatureMatrix>(features),
+                                                               std::make_unique<objective::SquaredNormRegularizer>(), phi);
+        auto fused = objective::FusedMarginClassifier<Phi>(std::make_shared<GenericFeatureMatrix>(features),
+                                                           std::make_unique<objective::SquaredNormRegularizer>(), phi);
+        Eigen::Matrix<std::int8_t, Eigen::Dynamic, 1> labels(features.rows());
+        for(int i = 0; i < labels.size(); ++i) {
+            labels.coeffRef(i) = i % 3 == 0 ? 1 : -1;
+        }
+        generic.get_label_ref() = labels;
+        fused.get_label_ref() = labels;
+        generic.update_costs(2.0, 1.0);
+        fused.update_costs(2.0, 1.0);
+
+        // a fresh weight vector for which no scores are cached, so this exercises the fused score calculation
+        HashVector weights{DenseRealVector::Random(features.cols())};
+        DenseRealVector grad_generic(features.cols());
+        DenseRealVector grad_fused(features.cols());
+        generic.gradient(weights, grad_generic);
+        fused.gradient(weights, grad_fused);
+        for(int i = 0; i < grad_generic.size(); ++i) {
+            REQUIRE(grad_generic.coeff(i) == doctest::Approx(grad_fused.coeff(i)));
+        }
+
+        test_equivalence(generic, fused, weights);
+
+        // line search lookup
+        objective::Objective& generic_obj = generic;
+        objective::Objective& fused_obj = fused;
+        DenseRealVector direction = DenseRealVector::Random(features.cols());
+        generic.project_to_line(weights, direction);
+        fused.project_to_line(weights, direction);
+        for(real_t t : {0.0, 0.5, 1.0, -2.0}) {
+            CHECK(generic_obj.lookup_on_line(t) == doctest::Approx(fused_obj.lookup_on_line(t)));
+        }
+    }
+}
+
+TEST_CASE("fused margin kernels") {
+    // more than one block, and a partial block at the end
+    DenseFeatures dense = DenseFeatures::Random(FUSED_MARGIN_BLOCK_SIZE * 2 + 13, 25);
+    SparseFeatures sparse = dense.sparseView(0.5);
+
+    auto run_test = [](const GenericFeatureMatrix& features) {
+        test_fused_equivalence(features, objective::SquaredHingePhi{});
+        test_fused_equivalence(features, objective::HuberPhi{0.1});
+        test_fused_equivalence(features, objective::LogisticPhi{});
+    };
+
+    SUBCASE("dense") {
+        run_test(GenericFeatureMatrix(dense));
+    }
+    SUBCASE("sparse") {
+        run_test(GenericFeatureMatrix(sparse));
+    }
+}
+
 TEST_CASE("generic squared hinge") {
     SparseFeatures x(3, 5);
     x.insert(0, 3) = 1.0;
@@ -388,4 +602,77 @@ TEST_CASE("generic squared hinge") {
     }
 }
 
+TEST_CASE("instance weights") {
+    // an instance with weight 2 has to behave exactly as if it appeared twice in the dataset
+    DenseFeatures features = DenseFeatures::Random(20, 8);
+    BinaryLabelVector labels = BinaryLabelVector::Constant(20, -1);
+    labels.coeffRef(3) = 1;
+    labels.coeffRef(11) = 1;
+
+    DenseRealVector instance_weights = DenseRealVector::Ones(20);
+    DenseFeatures duplicated(25, 8);
+    BinaryLabelVector duplicated_labels(25);
+    duplicated.topRows(20) = features;
+    duplicated_labels.head(20) = labels;
+    for(int i = 0; i < 5; ++i) {
+        duplicated.row(20 + i) = features.row(2 * i + 1);
+        duplicated_labels.coeffRef(20 + i) = labels.coeff(2 * i + 1);
+        instance_weights.coeffRef(2 * i + 1) = 2.0;
+    }
+
+    auto check_equivalent = [&](objective::LinearClassifierBase& weighted, objective::LinearClassifierBase& reference) {
+        weighted.get_label_ref() = labels;
+        weighted.update_costs(2.0, 1.0, instance_weights);
+        reference.get_label_ref() = duplicated_labels;
+        reference.update_costs(2.0, 1.0);
+
+        DenseRealVector weights = DenseRealVector::Random(8);
+        DenseRealVector direction = DenseRealVector::Random(8);
+        HashVector location{weights};
+        CHECK(weighted.value(location) == doctest::Approx(reference.value(location)));
+
+        DenseRealVector out_weighted(8);
+        DenseRealVector out_reference(8);
+        auto check_vectors = [&]() {
+            for(int i = 0; i < 8; ++i) {
+                REQUIRE(out_weighted.coeff(i) == doctest::Approx(out_reference.coeff(i)));
+            }
+        };
+        weighted.gradient(location, out_weighted);
+        reference.gradient(location, out_reference);
+        check_vectors();
+
+        weighted.hessian_times_direction(location, direction, out_weighted);
+        reference.hessian_times_direction(location, direction, out_reference);
+        check_vectors();
+
+        weighted.gradient_at_zero(out_weighted);
+        reference.gradient_at_zero(out_reference);
+        check_vectors();
+    };
+
+    auto single = std::make_shared<GenericFeatureMatrix>(features);
+    auto twice = std::make_shared<GenericFeatureMatrix>(duplicated);
+
+    SUBCASE("generic") {
+        auto weighted = make_squared_hinge(single, std::make_unique<objective::SquaredNormRegularizer>());
+        auto reference = make_squared_hinge(twice, std::make_unique<objective::SquaredNormRegularizer>());
+        check_equivalent(*weighted, *reference);
+    }
+
+    SUBCASE("squared hinge") {
+        // this implementation only supports sparse features
+        objective::Regularized_SquaredHingeSVC weighted(std::make_shared<GenericFeatureMatrix>(SparseFeatures(features.sparseView())),
+                                                        std::make_unique<objective::SquaredNormRegularizer>());
+        objective::Regularized_SquaredHingeSVC reference(std::make_shared<GenericFeatureMatrix>(SparseFeatures(duplicated.sparseView())),
+                                                         std::make_unique<objective::SquaredNormRegularizer>());
+        check_equivalent(weighted, reference);
+    }
+
+    SUBCASE("mismatched size") {
+        auto weighted = make_squared_hinge(single, std::make_unique<objective::SquaredNormRegularizer>());
+        CHECK_THROWS(weighted->update_costs(1.0, 1.0, DenseRealVector::Ones(25)));
+    }
+}
+
 #endif
@@ -25,6 +25,9 @@ namespace dismec::objective {
     class GenericLinearClassifier : public LinearClassifierBase {
     public:
         GenericLinearClassifier(std::shared_ptr<const GenericFeatureMatrix> X, std::unique_ptr<Objective> regularizer);
+    protected:
+        /// Gives derived classes that specialize some of the operations access to the regularizer.
+        [[nodiscard]] Objective& regularizer() { return *m_Regularizer; }
     private:
         // declaration of the "unchecked" methods that need to be implemented for an objective.
         //! @{
@@ -36,6 +39,11 @@ namespace dismec::objective {
             const HashVector& location,
             const DenseRealVector& direction,
             Eigen::Ref<DenseRealVector> target) override;
+        void hessian_times_direction_restricted_unchecked(
+            const HashVector& location,
+            const std::vector<long>& indices,
+            const DenseRealVector& direction,
+            Eigen::Ref<DenseRealVector> target) override;
         void diag_preconditioner_unchecked(
             const HashVector& location,
             Eigen::Ref<DenseRealVector> target) override;
@@ -96,6 +104,7 @@ namespace dismec::objective {
         //! @}
 
         void invalidate_labels() override;
+        void on_features_changed() override;
 
         //! Cached value of the last calculation of the loss derivative. Needs to be invalidated when the labels change.
         CacheHelper m_SecondDerivativeBuffer;
@@ -159,6 +168,53 @@ namespace dismec::objective {
         MarginFunction Phi;
     };
 
+    /*!
+     * \brief Margin classifier with compile-time specialized, fused kernels for the value and gradient computations.
+     * \details Whereas `GenericMarginClassifier` evaluates the loss function through the virtual `calculate_*`
+     * functions, which write into intermediate n-length buffers, this class processes the instances in small blocks.
+     * For each block, the margins, loss values and derivatives are computed using the array overloads of the
+     * `MarginFunction`, so they stay in registers/L1 cache and can be vectorized, and are directly accumulated into
+     * the result. If the scores \f$ x^T w\f$ are not already cached (e.g. from the line search), then their
+     * calculation is fused into the same pass over the feature matrix as the gradient accumulation.
+     *
+     * The Hessian-vector products and the preconditioner still use the cached second derivatives of the base class,
+     * because these are evaluated many times for the same location during the CG iterations.
+     *
+     * The member functions are defined in `generic_linear.cpp`, and explicitly instantiated for `SquaredHingePhi`,
+     * `HuberPhi`, and `LogisticPhi`.
+     */
+    template<class MarginFunction>
+    class FusedMarginClassifier : public GenericMarginClassifier<MarginFunction> {
+    public:
+        FusedMarginClassifier(std::shared_ptr<const GenericFeatureMatrix> X,
+                              std::unique_ptr<Objective> regularizer,
+                              MarginFunction phi);
+    private:
+        real_t value_unchecked(const HashVector& location) override;
+        real_t lookup_on_line(real_t position) override;
+        void gradient_unchecked(const HashVector& location, Eigen::Ref<DenseRealVector> target) override;
+        void gradient_at_zero_unchecked(Eigen::Ref<DenseRealVector> target) override;
+        void gradient_and_pre_conditioner_unchecked(
+            const HashVector& location,
+            Eigen::Ref<DenseRealVector> gradient,
+            Eigen::Ref<DenseRealVector> pre) override;
+
+        /// Calculates the cost-weighted sum of the losses for the given scores in a single pass.
+        template<class Derived>
+        real_t fused_loss(const Eigen::MatrixBase<Derived>& scores) const;
+
+        /*!
+         * \brief Accumulates the gradient (and, if `WithPreconditioner` is set, the diagonal preconditioner) of the
+         * loss part of the objective into the given vectors.
+         */
+        template<bool WithPreconditioner>
+        void fused_gradient(const HashVector& location, Eigen::Ref<DenseRealVector> gradient,
+                            Eigen::Ref<DenseRealVector> pre);
+
+        /// Buffer for the scores if they are calculated as part of `fused_gradient`.
+        DenseRealVector m_ScoreBuffer;
+    };
+
 
     std::unique_ptr<GenericLinearClassifier> make_squared_hinge(std::shared_ptr<const GenericFeatureMatrix> X,
                                                                 std::unique_ptr<Objective> regularizer);
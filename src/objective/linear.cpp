@@ -6,13 +6,49 @@
 #include "linear.h"
 #include "utils/eigen_generic.h"
 #include "utils/throw_error.h"
+#include "data/transform.h"
+#include "utils/conversion.h"
 #include "stats/timer.h"
+#include <mutex>
+#include <numeric>
 
 using namespace dismec;
 using namespace dismec::objective;
 
 namespace {
     constexpr const dismec::stats::stat_id_t STAT_PERF_MATMUL{7};
+    constexpr const dismec::stats::stat_id_t STAT_PERF_SPARSE_UPDATE{8};
+
+    using column_major_t = types::SparseColMajor<real_t>;
+
+    /*!
+     * \brief Returns a column-major copy of `features`.
+     * \details Copies are cached, so that all objectives that refer to the same feature matrix can share a single
+     * column-major version. The cache only holds weak references, so the copy is freed once no objective uses it
+     * anymore.
+     */
+    std::shared_ptr<const column_major_t> shared_column_view(const std::shared_ptr<const GenericFeatureMatrix>& features) {
+        static std::mutex cache_mutex;
+        static std::vector<std::pair<std::weak_ptr<const GenericFeatureMatrix>, std::weak_ptr<const column_major_t>>> cache;
+
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        // remove stale entries
+        cache.erase(std::remove_if(begin(cache), end(cache), [](const auto& entry) {
+            return entry.first.expired() || entry.second.expired();
+        }), end(cache));
+
+        for(const auto& [source, view] : cache) {
+            if(source.lock() == features) {
+                if(auto result = view.lock(); result) {
+                    return result;
+                }
+            }
+        }
+
+        auto view = std::make_shared<const column_major_t>(features->sparse());
+        cache.emplace_back(features, view);
+        return view;
+    }
 }
 
 LinearClassifierBase::LinearClassifierBase(std::shared_ptr<const GenericFeatureMatrix> X) :
@@ -25,6 +61,7 @@ LinearClassifierBase::LinearClassifierBase(std::shared_ptr<const GenericFeatureM
 {
     m_Costs.fill(1);
     declare_stat(STAT_PERF_MATMUL, {"perf_matmul", "µs"});
+    declare_stat(STAT_PERF_SPARSE_UPDATE, {"perf_sparse_update", "µs"});
 }
 
 
@@ -67,6 +104,86 @@ void LinearClassifierBase::project_linear_to_line(const HashVector& location, co
     m_LsCache_xTw = x_times_w(location);
 }
 
+const types::SparseColMajor<real_t>& LinearClassifierBase::column_view() {
+    if(!m_ColumnView) {
+        m_ColumnView = shared_column_view(m_FeatureMatrix);
+    }
+    return *m_ColumnView;
+}
+
+void LinearClassifierBase::declare_sparse_update(const VectorHash& base, const HashVector& location,
+                                                 const SparseRealVector& delta) {
+    if(base != m_Last_W) {
+        return;
+    }
+
+    if(m_FeatureMatrix->is_sparse()) {
+        const auto& columns = column_view();
+        // check that the incremental update is actually cheaper than a full recomputation
+        long work = 0;
+        for(SparseRealVector::InnerIterator it(delta); it; ++it) {
+            work += columns.outerIndexPtr()[it.index() + 1] - columns.outerIndexPtr()[it.index()];
+        }
+        if(work > columns.nonZeros()) {
+            return;
+        }
+
+        auto timer = make_timer(STAT_PERF_SPARSE_UPDATE);
+        for(SparseRealVector::InnerIterator it(delta); it; ++it) {
+            for(column_major_t::InnerIterator col(columns, it.index()); col; ++col) {
+                m_X_times_w.coeffRef(col.row()) += col.value() * it.value();
+            }
+        }
+    } else {
+        if(2 * delta.nonZeros() > num_variables()) {
+            return;
+        }
+
+        auto timer = make_timer(STAT_PERF_SPARSE_UPDATE);
+        const auto& features = m_FeatureMatrix->dense();
+        for(SparseRealVector::InnerIterator it(delta); it; ++it) {
+            m_X_times_w += features.col(it.index()) * it.value();
+        }
+    }
+    m_Last_W = location.hash();
+}
+
+void LinearClassifierBase::add_restricted_hessian_product(const DenseRealVector& curvature,
+                                                          const std::vector<long>& indices,
+                                                          const DenseRealVector& direction,
+                                                          Eigen::Ref<DenseRealVector> target) {
+    m_RestrictedBuffer.setZero(num_instances());
+    if(m_FeatureMatrix->is_sparse()) {
+        const auto& columns = column_view();
+        for(long k = 0; k < ssize(indices); ++k) {
+            if(real_t d = direction.coeff(k); d != 0) {
+                for (column_major_t::InnerIterator col(columns, indices[k]); col; ++col) {
+                    m_RestrictedBuffer.coeffRef(col.row()) += col.value() * d;
+                }
+            }
+        }
+        m_RestrictedBuffer.array() *= curvature.array();
+        for(long k = 0; k < ssize(indices); ++k) {
+            real_t sum = 0;
+            for (column_major_t::InnerIterator col(columns, indices[k]); col; ++col) {
+                sum += col.value() * m_RestrictedBuffer.coeff(col.row());
+            }
+            target.coeffRef(k) += sum;
+        }
+    } else {
+        const auto& features = m_FeatureMatrix->dense();
+        for(long k = 0; k < ssize(indices); ++k) {
+            if(real_t d = direction.coeff(k); d != 0) {
+                m_RestrictedBuffer += features.col(indices[k]) * d;
+            }
+        }
+        m_RestrictedBuffer.array() *= curvature.array();
+        for(long k = 0; k < ssize(indices); ++k) {
+            target.coeffRef(k) += features.col(indices[k]).dot(m_RestrictedBuffer);
+        }
+    }
+}
+
 BinaryLabelVector& LinearClassifierBase::get_label_ref() {
     invalidate_labels();
     return m_Y;
@@ -80,6 +197,48 @@ void LinearClassifierBase::update_costs(real_t positive, real_t negative) {
             m_Costs.coeffRef(i) = negative;
         }
     }
+    invalidate_labels();
+}
+
+void LinearClassifierBase::update_costs(real_t positive, real_t negative, const DenseRealVector& instance_weights) {
+    ALWAYS_ASSERT_EQUAL(instance_weights.size(), m_Costs.size(), "Mismatching number of instance weights ({}) and instances ({})");
+    update_costs(positive, negative);
+    m_Costs.array() *= instance_weights.array();
+}
+
+void LinearClassifierBase::update_features(std::shared_ptr<const GenericFeatureMatrix> features) {
+    ALWAYS_ASSERT_EQUAL(features->cols(), m_FeatureMatrix->cols(), "Mismatching number of features: Got {}, expected {}");
+    m_FeatureMatrix = std::move(features);
+    m_ColumnView.reset();
+    m_Last_W = {};
+
+    long rows = m_FeatureMatrix->rows();
+    m_X_times_w.resize(rows);
+    m_LsCache_xTd.resize(rows);
+    m_LsCache_xTw.resize(rows);
+    m_Costs = DenseRealVector::Ones(rows);
+    m_Y.resize(rows);
+    invalidate_labels();
+    on_features_changed();
+}
+
+void LinearClassifierBase::update_features(const GenericFeatureMatrix& source, const std::vector<long>& rows) {
+    // the previous subset may only be overwritten if no one except for this objective refers to it
+    bool reusable = m_RowSubset && m_RowSubset.use_count() <= (m_FeatureMatrix == m_RowSubset ? 2 : 1) &&
+                    m_RowSubset->is_sparse() == source.is_sparse();
+    if(!reusable) {
+        if(source.is_sparse()) {
+            m_RowSubset = std::make_shared<GenericFeatureMatrix>(SparseFeatures{});
+        } else {
+            m_RowSubset = std::make_shared<GenericFeatureMatrix>(DenseFeatures{});
+        }
+    }
+    if(source.is_sparse()) {
+        shortlist_features(source.sparse(), rows, m_RowSubset->sparse());
+    } else {
+        shortlist_features(source.dense(), rows, m_RowSubset->dense());
+    }
+    update_features(m_RowSubset);
 }
 
 const DenseRealVector& LinearClassifierBase::costs() const {
@@ -89,3 +248,103 @@ const DenseRealVector& LinearClassifierBase::costs() const {
 const BinaryLabelVector& LinearClassifierBase::labels() const {
     return m_Y;
 }
+
+#ifndef DOCTEST_CONFIG_DISABLE
+#include "doctest.h"
+#include "generic_linear.h"
+#include "regularizers_imp.h"
+
+TEST_CASE("sparse update of scores") {
+    DenseFeatures dense = DenseFeatures::Random(50, 30);
+    SparseFeatures sparse = dense.sparseView(0.5);
+
+    auto run_test = [](const GenericFeatureMatrix& features) {
+        auto features_ptr = std::make_shared<const GenericFeatureMatrix>(features);
+        auto incremental = make_squared_hinge(features_ptr, std::make_unique<objective::SquaredNormRegularizer>());
+        auto reference = make_squared_hinge(features_ptr, std::make_unique<objective::SquaredNormRegularizer>());
+        BinaryLabelVector labels(features.rows());
+        for(int i = 0; i < labels.size(); ++i) {
+            labels.coeffRef(i) = i % 4 == 0 ? 1 : -1;
+        }
+        incremental->get_label_ref() = labels;
+        reference->get_label_ref() = labels;
+
+        // declare_sparse_update is part of the public interface of `Objective`
+        objective::Objective& objective = *incremental;
+        HashVector weights{DenseRealVector::Random(features.cols())};
+        CHECK(objective.value(weights) == doctest::Approx(reference->value(weights)));
+
+        SparseRealVector delta(features.cols());
+        for(int step = 0; step < 5; ++step) {
+            VectorHash old_hash = weights.hash();
+            delta.setZero();
+            // change two coordinates. Use the hash of the unchanged vector as the base.
+            for(int j : {step, 2 * step + 10}) {
+                delta.insert(j) = real_t(0.5) - weights->coeff(j);
+            }
+            weights.modify() += delta;
+            objective.declare_sparse_update(old_hash, weights, delta);
+
+            CHECK(objective.value(weights) == doctest::Approx(reference->value(weights)));
+        }
+
+        // an update that is declared for a different base must be ignored
+        HashVector other{DenseRealVector::Random(features.cols())};
+        weights.modify().coeffRef(0) += 1;
+        objective.declare_sparse_update(other.hash(), weights, delta);
+        CHECK(objective.value(weights) == doctest::Approx(reference->value(weights)));
+    };
+
+    SUBCASE("dense") {
+        run_test(GenericFeatureMatrix(dense));
+    }
+    SUBCASE("sparse") {
+        run_test(GenericFeatureMatrix(sparse));
+    }
+}
+
+TEST_CASE("update features") {
+    DenseFeatures full = DenseFeatures::Random(40, 20);
+    DenseFeatures subset = full.topRows(25);
+    BinaryLabelVector labels(25);
+    for(int i = 0; i < labels.size(); ++i) {
+        labels.coeffRef(i) = i % 3 == 0 ? 1 : -1;
+    }
+
+    auto objective = make_squared_hinge(std::make_shared<const GenericFeatureMatrix>(full),
+                                        std::make_unique<objective::SquaredNormRegularizer>());
+    auto reference = make_squared_hinge(std::make_shared<const GenericFeatureMatrix>(subset),
+                                        std::make_unique<objective::SquaredNormRegularizer>());
+    reference->get_label_ref() = labels;
+
+    HashVector weights{DenseRealVector::Random(20)};
+    // fill the caches before switching to the subset
+    objective->get_label_ref().setConstant(-1);
+    objective->update_costs(1.0, 1.0);
+    CHECK(objective->value(weights) >= 0);
+
+    objective->update_features(std::make_shared<const GenericFeatureMatrix>(subset));
+    CHECK(objective->num_instances() == 25);
+    objective->get_label_ref() = labels;
+
+    CHECK(objective->value(weights) == doctest::Approx(reference->value(weights)));
+    DenseRealVector grad(20);
+    DenseRealVector ref_grad(20);
+    objective->gradient(weights, grad);
+    reference->gradient(weights, ref_grad);
+    CHECK(grad.isApprox(ref_grad));
+
+    // the number of features has to match
+    CHECK_THROWS(objective->update_features(std::make_shared<const GenericFeatureMatrix>(DenseFeatures(10, 5))));
+
+    // selecting the rows in place gives the same objective, and reuses the storage
+    std::vector<long> rows(25);
+    std::iota(rows.begin(), rows.end(), 0l);
+    objective->update_features(GenericFeatureMatrix(full), rows);
+    objective->get_label_ref() = labels;
+    CHECK(objective->value(weights) == doctest::Approx(reference->value(weights)));
+    const real_t* storage = objective->dense_features().data();
+    objective->update_features(GenericFeatureMatrix(full), rows);
+    CHECK(objective->dense_features().data() == storage);
+}
+#endif
@@ -33,6 +33,38 @@ namespace dismec::objective {
 
         [[nodiscard]] BinaryLabelVector& get_label_ref();
         void update_costs(real_t positive, real_t negative);
+
+        /*!
+         * \brief Replaces the feature matrix, e.g. to train on a subset of the instances.
+         * \details The new matrix needs to have the same number of columns, but the number of rows may differ. This
+         * invalidates all cached results, and resets labels and costs to the new size. Therefore, the labels and costs
+         * need to be set (again) after calling this function.
+         */
+        void update_features(std::shared_ptr<const GenericFeatureMatrix> features);
+
+        /*!
+         * \brief Replaces the feature matrix by the rows `rows` of `source`.
+         * \details This has the same effect as calling `update_features()` with a copy of the selected rows, but the
+         * copy is kept in a matrix that is owned by this objective. If this function is called repeatedly, e.g. once
+         * for each label when training with sampled negatives, the storage of that matrix is reused.
+         */
+        void update_features(const GenericFeatureMatrix& source, const std::vector<long>& rows);
+
+        /*!
+         * \brief Sets the costs as in `update_costs(real_t, real_t)`, and additionally multiplies the cost of
+         * each instance with its weight.
+         * \param instance_weights Per-instance weights, with one entry for each row of the feature matrix.
+         */
+        void update_costs(real_t positive, real_t negative, const DenseRealVector& instance_weights);
+
+        // read access to the training data, e.g. for solvers that work on the data directly instead of using the
+        // generic objective interface.
+        [[nodiscard]] const GenericFeatureMatrix& generic_features() const;
+        [[nodiscard]] const DenseFeatures& dense_features() const;
+        [[nodiscard]] const SparseFeatures& sparse_features() const;
+
+        [[nodiscard]] const DenseRealVector& costs() const;
+        [[nodiscard]] const BinaryLabelVector& labels() const;
     protected:
         /*!
          * \brief Calculates the vector of feature matrix times weights `w`
@@ -44,6 +76,15 @@ namespace dismec::objective {
          */
         const DenseRealVector& x_times_w(const HashVector& w);
 
+        /*!
+         * \brief Checks whether `x_times_w(w)` can be answered from the cache, i.e. without a matrix multiplication.
+         * \details This allows derived classes to fuse the calculation of the scores with other passes over the
+         * feature matrix if the scores are not yet available.
+         */
+        [[nodiscard]] bool is_xtw_cached(const HashVector& w) const {
+            return w.hash() == m_Last_W;
+        }
+
         /*!
          * \brief Updates the cached value for x_times_w
          * \param new_weight The new value of w.
@@ -77,12 +118,33 @@ namespace dismec::objective {
             update_xtw_cache(location, m_LsCache_xTw + t * m_LsCache_xTd);
         }
 
-        [[nodiscard]] const GenericFeatureMatrix& generic_features() const;
-        [[nodiscard]] const DenseFeatures& dense_features() const;
-        [[nodiscard]] const SparseFeatures& sparse_features() const;
+        /*!
+         * \brief Updates the cached `x_times_w()` result by adding the columns of the feature matrix corresponding to
+         * the nonzero entries of `delta`.
+         * \details For sparse features, this requires a column-major copy of the feature matrix. This copy is created
+         * on first use, and shared between all objectives that use the same feature matrix (see `column_view()`).
+         * If the cache does not correspond to `base`, or if the update would touch more nonzeros than a full
+         * recomputation, this function does nothing.
+         */
+        void declare_sparse_update(const VectorHash& base, const HashVector& location, const SparseRealVector& delta) override;
 
-        [[nodiscard]] const DenseRealVector& costs() const;
-        [[nodiscard]] const BinaryLabelVector& labels() const;
+        /*!
+         * \brief Gets a column-major version of the sparse feature matrix.
+         * \details The copy is created on the first call, and shared with all other `LinearClassifierBase` objects that
+         * use the same feature matrix, so even with many threads only one additional copy per (NUMA-local) feature
+         * matrix is created.
+         */
+        [[nodiscard]] const types::SparseColMajor<real_t>& column_view();
+
+        /*!
+         * \brief Adds \f$ X_A^T \diag(h) X_A d \f$ to `target`, where \f$ X_A \f$ are the columns of the feature matrix
+         * given by `indices`, and `h` is the per-instance `curvature`.
+         * \details This is the data part of the Hessian-vector product restricted to a subset of the variables, see
+         * `Objective::hessian_times_direction_restricted()`. For sparse features, the columns are taken from
+         * `column_view()`, so the cost is proportional to the number of nonzeros in the selected columns.
+         */
+        void add_restricted_hessian_product(const DenseRealVector& curvature, const std::vector<long>& indices,
+                                            const DenseRealVector& direction, Eigen::Ref<DenseRealVector> target);
     private:
         /// we keep a refcounted pointer to the training features.
         /// this is to support shared memory parallelization of multilabel training.
@@ -94,11 +156,20 @@ namespace dismec::objective {
         /// cache for the last result of `x_times_w()` corresponding to `m_Last_W`.
         DenseRealVector m_X_times_w;
 
+        /// storage for the feature matrix that is created by `update_features()` from a subset of the rows.
+        std::shared_ptr<GenericFeatureMatrix> m_RowSubset;
+
+        /// column-major copy of the sparse features. Only created if requested by `column_view()`.
+        std::shared_ptr<const types::SparseColMajor<real_t>> m_ColumnView;
+
         /// cache for line search implementation: feature times direction
         DenseRealVector m_LsCache_xTd;
         /// cache for line search implementation: feature times weights
         DenseRealVector m_LsCache_xTw;
 
+        /// buffer for the restricted hessian product: the selected feature columns times direction.
+        DenseRealVector m_RestrictedBuffer;
+
         /// Label-Dependent costs
         DenseRealVector m_Costs;
 
@@ -108,6 +179,10 @@ namespace dismec::objective {
         /// This function will be called whenever m_Y changes so that derived classes can invalidate
         /// their caches.
         virtual void invalidate_labels() = 0;
+
+        /// This function will be called after `update_features()`, so that derived classes can adapt the size of their
+        /// buffers to the new number of instances.
+        virtual void on_features_changed() {};
     };
 
     /*!
@@ -167,6 +242,14 @@ namespace dismec::objective {
             derived().hessian_times_direction_imp(location, direction, target);
         }
 
+        void hessian_times_direction_restricted_unchecked(const HashVector& location,
+                                                          const std::vector<long>& indices,
+                                                          const DenseRealVector& direction,
+                                                          Eigen::Ref<DenseRealVector> target) override {
+            m_Regularizer->hessian_times_direction_restricted(location, indices, direction, target);
+            derived().hessian_times_direction_restricted_imp(location, indices, direction, target);
+        }
+
         void diag_preconditioner_unchecked(const HashVector& location, Eigen::Ref<DenseRealVector> target) override {
             m_Regularizer->diag_preconditioner(location, target);
             derived().diag_preconditioner_imp(location, target);
@@ -8,8 +8,11 @@
 
 #include "config.h"
 #include <cmath>
+#include <Eigen/Core>
 
 // The structs defined here are used in a template.
+// In addition to the scalar functions, each struct provides overloads that operate on Eigen arrays of margins. These
+// are used by the fused kernels of `FusedMarginClassifier`, and are written such that Eigen can vectorize them.
 
 namespace dismec::objective {
     struct SquaredHingePhi {
@@ -27,6 +30,21 @@ namespace dismec::objective {
             real_t value = real_t{1.0} - margin;
             return value > 0 ? real_t{2} : real_t{0};
         }
+
+        template<class Derived>
+        [[nodiscard]] typename Derived::PlainObject value(const Eigen::ArrayBase<Derived>& margin) const {
+            return (real_t{1} - margin).max(real_t{0}).square();
+        }
+
+        template<class Derived>
+        [[nodiscard]] typename Derived::PlainObject grad(const Eigen::ArrayBase<Derived>& margin) const {
+            return real_t{-2} * (real_t{1} - margin).max(real_t{0});
+        }
+
+        template<class Derived>
+        [[nodiscard]] typename Derived::PlainObject quad(const Eigen::ArrayBase<Derived>& margin) const {
+            return real_t{2} * (margin < real_t{1}).template cast<real_t>();
+        }
     };
 
     struct HuberPhi {
@@ -54,6 +72,26 @@ namespace dismec::objective {
             return real_t{1} / Epsilon;
         }
 
+        template<class Derived>
+        [[nodiscard]] typename Derived::PlainObject value(const Eigen::ArrayBase<Derived>& margin) const {
+            typename Derived::PlainObject value = (real_t{1} - margin).max(real_t{0});
+            return (value > Epsilon).select(value - Epsilon / 2, real_t{0.5} * value.square() / Epsilon);
+        }
+
+        template<class Derived>
+        [[nodiscard]] typename Derived::PlainObject grad(const Eigen::ArrayBase<Derived>& margin) const {
+            typename Derived::PlainObject value = (real_t{1} - margin).max(real_t{0});
+            return (value > Epsilon).select(real_t{-1}, -value / Epsilon);
+        }
+
+        template<class Derived>
+        [[nodiscard]] typename Derived::PlainObject quad(const Eigen::ArrayBase<Derived>& margin) const {
+            typename Derived::PlainObject value = (real_t{1} - margin).max(real_t{0});
+            using array_t = typename Derived::PlainObject;
+            array_t small = (value == real_t{0}).select(real_t{0}, array_t::Constant(value.size(), real_t{1} / Epsilon));
+            return (value > Epsilon).select(value.inverse(), small);
+        }
+
         real_t Epsilon = 1;
     };
 
@@ -84,6 +122,26 @@ namespace dismec::objective {
                 return 0;
             }
         }
+
+        // The array versions use the formulation log(1 + exp(-m)) = log1p(exp(-|m|)) + max(-m, 0), which cannot
+        // overflow, so we don't need the `isfinite` branches of the scalar code and Eigen's vectorized `exp` and
+        // `log1p` can be used.
+        template<class Derived>
+        [[nodiscard]] typename Derived::PlainObject value(const Eigen::ArrayBase<Derived>& margin) const {
+            return (-margin.abs()).exp().log1p() + (-margin).max(real_t{0});
+        }
+
+        template<class Derived>
+        [[nodiscard]] typename Derived::PlainObject grad(const Eigen::ArrayBase<Derived>& margin) const {
+            return -(real_t{1} + margin.exp()).inverse();
+        }
+
+        template<class Derived>
+        [[nodiscard]] typename Derived::PlainObject quad(const Eigen::ArrayBase<Derived>& margin) const {
+            // the second derivative is symmetric in the margin, so we can use the non-overflowing exp(-|m|)
+            typename Derived::PlainObject exp_part = (-margin.abs()).exp();
+            return exp_part / (real_t{1} + exp_part).square();
+        }
     };
 }
 
@@ -6,6 +6,7 @@
 #include "objective.h"
 #include "utils/hash_vector.h"
 #include "utils/throw_error.h"
+#include "utils/conversion.h"
 #include "stats/timer.h"
 
 using namespace dismec;
@@ -121,6 +122,37 @@ void Objective::hessian_times_direction(
     hessian_times_direction_unchecked(location, direction, target);
 }
 
+void Objective::hessian_times_direction_restricted(
+        const HashVector& location,
+        const std::vector<long>& indices,
+        const DenseRealVector& direction,
+        Eigen::Ref<DenseRealVector> target) {
+    auto timer = make_timer(STAT_PERF_HESSIAN);
+    if(num_variables() > 0) {
+        ALWAYS_ASSERT_EQUAL(location->size(), num_variables(), "location size {} differs from num_variables {}");
+    }
+    ALWAYS_ASSERT_EQUAL(target.size(), ssize(indices), "target size {} differs from number of indices {}");
+    ALWAYS_ASSERT_EQUAL(direction.size(), ssize(indices), "direction size {} differs from number of indices {}");
+
+    hessian_times_direction_restricted_unchecked(location, indices, direction, target);
+}
+
+void Objective::hessian_times_direction_restricted_unchecked(
+        const HashVector& location,
+        const std::vector<long>& indices,
+        const DenseRealVector& direction,
+        Eigen::Ref<DenseRealVector> target) {
+    DenseRealVector full_direction = DenseRealVector::Zero(location->size());
+    for(long k = 0; k < ssize(indices); ++k) {
+        full_direction.coeffRef(indices[k]) = direction.coeff(k);
+    }
+    DenseRealVector full_target(location->size());
+    hessian_times_direction_unchecked(location, full_direction, full_target);
+    for(long k = 0; k < ssize(indices); ++k) {
+        target.coeffRef(k) = full_target.coeff(indices[k]);
+    }
+}
+
 void Objective::project_to_line(const HashVector& location, const DenseRealVector& direction) {
     auto timer = make_timer(STAT_PERF_PROJ_TO_LINE);
     if(num_variables() > 0) {
@@ -8,6 +8,7 @@
 
 #include <cstdint>
 #include <memory>
+#include <vector>
 #include "matrix_types.h"
 #include "stats/tracked.h"
 #include "fwd.h"
@@ -99,6 +100,19 @@ namespace dismec::objective
          */
          virtual void declare_vector_on_last_line(const HashVector& location, real_t t) {};
 
+        /*!
+         * \brief State that the given vector has been derived from another vector by a sparse update.
+         * \details This function is a pure optimization hint, similar to `declare_vector_on_last_line()`. If the
+         * objective has cached results for the vector with hash `base`, e.g. the product of feature matrix and weights,
+         * it can use `delta = location - base` to update these incrementally, instead of recomputing them at the next
+         * call with `location`. This is useful if only a few coordinates are changed, as happens e.g. during the
+         * sparsification of the weight vector or for coordinate-wise updates.
+         * \param base Hash of the vector before the update.
+         * \param location The vector after the update.
+         * \param delta Sparse vector that contains `location - base`.
+         */
+         virtual void declare_sparse_update(const VectorHash& base, const HashVector& location, const SparseRealVector& delta) {};
+
 
         /*!
          * \brief Gets the gradient for location zero.
@@ -133,6 +147,24 @@ namespace dismec::objective
                                      const DenseRealVector& direction,
                                      Eigen::Ref<DenseRealVector> target);
 
+        /*!
+         * \brief Calculates the product of the Hessian, restricted to the variables in `indices`, with `direction`.
+         * \details This is the product of the submatrix \f$ H_{AA} \f$ with `direction`, where \f$ A \f$ is given by
+         * `indices`. Thus, `direction` and `target` contain one entry for each index, and the variables that are not
+         * in `indices` are treated as fixed. This allows solvers that work on a subset of the variables, such as
+         * \ref solvers::ActiveSetNewton, to run CG on the reduced system. The default implementation scatters
+         * `direction` into a full-sized temporary vector and calls `hessian_times_direction()`, so derived classes
+         * should override it if the product can be computed in time proportional to the size of the subset.
+         * \param location Where should the Hessian be calculated.
+         * \param indices Sorted, unique indices of the variables that make up the subset.
+         * \param direction Vector to multiply with the Hessian, with `indices.size()` entries.
+         * \param target Reference to a buffer of size `indices.size()` where the resulting vector will be placed.
+         */
+        void hessian_times_direction_restricted(const HashVector& location,
+                                                const std::vector<long>& indices,
+                                                const DenseRealVector& direction,
+                                                Eigen::Ref<DenseRealVector> target);
+
         /*!
          * \brief Combines the calculation of gradient and pre-conditioner, which may be more efficient in some cases.
          * \details See `gradient()` and `get_diag_preconditioner()` for details. The default implementation just
@@ -161,6 +193,14 @@ namespace dismec::objective
                 const DenseRealVector& direction,
                 Eigen::Ref<DenseRealVector> target) = 0;
 
+        /// The function that does the actual computation. This is called in `hessian_times_direction_restricted()`
+        /// after the arguments have been validated. The default implementation goes through the full-sized product.
+        virtual void hessian_times_direction_restricted_unchecked(
+                const HashVector& location,
+                const std::vector<long>& indices,
+                const DenseRealVector& direction,
+                Eigen::Ref<DenseRealVector> target);
+
         /// The function that does the actual computation. This is called in `gradient_at_zero()` after
         /// the argument has been validated. The default implementation is rather inefficient and creates a new
         /// temporary zero vector.
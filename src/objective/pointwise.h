@@ -9,6 +9,7 @@
 #include "objective.h"
 #include "utils/hash_vector.h"
 #include "utils/throw_error.h"
+#include "utils/conversion.h"
 
 namespace dismec::objective {
     /*!
@@ -52,6 +53,11 @@ namespace dismec::objective {
                                                const DenseRealVector& direction,
                                                Eigen::Ref<DenseRealVector> target) override;
 
+        void hessian_times_direction_restricted_unchecked(const HashVector& location,
+                                                          const std::vector<long>& indices,
+                                                          const DenseRealVector& direction,
+                                                          Eigen::Ref<DenseRealVector> target) override;
+
         void gradient_unchecked(const HashVector& location, Eigen::Ref<DenseRealVector> target) override;
 
         void gradient_at_zero_unchecked(Eigen::Ref<DenseRealVector> target) override;
@@ -139,6 +145,24 @@ namespace dismec::objective {
             target.coeffRef(loop_bound) = real_t{0};
     }
 
+    template<class T>
+    void PointWiseRegularizer<T>::hessian_times_direction_restricted_unchecked(
+            const HashVector& location,
+            const std::vector<long>& indices,
+            const DenseRealVector& direction,
+            Eigen::Ref<DenseRealVector> target) {
+        // the hessian is diagonal, so the restriction only needs to look at the selected coefficients.
+        long loop_bound = get_loop_bound(location);
+        for (long k = 0; k < ssize(indices); ++k) {
+            long i = indices[k];
+            if(i < loop_bound) {
+                target.coeffRef(k) = m_Scale * point_wise_quad_(location->coeff(i)) * direction.coeff(k);
+            } else {
+                target.coeffRef(k) = real_t{0};
+            }
+        }
+    }
+
     template<class T>
     void PointWiseRegularizer<T>::gradient_unchecked(const HashVector& location, Eigen::Ref<DenseRealVector> target) {
         long loop_bound = get_loop_bound(location);
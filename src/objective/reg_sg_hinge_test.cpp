@@ -34,11 +34,10 @@ TEST_CASE("hessian_times_direction_sum") {
 
     htd_sum(indices, output, features, costs, direction);
 
-    if(output != reference) {
-        for(int i = 0; i < num_ftr; ++i) {
-            DOCTEST_CAPTURE(i);
-            REQUIRE(output.coeff(i) == reference.coeff(i));
-        }
+    // the vectorized kernels use a different summation order, so we cannot expect bitwise equality
+    for(int i = 0; i < num_ftr; ++i) {
+        DOCTEST_CAPTURE(i);
+        REQUIRE(output.coeff(i) == doctest::Approx(reference.coeff(i)));
     }
 }
 
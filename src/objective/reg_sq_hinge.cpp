@@ -7,7 +7,7 @@
 
 #include <utility>
 #include "utils/hash_vector.h"
-#include "utils/fast_sparse_row_iter.h"
+#include "utils/sparse_kernels.h"
 #include "reg_sq_hinge_detail.h"
 #include "spdlog/spdlog.h"
 #include "stats/collection.h"
@@ -17,7 +17,7 @@ using namespace dismec::l2_reg_sq_hinge_detail;
 
 namespace {
     using dismec::stats::stat_id_t;
-    constexpr const stat_id_t STAT_GRAD_SPARSITY{8};
+    constexpr const stat_id_t STAT_GRAD_SPARSITY{9};
 }
 
 Regularized_SquaredHingeSVC::Regularized_SquaredHingeSVC(std::shared_ptr<const GenericFeatureMatrix> X,
@@ -40,7 +40,24 @@ void Regularized_SquaredHingeSVC::hessian_times_direction_imp(
         const HashVector& location, const DenseRealVector& direction, Eigen::Ref<DenseRealVector> output)
 {
     margin_error(location);
-    htd_sum(m_MVPos, output, features(), costs(), direction);
+    htd_sum(m_MVPos.data(), m_NumMV, output, features(), costs(), direction);
+}
+
+void Regularized_SquaredHingeSVC::hessian_times_direction_restricted_imp(
+        const HashVector& location, const std::vector<long>& indices, const DenseRealVector& direction,
+        Eigen::Ref<DenseRealVector> output)
+{
+    if(location.hash() != m_Last_Curvature) {
+        margin_error(location);
+        const auto& cost_vec = costs();
+        m_Curvature.setZero(cost_vec.size());
+        for (long i = 0; i < m_NumMV; ++i) {
+            int pos = m_MVPos[i];
+            m_Curvature.coeffRef(pos) = real_t{2.0} * cost_vec.coeff(pos);
+        }
+        m_Last_Curvature = location.hash();
+    }
+    add_restricted_hessian_product(m_Curvature, indices, direction, output);
 }
 
 void Regularized_SquaredHingeSVC::diag_preconditioner_imp(const HashVector& location, Eigen::Ref<DenseRealVector> target)
@@ -66,29 +83,27 @@ void Regularized_SquaredHingeSVC::gradient_and_pre_conditioner_tpl(const HashVec
     const auto& label_vec = labels();
 
     margin_error(location);
-    record(STAT_GRAD_SPARSITY, static_cast<real_t>(static_cast<double>(100*m_MVPos.size()) / label_vec.size()));
+    record(STAT_GRAD_SPARSITY, static_cast<real_t>(static_cast<double>(100*m_NumMV) / label_vec.size()));
 
     const auto& ft = features();
+    const auto& sparse_ops = kernels::best_kernels();
 
-    long shortlist_size = to_long(m_MVPos.size());
-    for (long i = 0; i < shortlist_size; ++i)
+    for (long i = 0; i < m_NumMV; ++i)
     {
         int pos = m_MVPos[i];
         real_t cost = real_t{2.0} * cost_vec[pos];
         real_t vi = - cost * static_cast<real_t>(label_vec.coeff(pos)) * m_MVVal[i];
-        for (FastSparseRowIter it(ft, pos); it; ++it)
-        {
-            if constexpr (calc_grad) {
-                gradient.coeffRef(it.col()) += it.value() * vi;
-            }
-            if constexpr (calc_pre) {
-                pre.coeffRef(it.col()) += it.value() * it.value() * cost;
-            }
+        const auto start = ft.outerIndexPtr()[pos];
+        const auto nnz = ft.outerIndexPtr()[pos + 1] - start;
+        if constexpr (calc_grad) {
+            sparse_ops.axpy(vi, ft.valuePtr() + start, ft.innerIndexPtr() + start, nnz, gradient.data());
+        }
+        if constexpr (calc_pre) {
+            sparse_ops.sq_axpy(cost, ft.valuePtr() + start, ft.innerIndexPtr() + start, nnz, pre.data());
         }
     }
 }
 
-#include <iostream>
 void Regularized_SquaredHingeSVC::gradient_at_zero_imp(Eigen::Ref<DenseRealVector> target) {
     const auto& cost_vec = costs();
     const auto& label_vec = labels();
@@ -98,10 +113,7 @@ void Regularized_SquaredHingeSVC::gradient_at_zero_imp(Eigen::Ref<DenseRealVecto
         real_t cost = real_t{2} * cost_vec[i];
         // margin_error = 1
         real_t vi = -cost * label_vec.coeff(i)  ;
-        for (FastSparseRowIter it(features(), i); it; ++it)
-        {
-            target.coeffRef(it.col()) += it.value() * vi;
-        }
+        kernels::sparse_row_axpy(vi, features(), i, target);
     }
 }
 
@@ -112,6 +124,7 @@ const Regularized_SquaredHingeSVC::features_t& Regularized_SquaredHingeSVC::feat
 void Regularized_SquaredHingeSVC::invalidate_labels() {
     // modifying the true labels invalidates margin caches
     m_Last_MV = {};
+    m_Last_Curvature = {};
 }
 
 void Regularized_SquaredHingeSVC::margin_error(const HashVector& w) {
@@ -119,17 +132,15 @@ void Regularized_SquaredHingeSVC::margin_error(const HashVector& w) {
         return;
     }
 
-    m_MVPos.clear();
-    m_MVVal.clear();
     m_Last_MV = w.hash();
     const auto& lbl = labels();
     const auto& xTw = x_times_w(w);
-    for(Eigen::Index i = 0; i < lbl.size(); ++i) {
-        real_t label = lbl.coeff(i);
-        real_t d = real_t{1.0} - label * xTw.coeff(i);
-        if (d > 0) {
-            m_MVPos.push_back(i);
-            m_MVVal.push_back(d);
-        }
+    // the buffers need space for all instances. They only grow, so that switching between feature subsets of
+    // different sizes does not cause reallocations.
+    if(ssize(m_MVPos) < lbl.size()) {
+        m_MVPos.resize(lbl.size());
+        m_MVVal.resize(lbl.size());
     }
+    m_NumMV = kernels::best_kernels().margin_violators(xTw.data(), lbl.data(), lbl.size(),
+                                                      m_MVPos.data(), m_MVVal.data());
 }
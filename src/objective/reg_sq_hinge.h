@@ -32,6 +32,11 @@ namespace dismec::objective {
                                                const DenseRealVector &direction,
                                                Eigen::Ref<DenseRealVector> target);
 
+        void hessian_times_direction_restricted_imp(const HashVector& location,
+                                                    const std::vector<long>& indices,
+                                                    const DenseRealVector &direction,
+                                                    Eigen::Ref<DenseRealVector> target);
+
         void diag_preconditioner_imp(const HashVector& location, Eigen::Ref<DenseRealVector> target);
 
         void gradient_and_pre_conditioner_imp(const HashVector& location, Eigen::Ref<DenseRealVector> gradient,
@@ -56,9 +61,16 @@ namespace dismec::objective {
         void margin_error(const HashVector& w);
 
         VectorHash m_Last_MV;
-        // do not write to these directly, only `margin_error` is allowed to do that
+        // do not write to these directly, only `margin_error` is allowed to do that.
+        // The buffers have space for all instances, the first `m_NumMV` entries are valid.
         std::vector<int> m_MVPos;
         std::vector<real_t> m_MVVal;
+        long m_NumMV = 0;
+
+        /// per-instance second derivative `2 c_i` for margin violators, and zero otherwise. Only used by
+        /// `hessian_times_direction_restricted_imp`, and valid for the weights with hash `m_Last_Curvature`.
+        DenseRealVector m_Curvature;
+        VectorHash m_Last_Curvature;
 
         template<class T, class U>
         void gradient_and_pre_conditioner_tpl(const HashVector&location, T&& gradient, U&& pre); // __attribute__((hot));
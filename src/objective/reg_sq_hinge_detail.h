@@ -9,7 +9,7 @@
 #include <vector>
 #include "utils/conversion.h"
 #include "matrix_types.h"
-#include "utils/fast_sparse_row_iter.h"
+#include "utils/sparse_kernels.h"
 
 namespace dismec {
     namespace l2_reg_sq_hinge_detail {
@@ -23,58 +23,45 @@ namespace dismec {
             }
         }
 
+        /*!
+         * \brief Accumulates \f$ \sum_{i \in indices} 2 c_i x_i x_i^T d \f$ into `output`.
+         * \details The dot product and the update of `output` are done with the `kernels::SparseKernels` for the
+         * best instruction set of the current CPU.
+         * \tparam LOOK_AHEAD How many rows ahead we prefetch the feature data.
+         */
         template<int LOOK_AHEAD = 2>
-        inline void htd_sum(const std::vector<int>& indices, Eigen::Ref<DenseRealVector> output,
+        inline void htd_sum(const int* indices, long count, Eigen::Ref<DenseRealVector> output,
                             const SparseFeatures& features, const DenseRealVector& costs,
                             const DenseRealVector& direction) {
-            if (indices.empty())
+            if (count == 0)
                 return;
 
+            const auto& sparse_ops = kernels::best_kernels();
             const auto *val_ptr = features.valuePtr();
             const auto *inner_ptr = features.innerIndexPtr();
             const auto *outer_ptr = features.outerIndexPtr();
 
-            long sm1 = ssize(indices) - 1;
-            for (long i = 0; i < ssize(indices); ++i) {
+            long sm1 = count - 1;
+            for (long i = 0; i < count; ++i) {
                 int index = indices[i];
                 int next_index = indices[std::min(i + LOOK_AHEAD, sm1)];
                 int next_id = outer_ptr[next_index];
                 __builtin_prefetch(&val_ptr[next_id], 0, 1);
                 __builtin_prefetch(&inner_ptr[next_id], 0, 1);
 
-                FastSparseRowIter row_iter(features, index);
-                float factor = 0.f;
-                float cost_val = costs.coeff(index);
-                for (FastSparseRowIter it = row_iter; it; ++it) {
-                    factor += it.value() * direction.coeff(it.col());
-                }
-                factor *= 2.f * cost_val;
-                for (FastSparseRowIter it = row_iter; it; ++it) {
-                    output.coeffRef(it.col()) += it.value() * factor;
-                }
+                const auto start = outer_ptr[index];
+                const auto nnz = outer_ptr[index + 1] - start;
+                float factor = sparse_ops.dot(val_ptr + start, inner_ptr + start, nnz, direction.data());
+                factor *= 2.f * costs.coeff(index);
+                sparse_ops.axpy(factor, val_ptr + start, inner_ptr + start, nnz, output.data());
             }
         }
 
-        inline void __attribute__((hot))
-        htd_sum_new(const std::vector<int>& indices, Eigen::Ref<DenseRealVector> output,
-                    const SparseFeatures& features, const DenseRealVector& costs, const DenseRealVector& direction) {
-            const auto *val_ptr = features.valuePtr();
-            const auto *inner_ptr = features.innerIndexPtr();
-            const auto *outer_ptr = features.outerIndexPtr();
-            long sm1 = ssize(indices) - 1;
-
-            for (long i = 0; i < ssize(indices); ++i) {
-                int index = indices[i];
-                int next_index = indices[std::min(i + 2, sm1)];
-                int next_id = outer_ptr[next_index];
-                __builtin_prefetch(&val_ptr[next_id], 0, 1);
-                __builtin_prefetch(&inner_ptr[next_id], 0, 1);
-
-                float factor = 2.f * fast_dot(features, index, direction) * costs.coeff(index);
-                for (FastSparseRowIter it(features, index); it; ++it) {
-                    output.coeffRef(it.col()) += it.value() * factor;
-                }
-            }
+        template<int LOOK_AHEAD = 2>
+        inline void htd_sum(const std::vector<int>& indices, Eigen::Ref<DenseRealVector> output,
+                            const SparseFeatures& features, const DenseRealVector& costs,
+                            const DenseRealVector& direction) {
+            htd_sum<LOOK_AHEAD>(indices.data(), ssize(indices), output, features, costs, direction);
         }
 
         /// Given a vector expression xTw that contains the product of feature matrix and
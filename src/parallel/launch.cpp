@@ -0,0 +1,91 @@
+// Copyright (c) 2021, Aalto University, developed by Erik Schultheis
+// All rights reserved.
+//
+// SPDX-License-Identifier: MIT
+
+#include "parallel/launch.h"
+#include "io/model-io.h"
+#include "utils/throw_error.h"
+#include "spdlog/spdlog.h"
+#include <thread>
+
+using namespace dismec;
+using namespace dismec::parallel;
+
+void parallel::wait_for_running_ranges(LabelRangeQueue& queue, std::chrono::milliseconds poll_interval) {
+    queue.reclaim_timed_out();
+    while(queue.status().Running > 0) {
+        std::this_thread::sleep_for(poll_interval);
+        queue.reclaim_timed_out();
+    }
+}
+
+long parallel::assemble_model(const LabelRangeQueue& queue, const std::filesystem::path& model_file) {
+    auto status = queue.status();
+    if(!status.finished() || status.Failed > 0) {
+        THROW_EXCEPTION(std::runtime_error, "Cannot assemble model: {} label ranges are pending, {} are running and "
+                                            "{} have failed", status.Pending, status.Running, status.Failed);
+    }
+
+    io::PartialModelSaver saver(model_file, io::SaveOption{});
+    long count = 0;
+    for(const auto& [range, part_file] : queue.results()) {
+        saver.merge_partial_model(part_file);
+        ++count;
+    }
+    saver.update_meta_file();
+
+    auto missing = saver.get_missing_weights();
+    if(missing.first.to_index() != saver.num_labels()) {
+        spdlog::warn("Model {} is missing weight vectors {} to {}.", model_file.string(),
+                     missing.first.to_index(), missing.second.to_index() - 1);
+    }
+    return count;
+}
+
+#include "doctest.h"
+#include "model/dense.h"
+
+/*!
+ * \test Simulates a run of `dismec-launch` in which one worker dies without reporting back: Its range is returned to
+ * the queue while waiting, the model cannot be assembled until it has been trained by another worker, and then
+ * contains the partial models of both workers.
+ */
+TEST_CASE("launch and assemble") {
+    std::filesystem::remove_all("test/launch");
+    std::filesystem::create_directories("test/launch");
+    LabelRangeQueue queue("test/launch/queue", std::chrono::milliseconds(50), 3);
+    queue.initialize(label_id_t{0}, label_id_t{10}, 5);
+
+    io::SaveOption options;
+    options.Format = io::WeightFormat::NULL_FORMAT;
+    auto train = [&](const LabelRange& range, const std::string& part_file) {
+        io::PartialModelSaver part(part_file, options);
+        part.add_model(std::make_shared<model::DenseModel>(
+                4, model::PartialModelSpec{range.Begin, range.End - range.Begin, 10}));
+        part.update_meta_file();
+    };
+
+    auto first = queue.acquire("alive");
+    auto second = queue.acquire("dead");
+    REQUIRE(first.has_value());
+    REQUIRE(second.has_value());
+    train(*first, "test/launch/part-a");
+    CHECK(queue.complete(*first, "alive", "test/launch/part-a"));
+
+    // the heartbeat of the dead worker times out, so waiting does not block forever
+    wait_for_running_ranges(queue, std::chrono::milliseconds(10));
+    CHECK(queue.status().Pending == 1);
+    CHECK_THROWS(assemble_model(queue, "test/launch/model"));
+
+    auto retry = queue.acquire("alive");
+    REQUIRE(retry.has_value());
+    CHECK(retry->Begin == second->Begin);
+    train(*retry, "test/launch/part-b");
+    CHECK(queue.complete(*retry, "alive", "test/launch/part-b"));
+
+    CHECK(assemble_model(queue, "test/launch/model") == 2);
+    io::PartialModelLoader loader("test/launch/model");
+    CHECK(loader.num_labels() == 10);
+    CHECK(loader.num_weight_files() == 2);
+}
@@ -0,0 +1,34 @@
+// Copyright (c) 2021, Aalto University, developed by Erik Schultheis
+// All rights reserved.
+//
+// SPDX-License-Identifier: MIT
+
+#ifndef DISMEC_SRC_PARALLEL_LAUNCH_H
+#define DISMEC_SRC_PARALLEL_LAUNCH_H
+
+#include "parallel/work_queue.h"
+#include <chrono>
+#include <filesystem>
+
+namespace dismec::parallel {
+    /*!
+     * \brief Blocks until no range of `queue` is running.
+     * \details While waiting, ranges whose heartbeat has timed out are returned to the queue, so this also terminates
+     * if a worker dies without reporting back. Such ranges are pending afterwards, and need to be trained by another
+     * worker.
+     * \param poll_interval Time between two checks of the queue.
+     */
+    void wait_for_running_ranges(LabelRangeQueue& queue, std::chrono::milliseconds poll_interval);
+
+    /*!
+     * \brief Merges the partial models of all finished ranges of `queue` into the model `model_file`.
+     * \details The partial models are expected to be the results that have been passed to
+     * `LabelRangeQueue::complete()`.
+     * If the partial models do not cover all labels, a warning is logged.
+     * \throws std::runtime_error if there are ranges that are not done.
+     * \return The number of merged partial models.
+     */
+    long assemble_model(const LabelRangeQueue& queue, const std::filesystem::path& model_file);
+}
+
+#endif //DISMEC_SRC_PARALLEL_LAUNCH_H
@@ -0,0 +1,125 @@
+// Copyright (c) 2021, Aalto University, developed by Erik Schultheis
+// All rights reserved.
+//
+// SPDX-License-Identifier: MIT
+
+#include "parallel/pool.h"
+#include "parallel/numa.h"
+#include "utils/throw_error.h"
+
+using namespace dismec::parallel;
+
+ThreadPool::ThreadPool(long num_threads, bool pin_threads, std::shared_ptr<spdlog::logger> logger) {
+    if(pin_threads) {
+        m_Distributor = std::make_unique<ThreadDistributor>(num_threads, std::move(logger));
+    }
+
+    m_Workers.reserve(num_threads);
+    for(long thread = 0; thread < num_threads; ++thread) {
+        m_Workers.emplace_back(&ThreadPool::worker_main, this, thread_id_t{thread}, pin_threads);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_Lock);
+        m_Shutdown = true;
+    }
+    m_WorkAvailable.notify_all();
+    for(auto& worker : m_Workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::execute(long num_threads, const std::function<void(thread_id_t)>& job) {
+    if(num_threads > size()) {
+        THROW_EXCEPTION(std::invalid_argument, "Requested {} threads, but the pool only has {}", num_threads, size());
+    }
+    if(num_threads <= 0) {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(m_Lock);
+    m_Job = &job;
+    m_JobThreads = num_threads;
+    m_NumRunning = num_threads;
+    m_Error = nullptr;
+    ++m_Generation;
+    m_WorkAvailable.notify_all();
+
+    m_WorkDone.wait(lock, [&]() { return m_NumRunning == 0; });
+    m_Job = nullptr;
+
+    if(m_Error) {
+        std::rethrow_exception(std::exchange(m_Error, nullptr));
+    }
+}
+
+void ThreadPool::worker_main(thread_id_t thread_id, bool pin_thread) {
+    if(pin_thread) {
+        m_Distributor->pin_this_thread(thread_id);
+    }
+
+    long seen_generation = 0;
+    std::unique_lock<std::mutex> lock(m_Lock);
+    while(true) {
+        m_WorkAvailable.wait(lock, [&]() { return m_Shutdown || m_Generation != seen_generation; });
+        if(m_Shutdown) {
+            return;
+        }
+        seen_generation = m_Generation;
+        if(thread_id.to_index() >= m_JobThreads) {
+            continue;
+        }
+
+        const auto& job = *m_Job;
+        lock.unlock();
+        std::exception_ptr error;
+        try {
+            job(thread_id);
+        } catch (...) {
+            error = std::current_exception();
+        }
+        lock.lock();
+
+        if(error && !m_Error) {
+            m_Error = error;
+        }
+        if(--m_NumRunning == 0) {
+            m_WorkDone.notify_one();
+        }
+    }
+}
+
+#include "doctest.h"
+
+TEST_CASE("thread pool") {
+    ThreadPool pool(3, false);
+    REQUIRE(pool.size() == 3);
+
+    std::vector<int> counts(3, 0);
+    std::vector<std::thread::id> ids(3);
+    pool.execute(3, [&](thread_id_t id) {
+        counts[id.to_index()] += 1;
+        ids[id.to_index()] = std::this_thread::get_id();
+    });
+    CHECK(counts == std::vector<int>{1, 1, 1});
+
+    // subsequent jobs run on the same threads, and may use only some of them
+    for(int i = 0; i < 10; ++i) {
+        pool.execute(2, [&](thread_id_t id) {
+            counts[id.to_index()] += 1;
+            CHECK(ids[id.to_index()] == std::this_thread::get_id());
+        });
+    }
+    CHECK(counts == std::vector<int>{11, 11, 1});
+
+    // exceptions are forwarded to the caller, and the pool remains usable
+    CHECK_THROWS_AS(pool.execute(3, [](thread_id_t id) {
+        if(id.to_index() == 1) throw std::runtime_error("error");
+    }), std::runtime_error);
+    pool.execute(3, [&](thread_id_t id) { counts[id.to_index()] += 1; });
+    CHECK(counts == std::vector<int>{12, 12, 2});
+
+    CHECK_THROWS(pool.execute(4, [](thread_id_t) {}));
+}
@@ -0,0 +1,72 @@
+// Copyright (c) 2021, Aalto University, developed by Erik Schultheis
+// All rights reserved.
+//
+// SPDX-License-Identifier: MIT
+
+#ifndef DISMEC_SRC_PARALLEL_POOL_H
+#define DISMEC_SRC_PARALLEL_POOL_H
+
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "thread_id.h"
+#include "spdlog/fwd.h"
+
+namespace dismec::parallel {
+    class ThreadDistributor;
+
+    /*!
+     * \brief A fixed set of worker threads that can run successive jobs.
+     * \details The threads are created (and optionally pinned to their cores) once in the constructor, and then wait
+     * until a job is submitted with `execute()`. This avoids the cost of spawning and pinning new threads for every
+     * parallel operation. The threads are joined in the destructor.
+     */
+    class ThreadPool {
+    public:
+        /*!
+         * \brief Creates the pool and starts its threads.
+         * \param num_threads Number of worker threads.
+         * \param pin_threads If true, the workers are pinned to cores using a `ThreadDistributor`.
+         * \param logger Logger that is given to the `ThreadDistributor`.
+         */
+        ThreadPool(long num_threads, bool pin_threads, std::shared_ptr<spdlog::logger> logger = {});
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        /// Returns the number of worker threads.
+        [[nodiscard]] long size() const { return static_cast<long>(m_Workers.size()); }
+
+        /*!
+         * \brief Runs `job` on the first `num_threads` workers, and waits until all of them have finished.
+         * \details Each worker calls `job` with its own thread id. If `job` throws an exception in any of the workers,
+         * the first such exception is re-thrown here, after all workers have finished.
+         * \param num_threads Number of workers to use. Must not be larger than `size()`.
+         */
+        void execute(long num_threads, const std::function<void(thread_id_t)>& job);
+    private:
+        void worker_main(thread_id_t thread_id, bool pin_thread);
+
+        std::unique_ptr<ThreadDistributor> m_Distributor;
+        std::vector<std::thread> m_Workers;
+
+        std::mutex m_Lock;
+        std::condition_variable m_WorkAvailable;
+        std::condition_variable m_WorkDone;
+
+        // state of the current job. Protected by `m_Lock`.
+        const std::function<void(thread_id_t)>* m_Job = nullptr;
+        long m_JobThreads = 0;      //!< Number of workers that take part in the current job.
+        long m_Generation = 0;      //!< Incremented for each job, so that workers can recognize new work.
+        long m_NumRunning = 0;      //!< Number of workers that have not yet finished the current job.
+        std::exception_ptr m_Error;
+        bool m_Shutdown = false;
+    };
+}
+
+#endif //DISMEC_SRC_PARALLEL_POOL_H
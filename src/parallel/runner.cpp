@@ -6,10 +6,12 @@
 #include <algorithm>
 #include <thread>
 #include <atomic>
+#include <mutex>
 #include "config.h"
 #include "parallel/runner.h"
 #include "parallel/task.h"
 #include "parallel/numa.h"
+#include "parallel/pool.h"
 #include "utils/conversion.h"
 
 using namespace dismec;
@@ -21,10 +23,16 @@ ParallelRunner::ParallelRunner(long num_threads, long chunk_size) :
 
 }
 
+ParallelRunner::~ParallelRunner() = default;
+
 void ParallelRunner::set_chunk_size(long chunk_size) {
     m_ChunkSize = chunk_size;
 }
 
+void ParallelRunner::set_adaptive_chunk_size(std::chrono::microseconds target) {
+    m_AdaptiveTarget = target;
+}
+
 void ParallelRunner::set_logger(std::shared_ptr<spdlog::logger> logger) {
     m_Logger = std::move(logger);
 }
@@ -34,6 +42,115 @@ namespace {
     auto to_ms(T&& arg) {
         return std::chrono::duration_cast<std::chrono::milliseconds>(arg);
     }
+
+    /*!
+     * \brief The range of tasks that still need to be run by one thread.
+     * \details The owning thread takes tasks from the front, other threads steal from the back. Most of the time, only
+     * the owner accesses the range, so the lock is uncontended. Each range gets its own cache line, so that taking
+     * tasks does not interfere with the other threads.
+     */
+    struct alignas(64) TaskRange {
+        std::mutex Lock;
+        long Begin = 0;
+        long End = 0;
+
+        /// Removes up to `count` tasks from the front, and returns them as `[begin, end)`.
+        std::pair<long, long> pop_front(long count) {
+            std::lock_guard<std::mutex> lock(Lock);
+            long begin = Begin;
+            Begin = std::min(Begin + count, End);
+            return {begin, Begin};
+        }
+
+        /// Removes the back half of the remaining tasks, and returns them as `[begin, end)`.
+        std::pair<long, long> steal_back() {
+            std::lock_guard<std::mutex> lock(Lock);
+            long stolen = (End - Begin + 1) / 2;
+            long end = End;
+            End -= stolen;
+            return {End, end};
+        }
+
+        long remaining() {
+            std::lock_guard<std::mutex> lock(Lock);
+            return End - Begin;
+        }
+
+        void assign(long begin, long end) {
+            std::lock_guard<std::mutex> lock(Lock);
+            Begin = begin;
+            End = end;
+        }
+    };
+
+    /*!
+     * \brief Chooses the chunk sizes of a single thread in adaptive mode.
+     * \details This starts with chunks of a single task. After each chunk, the time per task is updated as an
+     * exponential moving average of the measurements, and the next chunk is sized such that it takes about `target`
+     * time. To prevent a single fast chunk from causing a huge jump, the size grows by at most a factor of two per
+     * step.
+     */
+    class AdaptiveChunkSize {
+    public:
+        AdaptiveChunkSize(std::chrono::microseconds target, long max_size) : m_Target(target), m_MaxSize(max_size) {
+        }
+
+        [[nodiscard]] long size() const { return m_Size; }
+
+        /// Updates the chunk size after a chunk of `num_tasks` tasks has taken `elapsed` time.
+        void record(std::chrono::nanoseconds elapsed, long num_tasks) {
+            double measured = std::chrono::duration<double, std::micro>(elapsed).count() / static_cast<double>(num_tasks);
+            m_TimePerTask = m_TimePerTask < 0 ? measured : 0.5 * m_TimePerTask + 0.5 * measured;
+            double ideal = static_cast<double>(m_Target.count()) / std::max(m_TimePerTask, 1e-3);
+            double limited = std::min(ideal, 2.0 * static_cast<double>(m_Size));
+            m_Size = std::clamp(static_cast<long>(limited), 1l, m_MaxSize);
+        }
+    private:
+        std::chrono::microseconds m_Target;
+        long m_MaxSize;
+        long m_Size = 1;
+        double m_TimePerTask = -1;      // in µs
+    };
+
+    /// Returns the index of the range with the most remaining tasks, or -1 if all ranges are empty.
+    long find_victim(std::vector<TaskRange>& ranges) {
+        long victim = -1;
+        long most_work = 0;
+        for(long i = 0; i < ssize(ranges); ++i) {
+            long work = ranges[i].remaining();
+            if(work > most_work) {
+                most_work = work;
+                victim = i;
+            }
+        }
+        return victim;
+    }
+}
+
+long parallel::initial_range_begin(long num_tasks, long num_threads, long thread) {
+    return (num_tasks * thread) / num_threads;
+}
+
+std::vector<long> parallel::interleave_across_threads(const std::vector<long>& order, long num_threads) {
+    long num_tasks = ssize(order);
+    num_threads = std::max(1l, std::min(num_threads, num_tasks));
+    std::vector<long> next_slot(num_threads);
+    for(long t = 0; t < num_threads; ++t) {
+        next_slot[t] = initial_range_begin(num_tasks, num_threads, t);
+    }
+
+    std::vector<long> result(order.size());
+    long thread = 0;
+    for(long task : order) {
+        // ranges can differ in size by one, so the smaller ones fill up in the last round
+        while(next_slot[thread] == initial_range_begin(num_tasks, num_threads, thread + 1)) {
+            thread = (thread + 1) % num_threads;
+        }
+        result[next_slot[thread]] = task;
+        ++next_slot[thread];
+        thread = (thread + 1) % num_threads;
+    }
+    return result;
 }
 
 RunResult ParallelRunner::run(TaskGenerator& tasks, long start) {
@@ -51,6 +168,12 @@ RunResult ParallelRunner::run(TaskGenerator& tasks, long start) {
         num_threads = static_cast<long>(std::thread::hardware_concurrency());
     }
 
+    // the pool is sized for the maximum number of threads, even if the current run needs fewer of them
+    if(!m_Pool || m_Pool->size() < num_threads) {
+        m_Pool.reset();
+        m_Pool = std::make_unique<ThreadPool>(num_threads, m_BindThreads, m_Logger);
+    }
+
     long num_tasks = tasks.num_tasks() - start;
     long num_chunks = num_tasks / m_ChunkSize;
     if(num_tasks % m_ChunkSize != 0) {
@@ -59,84 +182,118 @@ RunResult ParallelRunner::run(TaskGenerator& tasks, long start) {
     num_threads = std::min(num_threads, num_chunks);
 
     std::atomic<std::size_t> cpu_time{0};
-
-    // we need an atomic counter to make sure that all sub-problems are touched exactly once
-    std::atomic<long> sub_counter{0};
-    // long sub_counter = start;
-    // nothing we can do if the counter isn't lock free, but notify the user.
-    if(!sub_counter.is_lock_free()) {
-        spdlog::warn("Counter implementation is not lock-free. This might result in degraded performance in case of many threads");
+    std::atomic<long> num_steals{0};
+    std::atomic<long> tasks_done{0};
+    std::atomic<long> chunks_done{0};
+    bool adaptive = m_AdaptiveTarget.count() > 0;
+    std::vector<long> final_chunk_sizes(num_threads, m_ChunkSize);
+
+    // pre-partition the tasks into contiguous ranges, one per thread
+    std::vector<TaskRange> ranges(num_threads);
+    for(long t = 0; t < num_threads; ++t) {
+        ranges[t].Begin = start + initial_range_begin(num_tasks, num_threads, t);
+        ranges[t].End = start + initial_range_begin(num_tasks, num_threads, t + 1);
     }
+    std::vector<steady_clock::time_point> exit_times(num_threads);
 
     auto start_time = steady_clock::now();
 
-    std::vector<std::thread> workers;
-    workers.reserve(num_threads);
     if(m_Logger)
-        m_Logger->info("spawning {} threads to run {} tasks", num_threads, num_tasks);
+        m_Logger->info("using {} threads to run {} tasks", num_threads, num_tasks);
 
     tasks.prepare(num_threads, m_ChunkSize);
-    ThreadDistributor distribute(num_threads, m_Logger);
 
-    for(int thread = 0; thread < num_threads; ++thread) {
-        workers.emplace_back([&, thread_id=thread_id_t(thread)]()
+    m_Pool->execute(num_threads, [&](thread_id_t thread_id)
         {
-             if(m_BindThreads) {
-                 distribute.pin_this_thread(thread_id);
-             }
-
              tasks.init_thread(thread_id);
 
+             TaskRange& own = ranges[thread_id.to_index()];
+             AdaptiveChunkSize adaptive_size(m_AdaptiveTarget, m_ChunkSize);
+             long chunk_size = adaptive ? adaptive_size.size() : m_ChunkSize;
              while(to_ms(steady_clock::now() - start_time) < m_TimeLimit) {
                  // get a new sub-problem
-                 // see also https://stackoverflow.com/questions/41206861/atomic-increment-and-return-counter
-                 long search_pos = sub_counter++;
-                 if(search_pos >= num_chunks) {
-                     return;
+                 auto [begin_task, end_task] = own.pop_front(chunk_size);
+                 if(begin_task == end_task) {
+                     // out of work, so try to steal from the thread which has the most work left.
+                     // If stealing fails because the victim has run out of work in the meantime, just try again.
+                     long victim = find_victim(ranges);
+                     if(victim < 0) {
+                         break;
+                     }
+                     auto [steal_begin, steal_end] = ranges[victim].steal_back();
+                     if(steal_begin != steal_end) {
+                         own.assign(steal_begin, steal_end);
+                         ++num_steals;
+                     }
+                     continue;
                  }
 
                  auto task_start_time = steady_clock::now();
 
-                 long begin_task = search_pos * m_ChunkSize + start;
-                 long end_task = std::min((search_pos + 1) * m_ChunkSize, (long)num_tasks) + start;
-
                  log_start(begin_task, end_task);
                  tasks.run_tasks(begin_task, end_task, thread_id);
                  log_finished(begin_task, end_task);
 
-                 cpu_time.fetch_add( to_ms(steady_clock::now() - task_start_time).count());
+                 auto elapsed = steady_clock::now() - task_start_time;
+                 tasks_done += end_task - begin_task;
+                 ++chunks_done;
+                 cpu_time.fetch_add( to_ms(elapsed).count());
+
+                 if(adaptive) {
+                     adaptive_size.record(elapsed, end_task - begin_task);
+                     chunk_size = adaptive_size.size();
+                 }
              }
+             final_chunk_sizes[thread_id.to_index()] = chunk_size;
+             exit_times[thread_id.to_index()] = steady_clock::now();
         });
-    }
-
-    // OK, now we just have to wait for the threads to finnish
-    for(auto& t : workers) {
-        t.join();
-    }
 
     tasks.finalize();
 
-    auto wall_time = to_ms(steady_clock::now() - start_time);
+    auto end_time = steady_clock::now();
+    auto wall_time = to_ms(end_time - start_time);
+    milliseconds idle_time{0};
+    for(const auto& exit_time : exit_times) {
+        idle_time += to_ms(end_time - exit_time);
+    }
+
+    // after a timeout, the remaining tasks are still in the ranges. Since threads steal from the back, the tasks
+    // before the first unfinished one have all been run.
+    long next_task = num_tasks + start;
+    for(auto& range : ranges) {
+        if(range.Begin != range.End) {
+            next_task = std::min(next_task, range.Begin);
+        }
+    }
+    bool is_finished = next_task == num_tasks + start;
 
     if(m_Logger) {
-        if(sub_counter >= num_chunks) {
-            m_Logger->info("Threads finished after {}s (per thread {}s).", wall_time.count() / 1000,
-                           cpu_time / 1000 / num_threads);
+        if(is_finished) {
+            m_Logger->info("Threads finished after {}s (per thread {}s, {} steals, {}ms idle).", wall_time.count() / 1000,
+                           cpu_time / 1000 / num_threads, num_steals, idle_time.count());
         } else {
             m_Logger->info("Computation timeout ({}s) reached after {} tasks ({}s -- {}s per thread)",
                            m_TimeLimit.count() / 1000,
-                           sub_counter, wall_time.count() / 1000, cpu_time / 1000 / num_threads);
+                           tasks_done, wall_time.count() / 1000, cpu_time / 1000 / num_threads);
         }
     }
 
-    // display a warning if threads need to get new work more than every 5 ms.
-    if((cpu_time * m_ChunkSize) / num_tasks < MIN_TIME_PER_CHUNK_MS) {
+    double mean_chunk_size = chunks_done > 0 ? static_cast<double>(tasks_done) / static_cast<double>(chunks_done) : 0.0;
+    if(adaptive) {
+        auto [min_size, max_size] = std::minmax_element(begin(final_chunk_sizes), end(final_chunk_sizes));
+        if(m_Logger)
+            m_Logger->info("Adaptive chunk size (target {}µs, limit {}): {:.1f} tasks per chunk on average, final sizes {}-{}.",
+                           m_AdaptiveTarget.count(), m_ChunkSize, mean_chunk_size,
+                           min_size == end(final_chunk_sizes) ? 0 : *min_size,
+                           max_size == end(final_chunk_sizes) ? 0 : *max_size);
+    } else if((cpu_time * m_ChunkSize) / num_tasks < MIN_TIME_PER_CHUNK_MS) {
+        // display a warning if threads need to get new work more than every 5 ms.
         spdlog::warn("The average time per chunk of work is only {}µs, consider increasing chunk size (currently {}) to "
                      "reduce parallelization overhead.", (1000 * cpu_time * m_ChunkSize) / num_tasks, m_ChunkSize);
     }
 
-    return {sub_counter >= num_chunks, sub_counter * m_ChunkSize + start,
-            std::chrono::duration_cast<std::chrono::seconds>(wall_time)};
+    return {is_finished, next_task, std::chrono::duration_cast<std::chrono::seconds>(wall_time),
+            num_steals, idle_time, mean_chunk_size};
 }
 
 void ParallelRunner::log_start(long begin, long end) {
@@ -225,12 +382,114 @@ TEST_CASE("run parallel with timeout") {
     auto res = runner.run(task, 5);
     REQUIRE_FALSE(res.IsFinished);
 
-    // check that NextTask correctly identifies until where we have done our work
+    // check that NextTask correctly identifies until where we have done our work. Tasks after NextTask may have been
+    // run by other threads, but each at most once.
     for(int s = 5; s < res.NextTask; ++s) {
         REQUIRE(task.check[s] == 1);
-    }for(int s = res.NextTask; s < ssize(task.check); ++s) {
-        REQUIRE(task.check[s] == 0);
     }
+    REQUIRE(task.check[res.NextTask] == 0);
+    for(int s = res.NextTask; s < ssize(task.check); ++s) {
+        REQUIRE(task.check[s] <= 1);
+    }
+}
+
+TEST_CASE("adaptive chunk size") {
+    struct ChunkTask : DummyTask {
+        void prepare(long num_threads, long chunk_size) override {
+            max_chunk = chunk_size;
+        }
+        void run_tasks(long begin, long end, thread_id_t thread_id) override {
+            largest = std::max(largest, end - begin);
+            for(long t = begin; t < end; ++t) {
+                check.at(t) += 1;
+            }
+        }
+        long max_chunk = 0;
+        long largest = 0;
+    };
+
+    ParallelRunner runner{1, 64};
+    runner.set_adaptive_chunk_size(std::chrono::microseconds(200));
+    ChunkTask task;
+    auto res = runner.run(task);
+    REQUIRE(res.IsFinished);
+    for(int s = 0; s < ssize(task.check); ++s) {
+        REQUIRE_MESSAGE(task.check[s] == 1, "error at index " << s);
+    }
+
+    // chunks never exceed the size announced in prepare()
+    CHECK(task.max_chunk == 64);
+    CHECK(task.largest <= 64);
+    CHECK(res.MeanChunkSize >= 1);
+    CHECK(res.MeanChunkSize <= 64);
+}
+
+/*! \test This checks the adaptation of the chunk size with given durations, independent of the actual timing.
+ */
+TEST_CASE("adaptive chunk size steps") {
+    using std::chrono::microseconds;
+    AdaptiveChunkSize adaptive(microseconds(200), 64);
+    CHECK(adaptive.size() == 1);
+
+    // at 10µs per task, the target size is 20, which is reached by doubling
+    for(long expected : {2, 4, 8, 16, 20, 20}) {
+        adaptive.record(microseconds(10 * adaptive.size()), adaptive.size());
+        CHECK(adaptive.size() == expected);
+    }
+
+    // if tasks become slower, the size shrinks immediately, with the time per task being averaged
+    adaptive.record(microseconds(100 * 20), 20);
+    CHECK(adaptive.size() == 3);
+
+    // very fast tasks are limited by the maximum size
+    for(int i = 0; i < 10; ++i) {
+        adaptive.record(microseconds(0), adaptive.size());
+    }
+    CHECK(adaptive.size() == 64);
+}
+
+TEST_CASE("work stealing") {
+    struct UnevenTask : DummyTask {
+        void run_tasks(long begin, long end, thread_id_t thread_id) override {
+            for(long t = begin; t < end; ++t) {
+                check.at(t) += 1;
+                // all the expensive tasks are in the range of the first thread
+                if(t < 20) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+                }
+            }
+        }
+        [[nodiscard]] long num_tasks() const override {
+            return 60;
+        }
+    };
+
+    ParallelRunner runner{3};
+    UnevenTask task;
+    auto res = runner.run(task);
+    REQUIRE(res.IsFinished);
+    CHECK(res.NextTask == 60);
+    CHECK(res.NumSteals > 0);
+    for(int s = 0; s < 60; ++s) {
+        REQUIRE_MESSAGE(task.check[s] == 1, "error at index " << s);
+    }
+}
+
+/*! \test This checks that `interleave_across_threads` gives each initial range of the runner one of the most
+ * expensive tasks, and keeps each range sorted by decreasing cost.
+ */
+TEST_CASE("interleave across threads") {
+    // tasks 0-6, sorted by decreasing cost
+    std::vector<long> order = {6, 5, 4, 3, 2, 1, 0};
+    auto interleaved = interleave_across_threads(order, 3);
+    // initial ranges are [0, 2), [2, 4), [4, 7)
+    CHECK(initial_range_begin(7, 3, 1) == 2);
+    CHECK(initial_range_begin(7, 3, 2) == 4);
+    CHECK(interleaved == std::vector<long>{6, 3, 5, 2, 4, 1, 0});
+
+    CHECK(interleave_across_threads(order, 1) == order);
+    CHECK(interleave_across_threads(order, 10) == order);
+    CHECK(interleave_across_threads({}, 4).empty());
 }
 
 // TODO check chunks, starts etc
\ No newline at end of file
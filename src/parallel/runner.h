@@ -9,33 +9,78 @@
 #include <functional>
 #include <memory>
 #include <chrono>
+#include <vector>
 #include "spdlog/spdlog.h"
 
 namespace dismec::parallel {
     class TaskGenerator;
+    class ThreadPool;
 
     struct RunResult {
         bool IsFinished = false;        //!< If this is true, then all tasks have been run successfully
-        long NextTask = -1;             //!< If running timed out before all tasks were done, this is the task
-        //!< with which a subsequent run should start.
+        long NextTask = -1;             //!< If running timed out before all tasks were done, this is the first task
+        //!< that has not been run. All tasks before have been completed, but some of the later tasks may have been run,
+        //!< too. A subsequent run should start with this task.
         // timing info
         std::chrono::seconds Duration;  //!< How long did this run take.
+        long NumSteals = 0;             //!< How often an idle thread has taken over work from another thread.
+        std::chrono::milliseconds IdleTime{0}; //!< Total time threads spent waiting for the others to finish.
+        double MeanChunkSize = 0;       //!< Average number of tasks per call to `TaskGenerator::run_tasks()`.
     };
 
+    /*!
+     * \brief Returns the first task of the contiguous range that `ParallelRunner::run()` initially assigns to `thread`.
+     * \details The range of `thread` is `[initial_range_begin(n, k, thread), initial_range_begin(n, k, thread + 1))`,
+     * counted relative to the start task of the run.
+     */
+    [[nodiscard]] long initial_range_begin(long num_tasks, long num_threads, long thread);
+
+    /*!
+     * \brief Rearranges a sequence of tasks that is sorted by decreasing cost, so that each thread starts with a similar
+     * share of the expensive tasks.
+     * \details If tasks in `order` are run as given, the initial range of the first thread contains all the most
+     * expensive tasks. Instead, the tasks are dealt out round-robin to the initial ranges of `num_threads` threads,
+     * (longest processing time first), so that each range is still sorted by decreasing cost.
+     */
+    [[nodiscard]] std::vector<long> interleave_across_threads(const std::vector<long>& order, long num_threads);
+
+    /*!
+     * \brief Runs the tasks of a `TaskGenerator` in parallel.
+     * \details The worker threads are created (and pinned) on the first call to `run()`, and are reused by all
+     * subsequent calls, so running many small jobs (e.g. one per batch of labels, or one per weight file) does not
+     * pay for thread creation each time.
+     */
     class ParallelRunner {
     public:
         /// @param num_threads Number of threads to use. Value <= 0 indicate auto-detect,
         /// using `std::thread::hardware_concurrency()`
         explicit ParallelRunner(long num_threads, long chunk_size=1);
+        ~ParallelRunner();
+
+        ParallelRunner(const ParallelRunner&) = delete;
+        ParallelRunner& operator=(const ParallelRunner&) = delete;
 
         void set_chunk_size(long chunk_size);
         void set_time_limit(std::chrono::milliseconds time_limit);
 
+        /*!
+         * \brief Enables automatic tuning of the chunk size.
+         * \details In adaptive mode, each thread measures the time per task while it is running, and chooses the size
+         * of its next chunk such that it takes about `target` time. The chunk size set by `set_chunk_size()` is used as
+         * the upper limit. This is also the size that is given to `TaskGenerator::prepare()`, so buffers that are sized
+         * for one chunk (e.g. the prediction cache of `TopKPredictionTaskGenerator`) remain valid.
+         * The chosen sizes are logged after each run. A `target` of zero disables adaptive mode.
+         */
+        void set_adaptive_chunk_size(std::chrono::microseconds target);
+
         /// sets the logger object that is used for reporting. Set to nullptr for quiet mode.
         void set_logger(std::shared_ptr<spdlog::logger> logger);
 
         /*!
          * Runs the tasks provided by the `TaskGenerator` in parallel.
+         * \details The tasks are split into contiguous ranges, one for each thread. Each thread processes its own range
+         * from the front, in chunks of `chunk_size` tasks. Once a thread runs out of work, it steals the back half of
+         * the remaining range of the thread that has the most work left.
          * @param tasks The task generator that returns a runnable function for each task index.
          * @param start The first task id to run.
          */
@@ -49,10 +94,14 @@ namespace dismec::parallel {
 
         long m_NumThreads;
         long m_ChunkSize = 1;
+        std::chrono::microseconds m_AdaptiveTarget{0};
         std::chrono::milliseconds m_TimeLimit;
         std::shared_ptr<spdlog::logger> m_Logger;
 
         bool m_BindThreads = true;
+
+        /// The worker threads. Created on first use.
+        std::unique_ptr<ThreadPool> m_Pool;
     };
 }
 
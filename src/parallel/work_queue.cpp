@@ -0,0 +1,371 @@
+// Copyright (c) 2021, Aalto University, developed by Erik Schultheis
+// All rights reserved.
+//
+// SPDX-License-Identifier: MIT
+
+#include "parallel/work_queue.h"
+#include "utils/throw_error.h"
+#include "spdlog/spdlog.h"
+#include "nlohmann/json.hpp"
+#include <cerrno>
+#include <fstream>
+#include <iomanip>
+#include <fcntl.h>
+#include <unistd.h>
+
+using json = nlohmann::json;
+using namespace dismec;
+using namespace dismec::parallel;
+
+namespace {
+    constexpr const char* STATE_FILE = "queue.json";
+    constexpr const char* LOCK_FILE = "queue.lock";
+
+    constexpr const char* PENDING = "pending";
+    constexpr const char* RUNNING = "running";
+    constexpr const char* DONE = "done";
+    constexpr const char* FAILED = "failed";
+
+    /*!
+     * \brief Exclusive lock on a file, which is released in the destructor.
+     * \details This uses open file description locks, which belong to the file descriptor opened here instead of the
+     * process. Thus, two `FileLock`s exclude each other even within the same process, and releasing one of them does
+     * not affect other locks that the process holds on the same file.
+     */
+    class FileLock {
+    public:
+        explicit FileLock(const std::filesystem::path& file) {
+            m_FileDescriptor = ::open(file.c_str(), O_RDWR | O_CREAT, 0644);
+            if(m_FileDescriptor < 0) {
+                THROW_EXCEPTION(std::runtime_error, "Could not open lock file {}", file.string());
+            }
+            struct flock lock{};
+            lock.l_type = F_WRLCK;
+            lock.l_whence = SEEK_SET;
+            lock.l_pid = 0;     // required for open file description locks
+            while(::fcntl(m_FileDescriptor, F_OFD_SETLKW, &lock) != 0) {
+                if(errno != EINTR) {
+                    ::close(m_FileDescriptor);
+                    THROW_EXCEPTION(std::runtime_error, "Could not lock file {}", file.string());
+                }
+            }
+        }
+        ~FileLock() {
+            // closing the file releases the lock
+            ::close(m_FileDescriptor);
+        }
+        FileLock(const FileLock&) = delete;
+        FileLock& operator=(const FileLock&) = delete;
+    private:
+        int m_FileDescriptor;
+    };
+
+    long now_ms() {
+        using namespace std::chrono;
+        return duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+    }
+
+    json read_state(const std::filesystem::path& directory) {
+        std::ifstream source(directory / STATE_FILE);
+        if(!source.is_open()) {
+            return json{};
+        }
+        return json::parse(source);
+    }
+
+    /// Writes the new state to a temporary file, and renames it, so that the state file is never incomplete.
+    void write_state(const std::filesystem::path& directory, const json& state) {
+        auto temp_file = directory / (std::string(STATE_FILE) + ".tmp");
+        {
+            std::ofstream target(temp_file);
+            target << std::setw(4) << state << "\n";
+            if(!target.good()) {
+                THROW_EXCEPTION(std::runtime_error, "Could not write queue state to {}", temp_file.string());
+            }
+        }
+        std::filesystem::rename(temp_file, directory / STATE_FILE);
+    }
+
+    LabelRange to_range(const json& entry) {
+        return {label_id_t{entry["begin"].get<long>()}, label_id_t{entry["end"].get<long>()},
+                entry["attempts"].get<long>() - 1};
+    }
+
+    json* find_entry(json& state, const LabelRange& range) {
+        for(auto& entry : state["ranges"]) {
+            if(entry["begin"] == range.Begin.to_index() && entry["end"] == range.End.to_index()) {
+                return &entry;
+            }
+        }
+        return nullptr;
+    }
+
+    bool is_owned_by(const json* entry, const std::string& worker) {
+        return entry != nullptr && entry->at("state") == RUNNING && entry->at("worker") == worker;
+    }
+
+    /// Returns running ranges whose heartbeat is older than `timeout` to the queue, or marks them as failed if they
+    /// have been attempted `max_attempts` times. Returns the number of changed ranges.
+    long reclaim_stale_ranges(json& state, long now, std::chrono::milliseconds timeout, long max_attempts) {
+        long count = 0;
+        for (auto& entry: state["ranges"]) {
+            if(entry["state"] != RUNNING || now - entry["heartbeat"].get<long>() < timeout.count()) {
+                continue;
+            }
+            ++count;
+            if(entry["attempts"].get<long>() >= max_attempts) {
+                spdlog::error("Worker {} timed out on labels {}-{}, giving up after {} attempts",
+                              entry["worker"].get<std::string>(), entry["begin"].get<long>(),
+                              entry["end"].get<long>(), entry["attempts"].get<long>());
+                entry["state"] = FAILED;
+            } else {
+                spdlog::warn("Worker {} timed out on labels {}-{}, returning them to the queue",
+                             entry["worker"].get<std::string>(), entry["begin"].get<long>(), entry["end"].get<long>());
+                entry["state"] = PENDING;
+            }
+        }
+        return count;
+    }
+}
+
+LabelRangeQueue::LabelRangeQueue(std::filesystem::path directory, std::chrono::milliseconds heartbeat_timeout,
+                                 long max_attempts) :
+    m_Directory(std::move(directory)), m_HeartbeatTimeout(heartbeat_timeout), m_MaxAttempts(max_attempts) {
+    std::filesystem::create_directories(m_Directory);
+}
+
+void LabelRangeQueue::initialize(label_id_t begin, label_id_t end, long range_size) {
+    if(range_size <= 0) {
+        THROW_EXCEPTION(std::invalid_argument, "Range size must be positive, got {}", range_size);
+    }
+
+    FileLock lock(m_Directory / LOCK_FILE);
+    json state = read_state(m_Directory);
+    if(!state.is_null()) {
+        if(state["begin"] != begin.to_index() || state["end"] != end.to_index() || state["range-size"] != range_size) {
+            THROW_EXCEPTION(std::runtime_error, "Queue in {} has been created for labels {}-{} with range size {}",
+                            m_Directory.string(), state["begin"].get<long>(), state["end"].get<long>(),
+                            state["range-size"].get<long>());
+        }
+        return;
+    }
+
+    state["begin"] = begin.to_index();
+    state["end"] = end.to_index();
+    state["range-size"] = range_size;
+    state["ranges"] = json::array();
+    for(label_id_t first = begin; first < end; first = std::min(end, first + range_size)) {
+        state["ranges"].push_back({{"begin", first.to_index()}, {"end", std::min(end, first + range_size).to_index()},
+                                   {"state", PENDING}, {"worker", ""}, {"heartbeat", 0}, {"attempts", 0},
+                                   {"result", ""}});
+    }
+    write_state(m_Directory, state);
+}
+
+std::optional<LabelRange> LabelRangeQueue::acquire(const std::string& worker) {
+    FileLock lock(m_Directory / LOCK_FILE);
+    json state = read_state(m_Directory);
+    if(state.is_null()) {
+        THROW_EXCEPTION(std::runtime_error, "Queue in {} has not been initialized", m_Directory.string());
+    }
+
+    long now = now_ms();
+    json* selected = nullptr;
+    bool changed = reclaim_stale_ranges(state, now, m_HeartbeatTimeout, m_MaxAttempts) > 0;
+    for(auto& entry : state["ranges"]) {
+        if(entry["state"] == PENDING) {
+            selected = &entry;
+            break;
+        }
+    }
+
+    if(selected) {
+        (*selected)["state"] = RUNNING;
+        (*selected)["worker"] = worker;
+        (*selected)["heartbeat"] = now;
+        (*selected)["attempts"] = (*selected)["attempts"].get<long>() + 1;
+        changed = true;
+    }
+
+    if(changed) {
+        write_state(m_Directory, state);
+    }
+    if(selected) {
+        return to_range(*selected);
+    }
+    return std::nullopt;
+}
+
+void LabelRangeQueue::heartbeat(const std::string& worker) {
+    FileLock lock(m_Directory / LOCK_FILE);
+    json state = read_state(m_Directory);
+    long now = now_ms();
+    bool changed = false;
+    for(auto& entry : state["ranges"]) {
+        if(is_owned_by(&entry, worker)) {
+            entry["heartbeat"] = now;
+            changed = true;
+        }
+    }
+    if(changed) {
+        write_state(m_Directory, state);
+    }
+}
+
+bool LabelRangeQueue::complete(const LabelRange& range, const std::string& worker, const std::string& result) {
+    FileLock lock(m_Directory / LOCK_FILE);
+    json state = read_state(m_Directory);
+    json* entry = find_entry(state, range);
+    if(!is_owned_by(entry, worker)) {
+        return false;
+    }
+    (*entry)["state"] = DONE;
+    (*entry)["result"] = result;
+    write_state(m_Directory, state);
+    return true;
+}
+
+void LabelRangeQueue::fail(const LabelRange& range, const std::string& worker) {
+    FileLock lock(m_Directory / LOCK_FILE);
+    json state = read_state(m_Directory);
+    json* entry = find_entry(state, range);
+    if(!is_owned_by(entry, worker)) {
+        return;
+    }
+    (*entry)["state"] = (*entry)["attempts"].get<long>() >= m_MaxAttempts ? FAILED : PENDING;
+    write_state(m_Directory, state);
+}
+
+long LabelRangeQueue::reclaim_timed_out() {
+    FileLock lock(m_Directory / LOCK_FILE);
+    json state = read_state(m_Directory);
+    long count = reclaim_stale_ranges(state, now_ms(), m_HeartbeatTimeout, m_MaxAttempts);
+    if(count > 0) {
+        write_state(m_Directory, state);
+    }
+    return count;
+}
+
+long LabelRangeQueue::release(const std::string& worker) {
+    FileLock lock(m_Directory / LOCK_FILE);
+    json state = read_state(m_Directory);
+    long count = 0;
+    for(auto& entry : state["ranges"]) {
+        if(is_owned_by(&entry, worker)) {
+            entry["state"] = entry["attempts"].get<long>() >= m_MaxAttempts ? FAILED : PENDING;
+            ++count;
+        }
+    }
+    if(count > 0) {
+        write_state(m_Directory, state);
+    }
+    return count;
+}
+
+LabelRangeQueueStatus LabelRangeQueue::status() const {
+    FileLock lock(m_Directory / LOCK_FILE);
+    json state = read_state(m_Directory);
+    LabelRangeQueueStatus result;
+    for(const auto& entry : state["ranges"]) {
+        if(entry["state"] == PENDING) {
+            ++result.Pending;
+        } else if(entry["state"] == RUNNING) {
+            ++result.Running;
+        } else if(entry["state"] == DONE) {
+            ++result.Done;
+        } else {
+            ++result.Failed;
+        }
+    }
+    return result;
+}
+
+std::vector<std::pair<LabelRange, std::string>> LabelRangeQueue::results() const {
+    FileLock lock(m_Directory / LOCK_FILE);
+    json state = read_state(m_Directory);
+    std::vector<std::pair<LabelRange, std::string>> result;
+    for(const auto& entry : state["ranges"]) {
+        if(entry["state"] == DONE) {
+            result.emplace_back(to_range(entry), entry["result"].get<std::string>());
+        }
+    }
+    return result;
+}
+
+#include "doctest.h"
+
+TEST_CASE("label range queue") {
+    std::filesystem::remove_all("test/queue");
+    LabelRangeQueue queue("test/queue", std::chrono::hours(1), 3);
+    CHECK_THROWS(queue.acquire("a"));
+
+    queue.initialize(label_id_t{0}, label_id_t{10}, 4);
+    // initializing again with the same arguments keeps the state, but different arguments are an error
+    CHECK_NOTHROW(queue.initialize(label_id_t{0}, label_id_t{10}, 4));
+    CHECK_THROWS(queue.initialize(label_id_t{0}, label_id_t{10}, 5));
+
+    auto status = queue.status();
+    CHECK(status.Pending == 3);
+    CHECK_FALSE(status.finished());
+
+    auto first = queue.acquire("a");
+    REQUIRE(first.has_value());
+    CHECK(first->Begin == label_id_t{0});
+    CHECK(first->End == label_id_t{4});
+    CHECK(first->Attempt == 0);
+    auto second = queue.acquire("b");
+    REQUIRE(second.has_value());
+    CHECK(second->Begin == label_id_t{4});
+    auto third = queue.acquire("c");
+    REQUIRE(third.has_value());
+    CHECK(third->End == label_id_t{10});
+
+    // nothing left, and no worker has timed out
+    CHECK_FALSE(queue.acquire("d").has_value());
+    CHECK(queue.status().Running == 3);
+
+    CHECK(queue.complete(*first, "a", "result-a"));
+    // only the owner can complete a range
+    CHECK_FALSE(queue.complete(*second, "a", "result-a"));
+
+    // a failed range is handed out again
+    queue.fail(*third, "c");
+    auto retry = queue.acquire("d");
+    REQUIRE(retry.has_value());
+    CHECK(retry->Begin == label_id_t{8});
+    CHECK(retry->Attempt == 1);
+    // ... until the maximum number of attempts is reached
+    queue.fail(*retry, "d");
+    retry = queue.acquire("d");
+    REQUIRE(retry.has_value());
+    CHECK(retry->Attempt == 2);
+    queue.fail(*retry, "d");
+    CHECK(queue.status().Failed == 1);
+
+    // with a zero timeout, the range of b is considered to be abandoned
+    LabelRangeQueue impatient("test/queue", std::chrono::milliseconds(0), 3);
+    // a waiting process can return the range to the queue without taking it
+    CHECK(queue.reclaim_timed_out() == 0);
+    CHECK(impatient.reclaim_timed_out() == 1);
+    CHECK(queue.status().Pending == 1);
+    auto taken = impatient.acquire("e");
+    REQUIRE(taken.has_value());
+    CHECK(taken->Begin == label_id_t{4});
+    CHECK_FALSE(queue.complete(*second, "b", "result-b"));
+    CHECK(queue.release("e") == 1);
+    CHECK(queue.status().Pending == 1);
+    taken = queue.acquire("e");
+    REQUIRE(taken.has_value());
+    CHECK(queue.complete(*taken, "e", "result-e"));
+
+    status = queue.status();
+    CHECK(status.Done == 2);
+    CHECK(status.Failed == 1);
+    CHECK(status.finished());
+
+    auto results = queue.results();
+    REQUIRE(results.size() == 2);
+    CHECK(results[0].first.Begin == label_id_t{0});
+    CHECK(results[0].second == "result-a");
+    CHECK(results[1].second == "result-e");
+}
@@ -0,0 +1,121 @@
+// Copyright (c) 2021, Aalto University, developed by Erik Schultheis
+// All rights reserved.
+//
+// SPDX-License-Identifier: MIT
+
+#ifndef DISMEC_SRC_PARALLEL_WORK_QUEUE_H
+#define DISMEC_SRC_PARALLEL_WORK_QUEUE_H
+
+#include <chrono>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+#include "data/types.h"
+#include "config.h"
+
+namespace dismec::parallel {
+    /// A range of labels that is handed out by a `LabelRangeQueue`.
+    struct LabelRange {
+        label_id_t Begin;
+        label_id_t End;
+        long Attempt = 0;       //!< How many times this range has been handed out before.
+    };
+
+    /// Number of label ranges of a `LabelRangeQueue` in each state.
+    struct LabelRangeQueueStatus {
+        long Pending = 0;
+        long Running = 0;
+        long Done = 0;
+        long Failed = 0;
+
+        /// Returns true if no range is pending or running, i.e. if no more work will be done.
+        [[nodiscard]] bool finished() const { return Pending == 0 && Running == 0; }
+    };
+
+    /*!
+     * \brief A queue of label ranges that is shared between processes through the file system.
+     * \details The state of the queue is stored as a json file in a directory, and all modifications are guarded by an
+     * open file description lock on a separate lock file, which excludes other processes as well as other threads. This allows worker processes on the same machine, or on different machines
+     * that share a file system, to take label ranges from the queue without any other means of communication.
+     *
+     * Workers identify themselves by a name, and need to call `heartbeat()` regularly while they are working on a range.
+     * If the heartbeat of a running range is older than the timeout, the worker is assumed to be dead, and the range is
+     * handed out again. A worker that finds out that its range has been taken over (because its `complete()` call
+     * returns false) should discard its result.
+     */
+    class LabelRangeQueue {
+    public:
+        /*!
+         * \brief Opens the queue in `directory`.
+         * \param directory The directory which contains the state of the queue.
+         * \param heartbeat_timeout Running ranges whose last heartbeat is older than this are handed out again.
+         * \param max_attempts Number of times a range is attempted before it is marked as failed.
+         */
+        LabelRangeQueue(std::filesystem::path directory, std::chrono::milliseconds heartbeat_timeout,
+                        long max_attempts = LABEL_RANGE_MAX_ATTEMPTS);
+
+        /*!
+         * \brief Fills the queue with the labels `[begin, end)`, split into ranges of `range_size` labels.
+         * \details If the queue has already been initialized with the same labels and range size, the existing state is
+         * kept, so that an interrupted run can be continued.
+         * \throws std::runtime_error if the queue already exists with a different configuration.
+         */
+        void initialize(label_id_t begin, label_id_t end, long range_size);
+
+        /*!
+         * \brief Takes a range from the queue.
+         * \details Running ranges whose worker has timed out are returned to the queue (see `reclaim_timed_out()`),
+         * and then the first pending range is handed out.
+         * \return The range, or an empty optional if there is currently no range available. In that case, other workers
+         * may still be running, so the caller should check `status()` before giving up.
+         */
+        std::optional<LabelRange> acquire(const std::string& worker);
+
+        /// Updates the heartbeat for all ranges that `worker` is currently running.
+        void heartbeat(const std::string& worker);
+
+        /*!
+         * \brief Marks `range` as finished.
+         * \param result A string describing the result, e.g. the file to which the weights have been saved.
+         * \return false if the range is no longer assigned to `worker`, in which case nothing is changed.
+         */
+        bool complete(const LabelRange& range, const std::string& worker, const std::string& result);
+
+        /*!
+         * \brief Returns `range` to the queue after training has failed.
+         * \details If the range has been attempted `max_attempts` times, it is marked as failed instead.
+         */
+        void fail(const LabelRange& range, const std::string& worker);
+
+        /*!
+         * \brief Returns all running ranges whose heartbeat is older than the timeout to the queue.
+         * \details Ranges that have been attempted `max_attempts` times are marked as failed instead. This is done
+         * automatically by `acquire()`, but needs to be called explicitly by a process that waits for other workers
+         * without taking any ranges itself.
+         * \return The number of ranges that have been returned or marked as failed.
+         */
+        long reclaim_timed_out();
+
+        /*!
+         * \brief Returns all ranges that are running on `worker` to the queue.
+         * \details This can be used if it is known that the worker has died, so that we do not need to wait for the
+         * heartbeat to time out.
+         * \return The number of returned ranges.
+         */
+        long release(const std::string& worker);
+
+        /// Returns how many ranges are in which state.
+        [[nodiscard]] LabelRangeQueueStatus status() const;
+
+        /// Returns the finished ranges, and the results that were given to `complete()`, ordered by label.
+        [[nodiscard]] std::vector<std::pair<LabelRange, std::string>> results() const;
+
+    private:
+        std::filesystem::path m_Directory;
+        std::chrono::milliseconds m_HeartbeatTimeout;
+        long m_MaxAttempts;
+    };
+}
+
+#endif //DISMEC_SRC_PARALLEL_WORK_QUEUE_H
@@ -119,6 +119,7 @@ int main(int argc, const char** argv) {
         runner.set_logger(spdlog::default_logger());
 
     runner.set_chunk_size(PREDICTION_RUN_CHUNK_SIZE);
+    runner.set_adaptive_chunk_size(std::chrono::milliseconds(ADAPTIVE_CHUNK_TARGET_MS));
 
     if(top_k > 0) {
         io::PartialModelLoader loader(model_file, io::PartialModelLoader::DEFAULT);
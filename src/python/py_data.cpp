@@ -34,6 +34,9 @@ namespace {
     auto set_features_dense(DatasetBase& ds, DenseFeatures features) {
         (*ds.edit_features()) = GenericFeatureMatrix(std::move(features));
     }
+    auto set_instance_weights(DatasetBase& ds, DenseRealVector weights) {
+        ds.set_instance_weights(std::make_shared<const DenseRealVector>(std::move(weights)));
+    }
 
     PyDataSet load_xmc(const std::filesystem::path& source_file, bool one_based_indexing) {
         if(one_based_indexing) {
@@ -78,7 +81,8 @@ void register_dataset(pybind11::module_& m) {
              py::arg("sparse_features"))
         .def("set_features", set_features_dense,
              py::kw_only(),
-             py::arg("dense_features"));
+             py::arg("dense_features"))
+        .def("set_instance_weights", set_instance_weights, py::arg("weights"));
 
     // dataset io functions
     m.def("load_xmc", load_xmc,
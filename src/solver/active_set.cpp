@@ -0,0 +1,381 @@
+// Copyright (c) 2021, Aalto University, developed by Erik Schultheis
+// All rights reserved.
+//
+// SPDX-License-Identifier: MIT
+
+#include "active_set.h"
+#include "utils/conversion.h"
+#include "utils/throw_error.h"
+#include "stats/collection.h"
+#include "stats/timer.h"
+
+using namespace dismec::solvers;
+
+namespace {
+    using dismec::stats::stat_id_t;
+
+    constexpr const stat_id_t STAT_GRADIENT_NORM_0{0};
+    constexpr const stat_id_t STAT_OBJECTIVE_VALUE{1};
+    constexpr const stat_id_t STAT_GRADIENT_NORM{2};
+    constexpr const stat_id_t STAT_WORKING_SET{3};
+    constexpr const stat_id_t STAT_SNAPPED{4};
+    constexpr const stat_id_t STAT_LINESEARCH_STEPSIZE{5};
+    constexpr const stat_id_t STAT_CG_ITERS{6};
+    constexpr const stat_id_t STAT_ITER_TIME{7};
+    constexpr const stat_id_t STAT_LS_FAIL{8};
+    constexpr const stat_id_t STAT_HESSIAN_PRODUCTS{9};
+
+    constexpr const dismec::stats::tag_id_t TAG_ITERATION{0};
+};
+
+ActiveSetNewton::ActiveSetNewton(long num_variables) : m_CG_Solver(num_variables),
+                                                       m_Gradient(num_variables), m_PreConditioner(num_variables),
+                                                       m_Direction(num_variables),
+                                                       m_Weights(DenseRealVector(num_variables)),
+                                                       m_SnapDelta(num_variables)
+{
+    declare_hyper_parameter("epsilon", &ActiveSetNewton::get_epsilon, &ActiveSetNewton::set_epsilon);
+    declare_hyper_parameter("max-steps", &ActiveSetNewton::get_maximum_iterations, &ActiveSetNewton::set_maximum_iterations);
+    declare_hyper_parameter("alpha-pcg", &ActiveSetNewton::get_alpha_preconditioner, &ActiveSetNewton::set_alpha_preconditioner);
+    declare_hyper_parameter("l1-strength", &ActiveSetNewton::get_l1_strength, &ActiveSetNewton::set_l1_strength);
+    declare_sub_object("cg", &ActiveSetNewton::m_CG_Solver);
+    declare_sub_object("search", &ActiveSetNewton::m_LineSearcher);
+
+    declare_stat(STAT_GRADIENT_NORM_0, {"grad_norm_0", "|g_0|"});
+    declare_stat(STAT_OBJECTIVE_VALUE, {"objective", "loss"});
+    declare_stat(STAT_GRADIENT_NORM, {"grad_norm", "|g|"});
+    declare_stat(STAT_WORKING_SET, {"working_set", "#variables"});
+    declare_stat(STAT_SNAPPED, {"snapped_to_zero", "#variables"});
+    declare_stat(STAT_LINESEARCH_STEPSIZE, {"linesearch_step"});
+    declare_stat(STAT_CG_ITERS, {"cg_iters", "#iters"});
+    declare_stat(STAT_ITER_TIME, {"iter_time", "duration [µs]"});
+    declare_stat(STAT_LS_FAIL, {"linesearch_fail", "#instances"});
+    declare_stat(STAT_HESSIAN_PRODUCTS, {"hessian_products", "#Hv"});
+
+    declare_tag(TAG_ITERATION, "iteration");
+}
+
+MinimizationResult ActiveSetNewton::run(objective::Objective& objective, Eigen::Ref<DenseRealVector> init) {
+    m_HessianProducts = 0;
+    auto result = run_active_set(objective, init);
+    record(STAT_HESSIAN_PRODUCTS, m_HessianProducts);
+    return result;
+}
+
+dismec::real_t ActiveSetNewton::projected_gradient_norm(const DenseRealVector& weights,
+                                                        const DenseRealVector& gradient) const {
+    real_t result = 0;
+    for(long j = 0; j < gradient.size(); ++j) {
+        real_t g = gradient.coeff(j);
+        if(weights.coeff(j) == 0 && j != m_BiasIndex) {
+            // a zero weight is optimal if the gradient of the loss is within the subdifferential of the L1 term
+            g = std::max(std::abs(g) - real_t(m_L1_Strength), real_t{0});
+        }
+        result += g * g;
+    }
+    return std::sqrt(result);
+}
+
+void ActiveSetNewton::select_working_set() {
+    m_Active.clear();
+    const auto& weights = m_Weights.get();
+    for(long j = 0; j < weights.size(); ++j) {
+        if(weights.coeff(j) != 0 || j == m_BiasIndex || std::abs(m_Gradient.coeff(j)) > m_L1_Strength) {
+            m_Active.push_back(j);
+        }
+    }
+}
+
+long ActiveSetNewton::take_step(objective::Objective& objective, real_t step) {
+    const auto& direction = m_CG_Solver.get_solution();
+
+    // first, the step along the line, so that the objective can reuse the results of the line search
+    DenseRealVector& weights = m_Weights.modify();
+    for(long k = 0; k < ssize(m_Active); ++k) {
+        weights.coeffRef(m_Active[k]) += step * direction.coeff(k);
+    }
+    objective.declare_vector_on_last_line(m_Weights, step);
+
+    // then, the weights that crossed zero are set to exactly zero. This is a sparse update.
+    m_SnapDelta.setZero();
+    for(long k = 0; k < ssize(m_Active); ++k) {
+        long j = m_Active[k];
+        real_t new_value = weights.coeff(j);
+        real_t old_value = new_value - step * direction.coeff(k);
+        if(j != m_BiasIndex && old_value * new_value < 0) {
+            m_SnapDelta.insertBack(j) = -new_value;
+        }
+    }
+    return apply_snap(objective);
+}
+
+long ActiveSetNewton::apply_snap(objective::Objective& objective) {
+    if(m_SnapDelta.nonZeros() == 0) {
+        return 0;
+    }
+
+    VectorHash old_hash = m_Weights.hash();
+    DenseRealVector& target = m_Weights.modify();
+    for(SparseRealVector::InnerIterator it(m_SnapDelta); it; ++it) {
+        target.coeffRef(it.index()) = real_t{0};
+    }
+    objective.declare_sparse_update(old_hash, m_Weights, m_SnapDelta);
+    return m_SnapDelta.nonZeros();
+}
+
+MinimizationResult ActiveSetNewton::run_active_set(objective::Objective& objective, Eigen::Ref<DenseRealVector> init)
+{
+    // the stopping criterion is relative to the violation of the optimality conditions at zero
+    objective.gradient_at_zero(m_Gradient);
+    m_Direction.setZero();
+    real_t gnorm0 = projected_gradient_norm(m_Direction, m_Gradient);
+    record(STAT_GRADIENT_NORM_0, gnorm0);
+
+    m_Weights = init;
+    real_t f, gnorm;
+    {
+        set_tag(TAG_ITERATION, 0);
+        auto scope_timer = make_timer(STAT_ITER_TIME);
+        f = objective.value(m_Weights);
+        objective.gradient_and_pre_conditioner(m_Weights, m_Gradient, m_PreConditioner);
+        gnorm = projected_gradient_norm(m_Weights.get(), m_Gradient);
+        record(STAT_GRADIENT_NORM, gnorm);
+        record(STAT_OBJECTIVE_VALUE, f);
+    }
+
+    real_t f_start = f;
+    real_t gnorm_start = gnorm;
+
+    if(!std::isfinite(f) || !std::isfinite(gnorm) || !std::isfinite(gnorm0)) {
+        spdlog::error("Invalid active set optimization: initial value: {}, gradient norm: {}, gnorm_0: {}", f, gnorm, gnorm0);
+        return {MinimizerStatus::FAILED, 0, f, gnorm, f, gnorm};
+    }
+
+    if(m_Logger) {
+        m_Logger->info("initial: f={:<5.3} |g|={:<5.3} |g_0|={:<5.3} eps={:<5.3}", f, gnorm, gnorm0, m_Epsilon);
+    }
+
+    // this also covers the case that zero is optimal, i.e. gnorm0 == 0
+    if (gnorm <= m_Epsilon * gnorm0)
+        return {MinimizerStatus::SUCCESS, 0, f, gnorm, f, gnorm};
+
+    for(int iter = 1; iter <= m_MaxIter; ++iter) {
+        set_tag(TAG_ITERATION, iter);
+        auto scope_timer = make_timer(STAT_ITER_TIME);
+
+        select_working_set();
+        long num_active = ssize(m_Active);
+        record(STAT_WORKING_SET, num_active);
+
+        // gather the reduced system, and regularize the preconditioner: M = (1-a)I + aM
+        m_ReducedGradient.resize(num_active);
+        m_ReducedPreConditioner.resize(num_active);
+        for(long k = 0; k < num_active; ++k) {
+            m_ReducedGradient.coeffRef(k) = m_Gradient.coeff(m_Active[k]);
+            m_ReducedPreConditioner.coeffRef(k) = (1 - m_Alpha_PCG) + m_Alpha_PCG * m_PreConditioner.coeff(m_Active[k]);
+        }
+
+        // Here, we solve min \| H_AA d + g_A \|
+        m_CG_Solver.resize(num_active);
+        auto hessian_product = [&](const DenseRealVector& d, Eigen::Ref<DenseRealVector> o) {
+            ++m_HessianProducts;
+            objective.hessian_times_direction_restricted(m_Weights, m_Active, d, o);
+        };
+        long cg_iter = m_CG_Solver.minimize(hessian_product, m_ReducedGradient, m_ReducedPreConditioner);
+        record(STAT_CG_ITERS, cg_iter);
+
+        const auto& cg_solution = m_CG_Solver.get_solution();
+        m_Direction.setZero();
+        for(long k = 0; k < num_active; ++k) {
+            m_Direction.coeffRef(m_Active[k]) = cg_solution.coeff(k);
+        }
+
+        real_t fold = f;
+        objective.project_to_line(m_Weights, m_Direction);
+        auto ls_result = m_LineSearcher.search([&](real_t a){ return objective.lookup_on_line(a); },
+                                               m_ReducedGradient.dot(cg_solution), f);
+        record(STAT_LINESEARCH_STEPSIZE, real_t(ls_result.StepSize));
+
+        if (ls_result.StepSize == 0)
+        {
+            spdlog::warn("line search failed in iteration {} of active set optimization. Current objective value: {:.3}, "
+                         "gradient norm: {:.3} (target: {:.3}), working set: {}",
+                         iter, f, gnorm, m_Epsilon * gnorm0, num_active);
+            init = m_Weights.get();
+            record(STAT_LS_FAIL, 1);
+            return {MinimizerStatus::FAILED, iter, f, gnorm, f_start, gnorm_start};
+        }
+
+        f = ls_result.Value;
+        long snapped = take_step(objective, ls_result.StepSize);
+        record(STAT_SNAPPED, snapped);
+        if(snapped > 0) {
+            f = objective.value(m_Weights);
+        }
+        real_t absolute_improvement = fold - f;
+
+        objective.gradient_and_pre_conditioner(m_Weights, m_Gradient, m_PreConditioner);
+        gnorm = projected_gradient_norm(m_Weights.get(), m_Gradient);
+        record(STAT_GRADIENT_NORM, gnorm);
+        record(STAT_OBJECTIVE_VALUE, f);
+
+        if(m_Logger) {
+            m_Logger->info("iter {:3}: f={:<10.8} |g|={:<8.4} CG={:<3} line-search={:<4.2} active={}",
+                           iter, f, gnorm, cg_iter, ls_result.StepSize, num_active);
+        }
+
+        if (gnorm <= m_Epsilon * gnorm0 || check_validation(iter, m_Weights.get())) {
+            init = m_Weights.get();
+            return {MinimizerStatus::SUCCESS, iter, f, gnorm, f_start, gnorm_start};
+        }
+        if (f < -1.0e+32)
+        {
+            spdlog::warn("Objective appears to be unbounded (got value {:.2})", f);
+            return {MinimizerStatus::DIVERGED, iter, f, gnorm, f_start, gnorm_start};
+        }
+        if (abs(absolute_improvement) <= 1.0e-12 * abs(f))
+        {
+            spdlog::warn("relative improvement too low");
+            init = m_Weights.get();
+            return {MinimizerStatus::FAILED, iter, f, gnorm, f_start, gnorm_start};
+        }
+    }
+
+    init = m_Weights.get();
+    return {MinimizerStatus::TIMED_OUT, m_MaxIter, f, gnorm, f_start, gnorm_start};
+}
+
+void ActiveSetNewton::set_epsilon(double eps) {
+    if(eps <= 0) {
+        THROW_EXCEPTION(std::invalid_argument, "Epsilon must be larger than zero, got {}", eps);
+    }
+    m_Epsilon = eps;
+}
+
+void ActiveSetNewton::set_maximum_iterations(long max_iter) {
+    if(max_iter <= 0) {
+        THROW_EXCEPTION(std::invalid_argument, "Maximum iterations must be larger than zero, got {}", max_iter);
+    }
+    m_MaxIter = max_iter;
+}
+
+void ActiveSetNewton::set_alpha_preconditioner(double alpha) {
+    if(alpha <= 0 || alpha >= 1) {
+        THROW_EXCEPTION(std::invalid_argument, "The `alpha_pcg` parameter needs to be between 0 and 1, got {}", alpha);
+    }
+    m_Alpha_PCG = alpha;
+}
+
+void ActiveSetNewton::set_l1_strength(double strength) {
+    if(strength < 0) {
+        THROW_EXCEPTION(std::invalid_argument, "L1 strength cannot be negative, got {}", strength);
+    }
+    m_L1_Strength = strength;
+}
+
+#include "doctest.h"
+#include "objective/regularizers_imp.h"
+#include "objective/reg_sq_hinge.h"
+#include "solver/newton.h"
+#include "utils/eigen_generic.h"
+#include <random>
+
+using namespace dismec;
+
+TEST_CASE("active set newton") {
+    // a small random problem with informative and noise features, and a bias feature
+    constexpr long num_instances = 200;
+    constexpr long num_features = 40;
+    std::minstd_rand rng(5);
+    std::normal_distribution<real_t> noise(0, 1);
+    SparseFeatures features(num_instances, num_features);
+    std::vector<Eigen::Triplet<real_t>> triplets;
+    DenseRealVector true_w = DenseRealVector::Zero(num_features);
+    true_w.head(4) << 1.0, -1.0, 0.5, -0.5;
+    BinaryLabelVector labels(num_instances);
+    for(long i = 0; i < num_instances; ++i) {
+        real_t score = 0;
+        for(long j = 0; j < num_features - 1; ++j) {
+            if((i + j) % 3 == 0) {
+                real_t value = noise(rng);
+                triplets.emplace_back(i, j, value);
+                score += value * true_w.coeff(j);
+            }
+        }
+        triplets.emplace_back(i, num_features - 1, 1.0);
+        labels.coeffRef(i) = score + real_t{0.1} * noise(rng) > 0 ? 1 : -1;
+    }
+    features.setFromTriplets(triplets.begin(), triplets.end());
+    features.makeCompressed();
+    auto shared = std::make_shared<const GenericFeatureMatrix>(features);
+
+    constexpr real_t strength = 10.0;
+    auto make_objective = [&](real_t scale) {
+        auto reg = std::make_unique<objective::HuberRegularizer>(1e-2, scale, true);
+        auto loss = std::make_unique<objective::Regularized_SquaredHingeSVC>(shared, std::move(reg));
+        loss->get_label_ref() = labels;
+        return loss;
+    };
+
+    SUBCASE("restricted hessian product") {
+        auto loss = make_objective(strength);
+        HashVector w{DenseRealVector::Random(num_features)};
+        std::vector<long> indices = {0, 3, 7, num_features - 1};
+        DenseRealVector restricted_dir = DenseRealVector::Random(ssize(indices));
+        DenseRealVector full_dir = DenseRealVector::Zero(num_features);
+        for(long k = 0; k < ssize(indices); ++k) {
+            full_dir.coeffRef(indices[k]) = restricted_dir.coeff(k);
+        }
+
+        DenseRealVector full(num_features);
+        loss->hessian_times_direction(w, full_dir, full);
+        DenseRealVector restricted(indices.size());
+        loss->hessian_times_direction_restricted(w, indices, restricted_dir, restricted);
+        for(long k = 0; k < ssize(indices); ++k) {
+            CHECK(restricted.coeff(k) == doctest::Approx(full.coeff(indices[k])).epsilon(1e-4));
+        }
+    }
+
+    SUBCASE("compare to newton") {
+        auto loss = make_objective(strength);
+        ActiveSetNewton active_set(num_features);
+        active_set.set_l1_strength(strength);
+        active_set.set_bias_index(num_features - 1);
+        active_set.set_epsilon(1e-4);
+        DenseRealVector w_active = DenseRealVector::Zero(num_features);
+        auto result = active_set.minimize(*loss, w_active);
+        CHECK(result.Outcome == MinimizerStatus::SUCCESS);
+
+        NewtonWithLineSearch newton(num_features);
+        newton.set_epsilon(1e-4);
+        DenseRealVector w_newton = DenseRealVector::Zero(num_features);
+        auto reference = newton.minimize(*loss, w_newton);
+        CHECK(reference.Outcome == MinimizerStatus::SUCCESS);
+
+        // the active set solution is sparser, and at least as good for the non-smoothed l1 objective
+        auto l1_objective = [&](const DenseRealVector& w) {
+            auto loss_only = make_objective(0.0);
+            return loss_only->value(HashVector{w}) + strength * w.head(num_features - 1).lpNorm<1>();
+        };
+        long nnz = (w_active.array() != 0).count();
+        long nnz_newton = (w_newton.array() != 0).count();
+        CHECK(nnz < nnz_newton);
+        CHECK(l1_objective(w_active) <= doctest::Approx(l1_objective(w_newton)).epsilon(1e-3));
+        for(long j = 0; j < 4; ++j) {
+            CHECK(w_active.coeff(j) != 0);
+        }
+    }
+
+    SUBCASE("zero is optimal for strong regularization") {
+        auto loss = make_objective(1e6);
+        ActiveSetNewton active_set(num_features);
+        active_set.set_l1_strength(1e6);
+        DenseRealVector w = DenseRealVector::Zero(num_features);
+        auto result = active_set.minimize(*loss, w);
+        CHECK(result.Outcome == MinimizerStatus::SUCCESS);
+        CHECK(result.NumIters == 0);
+    }
+
+    CHECK_THROWS(ActiveSetNewton(2).set_l1_strength(-1.0));
+    CHECK_THROWS(ActiveSetNewton(2).set_alpha_preconditioner(1.5));
+}
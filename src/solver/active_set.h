@@ -0,0 +1,103 @@
+// Copyright (c) 2021, Aalto University, developed by Erik Schultheis
+// All rights reserved.
+//
+// SPDX-License-Identifier: MIT
+
+#ifndef DISMEC_SRC_SOLVER_ACTIVE_SET_H
+#define DISMEC_SRC_SOLVER_ACTIVE_SET_H
+
+#include "solver/minimizer.h"
+#include "solver/cg.h"
+#include "solver/line_search.h"
+#include "utils/hash_vector.h"
+#include <vector>
+
+namespace dismec::solvers
+{
+    /*!
+     * \brief Truncated newton with line search that only updates a working set of variables, for L1-regularized
+     * objectives.
+     * \details This follows the active set strategy of newGLMNET (Yuan, Ho and Lin, "An Improved GLMNET for
+     * L1-regularized Logistic Regression", JMLR 2012). The objective is assumed to contain an L1 term
+     * \f$ \lambda |w|_1 \f$ (possibly smoothed around zero, as the Huber and elastic net regularizers are), where
+     * \f$ \lambda \f$ is given by `set_l1_strength()`. A weight that is zero and whose gradient satisfies
+     * \f$ |g_j| \leq \lambda \f$ fulfills the optimality condition of the L1 problem, so it is kept fixed at zero.
+     * In each iteration, the working set consists of all nonzero weights and all zero weights that violate this
+     * condition. CG is run on the reduced system \f$ H_{AA} d_A = -g_A \f$ using
+     * \ref objective::Objective::hessian_times_direction_restricted, so its cost scales with the working set instead
+     * of the number of variables. After the line search, weights that would change their sign are set to exactly zero.
+     * A full gradient evaluation is needed once per iteration to update the working set.
+     *
+     * The stopping criterion is \f$ |g^P| \leq \epsilon |g^P_0| \f$, where \f$ g^P \f$ is the gradient of the working
+     * set, combined with the amount by which the fixed weights violate the optimality condition, and \f$ g^P_0 \f$ is
+     * the same quantity at zero. If no weight violates the optimality condition at zero, the solution is zero.
+     */
+    class ActiveSetNewton : public Minimizer {
+    public:
+        explicit ActiveSetNewton(long num_variables);
+
+        // hyperparameters
+        void set_epsilon(double eps);
+        double get_epsilon() const { return m_Epsilon; }
+
+        void set_maximum_iterations(long max_iter);
+        long get_maximum_iterations() const { return m_MaxIter; }
+
+        void set_alpha_preconditioner(double alpha);
+        double get_alpha_preconditioner() const { return m_Alpha_PCG; }
+
+        /// Sets the strength \f$ \lambda \f$ of the L1 term of the objective, which decides which weights can stay zero.
+        void set_l1_strength(double strength);
+        double get_l1_strength() const { return m_L1_Strength; }
+
+        /// Declares that the weight at `index` is not L1-regularized, e.g. because it is the bias, so that it is always
+        /// part of the working set. A negative value means that all weights are regularized.
+        void set_bias_index(long index) { m_BiasIndex = index; }
+
+    private:
+        MinimizationResult run(objective::Objective& objective, Eigen::Ref<DenseRealVector> init) override;
+        MinimizationResult run_active_set(objective::Objective& objective, Eigen::Ref<DenseRealVector> init);
+
+        /// Calculates the norm of the gradient of the working set at `weights`, combined with the violation of the
+        /// optimality condition of the fixed weights.
+        real_t projected_gradient_norm(const DenseRealVector& weights, const DenseRealVector& gradient) const;
+
+        /// Fills `m_Active` with the indices of the working set.
+        void select_working_set();
+
+        /// Moves the weights of the working set by `step` along the CG solution. Weights that would change their sign
+        /// are set to zero instead. Returns the number of such weights.
+        long take_step(objective::Objective& objective, real_t step);
+
+        /// Sets the weights given by `m_SnapDelta` to zero, and informs the objective about the sparse update.
+        long apply_snap(objective::Objective& objective);
+
+        // parameters
+        double m_Epsilon = 0.01;
+        double m_Alpha_PCG = 0.01;
+        double m_L1_Strength = 1.0;
+        long m_MaxIter = 1000;
+        long m_BiasIndex = -1;
+
+        /// Number of hessian-vector products in the current minimization.
+        long m_HessianProducts = 0;
+
+        // sub-algorithms
+        CGMinimizer m_CG_Solver;
+        BacktrackingLineSearch m_LineSearcher;
+
+        // full-sized buffers
+        DenseRealVector m_Gradient;
+        DenseRealVector m_PreConditioner;
+        DenseRealVector m_Direction;
+        HashVector      m_Weights;
+        SparseRealVector m_SnapDelta;
+
+        // working set and the reduced buffers
+        std::vector<long> m_Active;
+        DenseRealVector m_ReducedGradient;
+        DenseRealVector m_ReducedPreConditioner;
+    };
+}
+
+#endif //DISMEC_SRC_SOLVER_ACTIVE_SET_H
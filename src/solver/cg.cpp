@@ -5,45 +5,125 @@
 
 #include "cg.h"
 #include <spdlog/spdlog.h>
+#include <limits>
 
 using namespace dismec;
 using dismec::solvers::CGMinimizer;
 
-CGMinimizer::CGMinimizer(long num_vars) : m_Size(num_vars) {
-    m_A_times_d = DenseRealVector(num_vars);
-    m_S = DenseRealVector(num_vars);
-    m_Residual = DenseRealVector(num_vars);
-    m_Conjugate = DenseRealVector(num_vars);
-
+CGMinimizer::CGMinimizer(long num_vars) {
+    resize(num_vars);
     declare_hyper_parameter("epsilon", &CGMinimizer::get_epsilon, &CGMinimizer::set_epsilon);
 }
 
+void CGMinimizer::resize(long num_vars) {
+    m_Size = num_vars;
+    m_A_times_d.resize(num_vars);
+    m_S.resize(num_vars);
+    m_Residual.resize(num_vars);
+    m_Conjugate.resize(num_vars);
+    m_Preconditioned.resize(num_vars);
+}
+
+void CGMinimizer::set_preconditioner(std::unique_ptr<Preconditioner> preconditioner) {
+    m_Preconditioner = std::move(preconditioner);
+}
+
 long CGMinimizer::minimize(const MatrixVectorProductFn& A, const DenseRealVector& b, const DenseRealVector& M) {
-    long result = do_minimize(A, b, M);
+    long result = do_minimize(A, b, M, std::numeric_limits<real_t>::infinity(), nullptr);
     return result;
 }
 
-long CGMinimizer::do_minimize(const MatrixVectorProductFn& A, const DenseRealVector& b, const DenseRealVector& M) {
-    // in comments, we use z to denote Residual/M
-    m_S.setZero();                                  // assume x_0 = 0
-    m_Residual = -b;                                // note: We are solving Ax+b = 0, typically CG is used for Ax = b.
-    m_Conjugate = m_Residual.array() / M.array();
+long CGMinimizer::minimize(const MatrixVectorProductFn& A, const DenseRealVector& b, const DenseRealVector& M,
+                           const DenseRealVector& initial) {
+    return do_minimize(A, b, M, std::numeric_limits<real_t>::infinity(), &initial);
+}
 
+long CGMinimizer::minimize_in_trust_region(const MatrixVectorProductFn& A, const DenseRealVector& b,
+                                           const DenseRealVector& M, real_t radius) {
+    return do_minimize(A, b, M, radius, nullptr);
+}
+
+namespace {
+    /// calculates u^T diag(M) v
+    real_t uTMv(const dismec::DenseRealVector& u, const dismec::DenseRealVector& M, const dismec::DenseRealVector& v) {
+        return (u.array() * M.array() * v.array()).sum();
+    }
+}
+
+void CGMinimizer::step_to_boundary(const DenseRealVector& M, real_t radius) {
+    // find tau >= 0 such that |s + tau d|_M = radius
+    real_t sTMd = uTMv(m_S, M, m_Conjugate);
+    real_t sTMs = uTMv(m_S, M, m_S);
+    real_t dTMd = uTMv(m_Conjugate, M, m_Conjugate);
+    real_t dsq = radius * radius;
+    real_t rad = std::sqrt(std::max(sTMd * sTMd + dTMd * (dsq - sTMs), real_t{0}));
+    // choose the numerically stable form of the solution of the quadratic equation
+    real_t tau = sTMd >= 0 ? (dsq - sTMs) / (sTMd + rad) : (rad - sTMd) / dTMd;
+    m_S += tau * m_Conjugate;
+    m_Residual -= tau * m_A_times_d;
+    m_ReachedBoundary = true;
+}
+
+long CGMinimizer::do_minimize(const MatrixVectorProductFn& A, const DenseRealVector& b, const DenseRealVector& M,
+                              real_t radius, const DenseRealVector* initial) {
+    const bool trust_region = std::isfinite(radius);
+    m_ReachedBoundary = false;
+
+    real_t gMinv_norm = std::sqrt((b.array().square() / M.array()).sum());     // = sqrt(-b^T / M b)
+    real_t cg_tol = std::max(m_Forcing, std::min(m_Epsilon, std::sqrt(gMinv_norm)));
+
+    // note: We are solving Ax+b = 0, typically CG is used for Ax = b.
     real_t Q = 0;
+    if(initial) {
+        // `initial` may be the result of the previous call
+        if(initial != &m_S) {
+            m_S = *initial;
+        }
+        // start at the minimum of the quadratic along `initial`
+        A(m_S, m_A_times_d);
+        real_t sAs = m_S.dot(m_A_times_d);
+        real_t bs = b.dot(m_S);
+        if(sAs > 1e-16) {
+            real_t scale = -bs / sAs;
+            m_S *= scale;
+            m_Residual = -b - scale * m_A_times_d;
+            Q = -real_t{0.5} * bs * bs / sAs;
+        }
+    }
+    // only keep the initial guess if it is better than x_0 = 0
+    if(!initial || !(Q < 0)) {
+        m_S.setZero();
+        m_Residual = -b;
+        Q = 0;
+    }
 
+    // in comments, we use z to denote Residual/M
+    // the trust region is measured in the M-norm, so we cannot use a different preconditioner there
+    Preconditioner& preconditioner = trust_region || !m_Preconditioner ? m_DiagonalPreconditioner : *m_Preconditioner;
+    preconditioner.update(M);
+    preconditioner.apply(m_Residual, m_Conjugate);
     auto zT_dot_r = m_Conjugate.dot(m_Residual);             // at this point: m_Conjugate == z
-    real_t gMinv_norm = std::sqrt(zT_dot_r);                 // = sqrt(-b^T / M b)
-    real_t cg_tol = std::min(m_Epsilon, std::sqrt(gMinv_norm));
 
     long max_cg_iter = std::max(m_Size, CG_MIN_ITER_BOUND);
     for(long cg_iter = 1; cg_iter <= max_cg_iter; ++cg_iter) {
         A(m_Conjugate, m_A_times_d);
         real_t dAd = m_Conjugate.dot(m_A_times_d);
         if(dAd < 1e-16) {
+            if(trust_region) {
+                step_to_boundary(M, radius);
+            }
             return cg_iter;
         }
 
         real_t alpha = zT_dot_r / dAd;
+        if(trust_region) {
+            real_t new_norm = uTMv(m_S, M, m_S) + alpha * (2 * uTMv(m_S, M, m_Conjugate) +
+                                                           alpha * uTMv(m_Conjugate, M, m_Conjugate));
+            if(new_norm > radius * radius) {
+                step_to_boundary(M, radius);
+                return cg_iter;
+            }
+        }
         m_S += alpha * m_Conjugate;
         m_Residual -= alpha * m_A_times_d;
 
@@ -64,10 +144,10 @@ long CGMinimizer::do_minimize(const MatrixVectorProductFn& A, const DenseRealVec
         }
         Q = newQ;
 
-        // z == r.array() / M.array()
-        real_t znewTrnew = (m_Residual.array() / M.array()).matrix().dot(m_Residual);
+        preconditioner.apply(m_Residual, m_Preconditioned);
+        real_t znewTrnew = m_Preconditioned.dot(m_Residual);
         real_t beta = znewTrnew / zT_dot_r;
-        m_Conjugate = m_Conjugate * beta + (m_Residual.array() / M.array()).matrix();
+        m_Conjugate = m_Conjugate * beta + m_Preconditioned;
         zT_dot_r = znewTrnew;
     }
 
@@ -94,4 +174,82 @@ TEST_CASE("conjugate gradient") {
     DenseRealVector solution = minimizer.get_solution();
     DenseRealVector sol = A * solution + b;
     CHECK(sol.norm() == doctest::Approx(0.0));
-}
\ No newline at end of file
+}
+
+TEST_CASE("conjugate gradient in trust region") {
+    const int TEST_SIZE = 5;
+    auto minimizer = CGMinimizer(TEST_SIZE);
+    types::DenseColMajor<real_t> A(TEST_SIZE, TEST_SIZE);
+    A << 4, 1, 0, 0, 0,
+         1, 3, 1, 0, 0,
+         0, 1, 2, 0, 0,
+         0, 0, 0, 1, 0,
+         0, 0, 0, 0, 5;
+    DenseRealVector b(TEST_SIZE);
+    b << 1, -2, 3, 1, -1;
+    DenseRealVector m(TEST_SIZE);
+    m << 1, 2, 1, 0.5, 1;
+    auto product = [&](const DenseRealVector& d, Eigen::Ref<DenseRealVector> out){
+        out = A * d;
+    };
+
+    // with a large radius, we get the same result as without trust region
+    minimizer.minimize(product, b, m);
+    DenseRealVector unconstrained = minimizer.get_solution();
+    minimizer.minimize_in_trust_region(product, b, m, 100.0);
+    CHECK_FALSE(minimizer.reached_boundary());
+    CHECK((minimizer.get_solution() - unconstrained).norm() == doctest::Approx(0.0));
+
+    // with a small radius, the solution is on the boundary, and the residual is consistent
+    minimizer.minimize_in_trust_region(product, b, m, 0.1);
+    CHECK(minimizer.reached_boundary());
+    const DenseRealVector& s = minimizer.get_solution();
+    CHECK(std::sqrt((s.array().square() * m.array()).sum()) == doctest::Approx(0.1));
+    DenseRealVector residual = -(A * s + b);
+    CHECK((minimizer.get_residual() - residual).norm() == doctest::Approx(0.0).epsilon(1e-5));
+    // and it is a descent direction of the quadratic
+    CHECK(s.dot(A * s) / 2 + b.dot(s) < 0);
+}
+
+TEST_CASE("conjugate gradient with initial guess") {
+    const int TEST_SIZE = 4;
+    auto minimizer = CGMinimizer(TEST_SIZE);
+    minimizer.set_epsilon(1e-6);
+    types::DenseColMajor<real_t> A(TEST_SIZE, TEST_SIZE);
+    A << 4, 1, 0, 0,
+         1, 3, 1, 0,
+         0, 1, 2, 0,
+         0, 0, 0, 1;
+    DenseRealVector b(TEST_SIZE);
+    b << 1, -2, 3, 1;
+    DenseRealVector m = DenseRealVector::Ones(TEST_SIZE);
+    long products = 0;
+    auto product = [&](const DenseRealVector& d, Eigen::Ref<DenseRealVector> out){
+        ++products;
+        out = A * d;
+    };
+
+    minimizer.minimize(product, b, m);
+    DenseRealVector solution = minimizer.get_solution();
+
+    // starting at the solution, the first iteration already satisfies the stopping criterion
+    products = 0;
+    long iters = minimizer.minimize(product, b, m, minimizer.get_solution());
+    CHECK(iters <= 1);
+    CHECK(products == iters + 1);
+    CHECK((minimizer.get_solution() - solution).norm() == doctest::Approx(0.0).epsilon(1e-4));
+    CHECK((minimizer.get_residual() + A * minimizer.get_solution() + b).norm() == doctest::Approx(0.0).epsilon(1e-4));
+
+    // the length of the initial guess does not matter
+    DenseRealVector scaled = -10 * solution;
+    products = 0;
+    iters = minimizer.minimize(product, b, m, scaled);
+    CHECK(iters <= 1);
+    CHECK((minimizer.get_solution() - solution).norm() == doctest::Approx(0.0).epsilon(1e-4));
+
+    // an initial guess that is orthogonal to b is discarded
+    DenseRealVector orthogonal(TEST_SIZE);
+    orthogonal << 2, 1, 0, 0;
+    minimizer.minimize(product, b, m, orthogonal);
+    CHECK((minimizer.get_solution() - solution).norm() == doctest::Approx(0.0).epsilon(1e-4));
+}
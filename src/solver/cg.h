@@ -9,7 +9,9 @@
 #include "matrix_types.h"
 #include "config.h"
 #include <functional>
+#include <memory>
 #include "utils/hyperparams.h"
+#include "solver/preconditioner.h"
 
 namespace dismec::solvers {
 
@@ -28,9 +30,52 @@ namespace dismec::solvers {
 
         explicit CGMinimizer(long num_vars);
 
+        /*!
+         * \brief Changes the number of variables of the linear system.
+         * \details This is intended for solvers that run CG on a changing subset of the variables. The solution and
+         * residual of the previous call are lost, and a preconditioner set by `set_preconditioner()` needs to match
+         * the new size.
+         */
+        void resize(long num_vars);
+
         /// Solves `Ax+b=0`. returns the number of iterations
         long minimize(const MatrixVectorProductFn &A, const DenseRealVector &b, const DenseRealVector &M);
 
+        /*!
+         * \brief Solves `Ax+b=0`, starting from `initial` instead of zero.
+         * \details CG starts at the minimum of the quadratic `x^TAx/2 + b^Tx` along the direction of `initial`. This
+         * requires one additional evaluation of `A`, which is not included in the returned number of iterations. If
+         * `initial` is orthogonal to `b`, CG starts from zero instead.
+         * `initial` may be the solution of the last call, i.e. `get_solution()`.
+         */
+        long minimize(const MatrixVectorProductFn &A, const DenseRealVector &b, const DenseRealVector &M,
+                      const DenseRealVector& initial);
+
+        /*!
+         * \brief Approximately minimizes `x^TAx/2 + b^Tx` subject to `|x|_M <= radius`.
+         * \details This is the truncated CG method of Steihaug. If an iterate would leave the trust region, or a
+         * direction of non-positive curvature is encountered, the solution is moved to the boundary of the trust
+         * region along the current search direction and the iteration stops. The norm is given by the (diagonal)
+         * preconditioner, `|x|_M^2 = sum_i M_i x_i^2`. Returns the number of iterations, each of which requires one
+         * evaluation of `A`.
+         */
+        long minimize_in_trust_region(const MatrixVectorProductFn &A, const DenseRealVector &b,
+                                      const DenseRealVector &M, real_t radius);
+
+        /// returns whether the solution of the last `minimize_in_trust_region` call lies on the boundary.
+        [[nodiscard]] bool reached_boundary() const { return m_ReachedBoundary; }
+
+        /// returns the residual `-(Ax+b)` of the solution found by the last minimize call
+        const DenseRealVector& get_residual() const { return m_Residual; }
+
+        /*!
+         * \brief Replaces the diagonal preconditioner `M` by `preconditioner`.
+         * \details The preconditioner still receives `M` at the beginning of each solve. Setting a `nullptr` restores
+         * the default diagonal preconditioner. `minimize_in_trust_region` always uses the diagonal preconditioner,
+         * because the trust region is defined in terms of `M`.
+         */
+        void set_preconditioner(std::unique_ptr<Preconditioner> preconditioner);
+
         /// returns the solution vector found by the last minimize call
         const DenseRealVector& get_solution() const { return m_S; }
 
@@ -40,17 +85,34 @@ namespace dismec::solvers {
         /// Sets the value of the tolerance hyperparameter
         void set_epsilon(double v) { m_Epsilon = v; }
 
+        /*!
+         * \brief Sets a lower bound for the tolerance of the following minimize calls.
+         * \details By default, the tolerance is `min(epsilon, sqrt(|b|_{M^-1}))`. This allows the caller to loosen the
+         * tolerance for each solve, e.g. by a forcing sequence. A value of zero restores the default.
+         */
+        void set_forcing_tolerance(real_t tolerance) { m_Forcing = tolerance; }
+
     private:
-        long do_minimize(const MatrixVectorProductFn &A, const DenseRealVector &b, const DenseRealVector &M);
+        long do_minimize(const MatrixVectorProductFn &A, const DenseRealVector &b, const DenseRealVector &M,
+                         real_t radius, const DenseRealVector* initial);
+
+        /// Moves the solution along the current conjugate direction to the boundary of the trust region.
+        void step_to_boundary(const DenseRealVector &M, real_t radius);
 
         long m_Size;
         real_t m_Epsilon = CG_DEFAULT_EPSILON;
+        real_t m_Forcing = 0;
+        bool m_ReachedBoundary = false;
 
         // vector caches to prevent allocations
         DenseRealVector m_A_times_d;
         DenseRealVector m_S;                ///< s from the CG algorithm
         DenseRealVector m_Residual;         ///< r_k from the CG algorithm
         DenseRealVector m_Conjugate;        ///< p_k from the CG algorithm
+        DenseRealVector m_Preconditioned;   ///< z_k from the CG algorithm
+
+        DiagonalPreconditioner m_DiagonalPreconditioner;
+        std::unique_ptr<Preconditioner> m_Preconditioner;
     };
 }
 
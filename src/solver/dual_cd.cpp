@@ -0,0 +1,296 @@
+// Copyright (c) 2021, Aalto University, developed by Erik Schultheis
+// All rights reserved.
+//
+// SPDX-License-Identifier: MIT
+
+#include "solver/dual_cd.h"
+#include "objective/linear.h"
+#include "stats/collection.h"
+#include "utils/conversion.h"
+#include "utils/eigen_generic.h"
+#include <algorithm>
+#include <limits>
+
+using namespace dismec;
+using namespace dismec::solvers;
+
+namespace {
+    using dismec::stats::stat_id_t;
+
+    constexpr const stat_id_t STAT_PG_GAP{0};
+    constexpr const stat_id_t STAT_ACTIVE_SET{1};
+
+    constexpr const dismec::stats::tag_id_t TAG_ITERATION{0};
+
+    // row access for sparse and dense feature matrices
+    real_t row_dot(const SparseFeatures& features, long row, const DenseRealVector& w) {
+        real_t result = 0;
+        for(SparseFeatures::InnerIterator it(features, row); it; ++it) {
+            result += it.value() * w.coeff(it.col());
+        }
+        return result;
+    }
+
+    real_t row_dot(const DenseFeatures& features, long row, const DenseRealVector& w) {
+        return features.row(row).dot(w);
+    }
+
+    void add_row(const SparseFeatures& features, long row, real_t factor, DenseRealVector& w) {
+        for(SparseFeatures::InnerIterator it(features, row); it; ++it) {
+            w.coeffRef(it.col()) += factor * it.value();
+        }
+    }
+
+    void add_row(const DenseFeatures& features, long row, real_t factor, DenseRealVector& w) {
+        w += factor * features.row(row).transpose();
+    }
+
+    real_t row_squared_norm(const SparseFeatures& features, long row) {
+        real_t result = 0;
+        for(SparseFeatures::InnerIterator it(features, row); it; ++it) {
+            result += it.value() * it.value();
+        }
+        return result;
+    }
+
+    real_t row_squared_norm(const DenseFeatures& features, long row) {
+        return features.row(row).squaredNorm();
+    }
+}
+
+DualCoordinateDescent::DualCoordinateDescent(LossType loss, real_t regularization) : m_Loss(loss) {
+    set_regularization(regularization);
+    declare_hyper_parameter("pg-gap", &DualCoordinateDescent::get_epsilon, &DualCoordinateDescent::set_epsilon);
+    declare_hyper_parameter("max-steps", &DualCoordinateDescent::get_maximum_iterations, &DualCoordinateDescent::set_maximum_iterations);
+
+    declare_stat(STAT_PG_GAP, {"pg_gap", "max PG - min PG"});
+    declare_stat(STAT_ACTIVE_SET, {"active_set", "#instances"});
+
+    declare_tag(TAG_ITERATION, "iteration");
+}
+
+void DualCoordinateDescent::set_epsilon(double eps) {
+    if(eps <= 0) {
+        THROW_EXCEPTION(std::invalid_argument, "Epsilon must be larger than zero, got {}", eps);
+    }
+    m_Epsilon = eps;
+}
+
+void DualCoordinateDescent::set_maximum_iterations(long max_iter) {
+    if(max_iter <= 0) {
+        THROW_EXCEPTION(std::invalid_argument, "Maximum iterations must be larger than zero, got {}", max_iter);
+    }
+    m_MaxIter = max_iter;
+}
+
+void DualCoordinateDescent::set_regularization(real_t strength) {
+    if(strength <= 0) {
+        THROW_EXCEPTION(std::invalid_argument, "Regularization strength must be larger than zero, got {}", strength);
+    }
+    m_Regularization = strength;
+}
+
+MinimizationResult DualCoordinateDescent::run(objective::Objective& objective, Eigen::Ref<DenseRealVector> init) {
+    auto* linear = dynamic_cast<objective::LinearClassifierBase*>(&objective);
+    if(!linear) {
+        THROW_EXCEPTION(std::logic_error, "DualCoordinateDescent requires a linear classifier objective");
+    }
+
+    return visit([&](const auto& features) {
+        return run_on(features, linear->labels(), linear->costs(), init);
+    }, linear->generic_features());
+}
+
+template<class Matrix>
+MinimizationResult DualCoordinateDescent::run_on(const Matrix& features, const BinaryLabelVector& labels,
+                                                 const DenseRealVector& costs, Eigen::Ref<DenseRealVector> weights) {
+    const long num_instances = features.rows();
+    const bool squared = m_Loss == LossType::SQUARED_HINGE;
+    constexpr real_t infinity = std::numeric_limits<real_t>::infinity();
+
+    // we solve the equivalent problem 1/2 |w|^2 + sum_i C_i loss_i, with C_i = c_i / lambda
+    auto upper_bound = [&](long i) -> real_t {
+        return squared ? infinity : costs.coeff(i) / m_Regularization;
+    };
+    auto diagonal_shift = [&](long i) -> real_t {
+        return squared ? m_Regularization / (2 * costs.coeff(i)) : real_t{0};
+    };
+
+    DenseRealVector w = weights;
+    auto primal_value = [&]() {
+        real_t loss = 0;
+        for(long i = 0; i < num_instances; ++i) {
+            real_t d = std::max(real_t{0}, 1 - labels.coeff(i) * row_dot(features, i, w));
+            loss += costs.coeff(i) * (squared ? d * d : d);
+        }
+        return real_t{0.5} * m_Regularization * w.squaredNorm() + loss;
+    };
+    real_t initial_value = primal_value();
+
+    m_Alpha.resize(num_instances);
+    m_Diagonal.resize(num_instances);
+    m_Index.clear();
+    for(long i = 0; i < num_instances; ++i) {
+        if(costs.coeff(i) > 0) {
+            m_Index.push_back(i);
+            m_Diagonal.coeffRef(i) = row_squared_norm(features, i) + diagonal_shift(i);
+        }
+    }
+
+    // warm start: the optimality conditions give alpha as a function of the margin violation
+    m_Alpha.setZero();
+    if(!weights.isZero()) {
+        for(long i : m_Index) {
+            real_t violation = std::max(real_t{0}, 1 - labels.coeff(i) * row_dot(features, i, w));
+            real_t C = costs.coeff(i) / m_Regularization;
+            m_Alpha.coeffRef(i) = squared ? 2 * C * violation : (violation > 0 ? C : real_t{0});
+        }
+        w.setZero();
+        real_t dual_linear = 0;
+        for(long i : m_Index) {
+            add_row(features, i, m_Alpha.coeff(i) * labels.coeff(i), w);
+            dual_linear += m_Alpha.coeff(i) * (real_t{0.5} * diagonal_shift(i) * m_Alpha.coeff(i) - 1);
+        }
+        // the dual objective at alpha = 0 is zero, so only keep the warm start if it is an improvement
+        if(real_t{0.5} * w.squaredNorm() + dual_linear >= 0) {
+            m_Alpha.setZero();
+            w.setZero();
+        }
+    } else {
+        w.setZero();
+    }
+
+    long active_size = ssize(m_Index);
+    real_t pg_max_old = infinity;
+    real_t pg_min_old = -infinity;
+    real_t initial_gap = infinity;
+    real_t gap = infinity;
+
+    for(long iter = 1; iter <= m_MaxIter; ++iter) {
+        set_tag(TAG_ITERATION, iter);
+        std::shuffle(m_Index.begin(), m_Index.begin() + active_size, m_Random);
+
+        real_t pg_max_new = -infinity;
+        real_t pg_min_new = infinity;
+        for(long s = 0; s < active_size; ++s) {
+            long i = m_Index[s];
+            real_t y = labels.coeff(i);
+            real_t alpha = m_Alpha.coeff(i);
+            real_t G = y * row_dot(features, i, w) - 1 + diagonal_shift(i) * alpha;
+            real_t U = upper_bound(i);
+
+            // shrinking: variables at their bounds whose gradient points outwards are unlikely to change
+            real_t PG = 0;
+            if(alpha == 0) {
+                if(G > pg_max_old) {
+                    --active_size;
+                    std::swap(m_Index[s], m_Index[active_size]);
+                    --s;
+                    continue;
+                }
+                PG = std::min(G, real_t{0});
+            } else if(alpha == U) {
+                if(G < pg_min_old) {
+                    --active_size;
+                    std::swap(m_Index[s], m_Index[active_size]);
+                    --s;
+                    continue;
+                }
+                PG = std::max(G, real_t{0});
+            } else {
+                PG = G;
+            }
+
+            pg_max_new = std::max(pg_max_new, PG);
+            pg_min_new = std::min(pg_min_new, PG);
+
+            if(std::abs(PG) > 1e-12) {
+                real_t new_alpha = std::min(std::max(alpha - G / m_Diagonal.coeff(i), real_t{0}), U);
+                m_Alpha.coeffRef(i) = new_alpha;
+                add_row(features, i, (new_alpha - alpha) * y, w);
+            }
+        }
+
+        gap = pg_max_new - pg_min_new;
+        if(iter == 1) {
+            initial_gap = gap;
+        }
+        record(STAT_PG_GAP, gap);
+        record(STAT_ACTIVE_SET, active_size);
+        if(m_Logger) {
+            m_Logger->info("iter {:3}: gap={:<8.4} active={}", iter, gap, active_size);
+        }
+
+        if(gap <= m_Epsilon) {
+            if(active_size == ssize(m_Index)) {
+                weights = w;
+                return {MinimizerStatus::SUCCESS, iter, primal_value(), gap, initial_value, initial_gap};
+            }
+            // the shrunk problem has converged; verify on the full problem
+            active_size = ssize(m_Index);
+            pg_max_old = infinity;
+            pg_min_old = -infinity;
+            continue;
+        }
+        if(check_validation(iter, w)) {
+            weights = w;
+            return {MinimizerStatus::SUCCESS, iter, primal_value(), gap, initial_value, initial_gap};
+        }
+
+        pg_max_old = pg_max_new <= 0 ? infinity : pg_max_new;
+        pg_min_old = pg_min_new >= 0 ? -infinity : pg_min_new;
+    }
+
+    weights = w;
+    return {MinimizerStatus::TIMED_OUT, m_MaxIter, primal_value(), gap, initial_value, initial_gap};
+}
+
+#include "doctest.h"
+#include "utils/test_utils.h"
+
+TEST_CASE("dual coordinate descent") {
+    auto problem = make_solver_test_problem(2.0);
+    const SparseFeatures& features = problem.Features;
+    const BinaryLabelVector& labels = problem.Labels;
+    auto& objective = *problem.Objective;
+    // the squared hinge solution has to agree with the one found by the newton solver
+    const DenseRealVector& reference = problem.Reference;
+
+    DualCoordinateDescent dcd(DualCoordinateDescent::LossType::SQUARED_HINGE, 0.5);
+    dcd.set_epsilon(1e-5);
+    DenseRealVector weights = DenseRealVector::Zero(3);
+    auto result = dcd.minimize(objective, weights);
+    CHECK(result.Outcome == MinimizerStatus::SUCCESS);
+    for(int i = 0; i < 3; ++i) {
+        CHECK(weights.coeff(i) == doctest::Approx(reference.coeff(i)).epsilon(1e-3));
+    }
+    CHECK(result.FinalValue == doctest::Approx(objective.value(HashVector{weights})).epsilon(1e-4));
+
+    // starting at the solution, the warm start should need much fewer iterations
+    auto warm = dcd.minimize(objective, weights);
+    CHECK(warm.NumIters < result.NumIters / 2);
+    CHECK(warm.InitialValue == doctest::Approx(result.FinalValue).epsilon(1e-4));
+
+    // for the hinge loss, check the optimality conditions of the primal problem: the subgradient needs to contain 0
+    dcd.set_loss(DualCoordinateDescent::LossType::HINGE);
+    weights.setZero();
+    result = dcd.minimize(objective, weights);
+    CHECK(result.Outcome == MinimizerStatus::SUCCESS);
+    real_t f = result.FinalValue;
+    for(int i = 0; i < 3; ++i) {
+        for(real_t delta : {-1e-2f, 1e-2f}) {
+            DenseRealVector shifted = weights;
+            shifted.coeffRef(i) += delta;
+            real_t shifted_value = 0.25f * shifted.squaredNorm();
+            for(int j = 0; j < 8; ++j) {
+                real_t margin = labels.coeff(j) * row_dot(features, j, shifted);
+                shifted_value += (labels.coeff(j) == 1 ? 1.0f : 2.0f) * std::max(0.f, 1 - margin);
+            }
+            CHECK(shifted_value >= f - 1e-4);
+        }
+    }
+
+    CHECK_THROWS(dcd.set_epsilon(0.0));
+    CHECK_THROWS(dcd.set_regularization(-1.0));
+    CHECK_THROWS(dcd.set_maximum_iterations(0));
+}
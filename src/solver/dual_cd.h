@@ -0,0 +1,72 @@
+// Copyright (c) 2021, Aalto University, developed by Erik Schultheis
+// All rights reserved.
+//
+// SPDX-License-Identifier: MIT
+
+#ifndef DISMEC_SRC_SOLVER_DUAL_CD_H
+#define DISMEC_SRC_SOLVER_DUAL_CD_H
+
+#include "solver/minimizer.h"
+#include <random>
+#include <vector>
+
+namespace dismec::solvers {
+    /*!
+     * \brief Dual coordinate descent for L2-regularized (squared) hinge loss SVMs.
+     * \details This implements the algorithm of Hsieh et al., "A Dual Coordinate Descent Method for Large-scale Linear
+     * SVM" (ICML 2008), including the shrinking heuristic, as used in LIBLINEAR. Instead of going through the generic
+     * \ref objective::Objective interface, this minimizer works directly on the features, labels, and costs of a
+     * \ref objective::LinearClassifierBase. The objective is assumed to be
+     * \f[ \frac{\lambda}{2} \|w\|^2 + \sum_i c_i \ell(y_i \langle x_i, w \rangle), \f]
+     * where \f$\lambda\f$ is given by `set_regularization()` and the loss \f$\ell\f$ by `set_loss()`. The objective that
+     * is passed to `minimize()` is only used as the source of the data. For the hinge loss, this means that the
+     * objective may be a smoothed approximation, but this minimizer solves the actual non-smooth problem.
+     *
+     * If the initial weight vector is nonzero, it is used to derive a starting point for the dual variables from the
+     * optimality conditions. This warm start is only used if it has a lower dual objective than starting from zero.
+     *
+     * The stopping criterion is the gap between the largest and the smallest projected gradient of the dual problem,
+     * which is also reported as the gradient in the `MinimizationResult`. The values are those of the primal objective.
+     * The tolerance for this gap is an absolute value, which is available as the hyper-parameter `pg-gap`. Unlike the
+     * `epsilon` of the other minimizers, it is not relative to the initial gradient.
+     */
+    class DualCoordinateDescent : public Minimizer {
+    public:
+        enum class LossType {
+            HINGE,
+            SQUARED_HINGE
+        };
+
+        explicit DualCoordinateDescent(LossType loss = LossType::SQUARED_HINGE, real_t regularization = 1.0);
+
+        // hyperparameters
+        void set_epsilon(double eps);
+        double get_epsilon() const { return m_Epsilon; }
+
+        void set_maximum_iterations(long max_iter);
+        long get_maximum_iterations() const { return m_MaxIter; }
+
+        void set_loss(LossType loss) { m_Loss = loss; }
+        void set_regularization(real_t strength);
+
+    private:
+        MinimizationResult run(objective::Objective& objective, Eigen::Ref<DenseRealVector> init) override;
+
+        template<class Matrix>
+        MinimizationResult run_on(const Matrix& features, const BinaryLabelVector& labels, const DenseRealVector& costs,
+                                  Eigen::Ref<DenseRealVector> weights);
+
+        double m_Epsilon = 0.1;
+        long m_MaxIter = 1000;
+        LossType m_Loss;
+        real_t m_Regularization;
+
+        // buffers
+        DenseRealVector m_Alpha;
+        DenseRealVector m_Diagonal;
+        std::vector<long> m_Index;
+        std::minstd_rand m_Random;
+    };
+}
+
+#endif //DISMEC_SRC_SOLVER_DUAL_CD_H
@@ -0,0 +1,246 @@
+// Copyright (c) 2021, Aalto University, developed by Erik Schultheis
+// All rights reserved.
+//
+// SPDX-License-Identifier: MIT
+
+#include "solver/lbfgs.h"
+#include "stats/collection.h"
+#include "stats/timer.h"
+
+using namespace dismec::solvers;
+
+namespace {
+    using dismec::stats::stat_id_t;
+
+    constexpr const stat_id_t STAT_GRADIENT_NORM_0{0};
+    constexpr const stat_id_t STAT_OBJECTIVE_VALUE{1};
+    constexpr const stat_id_t STAT_GRADIENT_NORM{2};
+    constexpr const stat_id_t STAT_LINESEARCH_STEPSIZE{3};
+    constexpr const stat_id_t STAT_LS_STEPS{4};
+    constexpr const stat_id_t STAT_ITER_TIME{5};
+    constexpr const stat_id_t STAT_HISTORY_SIZE{6};
+    constexpr const stat_id_t STAT_PROGRESS{7};
+
+    constexpr const dismec::stats::tag_id_t TAG_ITERATION{0};
+}
+
+LBFGS::LBFGS(long num_variables, long history) : m_Gradient(num_variables), m_Direction(num_variables),
+                                                 m_Weights(DenseRealVector(num_variables))
+{
+    set_history_size(history);
+
+    declare_hyper_parameter("epsilon", &LBFGS::get_epsilon, &LBFGS::set_epsilon);
+    declare_hyper_parameter("max-steps", &LBFGS::get_maximum_iterations, &LBFGS::set_maximum_iterations);
+    declare_hyper_parameter("history", &LBFGS::get_history_size, &LBFGS::set_history_size);
+    declare_sub_object("search", &LBFGS::m_LineSearcher);
+
+    declare_stat(STAT_GRADIENT_NORM_0, {"grad_norm_0", "|g_0|"});
+    declare_stat(STAT_OBJECTIVE_VALUE, {"objective", "loss"});
+    declare_stat(STAT_GRADIENT_NORM, {"grad_norm", "|g|"});
+    declare_stat(STAT_LINESEARCH_STEPSIZE, {"linesearch_step"});
+    declare_stat(STAT_LS_STEPS, {"linesearch_iters", "#steps"});
+    declare_stat(STAT_ITER_TIME, {"iter_time", "duration [µs]"});
+    declare_stat(STAT_HISTORY_SIZE, {"history_size", "#pairs"});
+    declare_stat(STAT_PROGRESS, {"progress", "|g|/|eps g_0|"});
+
+    declare_tag(TAG_ITERATION, "iteration");
+}
+
+void LBFGS::compute_direction() {
+    // two-loop recursion, see Nocedal & Wright, Algorithm 7.4
+    m_Direction = -m_Gradient;
+    for(long i = m_Count - 1; i >= 0; --i) {
+        long k = slot(i);
+        real_t alpha = m_Rho.coeff(k) * m_Steps.col(k).dot(m_Direction);
+        m_Coefficients.coeffRef(k) = alpha;
+        m_Direction -= alpha * m_GradDiffs.col(k);
+    }
+
+    // initial hessian approximation gamma I, with gamma = s^T y / y^T y of the latest pair
+    if(m_Count > 0) {
+        long k = slot(m_Count - 1);
+        m_Direction *= 1 / (m_Rho.coeff(k) * m_GradDiffs.col(k).squaredNorm());
+    }
+
+    for(long i = 0; i < m_Count; ++i) {
+        long k = slot(i);
+        real_t beta = m_Rho.coeff(k) * m_GradDiffs.col(k).dot(m_Direction);
+        m_Direction += (m_Coefficients.coeff(k) - beta) * m_Steps.col(k);
+    }
+}
+
+MinimizationResult LBFGS::run(objective::Objective& objective, Eigen::Ref<DenseRealVector> init)
+{
+    objective.gradient_at_zero(m_Gradient);
+    real_t gnorm0 = m_Gradient.norm();
+    record(STAT_GRADIENT_NORM_0, gnorm0);
+
+    m_Weights = init;
+    m_Begin = 0;
+    m_Count = 0;
+
+    real_t f = objective.value(m_Weights);
+    objective.gradient(m_Weights, m_Gradient);
+    real_t gnorm = m_Gradient.norm();
+
+    const real_t f_start = f;
+    const real_t gnorm_start = gnorm;
+
+    if(!std::isfinite(f) || !std::isfinite(gnorm) || !std::isfinite(gnorm0)) {
+        spdlog::error("Invalid L-BFGS optimization: initial value: {}, gradient norm: {}, gnorm_0: {}", f, gnorm, gnorm0);
+        return {MinimizerStatus::FAILED, 0, f, gnorm, f, gnorm};
+    }
+
+    if(m_Logger) {
+        m_Logger->info("initial: f={:<5.3} |g|={:<5.3} |g_0|={:<5.3} eps={:<5.3}", f, gnorm, gnorm0, m_Epsilon);
+    }
+
+    if (gnorm <= m_Epsilon * gnorm0)
+        return {MinimizerStatus::SUCCESS, 0, f, gnorm, f, gnorm};
+
+    for(int iter = 1; iter <= m_MaxIter; ++iter) {
+        set_tag(TAG_ITERATION, iter);
+        auto scope_timer = make_timer(STAT_ITER_TIME);
+
+        compute_direction();
+        real_t gTd = m_Gradient.dot(m_Direction);
+        if(m_Count == 0 || gTd >= 0) {
+            // without curvature information, we start with a steepest descent step of length one
+            m_Count = 0;
+            m_Direction = -m_Gradient / std::max(gnorm, real_t{1});
+            gTd = m_Gradient.dot(m_Direction);
+        }
+
+        objective.project_to_line(m_Weights, m_Direction);
+        auto ls_result = m_LineSearcher.search([&](real_t a){ return objective.lookup_on_line(a); }, gTd, f);
+        if (ls_result.StepSize == 0) {
+            if(m_Count > 0) {
+                spdlog::warn("line search failed in iteration {} of L-BFGS, resetting history", iter);
+                m_Count = 0;
+                continue;
+            }
+            spdlog::warn("line search failed in iteration {} of L-BFGS. Current objective value: {:.3}, "
+                         "gradient norm: {:.3} (target: {:.3})", iter, f, gnorm, m_Epsilon * gnorm0);
+            init = m_Weights.get();
+            return {MinimizerStatus::FAILED, iter, f, gnorm, f_start, gnorm_start};
+        }
+
+        real_t fold = f;
+        f = ls_result.Value;
+        real_t step = ls_result.StepSize;
+        m_Weights.modify() += step * m_Direction;
+        objective.declare_vector_on_last_line(m_Weights, step);
+
+        // the new pair overwrites the oldest one if the buffer is full
+        long k = m_Count < m_Steps.cols() ? slot(m_Count) : m_Begin;
+        m_Steps.col(k) = step * m_Direction;
+        m_GradDiffs.col(k) = -m_Gradient;
+        objective.gradient(m_Weights, m_Gradient);
+        m_GradDiffs.col(k) += m_Gradient;
+        gnorm = m_Gradient.norm();
+
+        real_t sTy = m_Steps.col(k).dot(m_GradDiffs.col(k));
+        bool full = m_Count == m_Steps.cols();
+        if(sTy > std::numeric_limits<real_t>::epsilon() * m_GradDiffs.col(k).squaredNorm()) {
+            m_Rho.coeffRef(k) = 1 / sTy;
+            if(full) {
+                m_Begin = slot(1);
+            } else {
+                ++m_Count;
+            }
+        } else if(full) {
+            // the oldest pair has already been overwritten
+            m_Begin = slot(1);
+            --m_Count;
+        }
+
+        record(STAT_OBJECTIVE_VALUE, f);
+        record(STAT_GRADIENT_NORM, gnorm);
+        record(STAT_LINESEARCH_STEPSIZE, step);
+        record(STAT_LS_STEPS, ls_result.NumIters);
+        record(STAT_HISTORY_SIZE, m_Count);
+        record(STAT_PROGRESS, real_t(gnorm / (m_Epsilon * gnorm0)));
+        if(m_Logger) {
+            m_Logger->info("iter {:3}: f={:<10.8} |g|={:<8.4} line-search={:<4.2} history={}",
+                           iter, f, gnorm, step, m_Count);
+        }
+
+        if (gnorm <= m_Epsilon * gnorm0 || check_validation(iter, m_Weights.get())) {
+            init = m_Weights.get();
+            return {MinimizerStatus::SUCCESS, iter, f, gnorm, f_start, gnorm_start};
+        }
+        if (f < -1.0e+32) {
+            spdlog::warn("Objective appears to be unbounded (got value {:.2})", f);
+            init = m_Weights.get();
+            return {MinimizerStatus::DIVERGED, iter, f, gnorm, f_start, gnorm_start};
+        }
+        if (std::abs(fold - f) <= 1.0e-12 * std::abs(f)) {
+            spdlog::warn("relative improvement too low");
+            init = m_Weights.get();
+            return {MinimizerStatus::FAILED, iter, f, gnorm, f_start, gnorm_start};
+        }
+    }
+
+    init = m_Weights.get();
+    return {MinimizerStatus::TIMED_OUT, m_MaxIter, f, gnorm, f_start, gnorm_start};
+}
+
+void LBFGS::set_epsilon(double eps) {
+    if(eps <= 0) {
+        spdlog::error("Non-positive epsilon {} specified for L-BFGS minimization", eps);
+        throw std::invalid_argument("Epsilon must be larger than zero.");
+    }
+    m_Epsilon = eps;
+}
+
+void LBFGS::set_maximum_iterations(long max_iter) {
+    if(max_iter <= 0) {
+        spdlog::error("Non-positive iteration limit {} specified for L-BFGS minimization", max_iter);
+        throw std::invalid_argument("maximum iterations must be larger than zero.");
+    }
+    m_MaxIter = max_iter;
+}
+
+void LBFGS::set_history_size(long history) {
+    if(history <= 0) {
+        spdlog::error("Non-positive history size {} specified for L-BFGS minimization", history);
+        throw std::invalid_argument("history size must be larger than zero.");
+    }
+    long num_variables = m_Gradient.size();
+    m_Steps.resize(num_variables, history);
+    m_GradDiffs.resize(num_variables, history);
+    m_Rho.resize(history);
+    m_Coefficients.resize(history);
+    m_Begin = 0;
+    m_Count = 0;
+}
+
+#include "doctest.h"
+#include "utils/test_utils.h"
+
+using namespace dismec;
+
+TEST_CASE("lbfgs") {
+    auto problem = make_solver_test_problem();
+    auto& objective = *problem.Objective;
+    const DenseRealVector& reference = problem.Reference;
+
+    // a history that is smaller than the number of iterations exercises the ring buffer
+    LBFGS lbfgs(3, 2);
+    lbfgs.set_epsilon(1e-4);
+    DenseRealVector weights = DenseRealVector::Zero(3);
+    auto result = lbfgs.minimize(objective, weights);
+    CHECK(result.Outcome == MinimizerStatus::SUCCESS);
+    CHECK(result.NumIters > 2);
+    CHECK(result.FinalValue == doctest::Approx(objective.value(HashVector{weights})));
+    for(int i = 0; i < 3; ++i) {
+        CHECK(weights.coeff(i) == doctest::Approx(reference.coeff(i)).epsilon(1e-2));
+    }
+
+    // hp interface
+    lbfgs.set_hyper_parameter("history", 5l);
+    CHECK(lbfgs.get_history_size() == 5);
+    lbfgs.set_hyper_parameter("search.eta", 0.1);
+    CHECK_THROWS(lbfgs.set_history_size(0));
+    CHECK_THROWS(lbfgs.set_epsilon(0.0));
+}
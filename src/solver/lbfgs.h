@@ -0,0 +1,73 @@
+// Copyright (c) 2021, Aalto University, developed by Erik Schultheis
+// All rights reserved.
+//
+// SPDX-License-Identifier: MIT
+
+#ifndef DISMEC_SRC_SOLVER_LBFGS_H
+#define DISMEC_SRC_SOLVER_LBFGS_H
+
+#include "solver/minimizer.h"
+#include "solver/line_search.h"
+#include "utils/hash_vector.h"
+
+namespace dismec::solvers
+{
+    /*!
+     * \brief Limited-memory BFGS with backtracking line search.
+     * \details This minimizer only requires the value and gradient of the objective, and the line projection for the
+     * line search. It is thus suitable for objectives whose second derivative is only approximated, e.g. the
+     * Huber-hinge loss or the elastic-net regularizer. The last `history` pairs of steps and gradient differences are
+     * kept in a ring buffer that is allocated once, so that an iteration costs `O(history * num_variables)` operations
+     * and performs no allocations.
+     *
+     * Since the line search only ensures sufficient decrease, a pair is only added to the history if it satisfies the
+     * curvature condition \f$ s^T y > 0 \f$. If the line search fails, the history is discarded and the iteration is
+     * retried with the steepest descent direction.
+     *
+     * The stopping criterion is the same as for \ref NewtonWithLineSearch.
+     */
+    class LBFGS : public Minimizer {
+    public:
+        explicit LBFGS(long num_variables, long history = 10);
+
+        // hyperparameters
+        void set_epsilon(double eps);
+        double get_epsilon() const { return m_Epsilon; }
+
+        void set_maximum_iterations(long max_iter);
+        long get_maximum_iterations() const { return m_MaxIter; }
+
+        /// Sets the number of correction pairs that are kept. This reallocates the history buffers.
+        void set_history_size(long history);
+        long get_history_size() const { return m_Steps.cols(); }
+
+    private:
+        MinimizationResult run(objective::Objective& objective, Eigen::Ref<DenseRealVector> init) override;
+
+        /// Calculates the search direction \f$ -H g \f$ into `m_Direction` using the two-loop recursion.
+        void compute_direction();
+
+        /// Index of the `i`th oldest entry in the ring buffer
+        long slot(long i) const { return (m_Begin + i) % m_Steps.cols(); }
+
+        double m_Epsilon = 0.01;
+        long m_MaxIter = 1000;
+
+        BacktrackingLineSearch m_LineSearcher;
+
+        // history ring buffer
+        types::DenseColMajor<real_t> m_Steps;           //!< s_k = x_{k+1} - x_k
+        types::DenseColMajor<real_t> m_GradDiffs;       //!< y_k = g_{k+1} - g_k
+        DenseRealVector m_Rho;                          //!< 1 / (s_k^T y_k)
+        DenseRealVector m_Coefficients;                 //!< alpha_k of the two-loop recursion
+        long m_Begin = 0;
+        long m_Count = 0;
+
+        // buffers
+        DenseRealVector m_Gradient;
+        DenseRealVector m_Direction;
+        HashVector      m_Weights;
+    };
+}
+
+#endif //DISMEC_SRC_SOLVER_LBFGS_H
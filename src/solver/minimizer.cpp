@@ -6,8 +6,11 @@
 #include "minimizer.h"
 #include <vector>
 #include <stdexcept>
+#include <cmath>
 #include "spdlog/spdlog.h"
 #include "stats/collection.h"
+#include "utils/eigen_generic.h"
+#include "utils/conversion.h"
 
 using namespace dismec::solvers;
 
@@ -27,12 +30,62 @@ MinimizationResult Minimizer::minimize(objective::Objective& objective, Eigen::R
         throw std::invalid_argument("Weight vector incompatible with problem size");
     }
 
+    m_HasValidationScores = false;
     auto start = std::chrono::steady_clock::now();
     auto result = run(objective, init);
     result.Duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
     return result;
 }
 
+void Minimizer::set_validation_stopping(std::shared_ptr<const GenericFeatureMatrix> features, long interval,
+                                        real_t tolerance) {
+    if(interval <= 0) {
+        throw std::invalid_argument("validation interval must be larger than zero.");
+    }
+    if(tolerance < 0) {
+        throw std::invalid_argument("validation tolerance must not be negative.");
+    }
+    m_ValidationFeatures = std::move(features);
+    m_ValidationInterval = interval;
+    m_ValidationTolerance = tolerance;
+
+    if(m_StatValidationChange.to_index() < 0) {
+        long next = ssize(get_stats()->get_statistics_meta());
+        m_StatValidationChange = stats::stat_id_t{next};
+        m_StatEarlyStop = stats::stat_id_t{next + 1};
+        declare_stat(m_StatValidationChange, {"validation_change", "max |Δs| / max |s|"});
+        declare_stat(m_StatEarlyStop, {"early_stop", "iteration"});
+    }
+}
+
+bool Minimizer::check_validation(long iteration, const DenseRealVector& weights) {
+    if(!m_ValidationFeatures || iteration % m_ValidationInterval != 0) {
+        return false;
+    }
+
+    visit([&](const auto& features) {
+        m_NewValidationScores.noalias() = features * weights;
+    }, *m_ValidationFeatures);
+
+    bool converged = false;
+    if(m_HasValidationScores) {
+        real_t change = (m_NewValidationScores - m_ValidationScores).lpNorm<Eigen::Infinity>();
+        real_t scale = std::max(m_NewValidationScores.lpNorm<Eigen::Infinity>(), real_t{1});
+        record(m_StatValidationChange, change / scale);
+        converged = change <= m_ValidationTolerance * scale;
+    }
+    m_ValidationScores.swap(m_NewValidationScores);
+    m_HasValidationScores = true;
+
+    if(converged) {
+        record(m_StatEarlyStop, iteration);
+        if(m_Logger) {
+            m_Logger->info("iter {:3}: held-out scores have converged, stopping early", iteration);
+        }
+    }
+    return converged;
+}
+
 #include "doctest.h"
 
 using namespace dismec;
@@ -65,6 +118,20 @@ namespace
         void project_to_line_unchecked(const HashVector& location, const DenseRealVector& direction) override {};
         real_t lookup_on_line(real_t position) override { return 0.0; };
     };
+
+    //! A minimizer whose iterates approach (1, 2, 3), halving the distance in each iteration.
+    class ConvergingMinimizer : public Minimizer {
+        MinimizationResult run(Objective& objective, Eigen::Ref<DenseRealVector> init) override {
+            DenseRealVector target{{1.0, 2.0, 3.0}};
+            for(int iter = 1; iter <= 50; ++iter) {
+                DenseRealVector weights = (1.0 - std::pow(0.5, iter)) * target;
+                if(check_validation(iter, weights)) {
+                    return {MinimizerStatus::SUCCESS, iter, 0.0, 0.0, 0.0, 0.0};
+                }
+            }
+            return {MinimizerStatus::TIMED_OUT, 50, 0.0, 0.0, 0.0, 0.0};
+        }
+    };
 }
 
 /*!
@@ -101,3 +168,34 @@ TEST_CASE("minimizer base class minimize") {
         CHECK(result.NumIters == 55);
     }
 }
+
+/*!
+ * \test This checks that validation-based early stopping only looks at the held-out scores every `interval`
+ * iterations, stops once their relative change is below the tolerance, and starts from scratch for each `minimize()`
+ * call.
+ */
+TEST_CASE("validation early stopping") {
+    ConvergingMinimizer mnm;
+    MockObjective goal;
+    DenseRealVector vec(goal.num_variables());
+
+    DenseFeatures features(2, 3);
+    features << 1.0, 0.0, 1.0,
+                0.0, 2.0, -1.0;
+    auto validation = std::make_shared<const GenericFeatureMatrix>(features);
+
+    CHECK_THROWS(mnm.set_validation_stopping(validation, 0, 1e-3));
+    CHECK_THROWS(mnm.set_validation_stopping(validation, 2, -1.0));
+
+    // without validation data, we never stop early
+    CHECK(mnm.minimize(goal, vec).NumIters == 50);
+
+    // the change between checks at iterations k-2 and k is 0.75 * 0.5^(k-2) relative to the score of the target,
+    // so with a tolerance of 1e-3, the first check that succeeds is the one at k=12.
+    mnm.set_validation_stopping(validation, 2, 1e-3);
+    CHECK(mnm.minimize(goal, vec).NumIters == 12);
+    CHECK(mnm.minimize(goal, vec).NumIters == 12);
+
+    mnm.set_validation_stopping(nullptr, 2, 1e-3);
+    CHECK(mnm.minimize(goal, vec).NumIters == 50);
+}
@@ -41,10 +41,36 @@ namespace dismec::solvers
         /// sets the logger object that is used for progress tracking.
         void set_logger(std::shared_ptr<spdlog::logger> logger);
 
+        /*!
+         * \brief Enables early stopping based on the scores of held-out instances.
+         * \details Every `interval` iterations, the scores \f$ X w \f$ of the instances in `features` are calculated.
+         * If the largest change compared to the previous check, relative to the largest score (but at least 1), is
+         * below `tolerance`, the minimization is stopped and reported as successful. The relative changes are recorded
+         * in the `validation_change` statistics, and the iteration at which minimization was stopped early in
+         * `early_stop`. Passing a `nullptr` disables early stopping.
+         */
+        void set_validation_stopping(std::shared_ptr<const GenericFeatureMatrix> features, long interval,
+                                     real_t tolerance);
+
     protected:
         std::shared_ptr<spdlog::logger> m_Logger;
 
         virtual MinimizationResult run(objective::Objective& objective, Eigen::Ref<DenseRealVector> init) = 0;
+
+        /// This should be called by implementations after each iteration. If it returns true, minimization should stop.
+        bool check_validation(long iteration, const DenseRealVector& weights);
+
+    private:
+        std::shared_ptr<const GenericFeatureMatrix> m_ValidationFeatures;
+        long m_ValidationInterval = 1;
+        real_t m_ValidationTolerance = 0;
+        DenseRealVector m_ValidationScores;
+        DenseRealVector m_NewValidationScores;
+        bool m_HasValidationScores = false;
+
+        // these are declared after the stats of the implementation, so the ids are only known at runtime
+        stats::stat_id_t m_StatValidationChange{-1};
+        stats::stat_id_t m_StatEarlyStop{-1};
     };
 }
 
@@ -28,6 +28,13 @@ namespace {
     constexpr const stat_id_t STAT_LS_STEPS{10};
     constexpr const stat_id_t STAT_PROGRESS{11};
     constexpr const stat_id_t STAT_ABSOLUTE_STEP{12};
+    constexpr const stat_id_t STAT_HESSIAN_PRODUCTS{13};
+    constexpr const stat_id_t STAT_CG_TOLERANCE{14};
+
+    // parameters of the Eisenstat-Walker forcing sequence (choice 2)
+    constexpr const dismec::real_t FORCING_GAMMA = 0.9;
+    constexpr const dismec::real_t FORCING_MAX = 0.9;
+    constexpr const dismec::real_t FORCING_SAFEGUARD = 0.1;
 
     constexpr const dismec::stats::tag_id_t TAG_ITERATION{0};
 };
@@ -39,6 +46,8 @@ NewtonWithLineSearch::NewtonWithLineSearch(long num_variables) : m_CG_Solver(num
     declare_hyper_parameter("epsilon", &NewtonWithLineSearch::get_epsilon, &NewtonWithLineSearch::set_epsilon);
     declare_hyper_parameter("max-steps", &NewtonWithLineSearch::get_maximum_iterations, &NewtonWithLineSearch::set_maximum_iterations);
     declare_hyper_parameter("alpha-pcg", &NewtonWithLineSearch::get_alpha_preconditioner, &NewtonWithLineSearch::set_alpha_preconditioner);
+    declare_hyper_parameter("cg-warm-start", &NewtonWithLineSearch::get_warm_start_cg, &NewtonWithLineSearch::set_warm_start_cg);
+    declare_hyper_parameter("forcing", &NewtonWithLineSearch::get_adaptive_forcing, &NewtonWithLineSearch::set_adaptive_forcing);
     declare_sub_object("cg", &NewtonWithLineSearch::m_CG_Solver);
     declare_sub_object("search", &NewtonWithLineSearch::m_LineSearcher);
 
@@ -55,12 +64,35 @@ NewtonWithLineSearch::NewtonWithLineSearch(long num_variables) : m_CG_Solver(num
     declare_stat(STAT_LS_STEPS, {"linesearch_iters", "#steps"});
     declare_stat(STAT_PROGRESS, {"progress", "|g|/|eps g_0|"});
     declare_stat(STAT_ABSOLUTE_STEP, {"newton_step", ""});
+    declare_stat(STAT_HESSIAN_PRODUCTS, {"hessian_products", "#Hv"});
+    declare_stat(STAT_CG_TOLERANCE, {"cg_tolerance", ""});
 
     declare_tag(TAG_ITERATION, "iteration");
 }
 
 
 MinimizationResult NewtonWithLineSearch::run(objective::Objective& objective, Eigen::Ref<DenseRealVector> init)
+{
+    m_HessianProducts = 0;
+    auto result = run_newton(objective, init);
+    m_CG_Solver.set_forcing_tolerance(0);
+    // this is recorded once per minimization, in contrast to `cg_iters`, which is recorded for each newton step.
+    record(STAT_HESSIAN_PRODUCTS, m_HessianProducts);
+    return result;
+}
+
+dismec::real_t NewtonWithLineSearch::forcing_tolerance(real_t gnorm_old, real_t gnorm, real_t previous) const {
+    real_t ratio = gnorm / gnorm_old;
+    real_t eta = FORCING_GAMMA * ratio * ratio;
+    // prevent the tolerance from decreasing too quickly when the previous step happened to be very good
+    real_t safeguard = FORCING_GAMMA * previous * previous;
+    if(safeguard > FORCING_SAFEGUARD) {
+        eta = std::max(eta, safeguard);
+    }
+    return std::min(eta, FORCING_MAX);
+}
+
+MinimizationResult NewtonWithLineSearch::run_newton(objective::Objective& objective, Eigen::Ref<DenseRealVector> init)
 {
     // calculate gradient norm at w=0 for stopping condition.
     // first, check if the objective supports fast grad
@@ -106,6 +138,10 @@ MinimizationResult NewtonWithLineSearch::run(objective::Objective& objective, Ei
     if (gnorm <= m_Epsilon * gnorm0)
         return {MinimizerStatus::SUCCESS, 0, f, gnorm, f, gnorm};
 
+    // in the first iteration, the default tolerance of the CG solver is used
+    real_t cg_tolerance = 0;
+    m_CG_Solver.set_forcing_tolerance(0);
+
     for(int iter = 1; iter <= m_MaxIter; ++iter) {
         set_tag(TAG_ITERATION, iter);
         auto scope_timer = make_timer(STAT_ITER_TIME);
@@ -114,9 +150,17 @@ MinimizationResult NewtonWithLineSearch::run(objective::Objective& objective, Ei
         m_PreConditioner = (1 - m_Alpha_PCG) + (m_PreConditioner * m_Alpha_PCG).array();
 
         // Here, we solve min \| Hd + g \|
-        int cg_iter = m_CG_Solver.minimize([&](const DenseRealVector& d, Eigen::Ref<DenseRealVector> o) {
+        auto hessian_product = [&](const DenseRealVector& d, Eigen::Ref<DenseRealVector> o) {
+            ++m_HessianProducts;
             objective.hessian_times_direction(m_Weights, d, o);
-        }, m_Gradient, m_PreConditioner);
+        };
+        int cg_iter;
+        if(m_WarmStartCG && iter > 1) {
+            cg_iter = m_CG_Solver.minimize(hessian_product, m_Gradient, m_PreConditioner, m_CG_Solver.get_solution());
+        } else {
+            cg_iter = m_CG_Solver.minimize(hessian_product, m_Gradient, m_PreConditioner);
+        }
+        record(STAT_CG_TOLERANCE, cg_tolerance);
 
         const auto& cg_solution = m_CG_Solver.get_solution();
 
@@ -141,12 +185,17 @@ MinimizationResult NewtonWithLineSearch::run(objective::Objective& objective, Ei
         objective.declare_vector_on_last_line(m_Weights, ls_result.StepSize);
         objective.gradient_and_pre_conditioner(m_Weights, m_Gradient, m_PreConditioner);
 
+        real_t gnorm_old = gnorm;
         gnorm = m_Gradient.norm();
+        if(m_AdaptiveForcing) {
+            cg_tolerance = forcing_tolerance(gnorm_old, gnorm, cg_tolerance);
+            m_CG_Solver.set_forcing_tolerance(cg_tolerance);
+        }
 
         record_iteration(iter, cg_iter, gnorm, f, ls_result, m_Epsilon * gnorm0);
         record(STAT_ABSOLUTE_STEP, [&]() -> real_t { return cg_solution.norm(); });
 
-        if (gnorm <= m_Epsilon * gnorm0) {
+        if (gnorm <= m_Epsilon * gnorm0 || check_validation(iter, m_Weights.get())) {
             init = m_Weights.get();
             return {MinimizerStatus::SUCCESS, iter, f, gnorm, f_start, gnorm_start};
         }
@@ -199,6 +248,24 @@ void NewtonWithLineSearch::set_maximum_iterations(long max_iter) {
     m_MaxIter = max_iter;
 }
 
+void NewtonWithLineSearch::set_warm_start_cg(long enable) {
+    if(enable != 0 && enable != 1) {
+        throw std::invalid_argument("cg-warm-start needs to be 0 or 1");
+    }
+    m_WarmStartCG = enable;
+}
+
+void NewtonWithLineSearch::set_adaptive_forcing(long enable) {
+    if(enable != 0 && enable != 1) {
+        throw std::invalid_argument("forcing needs to be 0 or 1");
+    }
+    m_AdaptiveForcing = enable;
+}
+
+void NewtonWithLineSearch::set_preconditioner(std::unique_ptr<Preconditioner> preconditioner) {
+    m_CG_Solver.set_preconditioner(std::move(preconditioner));
+}
+
 void NewtonWithLineSearch::set_alpha_preconditioner(double alpha) {
     if(alpha <= 0 || alpha >= 1) {
         spdlog::error("The `alpha_pcg` parameter needs to be between 0 and 1, got {} ", alpha);
@@ -238,6 +305,11 @@ TEST_CASE("newton with line search hyperparameters") {
             CHECK( std::get<long>(nwls.get_hyper_parameter("max-steps")) == 50);
     nwls.set_hyper_parameter("alpha-pcg", 0.3);
             CHECK( std::get<double>(nwls.get_hyper_parameter("alpha-pcg")) == 0.3);
+    nwls.set_hyper_parameter("cg-warm-start", 1l);
+            CHECK( nwls.get_warm_start_cg() == 1);
+    nwls.set_hyper_parameter("forcing", 1l);
+            CHECK( nwls.get_adaptive_forcing() == 1);
+    CHECK_THROWS(nwls.set_hyper_parameter("forcing", 2l));
 }
 
 TEST_CASE("solve square objective") {
@@ -297,4 +369,13 @@ TEST_CASE("solve square objective") {
     for(int i = 0; i < w.size(); ++i) {
         CHECK(w.coeff(i) == doctest::Approx(direct.coeff(i)));
     }
+
+    // warm-started CG and adaptive forcing still find the minimum
+    solver.set_warm_start_cg(1);
+    solver.set_adaptive_forcing(1);
+    w = DenseRealVector::Random(4);
+    solver.minimize(objective, w);
+    for(int i = 0; i < w.size(); ++i) {
+        CHECK(w.coeff(i) == doctest::Approx(direct.coeff(i)));
+    }
 }
@@ -27,13 +27,38 @@ namespace dismec::solvers
         void set_alpha_preconditioner(double alpha);
         double get_alpha_preconditioner() const { return m_Alpha_PCG; }
 
+        /// If enabled, CG starts from the newton direction of the previous iteration instead of from zero.
+        void set_warm_start_cg(long enable);
+        long get_warm_start_cg() const { return m_WarmStartCG; }
+
+        /*!
+         * \brief If enabled, the CG tolerance is chosen by the Eisenstat-Walker forcing sequence.
+         * \details The forcing term in iteration `k` is `0.9 (|g_k| / |g_{k-1}|)^2`, safeguarded against decreasing too
+         * quickly and bounded by 0.9. It is used as a lower bound for the CG tolerance. Far from the optimum, where the
+         * gradient decreases slowly, this results in a loose tolerance and thus cheap newton steps.
+         */
+        void set_adaptive_forcing(long enable);
+        long get_adaptive_forcing() const { return m_AdaptiveForcing; }
+
+        /// Sets the preconditioner for CG, see \ref CGMinimizer::set_preconditioner.
+        void set_preconditioner(std::unique_ptr<Preconditioner> preconditioner);
+
     private:
         MinimizationResult run(objective::Objective& objective, Eigen::Ref<DenseRealVector> init) override;
+        MinimizationResult run_newton(objective::Objective& objective, Eigen::Ref<DenseRealVector> init);
+
+        /// Calculates the CG tolerance for the next iteration, given the previous and current gradient norm.
+        real_t forcing_tolerance(real_t gnorm_old, real_t gnorm, real_t previous) const;
 
         // newton parameters
         double m_Epsilon = 0.01;
         double m_Alpha_PCG = 0.01;
         long m_MaxIter = 1000;
+        bool m_WarmStartCG = false;
+        bool m_AdaptiveForcing = false;
+
+        /// Number of hessian-vector products in the current minimization.
+        long m_HessianProducts = 0;
 
         // sub-algorithms
         CGMinimizer m_CG_Solver;
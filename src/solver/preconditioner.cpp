@@ -0,0 +1,257 @@
+// Copyright (c) 2021, Aalto University, developed by Erik Schultheis
+// All rights reserved.
+//
+// SPDX-License-Identifier: MIT
+
+#include "solver/preconditioner.h"
+#include "utils/eigen_generic.h"
+#include "utils/throw_error.h"
+#include <Eigen/Eigenvalues>
+#include <Eigen/QR>
+#include <random>
+
+using namespace dismec;
+using namespace dismec::solvers;
+
+void DiagonalPreconditioner::update(const DenseRealVector& diagonal) {
+    m_Diagonal = &diagonal;
+}
+
+void DiagonalPreconditioner::apply(const DenseRealVector& residual, Eigen::Ref<DenseRealVector> target) {
+    target = residual.array() / m_Diagonal->array();
+}
+
+void CorrelationPreconditioner::update(const DenseRealVector& diagonal) {
+    m_InvSqrtDiagonal = diagonal.array().rsqrt();
+}
+
+void CorrelationPreconditioner::apply(const DenseRealVector& residual, Eigen::Ref<DenseRealVector> target) {
+    target = residual.cwiseProduct(m_InvSqrtDiagonal);
+    solve_correlation(target);
+    target.array() *= m_InvSqrtDiagonal.array();
+}
+
+BlockDiagonalPreconditioner::BlockDiagonalPreconditioner(std::shared_ptr<const BlockCorrelation> correlation) :
+    m_Correlation(std::move(correlation)) {
+}
+
+void BlockDiagonalPreconditioner::solve_correlation(Eigen::Ref<DenseRealVector> vector) {
+    long start = 0;
+    for(const auto& factor : m_Correlation->Factors) {
+        long size = factor.rows();
+        factor.solveInPlace(vector.segment(start, size));
+        start += size;
+    }
+}
+
+LowRankPreconditioner::LowRankPreconditioner(std::shared_ptr<const LowRankCorrelation> correlation) :
+    m_Correlation(std::move(correlation)), m_Projection(m_Correlation->Basis.cols()) {
+}
+
+void LowRankPreconditioner::solve_correlation(Eigen::Ref<DenseRealVector> vector) {
+    // Woodbury: (E + VV^T)^{-1} = E^{-1} - E^{-1} V (I + V^T E^{-1} V)^{-1} V^T E^{-1}
+    const auto& c = *m_Correlation;
+    vector.array() /= c.Diagonal.array();
+    m_Projection.noalias() = c.Basis.transpose() * vector;
+    c.Core.solveInPlace(m_Projection);
+    vector.noalias() -= (c.Basis * m_Projection).cwiseQuotient(c.Diagonal);
+}
+
+namespace {
+    /// Returns \f$ \textrm{diag}(X^T X)^{-1/2} \f$, with zero for features that never occur.
+    DenseRealVector inverse_feature_norms(const GenericFeatureMatrix& features) {
+        DenseRealVector norms = visit([](const auto& matrix) -> DenseRealVector {
+            DenseRealVector result = DenseRealVector::Zero(matrix.cols());
+            for(long row = 0; row < matrix.rows(); ++row) {
+                result += matrix.row(row).cwiseAbs2().transpose();
+            }
+            return result;
+        }, features);
+        return norms.unaryExpr([](real_t v) { return v > 0 ? 1 / std::sqrt(v) : real_t{0}; });
+    }
+
+    void check_strength(real_t strength) {
+        if(strength < 0 || strength >= 1) {
+            THROW_EXCEPTION(std::invalid_argument, "Preconditioner strength must be in [0, 1), got {}", strength);
+        }
+    }
+
+    /// Accumulates \f$ X_b^T X_b \f$ for all blocks of consecutive features.
+    void accumulate_blocks(const SparseFeatures& features, long block_size,
+                           std::vector<types::DenseColMajor<real_t>>& blocks) {
+        for (long row = 0; row < features.outerSize(); ++row) {
+            for (SparseFeatures::InnerIterator a(features, row); a; ++a) {
+                long block = a.col() / block_size;
+                auto& target = blocks[block];
+                long offset = block * block_size;
+                // the columns within a row are sorted, so all remaining pairs within the block follow `a`
+                for (SparseFeatures::InnerIterator b = a; b && b.col() / block_size == block; ++b) {
+                    real_t v = a.value() * b.value();
+                    target.coeffRef(a.col() - offset, b.col() - offset) += v;
+                    if(a.col() != b.col()) {
+                        target.coeffRef(b.col() - offset, a.col() - offset) += v;
+                    }
+                }
+            }
+        }
+    }
+
+    void accumulate_blocks(const DenseFeatures& features, long block_size,
+                           std::vector<types::DenseColMajor<real_t>>& blocks) {
+        for(std::size_t block = 0; block < blocks.size(); ++block) {
+            auto cols = features.middleCols(block * block_size, blocks[block].cols());
+            blocks[block].noalias() = cols.transpose() * cols;
+        }
+    }
+}
+
+std::shared_ptr<const BlockCorrelation> dismec::solvers::make_block_correlation(const GenericFeatureMatrix& features,
+                                                                                long block_size, real_t strength) {
+    check_strength(strength);
+    if(block_size <= 0) {
+        THROW_EXCEPTION(std::invalid_argument, "Block size must be positive, got {}", block_size);
+    }
+
+    long num_features = features.cols();
+    long num_blocks = (num_features + block_size - 1) / block_size;
+    std::vector<types::DenseColMajor<real_t>> blocks;
+    blocks.reserve(num_blocks);
+    for(long block = 0; block < num_blocks; ++block) {
+        long size = std::min(block_size, num_features - block * block_size);
+        blocks.emplace_back(types::DenseColMajor<real_t>::Zero(size, size));
+    }
+
+    visit([&](const auto& matrix) { accumulate_blocks(matrix, block_size, blocks); }, features);
+
+    DenseRealVector scale = inverse_feature_norms(features);
+    auto result = std::make_shared<BlockCorrelation>();
+    result->BlockSize = block_size;
+    result->Factors.reserve(num_blocks);
+    for(long block = 0; block < num_blocks; ++block) {
+        auto& gram = blocks[block];
+        auto s = scale.segment(block * block_size, gram.rows());
+        gram = strength * (s.asDiagonal() * gram * s.asDiagonal());
+        gram.diagonal().array() += 1 - strength;
+        result->Factors.emplace_back(gram);
+    }
+    return result;
+}
+
+std::shared_ptr<const LowRankCorrelation> dismec::solvers::make_low_rank_correlation(const GenericFeatureMatrix& features,
+                                                                                     long rank, real_t strength,
+                                                                                     unsigned seed) {
+    check_strength(strength);
+    long num_features = features.cols();
+    if(rank <= 0 || rank > num_features) {
+        THROW_EXCEPTION(std::invalid_argument, "Rank must be in [1, {}], got {}", num_features, rank);
+    }
+
+    DenseRealVector scale = inverse_feature_norms(features);
+    // calculates C * in = S X^T X S in
+    auto correlation_times = [&](const types::DenseColMajor<real_t>& in) -> types::DenseColMajor<real_t> {
+        return visit([&](const auto& matrix) -> types::DenseColMajor<real_t> {
+            types::DenseColMajor<real_t> projected = matrix * (scale.asDiagonal() * in);
+            return scale.asDiagonal() * (matrix.transpose() * projected);
+        }, features);
+    };
+
+    // randomized range finder for the dominant subspace of C
+    std::mt19937 rng(seed);
+    std::normal_distribution<real_t> normal;
+    types::DenseColMajor<real_t> sketch = types::DenseColMajor<real_t>::NullaryExpr(num_features, rank,
+                                                                                    [&]() { return normal(rng); });
+    sketch = correlation_times(sketch);
+    types::DenseColMajor<real_t> Q = sketch.householderQr().householderQ() *
+                                     types::DenseColMajor<real_t>::Identity(num_features, rank);
+
+    // Rayleigh-Ritz: C \approx Q U Lambda U^T Q^T
+    types::DenseColMajor<real_t> small = Q.transpose() * correlation_times(Q);
+    Eigen::SelfAdjointEigenSolver<types::DenseColMajor<real_t>> eigen(small);
+    DenseRealVector eigenvalues = eigen.eigenvalues().cwiseMax(0);
+
+    auto result = std::make_shared<LowRankCorrelation>();
+    // V = sqrt(beta Lambda) Q U, so that beta C \approx V V^T
+    result->Basis = Q * eigen.eigenvectors() * (strength * eigenvalues).cwiseSqrt().asDiagonal();
+
+    // choose E such that the diagonal matches that of (1-beta) I + beta C. Since C has a unit diagonal (except for
+    // features that never occur), the residual diagonal is non-negative up to rounding.
+    DenseRealVector target_diagonal = (scale.array() > 0).select(DenseRealVector::Ones(num_features),
+                                                                 DenseRealVector::Zero(num_features));
+    DenseRealVector low_rank_diagonal = result->Basis.rowwise().squaredNorm();
+    result->Diagonal = ((strength * target_diagonal - low_rank_diagonal).array().max(0) + (1 - strength)).matrix();
+
+    types::DenseColMajor<real_t> core = result->Basis.transpose() * result->Diagonal.cwiseInverse().asDiagonal() * result->Basis;
+    core.diagonal().array() += 1;
+    result->Core.compute(core);
+    return result;
+}
+
+#include "doctest.h"
+
+TEST_CASE("correlation preconditioners") {
+    // features 0 and 1 are strongly correlated, 2 is independent, and 3 never occurs
+    SparseFeatures features(6, 4);
+    std::vector<std::tuple<int, int, real_t>> entries = {{0, 0, 1.0}, {0, 1, 1.1}, {1, 0, 2.0}, {1, 1, 1.9},
+                                                         {2, 2, 1.0}, {3, 0, -1.0}, {3, 1, -1.0}, {3, 2, 0.5},
+                                                         {4, 2, -2.0}, {5, 0, 0.5}, {5, 1, 0.4}};
+    for(auto [row, col, value] : entries) {
+        features.insert(row, col) = value;
+    }
+    features.makeCompressed();
+    GenericFeatureMatrix generic{features};
+
+    DenseRealVector diagonal(4);
+    diagonal << 2.0, 1.0, 3.0, 0.5;
+    DenseRealVector residual(4);
+    residual << 1.0, -1.0, 2.0, 1.0;
+
+    // the reference: P = M^{1/2} ((1-beta) I + beta C) M^{1/2}
+    real_t strength = 0.5;
+    DenseFeatures dense = features;
+    types::DenseColMajor<real_t> gram = dense.transpose() * dense;
+    DenseRealVector s = gram.diagonal().unaryExpr([](real_t v) { return v > 0 ? 1 / std::sqrt(v) : real_t{0}; });
+    types::DenseColMajor<real_t> C = s.asDiagonal() * gram * s.asDiagonal();
+    auto reference = [&](const types::DenseColMajor<real_t>& correlation) -> DenseRealVector {
+        types::DenseColMajor<real_t> mixed = strength * correlation;
+        mixed.diagonal().array() += 1 - strength;
+        types::DenseColMajor<real_t> P = diagonal.cwiseSqrt().asDiagonal() * mixed * diagonal.cwiseSqrt().asDiagonal();
+        return P.llt().solve(residual);
+    };
+    DenseRealVector target(4);
+
+    SUBCASE("block diagonal") {
+        BlockDiagonalPreconditioner block(make_block_correlation(generic, 2, strength));
+        block.update(diagonal);
+        block.apply(residual, target);
+        types::DenseColMajor<real_t> blocked = C;
+        blocked.block(0, 2, 2, 2).setZero();
+        blocked.block(2, 0, 2, 2).setZero();
+        DenseRealVector expected = reference(blocked);
+        for(int i = 0; i < 4; ++i) {
+            CHECK(target.coeff(i) == doctest::Approx(expected.coeff(i)).epsilon(1e-4));
+        }
+
+        // the same with dense features
+        BlockDiagonalPreconditioner dense_block(make_block_correlation(GenericFeatureMatrix{dense}, 2, strength));
+        dense_block.update(diagonal);
+        DenseRealVector dense_target(4);
+        dense_block.apply(residual, dense_target);
+        CHECK((dense_target - target).norm() == doctest::Approx(0.0).epsilon(1e-5));
+
+        CHECK_THROWS(make_block_correlation(generic, 0, strength));
+        CHECK_THROWS(make_block_correlation(generic, 2, 1.0));
+    }
+
+    SUBCASE("low rank") {
+        // with full rank, the approximation is exact
+        LowRankPreconditioner low_rank(make_low_rank_correlation(generic, 4, strength));
+        low_rank.update(diagonal);
+        low_rank.apply(residual, target);
+        DenseRealVector expected = reference(C);
+        for(int i = 0; i < 4; ++i) {
+            CHECK(target.coeff(i) == doctest::Approx(expected.coeff(i)).epsilon(1e-3));
+        }
+
+        CHECK_THROWS(make_low_rank_correlation(generic, 5, strength));
+    }
+}
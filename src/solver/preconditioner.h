@@ -0,0 +1,118 @@
+// Copyright (c) 2021, Aalto University, developed by Erik Schultheis
+// All rights reserved.
+//
+// SPDX-License-Identifier: MIT
+
+#ifndef DISMEC_SRC_SOLVER_PRECONDITIONER_H
+#define DISMEC_SRC_SOLVER_PRECONDITIONER_H
+
+#include "matrix_types.h"
+#include <memory>
+#include <vector>
+#include <Eigen/Cholesky>
+
+namespace dismec::solvers {
+    /*!
+     * \brief Interface for the preconditioner of \ref CGMinimizer.
+     * \details At the beginning of each CG solve, `update()` is called with the diagonal preconditioner `M` that has
+     * been supplied to the solver. Then, in each iteration, `apply()` is used to calculate \f$ z = P^{-1} r \f$.
+     * Preconditioner objects are used by a single CG solver, and may keep internal buffers.
+     */
+    class Preconditioner {
+    public:
+        virtual ~Preconditioner() = default;
+
+        /// Sets the diagonal preconditioner for the following CG solve.
+        virtual void update(const DenseRealVector& diagonal) = 0;
+
+        /// Calculates `target` = \f$ P^{-1} \f$ `residual`.
+        virtual void apply(const DenseRealVector& residual, Eigen::Ref<DenseRealVector> target) = 0;
+    };
+
+    /// The default preconditioner, which just uses the given diagonal.
+    class DiagonalPreconditioner : public Preconditioner {
+    public:
+        void update(const DenseRealVector& diagonal) override;
+        void apply(const DenseRealVector& residual, Eigen::Ref<DenseRealVector> target) override;
+    private:
+        const DenseRealVector* m_Diagonal = nullptr;
+    };
+
+    /*!
+     * \brief Block-diagonal approximation of the feature correlation matrix.
+     * \details The correlation matrix is \f$ C = S X^T X S \f$, where \f$ S = \textrm{diag}(X^T X)^{-1/2} \f$. For each
+     * group of `BlockSize` consecutive features, this stores the Cholesky factorization of
+     * \f$ (1-\beta) I + \beta C_b \f$, where \f$ \beta \f$ is the strength given when building the data.
+     *
+     * This depends only on the features, so it can be calculated once per dataset and shared between threads.
+     */
+    struct BlockCorrelation {
+        long BlockSize;
+        std::vector<Eigen::LLT<types::DenseColMajor<real_t>>> Factors;
+    };
+
+    /*!
+     * \brief Low-rank plus diagonal approximation of the feature correlation matrix.
+     * \details This approximates \f$ (1-\beta) I + \beta C \approx E + V V^T \f$ (see \ref BlockCorrelation for the
+     * notation). The low-rank part is determined from a randomized sketch of \f$ C \f$, and the diagonal matrix
+     * \f$ E \f$ is chosen such that the diagonal of the approximation is correct. For applying the inverse using the
+     * Woodbury identity, this also stores the Cholesky factorization of \f$ I + V^T E^{-1} V \f$.
+     */
+    struct LowRankCorrelation {
+        types::DenseColMajor<real_t> Basis;             //!< The matrix \f$ V \f$
+        DenseRealVector Diagonal;                       //!< The diagonal of \f$ E \f$
+        Eigen::LLT<types::DenseColMajor<real_t>> Core;  //!< Factorization of \f$ I + V^T E^{-1} V \f$
+    };
+
+    /*!
+     * \brief Builds the block-diagonal correlation for features that are grouped into blocks of `block_size`.
+     * \param strength The interpolation \f$ \beta \in [0, 1) \f$ between the identity and the correlation matrix.
+     */
+    std::shared_ptr<const BlockCorrelation> make_block_correlation(const GenericFeatureMatrix& features,
+                                                                   long block_size, real_t strength);
+
+    /*!
+     * \brief Builds a low-rank plus diagonal correlation with (at most) the given `rank`.
+     * \details This requires two passes over the features, and stores a dense `num_features x rank` matrix.
+     * \param strength The interpolation \f$ \beta \in [0, 1) \f$ between the identity and the correlation matrix.
+     */
+    std::shared_ptr<const LowRankCorrelation> make_low_rank_correlation(const GenericFeatureMatrix& features,
+                                                                        long rank, real_t strength,
+                                                                        unsigned seed = 42);
+
+    /*!
+     * \brief Base class for preconditioners \f$ P = M^{1/2} \tilde{C} M^{1/2} \f$ based on an approximate correlation
+     * matrix \f$ \tilde{C} \f$.
+     * \details The diagonal of the preconditioner is given by `M` as for the \ref DiagonalPreconditioner, and the
+     * correlation structure is taken from the features.
+     */
+    class CorrelationPreconditioner : public Preconditioner {
+    public:
+        void update(const DenseRealVector& diagonal) override;
+        void apply(const DenseRealVector& residual, Eigen::Ref<DenseRealVector> target) override;
+    private:
+        /// Calculates \f$ \tilde{C}^{-1} \f$ `vector` in-place.
+        virtual void solve_correlation(Eigen::Ref<DenseRealVector> vector) = 0;
+
+        DenseRealVector m_InvSqrtDiagonal;
+    };
+
+    class BlockDiagonalPreconditioner : public CorrelationPreconditioner {
+    public:
+        explicit BlockDiagonalPreconditioner(std::shared_ptr<const BlockCorrelation> correlation);
+    private:
+        void solve_correlation(Eigen::Ref<DenseRealVector> vector) override;
+        std::shared_ptr<const BlockCorrelation> m_Correlation;
+    };
+
+    class LowRankPreconditioner : public CorrelationPreconditioner {
+    public:
+        explicit LowRankPreconditioner(std::shared_ptr<const LowRankCorrelation> correlation);
+    private:
+        void solve_correlation(Eigen::Ref<DenseRealVector> vector) override;
+        std::shared_ptr<const LowRankCorrelation> m_Correlation;
+        DenseRealVector m_Projection;
+    };
+}
+
+#endif //DISMEC_SRC_SOLVER_PRECONDITIONER_H
@@ -0,0 +1,244 @@
+// Copyright (c) 2021, Aalto University, developed by Erik Schultheis
+// All rights reserved.
+//
+// SPDX-License-Identifier: MIT
+
+#include "solver/tron.h"
+#include "stats/collection.h"
+#include "stats/timer.h"
+
+using namespace dismec::solvers;
+
+namespace {
+    using dismec::stats::stat_id_t;
+
+    constexpr const stat_id_t STAT_GRADIENT_NORM_0{0};
+    constexpr const stat_id_t STAT_OBJECTIVE_VALUE{1};
+    constexpr const stat_id_t STAT_GRADIENT_NORM{2};
+    constexpr const stat_id_t STAT_CG_ITERS{3};
+    constexpr const stat_id_t STAT_ITER_TIME{4};
+    constexpr const stat_id_t STAT_TRUST_RADIUS{5};
+    constexpr const stat_id_t STAT_STEP_ACCEPTED{6};
+    constexpr const stat_id_t STAT_PROGRESS{7};
+
+    constexpr const dismec::stats::tag_id_t TAG_ITERATION{0};
+
+    // parameters for accepting a step, and for updating the trust region, taken from LIBLINEAR
+    constexpr const dismec::real_t ETA0 = 1e-4;
+    constexpr const dismec::real_t ETA1 = 0.25;
+    constexpr const dismec::real_t ETA2 = 0.75;
+    constexpr const dismec::real_t SIGMA1 = 0.25;
+    constexpr const dismec::real_t SIGMA2 = 0.5;
+    constexpr const dismec::real_t SIGMA3 = 4.0;
+
+    /// calculates sqrt(u^T diag(M) u)
+    dismec::real_t m_norm(const dismec::DenseRealVector& u, const dismec::DenseRealVector& M) {
+        return std::sqrt((u.array().square() * M.array()).sum());
+    }
+}
+
+TrustRegionNewton::TrustRegionNewton(long num_variables) : m_CG_Solver(num_variables),
+                                                           m_Gradient(num_variables), m_PreConditioner(num_variables),
+                                                           m_Weights(DenseRealVector(num_variables))
+{
+    declare_hyper_parameter("epsilon", &TrustRegionNewton::get_epsilon, &TrustRegionNewton::set_epsilon);
+    declare_hyper_parameter("max-steps", &TrustRegionNewton::get_maximum_iterations, &TrustRegionNewton::set_maximum_iterations);
+    declare_hyper_parameter("alpha-pcg", &TrustRegionNewton::get_alpha_preconditioner, &TrustRegionNewton::set_alpha_preconditioner);
+    declare_sub_object("cg", &TrustRegionNewton::m_CG_Solver);
+
+    declare_stat(STAT_GRADIENT_NORM_0, {"grad_norm_0", "|g_0|"});
+    declare_stat(STAT_OBJECTIVE_VALUE, {"objective", "loss"});
+    declare_stat(STAT_GRADIENT_NORM, {"grad_norm", "|g|"});
+    declare_stat(STAT_CG_ITERS, {"cg_iters", "#iters"});
+    declare_stat(STAT_ITER_TIME, {"iter_time", "duration [µs]"});
+    declare_stat(STAT_TRUST_RADIUS, {"trust_radius", "|s|_M"});
+    declare_stat(STAT_STEP_ACCEPTED, {"step_accepted"});
+    declare_stat(STAT_PROGRESS, {"progress", "|g|/|eps g_0|"});
+
+    declare_tag(TAG_ITERATION, "iteration");
+}
+
+void TrustRegionNewton::update_preconditioner() {
+    // regularize the preconditioner: M = (1-a)I + aM
+    m_PreConditioner = (1 - m_Alpha_PCG) + (m_PreConditioner * m_Alpha_PCG).array();
+}
+
+MinimizationResult TrustRegionNewton::run(objective::Objective& objective, Eigen::Ref<DenseRealVector> init)
+{
+    objective.gradient_at_zero(m_Gradient);
+    real_t gnorm0 = m_Gradient.norm();
+    record(STAT_GRADIENT_NORM_0, gnorm0);
+
+    m_Weights = init;
+    real_t f = objective.value(m_Weights);
+    objective.gradient_and_pre_conditioner(m_Weights, m_Gradient, m_PreConditioner);
+    update_preconditioner();
+    real_t gnorm = m_Gradient.norm();
+
+    const real_t f_start = f;
+    const real_t gnorm_start = gnorm;
+
+    if(!std::isfinite(f) || !std::isfinite(gnorm) || !std::isfinite(gnorm0)) {
+        spdlog::error("Invalid trust region optimization: initial value: {}, gradient norm: {}, gnorm_0: {}", f, gnorm, gnorm0);
+        return {MinimizerStatus::FAILED, 0, f, gnorm, f, gnorm};
+    }
+
+    if(m_Logger) {
+        m_Logger->info("initial: f={:<5.3} |g|={:<5.3} |g_0|={:<5.3} eps={:<5.3}", f, gnorm, gnorm0, m_Epsilon);
+    }
+
+    if (gnorm <= m_Epsilon * gnorm0)
+        return {MinimizerStatus::SUCCESS, 0, f, gnorm, f, gnorm};
+
+    real_t delta = m_norm(m_Gradient, m_PreConditioner);
+
+    for(int iter = 1; iter <= m_MaxIter; ++iter) {
+        set_tag(TAG_ITERATION, iter);
+        auto scope_timer = make_timer(STAT_ITER_TIME);
+
+        long cg_iter = m_CG_Solver.minimize_in_trust_region([&](const DenseRealVector& d, Eigen::Ref<DenseRealVector> o) {
+            objective.hessian_times_direction(m_Weights, d, o);
+        }, m_Gradient, m_PreConditioner, delta);
+
+        const auto& step = m_CG_Solver.get_solution();
+        real_t gs = m_Gradient.dot(step);
+        real_t predicted_reduction = -real_t{0.5} * (gs - step.dot(m_CG_Solver.get_residual()));
+
+        objective.project_to_line(m_Weights, step);
+        real_t f_new = objective.lookup_on_line(1.0);
+        real_t actual_reduction = f - f_new;
+
+        // update the trust region radius, based on how well the quadratic model predicted the actual change
+        real_t snorm = m_norm(step, m_PreConditioner);
+        if (iter == 1) {
+            delta = std::min(delta, snorm);
+        }
+        real_t alpha;
+        if (f_new - f - gs <= 0) {
+            alpha = SIGMA3;
+        } else {
+            alpha = std::max(SIGMA1, -real_t{0.5} * (gs / (f_new - f - gs)));
+        }
+
+        if (actual_reduction < ETA0 * predicted_reduction) {
+            delta = std::min(alpha * snorm, SIGMA2 * delta);
+        } else if (actual_reduction < ETA1 * predicted_reduction) {
+            delta = std::max(SIGMA1 * delta, std::min(alpha * snorm, SIGMA2 * delta));
+        } else if (actual_reduction < ETA2 * predicted_reduction) {
+            delta = std::max(SIGMA1 * delta, std::min(alpha * snorm, SIGMA3 * delta));
+        } else if (m_CG_Solver.reached_boundary()) {
+            delta = SIGMA3 * delta;
+        } else {
+            delta = std::max(delta, std::min(alpha * snorm, SIGMA3 * delta));
+        }
+
+        record(STAT_CG_ITERS, cg_iter);
+        record(STAT_TRUST_RADIUS, delta);
+
+        bool accepted = actual_reduction > ETA0 * predicted_reduction;
+        record(STAT_STEP_ACCEPTED, accepted ? 1 : 0);
+        if (accepted) {
+            m_Weights = m_Weights + step;
+            objective.declare_vector_on_last_line(m_Weights, 1.0);
+            f = f_new;
+            objective.gradient_and_pre_conditioner(m_Weights, m_Gradient, m_PreConditioner);
+            update_preconditioner();
+            gnorm = m_Gradient.norm();
+
+            record(STAT_GRADIENT_NORM, gnorm);
+            record(STAT_OBJECTIVE_VALUE, f);
+            record(STAT_PROGRESS, real_t(gnorm / (m_Epsilon * gnorm0)));
+
+            if (gnorm <= m_Epsilon * gnorm0 || check_validation(iter, m_Weights.get())) {
+                if(m_Logger) {
+                    m_Logger->info("iter {:3}: f={:<10.8} |g|={:<8.4} CG={:<3} delta={:<8.4}",
+                                   iter, f, gnorm, cg_iter, delta);
+                }
+                init = m_Weights.get();
+                return {MinimizerStatus::SUCCESS, iter, f, gnorm, f_start, gnorm_start};
+            }
+        }
+
+        if(m_Logger) {
+            m_Logger->info("iter {:3}: f={:<10.8} |g|={:<8.4} CG={:<3} delta={:<8.4} {}",
+                           iter, f, gnorm, cg_iter, delta, accepted ? "" : "rejected");
+        }
+
+        if (f < -1.0e+32) {
+            spdlog::warn("Objective appears to be unbounded (got value {:.2})", f);
+            init = m_Weights.get();
+            return {MinimizerStatus::DIVERGED, iter, f, gnorm, f_start, gnorm_start};
+        }
+        if (actual_reduction <= 0 && predicted_reduction <= 0) {
+            spdlog::warn("actual and predicted reduction are non-positive in iteration {} of trust region newton", iter);
+            init = m_Weights.get();
+            return {MinimizerStatus::FAILED, iter, f, gnorm, f_start, gnorm_start};
+        }
+        if (std::abs(actual_reduction) <= 1.0e-12 * std::abs(f) && std::abs(predicted_reduction) <= 1.0e-12 * std::abs(f)) {
+            spdlog::warn("reduction too small in iteration {} of trust region newton", iter);
+            init = m_Weights.get();
+            return {MinimizerStatus::FAILED, iter, f, gnorm, f_start, gnorm_start};
+        }
+    }
+
+    init = m_Weights.get();
+    return {MinimizerStatus::TIMED_OUT, m_MaxIter, f, gnorm, f_start, gnorm_start};
+}
+
+void TrustRegionNewton::set_epsilon(double eps) {
+    if(eps <= 0) {
+        spdlog::error("Non-positive epsilon {} specified for trust region newton minimization", eps);
+        throw std::invalid_argument("Epsilon must be larger than zero.");
+    }
+    m_Epsilon = eps;
+}
+
+void TrustRegionNewton::set_maximum_iterations(long max_iter) {
+    if(max_iter <= 0) {
+        spdlog::error("Non-positive iteration limit {} specified for trust region newton minimization", max_iter);
+        throw std::invalid_argument("maximum iterations must be larger than zero.");
+    }
+    m_MaxIter = max_iter;
+}
+
+void TrustRegionNewton::set_alpha_preconditioner(double alpha) {
+    if(alpha <= 0 || alpha >= 1) {
+        spdlog::error("The `alpha_pcg` parameter needs to be between 0 and 1, got {} ", alpha);
+        throw std::invalid_argument("alpha_pcg not in (0, 1)");
+    }
+    m_Alpha_PCG = alpha;
+}
+
+#include "doctest.h"
+#include "utils/test_utils.h"
+
+using namespace dismec;
+
+TEST_CASE("trust region newton") {
+    // an ill-conditioned problem: the features are on very different scales
+    auto problem = make_solver_test_problem(1.0, 10.0, 0.1);
+    auto& objective = *problem.Objective;
+    const DenseRealVector& reference = problem.Reference;
+
+    TrustRegionNewton tron(3);
+    tron.set_epsilon(1e-4);
+    DenseRealVector weights = DenseRealVector::Zero(3);
+    auto result = tron.minimize(objective, weights);
+    CHECK(result.Outcome == MinimizerStatus::SUCCESS);
+    CHECK(result.FinalValue == doctest::Approx(objective.value(HashVector{weights})));
+    CHECK(result.FinalValue <= objective.value(HashVector{reference}) + 1e-4);
+    for(int i = 0; i < 3; ++i) {
+        CHECK(weights.coeff(i) == doctest::Approx(reference.coeff(i)).epsilon(1e-2));
+    }
+
+    // starting from the solution, we are done immediately
+    result = tron.minimize(objective, weights);
+    CHECK(result.NumIters == 0);
+
+    // hp interface is the same as for newton
+    tron.set_hyper_parameter("max-steps", 50l);
+    CHECK(tron.get_maximum_iterations() == 50);
+    tron.set_hyper_parameter("cg.epsilon", 0.1);
+    CHECK_THROWS(tron.set_epsilon(-0.4));
+    CHECK_THROWS(tron.set_alpha_preconditioner(1.1));
+}
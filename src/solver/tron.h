@@ -0,0 +1,59 @@
+// Copyright (c) 2021, Aalto University, developed by Erik Schultheis
+// All rights reserved.
+//
+// SPDX-License-Identifier: MIT
+
+#ifndef DISMEC_SRC_SOLVER_TRON_H
+#define DISMEC_SRC_SOLVER_TRON_H
+
+#include "solver/minimizer.h"
+#include "solver/cg.h"
+#include "utils/hash_vector.h"
+
+namespace dismec::solvers
+{
+    /*!
+     * \brief Trust-region newton method, as used by the TRON solver in LIBLINEAR.
+     * \details In each iteration, the newton step is determined by running preconditioned CG in the trust region
+     * (see \ref CGMinimizer::minimize_in_trust_region). The step is accepted if the actual reduction of the objective
+     * is large enough compared to the reduction predicted by the quadratic model, and the trust region radius is
+     * updated depending on this ratio. In contrast to \ref NewtonWithLineSearch, a step that is not accepted only
+     * costs a single objective evaluation, and CG stops early once it reaches the boundary of the trust region.
+     *
+     * The hyper-parameters and the stopping criterion are the same as for \ref NewtonWithLineSearch.
+     */
+    class TrustRegionNewton : public Minimizer {
+    public:
+        explicit TrustRegionNewton(long num_variables);
+
+        // hyperparameters
+        void set_epsilon(double eps);
+        double get_epsilon() const { return m_Epsilon; }
+
+        void set_maximum_iterations(long max_iter);
+        long get_maximum_iterations() const { return m_MaxIter; }
+
+        void set_alpha_preconditioner(double alpha);
+        double get_alpha_preconditioner() const { return m_Alpha_PCG; }
+
+    private:
+        MinimizationResult run(objective::Objective& objective, Eigen::Ref<DenseRealVector> init) override;
+
+        // newton parameters
+        double m_Epsilon = 0.01;
+        double m_Alpha_PCG = 0.01;
+        long m_MaxIter = 1000;
+
+        // sub-algorithms
+        CGMinimizer m_CG_Solver;
+
+        // buffers
+        DenseRealVector m_Gradient;
+        DenseRealVector m_PreConditioner;
+        HashVector      m_Weights;
+
+        void update_preconditioner();
+    };
+}
+
+#endif //DISMEC_SRC_SOLVER_TRON_H
@@ -0,0 +1,283 @@
+// Copyright (c) 2021, Aalto University, developed by Erik Schultheis
+// All rights reserved.
+//
+// SPDX-License-Identifier: MIT
+
+/*
+ * Coordinates several `train` processes that each train a range of labels. The label ranges are taken from a
+ * `LabelRangeQueue` on the file system, so additional workers can be started on other machines that share the file
+ * system:
+ *
+ *   dismec-launch run --queue q --model-file model --workers 4 --num-labels 1000 -- data.txt --threads 2
+ *   dismec-launch worker --queue q --model-file model -- data.txt --threads 2     # on another machine
+ *
+ * Everything after `--` is passed on to `train`, together with `--first-label`, `--num-labels` and `--model-file`
+ * for the range. Once all ranges are done, `run` assembles the partial models into the metadata file `model`.
+ */
+
+#include "parallel/work_queue.h"
+#include "parallel/launch.h"
+#include "utils/conversion.h"
+#include "CLI/CLI.hpp"
+#include "spdlog/spdlog.h"
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <map>
+#include <thread>
+#include <csignal>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace dismec;
+using parallel::LabelRange;
+using parallel::LabelRangeQueue;
+
+namespace {
+    struct WorkerConfig {
+        std::filesystem::path ModelFile;
+        std::filesystem::path TrainExecutable;
+        std::vector<std::string> TrainArgs;
+        std::chrono::milliseconds HeartbeatInterval;
+    };
+
+    std::string worker_name(pid_t pid) {
+        std::array<char, 256> host{};
+        gethostname(host.data(), host.size() - 1);
+        return fmt::format("{}:{}", host.data(), pid);
+    }
+
+    /// The partial model for each attempt gets its own file, so that a worker that has been presumed dead cannot
+    /// overwrite the result of the worker that took over its range.
+    std::filesystem::path part_file_name(const WorkerConfig& config, const LabelRange& range) {
+        auto file = std::filesystem::absolute(config.ModelFile);
+        file += fmt::format(".part-{}-{}-{}", range.Begin.to_index(), range.End.to_index() - 1, range.Attempt);
+        return file;
+    }
+
+    /// Runs `train` for `range`, and keeps the heartbeat of the range alive while it is running.
+    bool train_range(LabelRangeQueue& queue, const std::string& name, const WorkerConfig& config,
+                     const LabelRange& range, const std::filesystem::path& part_file) {
+        std::vector<std::string> args;
+        args.push_back(config.TrainExecutable.string());
+        args.insert(args.end(), config.TrainArgs.begin(), config.TrainArgs.end());
+        args.insert(args.end(), {"--first-label", std::to_string(range.Begin.to_index()),
+                                 "--num-labels", std::to_string(range.End - range.Begin),
+                                 "--model-file", part_file.string()});
+
+        pid_t child = fork();
+        if(child < 0) {
+            spdlog::error("Could not start training process: {}", std::strerror(errno));
+            return false;
+        }
+        if(child == 0) {
+            // make sure the training process does not outlive its worker
+            prctl(PR_SET_PDEATHSIG, SIGTERM);
+            std::vector<char*> argv;
+            for(auto& arg : args) {
+                argv.push_back(arg.data());
+            }
+            argv.push_back(nullptr);
+            execv(argv.front(), argv.data());
+            std::fprintf(stderr, "Could not execute %s: %s\n", argv.front(), std::strerror(errno));
+            _exit(127);
+        }
+
+        auto last_heartbeat = std::chrono::steady_clock::now();
+        int status = 0;
+        while(true) {
+            pid_t waited = waitpid(child, &status, WNOHANG);
+            if(waited == child) {
+                break;
+            }
+            if(waited < 0) {
+                if(errno == EINTR) {
+                    continue;
+                }
+                // `status` has not been set, so we cannot tell whether training succeeded
+                spdlog::error("Could not wait for the training of labels {}-{}: {}", range.Begin.to_index(),
+                              range.End.to_index() - 1, std::strerror(errno));
+                return false;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            if(std::chrono::steady_clock::now() - last_heartbeat > config.HeartbeatInterval) {
+                queue.heartbeat(name);
+                last_heartbeat = std::chrono::steady_clock::now();
+            }
+        }
+
+        if(WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+            return true;
+        }
+        if(WIFSIGNALED(status)) {
+            spdlog::error("Training of labels {}-{} was killed by signal {}", range.Begin.to_index(),
+                          range.End.to_index() - 1, WTERMSIG(status));
+        } else {
+            spdlog::error("Training of labels {}-{} failed with exit code {}", range.Begin.to_index(),
+                          range.End.to_index() - 1, WEXITSTATUS(status));
+        }
+        return false;
+    }
+
+    /// Takes ranges from the queue and trains them, until no work is left.
+    int run_worker(LabelRangeQueue& queue, const WorkerConfig& config) {
+        std::string name = worker_name(getpid());
+        while(true) {
+            auto range = queue.acquire(name);
+            if(!range.has_value()) {
+                // other workers may still fail or time out, so we can only stop once everything is finished
+                if(queue.status().finished()) {
+                    return EXIT_SUCCESS;
+                }
+                std::this_thread::sleep_for(config.HeartbeatInterval);
+                continue;
+            }
+
+            spdlog::info("Worker {} starts training labels {}-{}", name, range->Begin.to_index(),
+                         range->End.to_index() - 1);
+            auto part_file = part_file_name(config, *range);
+            if(!train_range(queue, name, config, *range, part_file)) {
+                queue.fail(*range, name);
+            } else if(!queue.complete(*range, name, part_file.string())) {
+                spdlog::warn("Labels {}-{} have been taken over by another worker, discarding result of {}",
+                             range->Begin.to_index(), range->End.to_index() - 1, name);
+            }
+        }
+    }
+
+    /// Forks `num_workers` local workers, and returns once all of them have stopped. Returns the number of workers
+    /// that could be started.
+    long fork_local_workers(LabelRangeQueue& queue, const WorkerConfig& config, long num_workers) {
+        std::map<pid_t, std::string> workers;
+        for(long i = 0; i < num_workers; ++i) {
+            pid_t child = fork();
+            if(child < 0) {
+                spdlog::error("Could not start worker process: {}", std::strerror(errno));
+                break;
+            }
+            if(child == 0) {
+                int result = EXIT_FAILURE;
+                try {
+                    result = run_worker(queue, config);
+                } catch (std::exception& error) {
+                    spdlog::error("Worker failed: {}", error.what());
+                }
+                _exit(result);
+            }
+            workers[child] = worker_name(child);
+        }
+        long num_started = ssize(workers);
+
+        while(!workers.empty()) {
+            int status = 0;
+            pid_t child = wait(&status);
+            if(child < 0) {
+                if(errno == EINTR) continue;
+                break;
+            }
+            auto worker = workers.find(child);
+            if(worker == workers.end()) {
+                continue;
+            }
+            if(!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                // no need to wait for the heartbeat to time out
+                long released = queue.release(worker->second);
+                spdlog::error("Worker {} died, returned {} label ranges to the queue", worker->second, released);
+            }
+            workers.erase(worker);
+        }
+        return num_started;
+    }
+
+    /*!
+     * \brief Runs local workers until all ranges are finished.
+     * \details Workers on other machines may still be running when the local workers stop. If one of them dies, its range is returned to the queue once its heartbeat times out, and new local
+     * workers are started for it. Without local workers, pending ranges are left for the next `worker` or `run`.
+     * This terminates, because each range is attempted at most `LABEL_RANGE_MAX_ATTEMPTS` times.
+     */
+    void run_local_workers(LabelRangeQueue& queue, const WorkerConfig& config, long num_workers) {
+        long num_started = 0;
+        do {
+            num_started = fork_local_workers(queue, config, num_workers);
+            parallel::wait_for_running_ranges(queue, config.HeartbeatInterval);
+        } while(num_started > 0 && queue.status().Pending > 0);
+    }
+
+    int assemble(const LabelRangeQueue& queue, const std::filesystem::path& model_file) {
+        try {
+            long num_parts = parallel::assemble_model(queue, model_file);
+            spdlog::info("Assembled model {} from {} partial models", model_file.string(), num_parts);
+        } catch (const std::runtime_error& error) {
+            spdlog::error("{}", error.what());
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+}
+
+int main(int argc, const char** argv) {
+    // everything after `--` is passed on to the training program
+    WorkerConfig config;
+    int own_argc = argc;
+    for(int i = 1; i < argc; ++i) {
+        if(std::strcmp(argv[i], "--") == 0) {
+            own_argc = i;
+            config.TrainArgs.assign(argv + i + 1, argv + argc);
+            break;
+        }
+    }
+
+    std::filesystem::path QueueDir;
+    long NumWorkers = 1;
+    long FirstLabel = 0;
+    long NumLabels = -1;
+    long RangeSize = 1000;
+    long HeartbeatTimeout = 600;
+    config.TrainExecutable = std::filesystem::canonical("/proc/self/exe").parent_path() / "train";
+
+    CLI::App app{"dismec-launch"};
+    app.require_subcommand(1);
+    auto* run_cmd = app.add_subcommand("run", "Initializes the work queue, starts local workers, and assembles the "
+                                              "model once all label ranges have been trained.");
+    auto* worker_cmd = app.add_subcommand("worker", "Starts a single worker for an existing work queue.");
+    auto* assemble_cmd = app.add_subcommand("assemble", "Assembles the model from the finished label ranges.");
+
+    for(auto* cmd : {run_cmd, worker_cmd, assemble_cmd}) {
+        cmd->add_option("--queue", QueueDir, "Directory which holds the shared work queue.")->required();
+        cmd->add_option("--model-file", config.ModelFile, "The file to which the model metadata will be saved. "
+                                                          "The partial models are saved next to it.")->required();
+    }
+    for(auto* cmd : {run_cmd, worker_cmd}) {
+        cmd->add_option("--train", config.TrainExecutable, "Path to the train executable.")->check(CLI::ExistingFile);
+        cmd->add_option("--heartbeat-timeout", HeartbeatTimeout, "If a worker has not reported progress for this many "
+                                                                 "seconds, its label range is handed to another worker.")
+                                                                 ->check(CLI::PositiveNumber);
+    }
+    run_cmd->add_option("--workers", NumWorkers, "Number of local worker processes.")->check(CLI::NonNegativeNumber);
+    run_cmd->add_option("--first-label", FirstLabel, "The first label to be trained.")->check(CLI::NonNegativeNumber);
+    run_cmd->add_option("--num-labels", NumLabels, "The number of labels to be trained.")->required()->check(CLI::PositiveNumber);
+    run_cmd->add_option("--range-size", RangeSize, "Number of labels that are given to a worker at once. If a worker "
+                                                   "dies, at most this many labels need to be retrained.")->check(CLI::PositiveNumber);
+
+    try {
+        app.parse(own_argc, argv);
+    } catch (const CLI::ParseError &e) {
+        return app.exit(e);
+    }
+
+    // workers should send a heartbeat several times before they are considered to be dead
+    config.HeartbeatInterval = std::chrono::milliseconds(HeartbeatTimeout * 1000 / 4);
+    LabelRangeQueue queue(QueueDir, std::chrono::seconds(HeartbeatTimeout));
+
+    if(*worker_cmd) {
+        return run_worker(queue, config);
+    }
+
+    if(*run_cmd) {
+        queue.initialize(label_id_t{FirstLabel}, label_id_t{FirstLabel + NumLabels}, RangeSize);
+        run_local_workers(queue, config, NumWorkers);
+    }
+
+    return assemble(queue, config.ModelFile);
+}
@@ -6,6 +6,7 @@
 #include "parallel/runner.h"
 #include "io/model-io.h"
 #include "io/slice.h"
+#include "io/checkpoint.h"
 #include "data/data.h"
 #include "data/transform.h"
 #include "training/training.h"
@@ -13,11 +14,15 @@
 #include "training/postproc.h"
 #include "training/initializer.h"
 #include "training/statistics.h"
+#include "training/negatives.h"
+#include "training/schedule.h"
+#include "training/init/similar.h"
 #include "CLI/CLI.hpp"
 #include "spdlog/spdlog.h"
 #include "io/numpy.h"
 #include "io/common.h"
 #include "app.h"
+#include <algorithm>
 #include <future>
 
 using namespace dismec;
@@ -74,18 +79,34 @@ private:
     CLI::Option* PreTrainedOpt;
 
     std::string InitMode;
+    bool ScreenLabels = false;
     std::optional<real_t> BiasInitValue;
     real_t MSI_PFac = 1;
     real_t MSI_NFac = -2;
     int InitMaxPos = 1;
+    long SimilarCacheSize = 0;
+    real_t SimilarMinJaccard = 0.2;
+    std::shared_ptr<const init::LabelSimilarity> Similarity;
 
     RegularizerType Regularizer = RegularizerType::REG_L2;
     real_t RegScale = 1.0;
     bool RegBias = false;
+    std::vector<real_t> RegPath;
+    [[nodiscard]] std::filesystem::path path_model_file(real_t factor) const;
 
     real_t Sparsify = -1;
 
+    // negative sampling
+    void setup_negative_sampling();
+    std::string NegativesShortlistFile;
+    long SampleNegatives = -1;
+    long HardNegatives = -1;
+    unsigned SamplingSeed = 42;
+
     LossType Loss = LossType::SQUARED_HINGE;
+    SolverType Solver = SolverType::NEWTON;
+    PreconditionerConfig Preconditioner;
+    ValidationStoppingConfig EarlyStopping;
 
     // statistics
     std::string StatsOutFile = "stats.json";
@@ -96,6 +117,9 @@ private:
     long NumThreads = -1;
     long Timeout = -1;
     long BatchSize = -1;
+    bool ScheduleByCost = false;
+    bool ScheduleDonorsFirst = false;
+    std::filesystem::path CheckpointLog;
 
     int Verbose = 0;
 
@@ -172,9 +196,15 @@ void TrainingProgram::setup_hyper_params()
     };
 
     add_hyper_param_option("--epsilon", "epsilon",
-                           "Tolerance for the minimizer. Will be adjusted by the number of positive/negative instances")
+                           "Tolerance for the minimizer. Will be adjusted by the number of positive/negative instances. "
+                           "Not used by `dual-cd`, see --pg-gap.")
                            ->check(CLI::NonNegativeNumber);
 
+    add_hyper_param_option("--pg-gap", "pg-gap",
+                           "Tolerance of `dual-cd` for the gap between the largest and smallest projected gradient of "
+                           "the dual problem. This is an absolute value, which is not adjusted per label.")
+                           ->check(CLI::PositiveNumber);
+
     add_hyper_param_option("--alpha-pcg", "alpha-pcg",
                            "Interpolation parameter for preconditioning of CG optimization.")->check(CLI::Range(0.0, 1.0));
 
@@ -189,11 +219,22 @@ void TrainingProgram::setup_hyper_params()
     add_hyper_param_option("--cg-epsilon", "cg.epsilon",
                            "Stopping criterion for the CG solver")->check(CLI::PositiveNumber);
 
+    app.add_flag("--cg-warm-start", [this](std::size_t){ hps.set("cg-warm-start", 1l); },
+                 "Start CG from the previous newton direction instead of from zero.")->group("hyper-parameters");
+    app.add_flag("--cg-forcing", [this](std::size_t){ hps.set("forcing", 1l); },
+                 "Choose the CG tolerance adaptively using the Eisenstat-Walker forcing sequence. This loosens the "
+                 "tolerance far from the optimum.")->group("hyper-parameters");
+
     app.add_option_function<long>(
             "--max-steps",
             [this](long value) { hps.set("max-steps", value); },
             "Maximum number of newton steps.")->check(CLI::PositiveNumber)->group("hyper-parameters");
 
+    app.add_option_function<long>(
+            "--lbfgs-history",
+            [this](long value) { hps.set("history", value); },
+            "Number of correction pairs kept by the lbfgs solver.")->check(CLI::PositiveNumber)->group("hyper-parameters");
+
     app.add_option_function<long>(
             "--line-search-max-steps",
             [this](long value) { hps.set("search.max-steps", value); },
@@ -266,8 +307,36 @@ void TrainingProgram::setup_regularization() {
         },CLI::ignore_case));
     app.add_option("--reg-scale", RegScale, "Scaling factor for the regularizer")->check(CLI::NonNegativeNumber);
     app.add_flag("--reg-bias", RegBias, "Include bias in regularization")->default_val(false);
+    app.add_option("--reg-path", RegPath, "Train each label for each of these factors of --reg-scale, in decreasing order, "
+                                          "starting from the (post-processed) weights for the previous factor. The model "
+                                          "for factor `f` is saved to `<model-file>.reg-<f>`. Saving a model overlaps "
+                                          "with training the next one, so about two models are kept in memory.")->delimiter(',')->check(CLI::PositiveNumber);
 }
 
+std::filesystem::path TrainingProgram::path_model_file(real_t factor) const {
+    if(RegPath.empty()) {
+        return ModelFile;
+    }
+    std::filesystem::path file = ModelFile;
+    file += fmt::format(".reg-{}", factor);
+    return file;
+}
+
+void TrainingProgram::setup_negative_sampling() {
+    auto* shortlist_opt = app.add_option("--negatives-shortlist", NegativesShortlistFile,
+                   "Train each label only on its positives and the negatives given in this shortlist file.")
+                   ->check(CLI::ExistingFile);
+    auto* sample_opt = app.add_option("--sample-negatives", SampleNegatives,
+                   "Train each label on its positives and this many uniformly sampled negatives. The sampled "
+                   "negatives are up-weighted to represent all negatives.")->check(CLI::PositiveNumber);
+    auto* hard_opt = app.add_option("--hard-negatives", HardNegatives,
+                   "Train each label on its positives and this many negatives that are most similar to "
+                   "the mean of the positive instances.")->check(CLI::PositiveNumber);
+    app.add_option("--sampling-seed", SamplingSeed, "Seed for the random negative sampling.")->needs(sample_opt);
+    shortlist_opt->excludes(sample_opt, hard_opt);
+    sample_opt->excludes(shortlist_opt, hard_opt);
+    hard_opt->excludes(shortlist_opt, sample_opt);
+}
 
 TrainingProgram::TrainingProgram() {
     setup_source_cmdline();
@@ -275,10 +344,24 @@ TrainingProgram::TrainingProgram() {
     setup_label_range();
     setup_hyper_params();
     setup_regularization();
+    setup_negative_sampling();
 
     app.add_option("--threads", NumThreads, "Number of threads to use. -1 means auto-detect");
     app.add_option("--batch-size", BatchSize, "If this is given, training is split into batches "
                                               "and results are written to disk after each batch.");
+    app.add_flag("--schedule-by-cost", ScheduleByCost, "If this flag is given, the labels of each batch are trained "
+                                                       "in order of decreasing estimated cost, so that expensive labels "
+                                                       "do not delay the end of the batch. The cost model is refined "
+                                                       "using the measured training times.");
+    app.add_flag("--schedule-donors-first", ScheduleDonorsFirst, "If this flag is given, each label is trained directly "
+                                                                 "after the most similar label in its batch, so that "
+                                                                 "`similar` initialization finds a donor. Labels without "
+                                                                 "a donor are ordered by estimated cost. Requires "
+                                                                 "--init-mode similar.");
+    app.add_option("--checkpoint-log", CheckpointLog, "If this is given, the weights of each label are appended to this "
+                                                      "file as soon as the label is finished. When training is resumed "
+                                                      "with --continue, labels that are contained in this file are not "
+                                                      "trained again, even if their batch was not completed.");
     app.add_option("--timeout", Timeout, "No new training tasks will be started after this time. "
                                          "This can be used e.g. on a cluster system to ensure that the training finishes properly "
                                          "even if not all work could be done in the allotted time.")
@@ -312,15 +395,60 @@ TrainingProgram::TrainingProgram() {
                                                                          {"hinge", LossType::HINGE},
                                                                          },CLI::ignore_case));
 
+    app.add_option("--solver", Solver, "The minimizer. `newton` uses a line search, `tron` a trust region. `lbfgs` only "
+                                       "needs gradients, which helps for losses without a proper second derivative. "
+                                       "`dual-cd` is dual coordinate descent, which requires the (squared) hinge loss "
+                                       "with l2 regularization and --reg-bias. `active-set` only updates the nonzero "
+                                       "weights and those that violate the optimality conditions, which is faster for "
+                                       "l1 and elastic net regularization; it rejects the smooth `huber` regularizer.")->default_str("newton")
+        ->transform(CLI::Transformer(std::map<std::string, SolverType>{{"newton", SolverType::NEWTON},
+                                                                       {"tron", SolverType::TRUST_REGION},
+                                                                       {"lbfgs", SolverType::LBFGS},
+                                                                       {"dual-cd", SolverType::DUAL_CD},
+                                                                       {"active-set", SolverType::ACTIVE_SET},
+                                                                       },CLI::ignore_case));
+
+    app.add_option("--preconditioner", Preconditioner.Type, "The CG preconditioner of the newton solver. `block` and "
+                                                            "`low-rank` take correlations between features into account. "
+                                                            "These work best with a large --alpha-pcg.")->default_str("diagonal")
+        ->transform(CLI::Transformer(std::map<std::string, PreconditionerType>{{"diagonal", PreconditionerType::DIAGONAL},
+                                                                               {"block", PreconditionerType::BLOCK_DIAGONAL},
+                                                                               {"low-rank", PreconditionerType::LOW_RANK},
+                                                                               },CLI::ignore_case));
+    app.add_option("--preconditioner-size", Preconditioner.Size, "Block size of the `block` preconditioner, or rank of the "
+                                                                 "`low-rank` preconditioner.")->check(CLI::PositiveNumber);
+    app.add_option("--preconditioner-strength", Preconditioner.Strength, "How strongly the feature correlations are taken "
+                                                                         "into account.")->check(CLI::Range(0.0, 0.99));
+    app.add_option("--early-stopping-instances", EarlyStopping.NumInstances, "Hold out this many randomly chosen "
+                                                                            "training instances, and stop the minimization "
+                                                                            "of each label once their scores no longer "
+                                                                            "change. The held-out instances are not "
+                                                                            "trained on. Disabled if zero.")
+                                                                            ->check(CLI::NonNegativeNumber);
+    app.add_option("--early-stopping-interval", EarlyStopping.Interval, "Number of iterations between checks of the early "
+                                                                        "stopping scores.")->check(CLI::PositiveNumber);
+    app.add_option("--early-stopping-tolerance", EarlyStopping.Tolerance, "Relative change of the early stopping scores "
+                                                                          "below which minimization stops.")->check(CLI::NonNegativeNumber);
+
     app.add_option("--sparsify", Sparsify, "Feedback-driven sparsification. Specify the maximum amount (in %) up to which the binary loss "
                                            "is allowed to increase.");
 
     app.add_option("--init-mode", InitMode, "How to initialize the weight vectors")
-        ->check(CLI::IsMember({"zero", "mean", "bias", "msi", "multi-pos", "ova-primal"}));
+        ->check(CLI::IsMember({"zero", "mean", "bias", "msi", "multi-pos", "ova-primal", "similar"}));
+    app.add_flag("--screen-labels", ScreenLabels, "Labels whose training instances are all negative (or all positive) "
+                                                  "get their exact solution without training. Requires a hinge-type loss, "
+                                                  "--augment-for-bias, and no --reg-bias.");
     app.add_option("--bias-init-value", BiasInitValue, "The value that is assigned to the bias weight for bias-init.");
     app.add_option("--msi-pos", MSI_PFac, "Positive target for msi init");
     app.add_option("--msi-neg", MSI_NFac, "Negative target for msi init");
     app.add_option("--max-num-pos", InitMaxPos, "Number of positives to consider for `multi-pos` initialization")->check(CLI::NonNegativeNumber);
+    app.add_option("--similar-cache-size", SimilarCacheSize, "Number of finished weight vectors that are kept in memory "
+                                                             "as donors for `similar` initialization. Each vector is "
+                                                             "stored densely, i.e., needs 4 bytes per feature. By default, "
+                                                             "the cache is sized to use at most 256 MiB.")->check(CLI::PositiveNumber);
+    app.add_option("--similar-min-jaccard", SimilarMinJaccard, "Minimum Jaccard similarity of the positive instances "
+                                                               "for a finished label to be used as a donor in `similar` "
+                                                               "initialization.")->check(CLI::Range(0.0, 1.0));
 
     app.add_option("--record-stats", StatsLevelFile,
                    "Record some statistics and save to file. The argument is a json file which describes which statistics are gathered.")
@@ -405,6 +533,16 @@ DismecTrainingConfig TrainingProgram::make_config(const std::shared_ptr<MultiLab
         config.Init = init::create_multi_pos_mean_strategy(data, InitMaxPos, MSI_PFac, MSI_NFac);
     } else if(InitMode == "ova-primal") {
         config.Init = init::create_ova_primal_initializer(data, config.Regularizer, Loss);
+    } else if(InitMode == "similar") {
+        Similarity = std::make_shared<init::LabelSimilarity>(data);
+        long cache_size = SimilarCacheSize;
+        if(cache_size <= 0) {
+            long vector_bytes = data->num_features() * static_cast<long>(sizeof(real_t));
+            cache_size = std::clamp(SIMILAR_CACHE_DEFAULT_BYTES / std::max(vector_bytes, 1l), 1l,
+                                    SIMILAR_CACHE_MAX_DEFAULT_SIZE);
+        }
+        spdlog::info("Keeping up to {} finished weight vectors for `similar` initialization", cache_size);
+        config.Init = init::create_similar_label_initializer(Similarity, cache_size, SimilarMinJaccard);
     } else if(InitMode == "bias" || (InitMode.empty() && BiasInitValue.has_value())) {
         if(DataProc.augment_for_bias()) {
             DenseRealVector init_vec(data->num_features());
@@ -419,6 +557,32 @@ DismecTrainingConfig TrainingProgram::make_config(const std::shared_ptr<MultiLab
 
     config.StatsGatherer = std::make_shared<TrainingStatsGatherer>(StatsLevelFile, StatsOutFile);
     config.Loss = Loss;
+    config.Solver = Solver;
+    config.Preconditioner = Preconditioner;
+    config.EarlyStopping = EarlyStopping;
+    config.ScreenLabels = ScreenLabels;
+
+    // Negative sampling
+    if(!NegativesShortlistFile.empty()) {
+        auto stream = std::fstream(NegativesShortlistFile, std::fstream::in);
+        auto result = io::read_binary_matrix_as_lol(stream);
+        if(result.NumCols != data->num_labels()) {
+            spdlog::error("Mismatch between number of labels in shortlist {} and in dataset {}",
+                          result.NumCols, data->num_labels());
+            exit(EXIT_FAILURE);
+        }
+        if(result.NumRows != data->num_examples()) {
+            spdlog::error("Mismatch between number of examples in shortlist {} and in dataset {}",
+                          result.NumRows, data->num_examples());
+            exit(EXIT_FAILURE);
+        }
+        config.NegativeSampling = create_shortlist_sampler(
+                std::make_shared<std::vector<std::vector<long>>>(std::move(result.NonZeros)));
+    } else if(SampleNegatives > 0) {
+        config.NegativeSampling = create_random_sampler(SampleNegatives, SamplingSeed);
+    } else if(HardNegatives > 0) {
+        config.NegativeSampling = create_hard_negative_sampler(HardNegatives);
+    }
 
     return config;
 }
@@ -445,6 +609,16 @@ int TrainingProgram::run(int argc, const char** argv)
     // TODO At this point, we know that the target directory exists, but not whether it is writeable.
     // still, it's a start.
 
+    if(!RegPath.empty() && (ContinueRun || !CheckpointLog.empty())) {
+        spdlog::error("--reg-path cannot be combined with --continue or --checkpoint-log");
+        return EXIT_FAILURE;
+    }
+
+    if(ScheduleDonorsFirst && InitMode != "similar") {
+        spdlog::error("--schedule-donors-first requires --init-mode similar");
+        return EXIT_FAILURE;
+    }
+
 
     auto start_time = std::chrono::steady_clock::now();
     auto timeout_time = start_time + std::chrono::milliseconds(Timeout);
@@ -506,7 +680,13 @@ int TrainingProgram::run(int argc, const char** argv)
 
     // batched training
     spdlog::info("Start training");
-    io::PartialModelSaver saver(ModelFile, SaveOptions, ContinueRun);
+    // without a regularization path, there is a single point with the unchanged regularization
+    std::vector<real_t> reg_path = RegPath.empty() ? std::vector<real_t>{1} : RegPath;
+    std::sort(reg_path.begin(), reg_path.end(), std::greater<>());
+    std::vector<std::unique_ptr<io::PartialModelSaver>> savers;
+    for(real_t factor : reg_path) {
+        savers.push_back(std::make_unique<io::PartialModelSaver>(path_model_file(factor), SaveOptions, ContinueRun));
+    }
     std::optional<io::PartialModelLoader> loader;
     if(*PreTrainedOpt) {
         loader.emplace(SourceModel);
@@ -516,52 +696,109 @@ int TrainingProgram::run(int argc, const char** argv)
         LabelsEnd = label_id_t{data->num_labels()};
     }
     label_id_t next_label = std::min(LabelsEnd, first_label + BatchSize);
+    // at most one model is saved in the background while the next one is trained, so that even for a long
+    // regularization path, only about two models need to be kept in memory.
     std::future<io::model::WeightFileEntry> saving;
+    std::size_t saving_point = 0;
+    auto finish_saving = [&]() {
+        // throw any exception that happened during the saving
+        if(saving.valid()) {
+            saving.get();
+            // saving weights has finished, we can update the meta data
+            savers[saving_point]->update_meta_file();
+        }
+    };
 
     config.PostProcessing = post_proc;
     config.Sparse = use_sparse_model;
 
+    // the training spec and the task generator are shared by all batches, so that the thread-local objectives,
+    // minimizers and their buffers only need to be set up once.
+    std::shared_ptr<TrainingSpec> train_spec = create_dismec_training(data, hps, config);
+    if(Verbose >= 0) {
+        train_spec->set_logger(spdlog::default_logger());
+    }
+    TrainingTaskGenerator task(train_spec, first_label, next_label);
+    if(ScheduleDonorsFirst) {
+        task.set_cost_model(std::make_shared<DonorFirstSchedule>(Similarity, SimilarMinJaccard));
+    } else if(ScheduleByCost) {
+        task.set_cost_model(std::make_shared<LabelCostModel>(data));
+    }
+
+    if(!CheckpointLog.empty()) {
+        if(ContinueRun && std::filesystem::exists(CheckpointLog)) {
+            // labels before `first_label` are already part of the saved model, so their records are not needed
+            auto known = std::make_shared<io::LabelCheckpoint>(
+                    io::read_label_checkpoints(CheckpointLog, first_label, LabelsEnd));
+            if(known->NumFeatures != train_spec->num_features() || known->NumLabels != data->num_labels()) {
+                THROW_ERROR("Checkpoint log {} is for {} features and {} labels, but training uses {} features and {} labels",
+                            CheckpointLog.string(), known->NumFeatures, known->NumLabels,
+                            train_spec->num_features(), data->num_labels());
+            }
+            spdlog::info("Checkpoint log {} contains weights for {} labels", CheckpointLog.string(), known->Weights.size());
+            task.set_known_weights(std::move(known));
+        }
+        task.set_checkpoint_writer(std::make_shared<io::LabelCheckpointWriter>(
+                CheckpointLog, train_spec->num_features(), data->num_labels(), ContinueRun));
+    }
+
+    // the initialization strategy of the first point of the regularization path, which needs to be restored after
+    // the later points have been warm-started.
+    auto path_init = config.Init ? config.Init : init::create_zero_initializer();
+    bool warm_started = false;
+
     while(true) {
         spdlog::info("Starting batch {} - {}", first_label.to_index(), next_label.to_index());
 
         if(loader.has_value()) {
             auto initial_weights = loader->load_model(first_label, next_label);
-            config.Init = init::create_pretrained_initializer(initial_weights);
+            train_spec->set_initialization_strategy(init::create_pretrained_initializer(initial_weights));
+            task.reset_initializers();
+        } else if(warm_started) {
+            train_spec->set_initialization_strategy(path_init);
+            task.reset_initializers();
+            warm_started = false;
         }
 
-        // update time limit to respect remaining time
-        runner.set_time_limit(std::chrono::duration_cast<std::chrono::milliseconds>(timeout_time - std::chrono::steady_clock::now()));
+        for(std::size_t point = 0; point < reg_path.size(); ++point) {
+            if(!RegPath.empty()) {
+                spdlog::info("Training with regularization factor {}", reg_path[point]);
+                train_spec->set_regularization_scale(reg_path[point]);
+            }
 
-        std::shared_ptr<TrainingSpec> train_spec = create_dismec_training(data, hps, config);
-        if(Verbose >= 0) {
-            train_spec->set_logger(spdlog::default_logger());
-        }
-        auto result = run_training(runner, train_spec,
-                                   first_label, next_label);
-
-        /* do async saving. This has some advantages and some drawbacks:
-            + all the i/o latency will be interleaved with actual new computation and we don't waste much time
-              in this essentially non-parallel code
-            - we may overcommit the processor. If run_training uses all cores, then we will spawn an additional thread
-              here
-            - increased memory consumption. Instead of 1 model, we need to keep 2 in memory at the same time: The one
-              that is currently worked on and the one that is still being saved.
-         */
-        // make sure we don't interleave saving, as we don't do any locking in `saver`. Also, throw any exception
-        // that happened during the saving
-        if(saving.valid()) {
-            saving.get();
-            // saving weights has finished, we can update the meta data
-            saver.update_meta_file();
+            // update time limit to respect remaining time
+            runner.set_time_limit(std::chrono::duration_cast<std::chrono::milliseconds>(timeout_time - std::chrono::steady_clock::now()));
+
+            auto result = run_training(runner, task);
+
+            /* do async saving. This has some advantages and some drawbacks:
+                + all the i/o latency will be interleaved with actual new computation and we don't waste much time
+                  in this essentially non-parallel code
+                - we may overcommit the processor. If run_training uses all cores, then we will spawn an additional thread
+                  here
+                - increased memory consumption. Instead of 1 model, we need to keep 2 in memory at the same time: The one
+                  that is currently worked on and the one that is still being saved.
+             */
+            // make sure we don't interleave saving, as we don't do any locking in `saver`.
+            finish_saving();
+            saving = savers[point]->add_model(result.Model);
+            saving_point = point;
+
+            if(point + 1 < reg_path.size()) {
+                // the next point of the path starts from the weights for the current, stronger regularization. These
+                // are the post-processed weights, as the raw minimizer output would need a second model per batch. The
+                // usual post-processing only culls small weights, which the next minimization can restore.
+                train_spec->set_initialization_strategy(init::create_pretrained_initializer(result.Model));
+                task.reset_initializers();
+                task.set_label_range(first_label, next_label);
+                warm_started = true;
+            }
         }
 
-        saving = saver.add_model(result.Model);
-
         first_label = next_label;
         if(first_label == LabelsEnd) {
             // wait for the last saving process to finish
-            saving.get();
-            saver.update_meta_file();
+            finish_saving();
             break;
         }
         next_label = std::min(LabelsEnd, first_label + BatchSize);
@@ -570,6 +807,7 @@ int TrainingProgram::run(int argc, const char** argv)
         if(next_label + BatchSize/2 > LabelsEnd) {
             next_label = LabelsEnd;
         }
+        task.set_label_range(first_label, next_label);
     }
 
     spdlog::info("program finished after {} seconds", std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - start_time).count() );
@@ -83,26 +83,35 @@ void CascadeTraining::update_objective(objective::Objective& base_objective, lab
         throw std::logic_error("Could not cast objective to <DenseAndSparseLinearBase>");
 
     if(m_Shortlist) {
-        // TODO this causes several memory allocations
         const auto& shortlist = m_Shortlist->at(label_id.to_index());
-        DenseFeatures shortlisted_dense = shortlist_features(m_DenseReplicator.get_local()->dense(),
-                                                             shortlist);
-        SparseFeatures shortlisted_sparse = shortlist_features(m_SparseReplicator.get_local()->sparse(),
-                                                               shortlist);
-        objective->update_features(shortlisted_dense, shortlisted_sparse);
+        // the objective only keeps a view of the rows. The aliasing constructor shares ownership with the entire
+        // shortlist, so neither the rows nor the features need to be copied.
+        objective->select_instances(std::shared_ptr<const std::vector<long>>(m_Shortlist, &shortlist));
         BinaryLabelVector& target_labels = objective->get_label_ref();
-        target_labels.resize(ssize(shortlist));
         auto label_vec = get_data().get_labels(label_id);
         long target_id = 0;
         for(const auto& row : shortlist) {
             target_labels.coeffRef(target_id) = label_vec->coeff(row);
             ++target_id;
         }
-        objective->update_costs(1.0, 1.0);
+        if(const auto& instance_weights = get_data().get_instance_weights(); instance_weights) {
+            DenseRealVector shortlisted_weights(ssize(shortlist));
+            target_id = 0;
+            for(const auto& row : shortlist) {
+                shortlisted_weights.coeffRef(target_id) = instance_weights->coeff(row);
+                ++target_id;
+            }
+            objective->update_costs(1.0, 1.0, shortlisted_weights);
+        } else {
+            objective->update_costs(1.0, 1.0);
+        }
     } else {
         // we need to set the labels before we update the costs, since the label information is needed
         // to determine whether to apply the positive or the negative weighting
         get_data().get_labels(label_id, objective->get_label_ref());
+        if(const auto& instance_weights = get_data().get_instance_weights(); instance_weights) {
+            objective->update_costs(1.0, 1.0, *instance_weights);
+        }
     }
 }
 
@@ -8,6 +8,10 @@
 #include "objective/regularizers_imp.h"
 #include "objective/generic_linear.h"
 #include "solver/newton.h"
+#include "solver/dual_cd.h"
+#include "solver/tron.h"
+#include "solver/lbfgs.h"
+#include "solver/active_set.h"
 #include "model/model.h"
 #include "model/dense.h"
 #include "model/sparse.h"
@@ -15,6 +19,13 @@
 #include "initializer.h"
 #include "weighting.h"
 #include "postproc.h"
+#include "negatives.h"
+#include "data/transform.h"
+#include "utils/conversion.h"
+#include "utils/eigen_generic.h"
+#include <algorithm>
+#include <numeric>
+#include <random>
 
 using namespace dismec;
 
@@ -61,30 +72,109 @@ std::shared_ptr<objective::Objective> dismec::make_loss(
 }
 
 
+namespace {
+    /// Checks whether the last column of `features` is one for every instance.
+    bool has_bias_feature(const DenseFeatures& features) {
+        return (features.col(features.cols() - 1).array() == real_t{1}).all();
+    }
+
+    bool has_bias_feature(const SparseFeatures& features) {
+        for(long row = 0; row < features.rows(); ++row) {
+            bool found = false;
+            for(SparseFeatures::InnerIterator it(features, row); it; ++it) {
+                found = it.col() == features.cols() - 1 && it.value() == real_t{1};
+            }
+            if(!found) {
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
 std::shared_ptr<objective::Objective> DiSMECTraining::make_objective() const {
-    // we make a copy of the features, so they are in the local numa memory
-    auto copy = m_FeatureReplicator.get_local();
+    // we make a copy of the features, so they are in the local numa memory. If instances are held out for early
+    // stopping, the objective only gets the remaining ones.
+    auto copy = m_TrainingFeatures ? m_TrainingFeatures->get_local() : m_FeatureReplicator.get_local();
     auto reg = std::visit([](auto&& config){ return make_regularizer(config); }, m_Regularizer);
     return make_loss(m_Loss, std::move(copy), std::move(reg));
 }
 
 std::unique_ptr<solvers::Minimizer> DiSMECTraining::make_minimizer() const {
-    auto minimizer = std::make_unique<solvers::NewtonWithLineSearch>(num_features());
+    auto minimizer = make_solver();
+    if(m_EarlyStoppingFeatures) {
+        minimizer->set_validation_stopping(m_EarlyStoppingFeatures->get_local(), m_EarlyStopping.Interval,
+                                           m_EarlyStopping.Tolerance);
+    }
+    return minimizer;
+}
+
+std::unique_ptr<solvers::Minimizer> DiSMECTraining::create_solver() const {
+    switch(m_Solver) {
+        case SolverType::DUAL_CD: {
+            auto loss = m_Loss == LossType::HINGE ? solvers::DualCoordinateDescent::LossType::HINGE :
+                                                    solvers::DualCoordinateDescent::LossType::SQUARED_HINGE;
+            auto strength = std::get<objective::SquaredNormConfig>(m_Regularizer).Strength;
+            return std::make_unique<solvers::DualCoordinateDescent>(loss, strength);
+        }
+        case SolverType::TRUST_REGION:
+            return std::make_unique<solvers::TrustRegionNewton>(num_features());
+        case SolverType::LBFGS:
+            return std::make_unique<solvers::LBFGS>(num_features());
+        case SolverType::ACTIVE_SET:
+            return std::make_unique<solvers::ActiveSetNewton>(num_features());
+        case SolverType::NEWTON:
+        default:
+            return std::make_unique<solvers::NewtonWithLineSearch>(num_features());
+    }
+}
+
+std::unique_ptr<solvers::Minimizer> DiSMECTraining::make_solver() const {
+    auto minimizer = create_solver();
+    // the constructor has verified that the solver declares all of these hyper-parameters
     m_NewtonSettings.apply(*minimizer);
+
+    if(auto* active_set = dynamic_cast<solvers::ActiveSetNewton*>(minimizer.get()); active_set) {
+        // the l1 part of the regularizer decides which weights can stay at zero
+        if(const auto* elastic = std::get_if<objective::ElasticConfig>(&m_Regularizer)) {
+            active_set->set_l1_strength(elastic->Strength * (1 - elastic->Interpolation));
+        } else {
+            active_set->set_l1_strength(std::get<objective::HuberConfig>(m_Regularizer).Strength);
+        }
+        if(std::visit([](const auto& config) { return config.IgnoreBias; }, m_Regularizer)) {
+            active_set->set_bias_index(num_features() - 1);
+        }
+    }
+
+    if(auto* newton = dynamic_cast<solvers::NewtonWithLineSearch*>(minimizer.get()); newton) {
+        if(m_BlockCorrelation) {
+            newton->set_preconditioner(std::make_unique<solvers::BlockDiagonalPreconditioner>(m_BlockCorrelation->get_local()));
+        } else if(m_LowRankCorrelation) {
+            newton->set_preconditioner(std::make_unique<solvers::LowRankPreconditioner>(m_LowRankCorrelation->get_local()));
+        }
+    }
     return minimizer;
 }
 
 void DiSMECTraining::update_minimizer(solvers::Minimizer& base_minimizer, label_id_t label_id) const
 {
-    auto* minimizer = dynamic_cast<solvers::NewtonWithLineSearch*>(&base_minimizer);
-    if(!minimizer)
-        throw std::logic_error("Could not cast minimizer to <NewtonWithLineSearch>");
+    // dual coordinate descent stops once the gap between the largest and smallest projected gradient of the dual is
+    // below `pg-gap`. The projected gradients are per-instance quantities, whose scale does not grow with the number of
+    // instances, so this tolerance is used as given, without the scaling of the relative `epsilon` below.
+    if(m_Solver == SolverType::DUAL_CD) {
+        return;
+    }
 
     // adjust the epsilon parameter according to number of positives/number of negatives
     std::size_t num_pos = get_data().num_positives(label_id);
-    double small_count = static_cast<double>(std::min(num_pos, get_data().num_examples() - num_pos));
-    double epsilon_scale = std::max(small_count, 1.0) / get_data().num_examples();
-    minimizer->set_epsilon(m_BaseEpsilon * epsilon_scale);
+    std::size_t num_neg = get_data().num_examples() - num_pos;
+    if(m_NegativeSampler) {
+        num_neg = m_NegativeSampler->num_negatives(get_data(), label_id);
+    }
+    double small_count = static_cast<double>(std::min(num_pos, num_neg));
+    double epsilon_scale = std::max(small_count, 1.0) / static_cast<double>(num_pos + num_neg);
+    // all gradient-based minimizers declare the same `epsilon` hyper-parameter
+    base_minimizer.set_hyper_parameter("epsilon", m_BaseEpsilon * epsilon_scale);
 }
 
 DiSMECTraining::DiSMECTraining(std::shared_ptr<const DatasetBase> data,
@@ -95,7 +185,12 @@ DiSMECTraining::DiSMECTraining(std::shared_ptr<const DatasetBase> data,
                                std::shared_ptr<TrainingStatsGatherer> gatherer,
                                bool use_sparse,
                                RegularizerSpec regularizer,
-                               LossType loss) :
+                               LossType loss,
+                               std::shared_ptr<NegativeSampler> sampler,
+                               SolverType solver,
+                               PreconditionerConfig preconditioner,
+                               ValidationStoppingConfig early_stopping,
+                               bool screen_labels) :
         TrainingSpec(std::move(data)),
         m_NewtonSettings( std::move(hyper_params) ),
         m_Weighting( std::move(weighting) ),
@@ -105,7 +200,11 @@ DiSMECTraining::DiSMECTraining(std::shared_ptr<const DatasetBase> data,
         m_FeatureReplicator(get_data().get_features() ),
         m_StatsGather( std::move(gatherer) ),
         m_Regularizer( regularizer ),
-        m_Loss( loss )
+        m_Loss( loss ),
+        m_NegativeSampler( std::move(sampler) ),
+        m_Solver( solver ),
+        m_EarlyStopping( early_stopping ),
+        m_ScreenLabels( screen_labels )
 {
     if(!m_InitStrategy) {
         throw std::invalid_argument("Missing weight initialization strategy");
@@ -115,8 +214,113 @@ DiSMECTraining::DiSMECTraining(std::shared_ptr<const DatasetBase> data,
         throw std::invalid_argument("Missing weight post processor");
     }
 
+    if(m_Solver == SolverType::DUAL_CD) {
+        if(m_Loss != LossType::SQUARED_HINGE && m_Loss != LossType::HINGE) {
+            THROW_EXCEPTION(std::invalid_argument, "Dual coordinate descent requires the hinge or squared hinge loss");
+        }
+        const auto* reg = std::get_if<objective::SquaredNormConfig>(&m_Regularizer);
+        if(!reg || reg->IgnoreBias) {
+            THROW_EXCEPTION(std::invalid_argument, "Dual coordinate descent requires a L2 regularizer that includes the bias");
+        }
+
+        // the relative `epsilon` of the other solvers has no meaning for the projected gradient gap, so it is not
+        // passed on. Dual coordinate descent has its own tolerance `pg-gap`.
+        HyperParameters solver_settings;
+        for(const auto& name : m_NewtonSettings.names()) {
+            if(name != "epsilon") {
+                std::visit([&](auto value) { solver_settings.set(name, value); }, m_NewtonSettings.get(name));
+            }
+        }
+        m_NewtonSettings = std::move(solver_settings);
+    }
+
+    if(m_Solver == SolverType::ACTIVE_SET) {
+        // the active set solver treats the regularizer as an exact L1 penalty when deciding which weights are fixed to
+        // zero, so this is only sensible if the smoothing of the regularizer is small.
+        real_t smoothing;
+        if(const auto* huber = std::get_if<objective::HuberConfig>(&m_Regularizer); huber) {
+            smoothing = huber->Epsilon;
+        } else if(const auto* elastic = std::get_if<objective::ElasticConfig>(&m_Regularizer);
+                  elastic && elastic->Interpolation < 1) {
+            smoothing = elastic->Epsilon;
+        } else {
+            THROW_EXCEPTION(std::invalid_argument, "The active set solver requires a L1 or elastic net regularizer");
+        }
+        if(smoothing > ACTIVE_SET_MAX_L1_SMOOTHING) {
+            THROW_EXCEPTION(std::invalid_argument, "The active set solver requires a L1-like regularizer, but the "
+                                                   "regularizer is smoothed with epsilon={} > {}",
+                            smoothing, ACTIVE_SET_MAX_L1_SMOOTHING);
+        }
+    }
+
+    if(preconditioner.Type != PreconditionerType::DIAGONAL) {
+        if(m_Solver != SolverType::NEWTON) {
+            THROW_EXCEPTION(std::invalid_argument, "Only the newton solver supports a non-diagonal preconditioner");
+        }
+        const auto& features = *get_data().get_features();
+        if(preconditioner.Type == PreconditionerType::BLOCK_DIAGONAL) {
+            m_BlockCorrelation = std::make_unique<parallel::NUMAReplicator<const solvers::BlockCorrelation>>(
+                    solvers::make_block_correlation(features, preconditioner.Size, preconditioner.Strength));
+        } else {
+            m_LowRankCorrelation = std::make_unique<parallel::NUMAReplicator<const solvers::LowRankCorrelation>>(
+                    solvers::make_low_rank_correlation(features, preconditioner.Size, preconditioner.Strength));
+        }
+    }
+
+    if(m_ScreenLabels) {
+        if(m_Loss == LossType::LOGISTIC) {
+            THROW_EXCEPTION(std::invalid_argument, "Label screening requires a hinge-type loss");
+        }
+        if(!std::visit([](const auto& config) { return config.IgnoreBias; }, m_Regularizer)) {
+            THROW_EXCEPTION(std::invalid_argument, "Label screening requires a regularizer that excludes the bias");
+        }
+        if(!visit([](const auto& features) { return has_bias_feature(features); }, *get_data().get_features())) {
+            THROW_EXCEPTION(std::invalid_argument, "Label screening requires the last feature to be a bias feature");
+        }
+    }
+
+    if(m_EarlyStopping.NumInstances < 0) {
+        THROW_EXCEPTION(std::invalid_argument, "Number of early stopping instances cannot be negative, got {}",
+                        m_EarlyStopping.NumInstances);
+    }
+    if(m_EarlyStopping.NumInstances > 0) {
+        long num_examples = get_data().num_examples();
+        if(m_EarlyStopping.NumInstances >= num_examples) {
+            THROW_EXCEPTION(std::invalid_argument, "Cannot hold out {} instances for early stopping from a dataset "
+                                                   "with {} instances", m_EarlyStopping.NumInstances, num_examples);
+        }
+        // a fixed random subset of the instances, in increasing order, is held out of the training objectives
+        std::vector<long> all_instances(num_examples);
+        std::iota(all_instances.begin(), all_instances.end(), 0);
+        std::sample(all_instances.begin(), all_instances.end(), std::back_inserter(m_HeldOutInstances),
+                    m_EarlyStopping.NumInstances, std::mt19937{42});
+        std::set_difference(all_instances.begin(), all_instances.end(),
+                            m_HeldOutInstances.begin(), m_HeldOutInstances.end(),
+                            std::back_inserter(m_TrainingInstances));
+
+        auto monitored = visit([&](const auto& features) {
+            return std::make_shared<const GenericFeatureMatrix>(shortlist_features(features, m_HeldOutInstances));
+        }, *get_data().get_features());
+        m_EarlyStoppingFeatures = std::make_unique<parallel::NUMAReplicator<const GenericFeatureMatrix>>(monitored);
+        auto training = visit([&](const auto& features) {
+            return std::make_shared<const GenericFeatureMatrix>(shortlist_features(features, m_TrainingInstances));
+        }, *get_data().get_features());
+        m_TrainingFeatures = std::make_unique<parallel::NUMAReplicator<const GenericFeatureMatrix>>(training);
+    }
+
+    // a hyper-parameter that the solver does not know would either make `make_minimizer()` fail inside the worker
+    // threads, or be ignored silently, so we reject it here.
+    auto supported = create_solver()->get_hyper_parameter_names();
+    for(const auto& name : m_NewtonSettings.names()) {
+        if(std::find(supported.begin(), supported.end(), name) == supported.end()) {
+            THROW_EXCEPTION(std::invalid_argument, "Hyper-parameter '{}' is not supported by the chosen solver", name);
+        }
+    }
+
     // extract the base value of `epsilon` from the `hyper_params` object.
-    m_BaseEpsilon = std::get<double>(m_NewtonSettings.get("epsilon"));
+    if(m_Solver != SolverType::DUAL_CD) {
+        m_BaseEpsilon = std::get<double>(m_NewtonSettings.get("epsilon"));
+    }
 }
 
 void DiSMECTraining::update_objective(objective::Objective& base_objective, label_id_t label_id) const {
@@ -124,17 +328,119 @@ void DiSMECTraining::update_objective(objective::Objective& base_objective, labe
     if(!objective)
         throw std::logic_error("Could not cast objective to <LinearClassifierBase>");
 
+    if(m_NegativeSampler) {
+        update_sampled_objective(*objective, label_id);
+        return;
+    }
+
+    if(!m_TrainingInstances.empty()) {
+        update_held_out_objective(*objective, label_id);
+        return;
+    }
+
     // we need to set the labels before we update the costs, since the label information is needed
     // to determine whether to apply the positive or the negative weighting
     get_data().get_labels(label_id, objective->get_label_ref());
+    real_t positive = m_CostScale;
+    real_t negative = m_CostScale;
+    if(m_Weighting) {
+        positive *= m_Weighting->get_positive_weight(label_id);
+        negative *= m_Weighting->get_negative_weight(label_id);
+    }
+
+    if(const auto& instance_weights = get_data().get_instance_weights(); instance_weights) {
+        objective->update_costs(positive, negative, *instance_weights);
+    } else {
+        objective->update_costs(positive, negative);
+    }
+}
+
+void DiSMECTraining::update_sampled_objective(objective::LinearClassifierBase& objective, label_id_t label_id) const {
+    auto label_vec = get_data().get_labels(label_id);
+    auto features = m_FeatureReplicator.get_local();
+
+    std::vector<long> instances;
+    DenseRealVector weights;
+    m_NegativeSampler->select(*features, *label_vec, label_id, instances, weights);
+    if(!m_HeldOutInstances.empty()) {
+        // the instances that are monitored for early stopping must not be trained on
+        long kept = 0;
+        for(long i = 0; i < ssize(instances); ++i) {
+            if(!std::binary_search(m_HeldOutInstances.begin(), m_HeldOutInstances.end(), instances[i])) {
+                instances[kept] = instances[i];
+                weights.coeffRef(kept) = weights.coeff(i);
+                ++kept;
+            }
+        }
+        instances.resize(kept);
+        weights.conservativeResize(kept);
+    }
+    // the selected rows are copied into storage owned by the objective, which is reused for the next label
+    objective.update_features(*features, instances);
+
+    BinaryLabelVector& target_labels = objective.get_label_ref();
+    for(long i = 0; i < ssize(instances); ++i) {
+        target_labels.coeffRef(i) = label_vec->coeff(instances[i]);
+    }
+
+    if(const auto& instance_weights = get_data().get_instance_weights(); instance_weights) {
+        for(long i = 0; i < ssize(instances); ++i) {
+            weights.coeffRef(i) *= instance_weights->coeff(instances[i]);
+        }
+    }
+
+    if(m_Weighting) {
+        objective.update_costs(m_CostScale * m_Weighting->get_positive_weight(label_id),
+                               m_CostScale * m_Weighting->get_negative_weight(label_id),
+                               weights);
+    } else {
+        objective.update_costs(m_CostScale, m_CostScale, weights);
+    }
+}
+
+void DiSMECTraining::update_held_out_objective(objective::LinearClassifierBase& objective, label_id_t label_id) const {
+    // the features of the objective already are restricted to `m_TrainingInstances`, so only labels and costs change
+    auto label_vec = get_data().get_labels(label_id);
+    BinaryLabelVector& target_labels = objective.get_label_ref();
+    for(long i = 0; i < ssize(m_TrainingInstances); ++i) {
+        target_labels.coeffRef(i) = label_vec->coeff(m_TrainingInstances[i]);
+    }
+
+    real_t positive = m_CostScale;
+    real_t negative = m_CostScale;
     if(m_Weighting) {
-        objective->update_costs(m_Weighting->get_positive_weight(label_id),
-                                m_Weighting->get_negative_weight(label_id));
+        positive *= m_Weighting->get_positive_weight(label_id);
+        negative *= m_Weighting->get_negative_weight(label_id);
+    }
+
+    if(const auto& instance_weights = get_data().get_instance_weights(); instance_weights) {
+        DenseRealVector weights(ssize(m_TrainingInstances));
+        for(long i = 0; i < ssize(m_TrainingInstances); ++i) {
+            weights.coeffRef(i) = instance_weights->coeff(m_TrainingInstances[i]);
+        }
+        objective.update_costs(positive, negative, weights);
+    } else {
+        objective.update_costs(positive, negative);
+    }
+}
+
+void DiSMECTraining::set_regularization_scale(real_t scale) {
+    if(scale <= 0) {
+        THROW_EXCEPTION(std::invalid_argument, "Regularization scale must be positive, got {}", scale);
     }
+    m_CostScale = real_t{1} / scale;
 }
 
 std::unique_ptr<init::WeightsInitializer> DiSMECTraining::make_initializer() const {
-    return m_InitStrategy->make_initializer(m_FeatureReplicator.get_local());
+    auto initializer = m_InitStrategy->make_initializer(m_FeatureReplicator.get_local());
+    if(m_ScreenLabels) {
+        initializer->enable_label_screening(num_features() - 1);
+    }
+    return initializer;
+}
+
+void DiSMECTraining::set_initialization_strategy(std::shared_ptr<init::WeightInitializationStrategy> strategy) {
+    m_InitStrategy = std::move(strategy);
 }
 
 std::shared_ptr<model::Model> DiSMECTraining::make_model(long num_features, model::PartialModelSpec spec) const {
@@ -167,7 +473,227 @@ std::shared_ptr<TrainingSpec> dismec::create_dismec_training(std::shared_ptr<con
                                             std::move(config.StatsGatherer),
                                             config.Sparse,
                                             config.Regularizer,
-                                            config.Loss);
+                                            config.Loss,
+                                            std::move(config.NegativeSampling),
+                                            config.Solver,
+                                            config.Preconditioner,
+                                            config.EarlyStopping,
+                                            config.ScreenLabels);
 }
 
 long TrainingSpec::num_features() const { return get_data().num_features(); }
+
+void TrainingSpec::set_initialization_strategy(std::shared_ptr<init::WeightInitializationStrategy> strategy) {
+    THROW_EXCEPTION(std::logic_error, "This TrainingSpec does not support changing the initialization strategy");
+}
+
+void TrainingSpec::set_regularization_scale(real_t scale) {
+    THROW_EXCEPTION(std::logic_error, "This TrainingSpec does not support changing the regularization strength");
+}
+
+#include "doctest.h"
+#include "statistics.h"
+
+/*!
+ * \test This checks that training with `set_regularization_scale(2)` gives the same weights as training with a regularizer
+ * that is twice as strong, both for the full and for the sampled objective.
+ */
+TEST_CASE("regularization scale") {
+    DenseFeatures features(6, 3);
+    features << 1.0, 0.0, 1.0,
+                0.9, 0.3, 1.0,
+                0.0, 1.0, 1.0,
+                0.2, 0.8, 1.0,
+                0.5, 0.5, 1.0,
+                1.0, 0.2, 1.0;
+    std::vector<std::vector<long>> labels = {{0}, {0, 1}, {1}, {1}, {}, {0}};
+    auto data = std::make_shared<MultiLabelData>(features, labels);
+
+    HyperParameters hps;
+    hps.set("epsilon", 1e-4);
+
+    auto train = [&](real_t strength, real_t scale, std::shared_ptr<NegativeSampler> sampler) {
+        DismecTrainingConfig config;
+        config.Weighting = std::make_shared<ConstantWeighting>(1.0, 1.0);
+        config.StatsGatherer = std::make_shared<TrainingStatsGatherer>("", "");
+        config.Sparse = false;
+        config.Regularizer = objective::SquaredNormConfig{strength, false};
+        config.Loss = LossType::SQUARED_HINGE;
+        config.NegativeSampling = std::move(sampler);
+        auto spec = create_dismec_training(data, hps, config);
+        spec->set_regularization_scale(scale);
+        auto objective = spec->make_objective();
+        auto minimizer = spec->make_minimizer();
+        spec->update_objective(*objective, label_id_t{1});
+        spec->update_minimizer(*minimizer, label_id_t{1});
+        DenseRealVector weights = DenseRealVector::Zero(3);
+        REQUIRE(minimizer->minimize(*objective, weights).Outcome == solvers::MinimizerStatus::SUCCESS);
+        return weights;
+    };
+
+    CHECK_THROWS(train(1.0, 0.0, nullptr));
+
+    SUBCASE("full") {
+        DenseRealVector expected = train(2.0, 1.0, nullptr);
+        DenseRealVector scaled = train(1.0, 2.0, nullptr);
+        CHECK((expected - scaled).norm() < 1e-4);
+        CHECK((expected - train(1.0, 1.0, nullptr)).norm() > 1e-2);
+    }
+
+    SUBCASE("sampled") {
+        auto sampler = create_random_sampler(2, 42);
+        DenseRealVector expected = train(2.0, 1.0, sampler);
+        DenseRealVector scaled = train(1.0, 2.0, sampler);
+        CHECK((expected - scaled).norm() < 1e-4);
+    }
+}
+
+/*!
+ * \test This checks that hyper-parameters which the chosen solver does not declare are rejected when the training is
+ * set up, instead of failing or being ignored once the minimizer is created.
+ */
+TEST_CASE("unsupported solver hyper-parameters") {
+    DenseFeatures features(2, 2);
+    features << 1.0, 1.0,
+                0.0, 1.0;
+    auto data = std::make_shared<MultiLabelData>(features, std::vector<std::vector<long>>{{0}});
+
+    DismecTrainingConfig config;
+    config.Weighting = std::make_shared<ConstantWeighting>(1.0, 1.0);
+    config.StatsGatherer = std::make_shared<TrainingStatsGatherer>("", "");
+    config.Regularizer = objective::SquaredNormConfig{1.0, false};
+    config.Loss = LossType::SQUARED_HINGE;
+
+    HyperParameters hps;
+    hps.set("epsilon", 0.01);
+    hps.set("history", 5l);
+
+    config.Solver = SolverType::LBFGS;
+    CHECK_NOTHROW(create_dismec_training(data, hps, config)->make_minimizer());
+    config.Solver = SolverType::NEWTON;
+    CHECK_THROWS_AS(create_dismec_training(data, hps, config), std::invalid_argument);
+    config.Solver = SolverType::TRUST_REGION;
+    CHECK_THROWS_AS(create_dismec_training(data, hps, config), std::invalid_argument);
+
+    hps = HyperParameters{};
+    hps.set("epsilon", 0.01);
+    hps.set("cg-warm-start", 1l);
+    config.Solver = SolverType::DUAL_CD;
+    CHECK_THROWS_AS(create_dismec_training(data, hps, config), std::invalid_argument);
+    config.Solver = SolverType::NEWTON;
+    CHECK_NOTHROW(create_dismec_training(data, hps, config)->make_minimizer());
+
+    // dual coordinate descent does not use `epsilon`, but its own `pg-gap`
+    hps = HyperParameters{};
+    hps.set("epsilon", 0.01);
+    hps.set("pg-gap", 0.5);
+    config.Solver = SolverType::DUAL_CD;
+    config.Regularizer = objective::SquaredNormConfig{1.0, false};
+    auto dual_cd = create_dismec_training(data, hps, config);
+    auto minimizer = dual_cd->make_minimizer();
+    dual_cd->update_minimizer(*minimizer, label_id_t{0});
+    CHECK(std::get<double>(minimizer->get_hyper_parameter("pg-gap")) == 0.5);
+    config.Solver = SolverType::NEWTON;
+    CHECK_THROWS_AS(create_dismec_training(data, hps, config), std::invalid_argument);
+}
+
+/*! \test This checks that the active set solver only accepts regularizers that are close to a L1 penalty.
+ */
+TEST_CASE("active set regularizers") {
+    DenseFeatures features(2, 2);
+    features << 1.0, 1.0,
+                0.0, 1.0;
+    auto data = std::make_shared<MultiLabelData>(features, std::vector<std::vector<long>>{{0}});
+
+    DismecTrainingConfig config;
+    config.Weighting = std::make_shared<ConstantWeighting>(1.0, 1.0);
+    config.StatsGatherer = std::make_shared<TrainingStatsGatherer>("", "");
+    config.Loss = LossType::SQUARED_HINGE;
+    config.Solver = SolverType::ACTIVE_SET;
+
+    HyperParameters hps;
+    hps.set("epsilon", 0.01);
+
+    config.Regularizer = objective::HuberConfig{1.0, 1e-2, true};
+    CHECK_NOTHROW(create_dismec_training(data, hps, config));
+    config.Regularizer = objective::ElasticConfig{1.0, 1e-1, 0.5, true};
+    CHECK_NOTHROW(create_dismec_training(data, hps, config));
+
+    // huber with a large epsilon, pure L2 and an elastic net without L1 part are rejected
+    config.Regularizer = objective::HuberConfig{1.0, 1.0, true};
+    CHECK_THROWS_AS(create_dismec_training(data, hps, config), std::invalid_argument);
+    config.Regularizer = objective::SquaredNormConfig{1.0, true};
+    CHECK_THROWS_AS(create_dismec_training(data, hps, config), std::invalid_argument);
+    config.Regularizer = objective::ElasticConfig{1.0, 1e-1, 1.0, true};
+    CHECK_THROWS_AS(create_dismec_training(data, hps, config), std::invalid_argument);
+}
+
+/*!
+ * \test This checks that the instances which are monitored for early stopping are removed from the training objective,
+ * both for the full and for the sampled objective, and that the remaining instances keep their labels.
+ */
+TEST_CASE("early stopping instances are held out") {
+    DenseFeatures features(6, 3);
+    features << 1.0, 0.0, 1.0,
+                0.9, 0.3, 1.0,
+                0.0, 1.0, 1.0,
+                0.2, 0.8, 1.0,
+                0.5, 0.5, 1.0,
+                1.0, 0.2, 1.0;
+    std::vector<std::vector<long>> labels = {{0}, {0, 1}, {1}, {1}, {}, {0}};
+    auto data = std::make_shared<MultiLabelData>(features, labels);
+    auto label_vec = static_cast<const DatasetBase&>(*data).get_labels(label_id_t{1});
+
+    HyperParameters hps;
+    hps.set("epsilon", 1e-4);
+
+    DismecTrainingConfig config;
+    config.Weighting = std::make_shared<ConstantWeighting>(1.0, 1.0);
+    config.StatsGatherer = std::make_shared<TrainingStatsGatherer>("", "");
+    config.Regularizer = objective::SquaredNormConfig{1.0, false};
+    config.Loss = LossType::SQUARED_HINGE;
+    config.EarlyStopping.NumInstances = 2;
+
+    // each training row needs to be one of the original rows, with its original label
+    auto check_training_rows = [&](const objective::LinearClassifierBase& objective, long expected_rows) {
+        const DenseFeatures& subset = objective.generic_features().dense();
+        REQUIRE(subset.rows() == expected_rows);
+        std::vector<long> original;
+        for(long i = 0; i < subset.rows(); ++i) {
+            for(long j = 0; j < features.rows(); ++j) {
+                if(subset.row(i) == features.row(j)) {
+                    original.push_back(j);
+                }
+            }
+            REQUIRE(ssize(original) == i + 1);
+            CHECK(objective.labels().coeff(i) == label_vec->coeff(original.back()));
+        }
+        return original;
+    };
+
+    SUBCASE("full") {
+        auto spec = create_dismec_training(data, hps, config);
+        auto objective = spec->make_objective();
+        spec->update_objective(*objective, label_id_t{1});
+        check_training_rows(dynamic_cast<const objective::LinearClassifierBase&>(*objective), 4);
+    }
+
+    SUBCASE("sampled") {
+        auto full = create_dismec_training(data, hps, config);
+        auto full_objective = full->make_objective();
+        full->update_objective(*full_objective, label_id_t{1});
+        auto training = check_training_rows(dynamic_cast<const objective::LinearClassifierBase&>(*full_objective), 4);
+
+        // with enough negatives, the sampler selects all instances, of which the held-out ones are dropped
+        config.NegativeSampling = create_random_sampler(6, 42);
+        auto spec = create_dismec_training(data, hps, config);
+        auto objective = spec->make_objective();
+        spec->update_objective(*objective, label_id_t{1});
+        auto sampled = check_training_rows(dynamic_cast<const objective::LinearClassifierBase&>(*objective), 4);
+        std::sort(sampled.begin(), sampled.end());
+        CHECK(sampled == training);
+    }
+
+    config.EarlyStopping.NumInstances = 6;
+    CHECK_THROWS_AS(create_dismec_training(data, hps, config), std::invalid_argument);
+}
@@ -10,6 +10,7 @@
 #include "spec.h"
 #include "parallel/numa.h"
 #include "utils/hyperparams.h"
+#include "solver/preconditioner.h"
 
 namespace dismec
 {
@@ -36,6 +37,20 @@ namespace dismec
          * \param data The dataset on which to train.
          * \param hyper_params Hyper parameters that will be applied to the \ref NewtonWithLineSearch optimizer.
          * \param weighting Positive/Negative label weighting that will be used for the \ref Regularized_SquaredHingeSVC objective.
+         * \param sampler If given, the objective for each label only contains the positives and the negatives selected
+         * by this \ref NegativeSampler, instead of the full dataset.
+         * \param solver The minimizer to use. \ref DualCoordinateDescent can only be used for the (squared) hinge loss
+         * with a L2 regularizer that includes the bias. Of the `hyper_params`, it only uses `epsilon` and `max-steps`.
+         * \ref TrustRegionNewton uses all `hyper_params` except for those of the line search, `cg-warm-start` and
+         * `forcing`, \ref LBFGS all except for those of CG. Conversely, the `history` of \ref LBFGS cannot be used with
+         * the other solvers. Throws `std::invalid_argument` if `hyper_params` contains a value that the chosen solver
+         * does not declare.
+         * \param preconditioner The CG preconditioner. Anything except the diagonal preconditioner can only be used with
+         * \ref NewtonWithLineSearch. The correlation data is calculated here, once for the entire dataset.
+         * \param early_stopping If enabled, a random subset of the instances is selected here and held out of the
+         * objectives of all labels. The minimizers stop once the scores of these instances no longer change.
+         * \param screen_labels Whether to skip training for labels that only have instances of one class. This requires
+         * a hinge-type loss, a regularizer that excludes the bias, and a bias feature as the last feature.
          */
         DiSMECTraining(std::shared_ptr<const DatasetBase> data, HyperParameters hyper_params,
                        std::shared_ptr<WeightingScheme> weighting,
@@ -43,11 +58,25 @@ namespace dismec
                        std::shared_ptr<postproc::PostProcessFactory> post_proc,
                        std::shared_ptr<TrainingStatsGatherer> gatherer,
                        bool use_sparse,
-                       RegularizerSpec regularizer, LossType loss);
+                       RegularizerSpec regularizer, LossType loss,
+                       std::shared_ptr<NegativeSampler> sampler = nullptr,
+                       SolverType solver = SolverType::NEWTON,
+                       PreconditionerConfig preconditioner = {},
+                       ValidationStoppingConfig early_stopping = {},
+                       bool screen_labels = false);
 
         [[nodiscard]] std::shared_ptr<objective::Objective> make_objective() const override;
         [[nodiscard]] std::unique_ptr<solvers::Minimizer> make_minimizer() const override;
         [[nodiscard]] std::unique_ptr<init::WeightsInitializer> make_initializer() const override;
+        void set_initialization_strategy(std::shared_ptr<init::WeightInitializationStrategy> strategy) override;
+
+        /*!
+         * \copydoc TrainingSpec::set_regularization_scale
+         * \note Scaling the regularizer by `scale` is equivalent to scaling the loss by `1/scale`, which is how this is
+         * implemented, as it works for all losses, regularizers and solvers. As a consequence, the objective values
+         * reported by the minimizer are also scaled by `1/scale`.
+         */
+        void set_regularization_scale(real_t scale) override;
         [[nodiscard]] std::shared_ptr<model::Model> make_model(long num_features, model::PartialModelSpec spec) const override;
 
         void update_minimizer(solvers::Minimizer& base_minimizer, label_id_t label_id) const override;
@@ -57,6 +86,18 @@ namespace dismec
 
         TrainingStatsGatherer& get_statistics_gatherer() override;
     private:
+        /// Implementation of `update_objective()` if a \ref NegativeSampler is given.
+        void update_sampled_objective(objective::LinearClassifierBase& objective, label_id_t label_id) const;
+
+        /// Implementation of `update_objective()` if instances are held out for early stopping.
+        void update_held_out_objective(objective::LinearClassifierBase& objective, label_id_t label_id) const;
+
+        /// Creates the minimizer for `m_Solver`, without the early stopping settings.
+        [[nodiscard]] std::unique_ptr<solvers::Minimizer> make_solver() const;
+
+        /// Creates the minimizer object for `m_Solver`, without applying any settings.
+        [[nodiscard]] std::unique_ptr<solvers::Minimizer> create_solver() const;
+
         HyperParameters m_NewtonSettings;
         std::shared_ptr<WeightingScheme> m_Weighting;
         bool m_UseSparseModel = false;
@@ -71,9 +112,30 @@ namespace dismec
 
         std::shared_ptr<TrainingStatsGatherer> m_StatsGather;
 
-        double m_BaseEpsilon;
+        double m_BaseEpsilon = 0;
         RegularizerSpec m_Regularizer;
+        /// Factor for the costs of all instances, i.e. the inverse of the regularization scale.
+        real_t m_CostScale = 1;
         LossType m_Loss;
+
+        /// Optional selection of the negative instances. If this is `nullptr`, all instances are used.
+        std::shared_ptr<NegativeSampler> m_NegativeSampler;
+
+        SolverType m_Solver;
+
+        // the correlation data for the preconditioner, if one is used.
+        std::unique_ptr<parallel::NUMAReplicator<const solvers::BlockCorrelation>> m_BlockCorrelation;
+        std::unique_ptr<parallel::NUMAReplicator<const solvers::LowRankCorrelation>> m_LowRankCorrelation;
+
+        // the instances that are monitored for early stopping, if enabled. These are held out of the training
+        // objective, which only contains the features of `m_TrainingInstances`. Both index lists are sorted.
+        std::unique_ptr<parallel::NUMAReplicator<const GenericFeatureMatrix>> m_EarlyStoppingFeatures;
+        std::unique_ptr<parallel::NUMAReplicator<const GenericFeatureMatrix>> m_TrainingFeatures;
+        std::vector<long> m_HeldOutInstances;
+        std::vector<long> m_TrainingInstances;
+        ValidationStoppingConfig m_EarlyStopping;
+
+        bool m_ScreenLabels;
     };
 }
 
@@ -0,0 +1,94 @@
+// Copyright (c) 2021, Aalto University, developed by Erik Schultheis
+// All rights reserved.
+//
+// SPDX-License-Identifier: MIT
+
+#include "training/initializer.h"
+#include "data/types.h"
+#include "objective/linear.h"
+#include "stats/collection.h"
+#include "utils/conversion.h"
+
+using namespace dismec::init;
+
+void WeightsInitializer::enable_label_screening(long bias_index) {
+    if(bias_index < 0) {
+        throw std::invalid_argument("bias index must not be negative");
+    }
+    m_BiasIndex = bias_index;
+
+    if(m_StatScreened.to_index() < 0) {
+        m_StatScreened = stats::stat_id_t{ssize(get_stats()->get_statistics_meta())};
+        declare_stat(m_StatScreened, {"screened", "fraction"});
+    }
+}
+
+bool WeightsInitializer::initialize(label_id_t label_id, Eigen::Ref<DenseRealVector> target,
+                                    objective::Objective& objective) {
+    if(m_BiasIndex >= 0) {
+        const auto* linear = dynamic_cast<const objective::LinearClassifierBase*>(&objective);
+        if(!linear) {
+            throw std::logic_error("Label screening requires a linear classifier objective");
+        }
+
+        const auto& labels = linear->labels();
+        bool all_negative = (labels.array() == -1).all();
+        bool all_positive = (labels.array() == 1).all();
+        record(m_StatScreened, (all_negative || all_positive) ? 1 : 0);
+        if(all_negative || all_positive) {
+            target.setZero();
+            target.coeffRef(m_BiasIndex) = all_negative ? -1 : 1;
+            return true;
+        }
+    }
+
+    get_initial_weight(label_id, target, objective);
+    return false;
+}
+
+#include "doctest.h"
+#include "objective/reg_sq_hinge.h"
+#include "objective/regularizers_imp.h"
+#include "utils/hash_vector.h"
+#include "utils/eigen_generic.h"
+
+using namespace dismec;
+
+/*!
+ * \test This checks that labels with only negative instances are screened, and that the screened weight vector is
+ * actually the minimum, i.e. has zero gradient. Labels with both classes are passed on to `get_initial_weight()`.
+ */
+TEST_CASE("label screening") {
+    DenseFeatures features(4, 3);
+    features << 1.0, 0.0, 1.0,
+                0.5, 2.0, 1.0,
+                0.0, 1.0, 1.0,
+                3.0, 0.5, 1.0;
+    auto shared = std::make_shared<const GenericFeatureMatrix>(SparseFeatures(features.sparseView()));
+    objective::Regularized_SquaredHingeSVC objective(shared, std::make_unique<objective::SquaredNormRegularizer>(1.0, true));
+
+    auto initializer = create_constant_initializer(DenseRealVector::Constant(3, 0.5))->make_initializer(shared);
+    DenseRealVector target(3);
+
+    // without screening, the base initializer is used
+    objective.get_label_ref() << -1, -1, -1, -1;
+    CHECK_FALSE(initializer->initialize(label_id_t{0}, target, objective));
+    CHECK(target == DenseRealVector::Constant(3, 0.5));
+
+    initializer->enable_label_screening(2);
+    CHECK_THROWS(initializer->enable_label_screening(-1));
+
+    REQUIRE(initializer->initialize(label_id_t{0}, target, objective));
+    CHECK(target == DenseRealVector{{0.0, 0.0, -1.0}});
+    DenseRealVector gradient(3);
+    objective.gradient(HashVector{target}, gradient);
+    CHECK(gradient.norm() == doctest::Approx(0.0));
+
+    objective.get_label_ref() << 1, 1, 1, 1;
+    REQUIRE(initializer->initialize(label_id_t{0}, target, objective));
+    CHECK(target == DenseRealVector{{0.0, 0.0, 1.0}});
+
+    objective.get_label_ref() << 1, -1, 1, -1;
+    CHECK_FALSE(initializer->initialize(label_id_t{0}, target, objective));
+    CHECK(target == DenseRealVector::Constant(3, 0.5));
+}
@@ -0,0 +1,315 @@
+// Copyright (c) 2021, Aalto University, developed by Erik Schultheis
+// All rights reserved.
+//
+// SPDX-License-Identifier: MIT
+
+#include "similar.h"
+#include "training/initializer.h"
+#include "data/data.h"
+#include "objective/objective.h"
+#include "stats/collection.h"
+#include "stats/timer.h"
+#include "utils/conversion.h"
+#include "utils/hash_vector.h"
+#include "utils/throw_error.h"
+#include <algorithm>
+#include <array>
+#include <mutex>
+
+using namespace dismec::init;
+
+LabelSimilarity::LabelSimilarity(std::shared_ptr<const MultiLabelData> data) : m_Data(std::move(data)) {
+    if(!m_Data) {
+        throw std::invalid_argument("data must not be null");
+    }
+
+    m_InstanceLabels.resize(m_Data->num_examples());
+    for(long label = 0; label < m_Data->num_labels(); ++label) {
+        for(long instance : m_Data->get_label_instances(label_id_t{label})) {
+            m_InstanceLabels.at(instance).push_back(label);
+        }
+    }
+}
+
+void LabelSimilarity::find_similar(label_id_t label, std::vector<Neighbour>& target) const {
+    target.clear();
+
+    // collect the labels of all positive instances. After sorting, the number of co-occurrences of a label is the
+    // length of its run.
+    std::vector<long> co_labels;
+    const auto& positives = m_Data->get_label_instances(label);
+    for(long instance : positives) {
+        const auto& labels = m_InstanceLabels[instance];
+        co_labels.insert(co_labels.end(), labels.begin(), labels.end());
+    }
+    std::sort(co_labels.begin(), co_labels.end());
+
+    real_t num_pos = ssize(positives);
+    auto run_start = co_labels.begin();
+    while(run_start != co_labels.end()) {
+        auto run_end = std::upper_bound(run_start, co_labels.end(), *run_start);
+        label_id_t other{*run_start};
+        if(other != label) {
+            real_t common = std::distance(run_start, run_end);
+            real_t other_pos = ssize(m_Data->get_label_instances(other));
+            target.push_back({other, common / (num_pos + other_pos - common)});
+        }
+        run_start = run_end;
+    }
+
+    std::stable_sort(target.begin(), target.end(), [](const Neighbour& a, const Neighbour& b) {
+        return a.Similarity > b.Similarity;
+    });
+}
+
+FinishedWeightsCache::FinishedWeightsCache(long capacity) : m_Capacity(capacity) {
+    if(capacity <= 0) {
+        THROW_EXCEPTION(std::invalid_argument, "Cache capacity must be positive, got {}", capacity);
+    }
+}
+
+void FinishedWeightsCache::insert(label_id_t label, const DenseRealVector& weights) {
+    // make the copy before acquiring the lock
+    auto copy = std::make_shared<const DenseRealVector>(weights);
+
+    std::unique_lock<std::shared_mutex> lock(m_Lock);
+    auto [pos, inserted] = m_Weights.insert_or_assign(label.to_index(), std::move(copy));
+    if(!inserted) {
+        return;
+    }
+    m_Order.push_back(label.to_index());
+    while(ssize(m_Order) > m_Capacity) {
+        m_Weights.erase(m_Order.front());
+        m_Order.pop_front();
+    }
+}
+
+std::shared_ptr<const dismec::DenseRealVector> FinishedWeightsCache::find(label_id_t label) const {
+    std::shared_lock<std::shared_mutex> lock(m_Lock);
+    auto found = m_Weights.find(label.to_index());
+    if(found == m_Weights.end()) {
+        return nullptr;
+    }
+    return found->second;
+}
+
+long FinishedWeightsCache::size() const {
+    std::shared_lock<std::shared_mutex> lock(m_Lock);
+    return ssize(m_Weights);
+}
+
+namespace dismec::init {
+    class SimilarLabelInitializer : public WeightsInitializer {
+    public:
+        SimilarLabelInitializer(std::shared_ptr<const LabelSimilarity> similarity,
+                                std::shared_ptr<FinishedWeightsCache> cache, real_t min_similarity);
+
+        void get_initial_weight(label_id_t label_id, Eigen::Ref<DenseRealVector> target,
+                                objective::Objective& objective) override;
+
+        void on_label_finished(label_id_t label_id, const DenseRealVector& weights) override;
+    private:
+        std::shared_ptr<const LabelSimilarity> m_Similarity;
+        std::shared_ptr<FinishedWeightsCache> m_Cache;
+        real_t m_MinSimilarity;
+
+        std::vector<LabelSimilarity::Neighbour> m_Neighbours;
+        HashVector m_Zero{DenseRealVector::Zero(0)};
+
+        static constexpr stats::stat_id_t STAT_DURATION{0};
+        static constexpr stats::stat_id_t STAT_HAS_DONOR{1};
+        static constexpr stats::stat_id_t STAT_SIMILARITY{2};
+        static constexpr stats::stat_id_t STAT_SCALE{3};
+        static constexpr stats::stat_id_t STAT_LOSS_REDUCTION{4};
+    };
+
+    class SimilarLabelStrategy : public WeightInitializationStrategy {
+    public:
+        SimilarLabelStrategy(std::shared_ptr<const LabelSimilarity> similarity, long cache_size, real_t min_similarity) :
+            m_Similarity(std::move(similarity)), m_Cache(std::make_shared<FinishedWeightsCache>(cache_size)),
+            m_MinSimilarity(min_similarity) {
+        }
+
+        [[nodiscard]] std::unique_ptr<WeightsInitializer>
+        make_initializer(const std::shared_ptr<const GenericFeatureMatrix>& features) const override {
+            return std::make_unique<SimilarLabelInitializer>(m_Similarity, m_Cache, m_MinSimilarity);
+        }
+    private:
+        std::shared_ptr<const LabelSimilarity> m_Similarity;
+        std::shared_ptr<FinishedWeightsCache> m_Cache;
+        real_t m_MinSimilarity;
+    };
+}
+
+SimilarLabelInitializer::SimilarLabelInitializer(std::shared_ptr<const LabelSimilarity> similarity,
+                                                 std::shared_ptr<FinishedWeightsCache> cache, real_t min_similarity) :
+    m_Similarity(std::move(similarity)), m_Cache(std::move(cache)), m_MinSimilarity(min_similarity)
+{
+    declare_stat(STAT_DURATION, {"duration", "µs"});
+    declare_stat(STAT_HAS_DONOR, {"has_donor", "fraction"});
+    declare_stat(STAT_SIMILARITY, {"similarity", "jaccard"});
+    declare_stat(STAT_SCALE, {"scale", {}});
+    declare_stat(STAT_LOSS_REDUCTION, {"loss_reduction", "(f(0)-f(w))/f(0) [%]"});
+}
+
+void SimilarLabelInitializer::get_initial_weight(label_id_t label_id, Eigen::Ref<DenseRealVector> target,
+                                                 objective::Objective& objective) {
+    auto timer = make_timer(STAT_DURATION);
+
+    // the neighbours are sorted by similarity, so the first one that is in the cache is the best available donor
+    std::shared_ptr<const DenseRealVector> donor;
+    real_t similarity = 0;
+    m_Similarity->find_similar(label_id, m_Neighbours);
+    for(const auto& candidate : m_Neighbours) {
+        if(candidate.Similarity < m_MinSimilarity) {
+            break;
+        }
+        donor = m_Cache->find(candidate.Label);
+        if(donor) {
+            similarity = candidate.Similarity;
+            break;
+        }
+    }
+
+    record(STAT_HAS_DONOR, donor ? 1 : 0);
+    if(!donor || donor->size() != target.size()) {
+        target.setZero();
+        return;
+    }
+
+    // The donor is trained for a different set of positives, so its scores are too confident for the instances that
+    // are not shared. We correct for this by rescaling. Since zero is one of the candidates, a donor can never result
+    // in an initial vector that is worse than the default zero initialization.
+    if(m_Zero->size() != target.size()) {
+        m_Zero.modify() = DenseRealVector::Zero(target.size());
+    }
+    objective.project_to_line(m_Zero, *donor);
+    constexpr std::array<real_t, 5> candidates = {0.25, 0.5, 0.75, 1.0, 1.25};
+    real_t best_scale = 0;
+    real_t value_at_zero = objective.lookup_on_line(0.0);
+    real_t best_value = value_at_zero;
+    for(real_t scale : candidates) {
+        real_t value = objective.lookup_on_line(scale);
+        if(value < best_value) {
+            best_value = value;
+            best_scale = scale;
+        }
+    }
+    target = best_scale * *donor;
+
+    record(STAT_SIMILARITY, similarity);
+    record(STAT_SCALE, best_scale);
+    record(STAT_LOSS_REDUCTION, [&]() {
+        return 100.f * (value_at_zero - best_value) / value_at_zero;
+    });
+}
+
+void SimilarLabelInitializer::on_label_finished(label_id_t label_id, const DenseRealVector& weights) {
+    m_Cache->insert(label_id, weights);
+}
+
+std::shared_ptr<WeightInitializationStrategy> dismec::init::create_similar_label_initializer(
+        std::shared_ptr<const LabelSimilarity> similarity, long cache_size, real_t min_similarity) {
+    return std::make_shared<SimilarLabelStrategy>(std::move(similarity), cache_size, min_similarity);
+}
+
+#include "doctest.h"
+#include "objective/reg_sq_hinge.h"
+#include "objective/regularizers_imp.h"
+#include "solver/newton.h"
+
+using namespace dismec;
+
+TEST_CASE("label similarity") {
+    SparseFeatures features(5, 2);
+    std::vector<std::vector<long>> labels = {{0, 1, 2}, {1, 2}, {0, 1, 2, 3}, {4}, {}};
+    LabelSimilarity similarity(std::make_shared<MultiLabelData>(features, labels));
+
+    std::vector<LabelSimilarity::Neighbour> neighbours;
+    similarity.find_similar(label_id_t{0}, neighbours);
+    REQUIRE(neighbours.size() == 2);
+    CHECK(neighbours[0].Label == label_id_t{2});
+    CHECK(neighbours[0].Similarity == doctest::Approx(0.75));
+    CHECK(neighbours[1].Label == label_id_t{1});
+    CHECK(neighbours[1].Similarity == doctest::Approx(2.0 / 3.0));
+
+    similarity.find_similar(label_id_t{3}, neighbours);
+    CHECK(neighbours.empty());
+    similarity.find_similar(label_id_t{4}, neighbours);
+    CHECK(neighbours.empty());
+}
+
+TEST_CASE("finished weights cache") {
+    CHECK_THROWS(FinishedWeightsCache(0));
+
+    FinishedWeightsCache cache(2);
+    DenseRealVector weights = DenseRealVector::Constant(3, 1.0);
+    cache.insert(label_id_t{5}, weights);
+    weights.setConstant(2.0);
+    cache.insert(label_id_t{3}, weights);
+
+    auto found = cache.find(label_id_t{5});
+    REQUIRE(found);
+    CHECK(*found == DenseRealVector::Constant(3, 1.0));
+    CHECK(cache.find(label_id_t{4}) == nullptr);
+
+    // re-inserting replaces the weights without changing the eviction order
+    cache.insert(label_id_t{5}, weights);
+    CHECK(*cache.find(label_id_t{5}) == DenseRealVector::Constant(3, 2.0));
+    CHECK(cache.size() == 2);
+
+    cache.insert(label_id_t{1}, weights);
+    CHECK(cache.size() == 2);
+    CHECK(cache.find(label_id_t{5}) == nullptr);
+    CHECK(cache.find(label_id_t{3}) != nullptr);
+    // the pointer we got before remains valid
+    CHECK(*found == DenseRealVector::Constant(3, 1.0));
+}
+
+/*!
+ * \test Trains label 0, and checks that label 1, which shares most of its positives, is initialized from it with a
+ * lower objective than zero, whereas label 2, which has no overlap, gets zero.
+ */
+TEST_CASE("similar label initializer") {
+    DenseFeatures dense(6, 3);
+    dense << 1.0, 0.2, 1.0,
+             0.9, 0.1, 1.0,
+             0.8, 0.5, 1.0,
+            -0.5, 1.0, 1.0,
+            -1.0, 0.8, 1.0,
+             0.1, -0.9, 1.0;
+    SparseFeatures features = dense.sparseView();
+    std::vector<std::vector<long>> labels = {{0, 1, 2}, {0, 1}, {3, 4}};
+    auto data = std::make_shared<MultiLabelData>(features, labels);
+    auto similarity = std::make_shared<LabelSimilarity>(data);
+
+    auto shared = std::make_shared<const GenericFeatureMatrix>(features);
+    objective::Regularized_SquaredHingeSVC objective(shared, std::make_unique<objective::SquaredNormRegularizer>(1.0, true));
+
+    auto strategy = create_similar_label_initializer(similarity, 10, 0.5);
+    auto initializer = strategy->make_initializer(shared);
+    DenseRealVector target(3);
+
+    // without any finished labels, there is no donor
+    data->get_labels(label_id_t{1}, objective.get_label_ref());
+    initializer->get_initial_weight(label_id_t{1}, target, objective);
+    CHECK(target == DenseRealVector::Zero(3));
+
+    data->get_labels(label_id_t{0}, objective.get_label_ref());
+    solvers::NewtonWithLineSearch newton(3);
+    target.setZero();
+    newton.minimize(objective, target);
+    // the cache is shared between the initializers of all threads
+    strategy->make_initializer(shared)->on_label_finished(label_id_t{0}, target);
+
+    data->get_labels(label_id_t{1}, objective.get_label_ref());
+    initializer->get_initial_weight(label_id_t{1}, target, objective);
+    CHECK(target != DenseRealVector::Zero(3));
+    HashVector init{target};
+    HashVector zero{DenseRealVector::Zero(3)};
+    CHECK(objective.value(init) < objective.value(zero));
+
+    data->get_labels(label_id_t{2}, objective.get_label_ref());
+    initializer->get_initial_weight(label_id_t{2}, target, objective);
+    CHECK(target == DenseRealVector::Zero(3));
+}
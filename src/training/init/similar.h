@@ -0,0 +1,76 @@
+// Copyright (c) 2021, Aalto University, developed by Erik Schultheis
+// All rights reserved.
+//
+// SPDX-License-Identifier: MIT
+
+#ifndef DISMEC_SRC_TRAINING_INIT_SIMILAR_H
+#define DISMEC_SRC_TRAINING_INIT_SIMILAR_H
+
+#include "matrix_types.h"
+#include "data/types.h"
+#include "fwd.h"
+#include <deque>
+#include <memory>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace dismec::init {
+    /*!
+     * \brief Finds labels whose sets of positive instances overlap.
+     * \details The similarity of two labels is the Jaccard index \f$ |P_a \cap P_b| / |P_a \cup P_b| \f$ of their sets
+     * of positive instances. In order to find all labels that are similar to a given label, an index from instances to
+     * labels is built once in the constructor. After that, all functions are read-only and can be called concurrently.
+     */
+    class LabelSimilarity {
+    public:
+        explicit LabelSimilarity(std::shared_ptr<const MultiLabelData> data);
+
+        struct Neighbour {
+            label_id_t Label;
+            real_t Similarity;
+        };
+
+        /*!
+         * \brief Finds all labels that share at least one positive instance with `label`.
+         * \details The result, which does not include `label` itself, is written to `target` and is sorted by decreasing
+         * similarity. Ties are broken by the label id, so the order is deterministic.
+         * The cost is proportional to the total number of labels of the positive instances of `label`.
+         */
+        void find_similar(label_id_t label, std::vector<Neighbour>& target) const;
+
+        [[nodiscard]] const std::shared_ptr<const MultiLabelData>& get_data() const { return m_Data; }
+    private:
+        std::shared_ptr<const MultiLabelData> m_Data;
+        /// For each instance, the list of its labels.
+        std::vector<std::vector<long>> m_InstanceLabels;
+    };
+
+    /*!
+     * \brief Keeps the most recently finished weight vectors, so that they can be used to initialize related labels.
+     * \details This cache is shared by all training threads. Lookups only need a shared lock, and return a pointer to
+     * the immutable weight vector, so a vector remains valid for the caller even if it is evicted in the meantime.
+     * If more than `capacity` vectors are inserted, the oldest ones are dropped.
+     */
+    class FinishedWeightsCache {
+    public:
+        explicit FinishedWeightsCache(long capacity);
+
+        /// Stores a copy of `weights` as the result for `label`.
+        void insert(label_id_t label, const DenseRealVector& weights);
+
+        /// Returns the weights for `label`, or `nullptr` if these are not (or no longer) in the cache.
+        [[nodiscard]] std::shared_ptr<const DenseRealVector> find(label_id_t label) const;
+
+        [[nodiscard]] long size() const;
+        [[nodiscard]] long capacity() const { return m_Capacity; }
+    private:
+        long m_Capacity;
+        mutable std::shared_mutex m_Lock;
+        std::unordered_map<long, std::shared_ptr<const DenseRealVector>> m_Weights;
+        /// Labels in the order of insertion, used for eviction.
+        std::deque<long> m_Order;
+    };
+}
+
+#endif //DISMEC_SRC_TRAINING_INIT_SIMILAR_H
@@ -7,6 +7,7 @@
 #define DISMEC_INITIALIZER_H
 
 #include "matrix_types.h"
+#include "data/types.h"
 #include "fwd.h"
 #include "parallel/numa.h"
 #include "stats/tracked.h"
@@ -34,6 +35,36 @@ namespace dismec::init {
         /// Generate an initial vector for the given label. The result should be placed in target.
         virtual void get_initial_weight(label_id_t label_id, Eigen::Ref<DenseRealVector> target,
                                         objective::Objective& objective) = 0;
+
+        /*!
+         * \brief Enables screening of labels for which the solution is known without training.
+         * \details If all instances of the objective are negative (positive), then the weight vector that is zero
+         * except for a bias weight of -1 (+1) gives every instance a margin of one. For hinge-type losses, which vanish
+         * for margins of at least one, and a regularizer that does not include the bias, this is the minimum of the
+         * objective. The caller is responsible for ensuring that these conditions hold. The fraction of screened labels
+         * is recorded in the `screened` statistics.
+         * \param bias_index The index of the bias feature, which needs to be one for every instance.
+         */
+        void enable_label_screening(long bias_index);
+
+        /*!
+         * \brief Generates the initial vector for `label_id` in `target`, after applying the screening rules.
+         * \return true if the label has been screened, in which case `target` is the solution and does not need to be
+         * minimized. Otherwise, `target` is the result of `get_initial_weight()`.
+         */
+        bool initialize(label_id_t label_id, Eigen::Ref<DenseRealVector> target, objective::Objective& objective);
+
+        /*!
+         * \brief Informs the initializer that the minimization for `label_id` has finished with the given `weights`.
+         * \details This is called by the training thread before any post-processing is applied to the weights. The
+         * default does nothing; initializers that derive the initial vector of a label from the results of other labels
+         * can use this to collect the results.
+         */
+        virtual void on_label_finished(label_id_t label_id, const DenseRealVector& weights) {}
+
+    private:
+        long m_BiasIndex = -1;
+        stats::stat_id_t m_StatScreened{-1};
     };
 
 
@@ -95,6 +126,18 @@ namespace dismec::init {
     */
     std::shared_ptr<WeightInitializationStrategy> create_ova_primal_initializer(
             const std::shared_ptr<DatasetBase>& data, RegularizerSpec regularizer, LossType loss);
+
+    /*!
+     * \brief Creates an initialization strategy that starts from the weights of an already trained, similar label.
+     * \details The weights of the most recently finished labels are kept in a cache with room for `cache_size` vectors,
+     * which is shared by all threads. A new label is initialized from the cached label with the largest Jaccard
+     * similarity of the positive instances, as long as this similarity is at least `min_similarity`. As a correction,
+     * the donor weights are rescaled by the factor in `[0, 1.25]` that gives the lowest objective, so a bad donor
+     * results in a zero initialization. To make sure that good donors are available, labels can be scheduled with a
+     * `DonorFirstSchedule`.
+     */
+    std::shared_ptr<WeightInitializationStrategy> create_similar_label_initializer(
+            std::shared_ptr<const LabelSimilarity> similarity, long cache_size, real_t min_similarity);
 }
 
 #endif //DISMEC_INITIALIZER_H
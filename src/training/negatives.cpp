@@ -0,0 +1,281 @@
+// Copyright (c) 2021, Aalto University, developed by Erik Schultheis
+// All rights reserved.
+//
+// SPDX-License-Identifier: MIT
+
+#include "negatives.h"
+#include "data/data.h"
+#include "utils/conversion.h"
+#include "utils/eigen_generic.h"
+#include "utils/throw_error.h"
+#include <algorithm>
+#include <mutex>
+#include <random>
+
+using namespace dismec;
+
+namespace {
+    /*!
+     * \brief Fills `instances` with the positives of `labels` and the given `negatives`, and sets up the corresponding
+     * `weights`.
+     */
+    void assemble_instances(const BinaryLabelVector& labels, const std::vector<long>& negatives, real_t negative_weight,
+                            std::vector<long>& instances, DenseRealVector& weights) {
+        instances.clear();
+        for(long i = 0; i < labels.size(); ++i) {
+            if(labels.coeff(i) == 1) {
+                instances.push_back(i);
+            }
+        }
+        instances.insert(end(instances), begin(negatives), end(negatives));
+        std::sort(begin(instances), end(instances));
+
+        weights.resize(ssize(instances));
+        for(long j = 0; j < ssize(instances); ++j) {
+            weights.coeffRef(j) = labels.coeff(instances[j]) == 1 ? real_t{1} : negative_weight;
+        }
+    }
+
+    void collect_negatives(const BinaryLabelVector& labels, std::vector<long>& target) {
+        target.clear();
+        for(long i = 0; i < labels.size(); ++i) {
+            if(labels.coeff(i) != 1) {
+                target.push_back(i);
+            }
+        }
+    }
+
+    class ShortlistSampler : public NegativeSampler {
+    public:
+        explicit ShortlistSampler(std::shared_ptr<const std::vector<std::vector<long>>> shortlist) :
+            m_Shortlist(std::move(shortlist)) {
+            if(!m_Shortlist) {
+                throw std::invalid_argument("shortlist must not be nullptr");
+            }
+        }
+
+        void select(const GenericFeatureMatrix& features, const BinaryLabelVector& labels, label_id_t label,
+                    std::vector<long>& instances, DenseRealVector& weights) const override {
+            std::vector<long> negatives;
+            for(long row : m_Shortlist->at(label.to_index())) {
+                if(labels.coeff(row) != 1) {
+                    negatives.push_back(row);
+                }
+            }
+            assemble_instances(labels, negatives, 1, instances, weights);
+        }
+
+        [[nodiscard]] long num_negatives(const DatasetBase& data, label_id_t label) const override {
+            auto labels = data.get_labels(label);
+            const auto& shortlist = m_Shortlist->at(label.to_index());
+            return std::count_if(begin(shortlist), end(shortlist), [&](long row){ return labels->coeff(row) != 1; });
+        }
+    private:
+        std::shared_ptr<const std::vector<std::vector<long>>> m_Shortlist;
+    };
+
+    class RandomSampler : public NegativeSampler {
+    public:
+        RandomSampler(long num_negatives, unsigned seed) : m_NumNegatives(num_negatives), m_Seed(seed) {
+            if(num_negatives <= 0) {
+                THROW_EXCEPTION(std::invalid_argument, "Number of negatives needs to be positive, got {}", num_negatives);
+            }
+        }
+
+        void select(const GenericFeatureMatrix& features, const BinaryLabelVector& labels, label_id_t label,
+                    std::vector<long>& instances, DenseRealVector& weights) const override {
+            std::vector<long> negatives;
+            collect_negatives(labels, negatives);
+            long total = ssize(negatives);
+            if(total <= m_NumNegatives) {
+                assemble_instances(labels, negatives, 1, instances, weights);
+                return;
+            }
+
+            // partial Fisher-Yates shuffle to get the first `m_NumNegatives` entries
+            std::seed_seq seq{m_Seed, static_cast<unsigned>(label.to_index())};
+            std::mt19937 rng(seq);
+            for(long i = 0; i < m_NumNegatives; ++i) {
+                std::uniform_int_distribution<long> dist(i, total - 1);
+                std::swap(negatives[i], negatives[dist(rng)]);
+            }
+            negatives.resize(m_NumNegatives);
+            assemble_instances(labels, negatives, static_cast<real_t>(total) / static_cast<real_t>(m_NumNegatives),
+                               instances, weights);
+        }
+
+        [[nodiscard]] long num_negatives(const DatasetBase& data, label_id_t label) const override {
+            return std::min(m_NumNegatives, data.num_negatives(label));
+        }
+    private:
+        long m_NumNegatives;
+        unsigned m_Seed;
+    };
+
+    class HardNegativeSampler : public NegativeSampler {
+    public:
+        explicit HardNegativeSampler(long num_negatives) : m_NumNegatives(num_negatives) {
+            if(num_negatives <= 0) {
+                THROW_EXCEPTION(std::invalid_argument, "Number of negatives needs to be positive, got {}", num_negatives);
+            }
+        }
+
+        void select(const GenericFeatureMatrix& features, const BinaryLabelVector& labels, label_id_t label,
+                    std::vector<long>& instances, DenseRealVector& weights) const override {
+            std::vector<long> negatives;
+            collect_negatives(labels, negatives);
+            if(ssize(negatives) > m_NumNegatives) {
+                DenseRealVector scores;
+                if(features.is_sparse()) {
+                    scores = sparse_scores(features.sparse(), labels);
+                } else {
+                    scores = features.dense() * centroid(features.dense(), labels);
+                }
+
+                std::nth_element(begin(negatives), begin(negatives) + m_NumNegatives, end(negatives),
+                                 [&](long a, long b) { return scores.coeff(a) > scores.coeff(b); });
+                negatives.resize(m_NumNegatives);
+            }
+            assemble_instances(labels, negatives, 1, instances, weights);
+        }
+
+        [[nodiscard]] long num_negatives(const DatasetBase& data, label_id_t label) const override {
+            return std::min(m_NumNegatives, data.num_negatives(label));
+        }
+    private:
+        using column_major_t = types::SparseColMajor<real_t>;
+
+        template<class Matrix>
+        static DenseRealVector centroid(const Matrix& matrix, const BinaryLabelVector& labels) {
+            DenseRealVector centroid = DenseRealVector::Zero(matrix.cols());
+            for(long i = 0; i < labels.size(); ++i) {
+                if(labels.coeff(i) == 1) {
+                    centroid += matrix.row(i).transpose();
+                }
+            }
+            return centroid;
+        }
+
+        /*!
+         * \brief Calculates the product of the sparse `features` with the centroid of the positives.
+         * \details Only the columns in which the centroid is nonzero contribute, so this product is calculated on a
+         * column-major copy of the features. Its cost is given by the number of nonzeros in these columns, instead of
+         * the number of nonzeros of the entire matrix.
+         */
+        DenseRealVector sparse_scores(const SparseFeatures& features, const BinaryLabelVector& labels) const {
+            DenseRealVector center = centroid(features, labels);
+            const column_major_t& columns = column_view(features);
+            DenseRealVector scores = DenseRealVector::Zero(features.rows());
+            for(long f = 0; f < center.size(); ++f) {
+                if(center.coeff(f) == 0) {
+                    continue;
+                }
+                for(column_major_t::InnerIterator it(columns, f); it; ++it) {
+                    scores.coeffRef(it.row()) += it.value() * center.coeff(f);
+                }
+            }
+            return scores;
+        }
+
+        /// Gets the column-major copy of `features`, which is created on first use. Each (NUMA-local) feature matrix
+        /// gets its own copy. The feature matrices need to outlive the sampler.
+        const column_major_t& column_view(const SparseFeatures& features) const {
+            std::lock_guard<std::mutex> lock(m_ColumnLock);
+            for(const auto& [source, view] : m_ColumnViews) {
+                if(source == &features) {
+                    return *view;
+                }
+            }
+            m_ColumnViews.emplace_back(&features, std::make_unique<const column_major_t>(features));
+            return *m_ColumnViews.back().second;
+        }
+
+        long m_NumNegatives;
+
+        mutable std::mutex m_ColumnLock;
+        mutable std::vector<std::pair<const SparseFeatures*, std::unique_ptr<const column_major_t>>> m_ColumnViews;
+    };
+}
+
+std::shared_ptr<NegativeSampler> dismec::create_shortlist_sampler(std::shared_ptr<const std::vector<std::vector<long>>> shortlist) {
+    return std::make_shared<ShortlistSampler>(std::move(shortlist));
+}
+
+std::shared_ptr<NegativeSampler> dismec::create_random_sampler(long num_negatives, unsigned seed) {
+    return std::make_shared<RandomSampler>(num_negatives, seed);
+}
+
+std::shared_ptr<NegativeSampler> dismec::create_hard_negative_sampler(long num_negatives) {
+    return std::make_shared<HardNegativeSampler>(num_negatives);
+}
+
+#include "doctest.h"
+
+TEST_CASE("negative sampling") {
+    DenseFeatures features(8, 2);
+    features << 1.0, 0.0,
+                0.9, 0.1,
+                0.0, 1.0,
+                0.8, 0.2,
+                0.1, 0.9,
+                1.0, 0.0,
+                0.0, 1.0,
+                0.5, 0.5;
+    GenericFeatureMatrix matrix(features);
+    BinaryLabelVector labels(8);
+    labels << 1, -1, -1, -1, -1, 1, -1, -1;
+
+    std::vector<long> instances;
+    DenseRealVector weights;
+
+    SUBCASE("shortlist") {
+        auto shortlist = std::make_shared<std::vector<std::vector<long>>>(std::vector<std::vector<long>>{{6, 0, 2}});
+        create_shortlist_sampler(shortlist)->select(matrix, labels, label_id_t{0}, instances, weights);
+        CHECK(instances == std::vector<long>{0, 2, 5, 6});
+        CHECK(weights == DenseRealVector::Ones(4));
+    }
+
+    SUBCASE("random") {
+        auto sampler = create_random_sampler(3, 42);
+        sampler->select(matrix, labels, label_id_t{0}, instances, weights);
+        REQUIRE(instances.size() == 5);
+        CHECK(std::is_sorted(begin(instances), end(instances)));
+        for(int i = 0; i < 5; ++i) {
+            if(labels.coeff(instances[i]) == 1) {
+                CHECK(weights.coeff(i) == 1.0);
+            } else {
+                // six negatives in total, three of which are selected
+                CHECK(weights.coeff(i) == 2.0);
+            }
+        }
+
+        // the selection is deterministic
+        std::vector<long> again;
+        sampler->select(matrix, labels, label_id_t{0}, again, weights);
+        CHECK(instances == again);
+    }
+
+    SUBCASE("hard") {
+        create_hard_negative_sampler(2)->select(matrix, labels, label_id_t{0}, instances, weights);
+        CHECK(instances == std::vector<long>{0, 1, 3, 5});
+        CHECK(weights == DenseRealVector::Ones(4));
+    }
+
+    SUBCASE("hard sparse") {
+        GenericFeatureMatrix sparse_matrix(SparseFeatures(features.sparseView()));
+        auto sampler = create_hard_negative_sampler(2);
+        sampler->select(sparse_matrix, labels, label_id_t{0}, instances, weights);
+        CHECK(instances == std::vector<long>{0, 1, 3, 5});
+        // the second call uses the cached column-major copy
+        sampler->select(sparse_matrix, labels, label_id_t{0}, instances, weights);
+        CHECK(instances == std::vector<long>{0, 1, 3, 5});
+    }
+
+    SUBCASE("all") {
+        create_hard_negative_sampler(10)->select(matrix, labels, label_id_t{0}, instances, weights);
+        CHECK(instances.size() == 8);
+        create_random_sampler(10, 1)->select(matrix, labels, label_id_t{0}, instances, weights);
+        CHECK(instances.size() == 8);
+        CHECK(weights == DenseRealVector::Ones(8));
+    }
+}
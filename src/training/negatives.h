@@ -0,0 +1,71 @@
+// Copyright (c) 2021, Aalto University, developed by Erik Schultheis
+// All rights reserved.
+//
+// SPDX-License-Identifier: MIT
+
+#ifndef DISMEC_SRC_TRAINING_NEGATIVES_H
+#define DISMEC_SRC_TRAINING_NEGATIVES_H
+
+#include "matrix_types.h"
+#include "fwd.h"
+#include <memory>
+#include <vector>
+
+namespace dismec
+{
+    /*!
+     * \brief Base class for strategies that select the negative instances used for training a label.
+     * \details Instead of training each label against all instances, `DiSMECTraining` can restrict the objective to
+     * the positives of the label and a subset of the negatives. The training cost of a label then scales with the size
+     * of this subset instead of with the size of the dataset. The `NegativeSampler` decides which negatives are
+     * selected, and with which (importance) weight each selected instance enters the loss.
+     *
+     * The `select()` function will be called concurrently from different training threads, so implementations need to
+     * be thread-safe.
+     */
+    class NegativeSampler {
+    public:
+        virtual ~NegativeSampler() = default;
+
+        /*!
+         * \brief Selects the training instances for `label`.
+         * \param features The feature matrix of the dataset.
+         * \param labels The label vector of `label`, for all instances of the dataset.
+         * \param label The id of the label.
+         * \param instances Will be filled with the sorted indices of the selected instances. All positives are always
+         * selected.
+         * \param weights Will be filled with the weight of each selected instance, in the same order as `instances`.
+         */
+        virtual void select(const GenericFeatureMatrix& features, const BinaryLabelVector& labels, label_id_t label,
+                            std::vector<long>& instances, DenseRealVector& weights) const = 0;
+
+        /// Gets the number of negative instances that `select()` will pick for the given label.
+        [[nodiscard]] virtual long num_negatives(const DatasetBase& data, label_id_t label) const = 0;
+    };
+
+    /*!
+     * \brief Selects the negatives from a fixed shortlist of instances for each label.
+     * \param shortlist Contains for each label the list of candidate instances. Positives in the shortlist are ignored,
+     * as all positives are selected anyway.
+     */
+    std::shared_ptr<NegativeSampler> create_shortlist_sampler(std::shared_ptr<const std::vector<std::vector<long>>> shortlist);
+
+    /*!
+     * \brief Selects `num_negatives` uniformly random negatives for each label.
+     * \details The selected negatives get the weight `total negatives / num_negatives`, so that the loss is an unbiased
+     * estimate of the loss on the full dataset. The random generator is seeded per label, so the selection does not
+     * depend on which thread trains the label.
+     */
+    std::shared_ptr<NegativeSampler> create_random_sampler(long num_negatives, unsigned seed);
+
+    /*!
+     * \brief Selects the `num_negatives` negatives that are closest to the positives.
+     * \details Closeness is measured by the inner product with the sum of the positive instances. For sparse features,
+     * the sampler keeps a column-major copy of the feature matrix (one per NUMA node), so that this product only touches
+     * the columns in which the positives are nonzero, instead of the entire matrix. The selected negatives keep unit
+     * weight; the loss is intentionally focused on the hard negatives.
+     */
+    std::shared_ptr<NegativeSampler> create_hard_negative_sampler(long num_negatives);
+}
+
+#endif //DISMEC_SRC_TRAINING_NEGATIVES_H
@@ -29,7 +29,8 @@ namespace dismec::postproc {
         Sparsify(std::shared_ptr<objective::Objective> objective, real_t tolerance) :
             m_Objective(std::move(objective)),
             m_Tolerance(tolerance),
-            m_WorkingVector(DenseRealVector(m_Objective->num_variables())) {
+            m_WorkingVector(DenseRealVector(m_Objective->num_variables())),
+            m_Delta(m_Objective->num_variables()) {
 
             declare_stat(STAT_CUTOFF, {"cutoff", {}});
             declare_stat(STAT_NNZ, {"nnz", "%"});
@@ -43,6 +44,8 @@ namespace dismec::postproc {
         std::shared_ptr<objective::Objective> m_Objective;
         real_t m_Tolerance;
         HashVector m_WorkingVector;
+        /// Buffer for the change of `m_WorkingVector` in `sparsify_working_vector()`.
+        SparseRealVector m_Delta;
 
         static int make_sparse(Eigen::Ref<DenseRealVector> target, const Eigen::Ref<const DenseRealVector>& source, real_t cutoff) {
             int nnz = 0;
@@ -55,6 +58,32 @@ namespace dismec::postproc {
             return nnz;
         }
 
+        /*!
+         * \brief Sets `m_WorkingVector` to the sparsified version of `source`.
+         * \details Successive cutoffs of the search only differ in a few coordinates, so we inform the objective
+         * about the changed coordinates. It can then update its cached scores, instead of doing a full matrix
+         * multiplication for the next evaluation.
+         * \return The number of nonzeros in the working vector.
+         */
+        int sparsify_working_vector(const Eigen::Ref<const DenseRealVector>& source, real_t cutoff) {
+            VectorHash old_hash = m_WorkingVector.hash();
+            DenseRealVector& target = m_WorkingVector.modify();
+            m_Delta.setZero();
+            int nnz = 0;
+            for(int i = 0; i < target.size(); ++i) {
+                auto w_i = source.coeff(i);
+                bool is_small = abs(w_i) < cutoff;
+                real_t new_value = is_small ? 0 : w_i;
+                if(new_value != target.coeff(i)) {
+                    m_Delta.insertBack(i) = new_value - target.coeff(i);
+                    target.coeffRef(i) = new_value;
+                }
+                if(!is_small) ++nnz;
+            }
+            m_Objective->declare_sparse_update(old_hash, m_WorkingVector, m_Delta);
+            return nnz;
+        }
+
         struct BoundData {
             real_t Cutoff;
             long NNZ;
@@ -88,7 +117,7 @@ namespace dismec::postproc {
         int count = 0;
         while( (lower.NNZ - upper.NNZ) > upper.NNZ / 10 + 1 ) {
             real_t middle = (upper.Cutoff + lower.Cutoff) / 2;
-            int nnz = make_sparse(m_WorkingVector.modify(), weight_vector, middle);
+            int nnz = sparsify_working_vector(weight_vector, middle);
             auto new_score = m_Objective->value(m_WorkingVector);
             if(new_score > tolerance) {
                 upper.Cutoff = middle;
@@ -124,7 +153,7 @@ namespace dismec::postproc {
 
         auto check_bound = [&](real_t log_cutoff) {
             real_t cutoff = std::exp(log_cutoff);
-            int nnz = make_sparse(m_WorkingVector.modify(), weight_vector, cutoff);
+            int nnz = sparsify_working_vector(weight_vector, cutoff);
             auto score = m_Objective->value(m_WorkingVector);
             ++step_count;
             return BoundData{cutoff, nnz, score};
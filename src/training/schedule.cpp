@@ -0,0 +1,255 @@
+// Copyright (c) 2021, Aalto University, developed by Erik Schultheis
+// All rights reserved.
+//
+// SPDX-License-Identifier: MIT
+
+#include "schedule.h"
+#include "data/data.h"
+#include "training/init/similar.h"
+#include "parallel/runner.h"
+#include "config.h"
+#include <Eigen/Dense>
+#include <algorithm>
+#include <numeric>
+
+using namespace dismec;
+
+LabelCostModel::LabelCostModel(std::shared_ptr<const DatasetBase> data) :
+    m_Data(std::move(data)), m_Coefficients(0.0, 1.0, 1.0) {
+}
+
+LabelCostModel::features_t LabelCostModel::label_features(label_id_t label) const {
+    const auto& features = *m_Data->get_features();
+    auto row_nnz = [&](long row) -> long {
+        if(features.is_sparse()) {
+            const auto* outer = features.sparse().outerIndexPtr();
+            return outer[row + 1] - outer[row];
+        }
+        return features.cols();
+    };
+
+    long positives = 0;
+    long nonzeros = 0;
+    // for multi-label data, we can get the positives directly, without going through the entire label vector
+    if(const auto* ml_data = dynamic_cast<const MultiLabelData*>(m_Data.get()); ml_data) {
+        for(long instance : ml_data->get_label_instances(label)) {
+            ++positives;
+            nonzeros += row_nnz(instance);
+        }
+    } else {
+        auto labels = m_Data->get_labels(label);
+        for(long i = 0; i < labels->size(); ++i) {
+            if(labels->coeff(i) == 1) {
+                ++positives;
+                nonzeros += row_nnz(i);
+            }
+        }
+    }
+    return {1.0, static_cast<double>(positives), static_cast<double>(nonzeros)};
+}
+
+double LabelCostModel::estimate(label_id_t label) const {
+    return m_Coefficients.dot(label_features(label));
+}
+
+void LabelCostModel::record(label_id_t label, std::chrono::milliseconds duration) {
+    features_t x = label_features(label);
+    std::lock_guard<std::mutex> lock(m_RecordLock);
+    m_XtX.noalias() += x * x.transpose();
+    m_XtY += x * static_cast<double>(duration.count());
+    ++m_NumRecords;
+}
+
+void LabelCostModel::refit() {
+    std::lock_guard<std::mutex> lock(m_RecordLock);
+    if(m_NumRecords < COST_MODEL_MIN_RECORDS) {
+        return;
+    }
+
+    // the features differ by orders of magnitude, so we solve the normal equations for rescaled variables,
+    // with a tiny ridge term to handle degenerate data (e.g. all labels having the same number of positives).
+    features_t scale = m_XtX.diagonal().cwiseSqrt().cwiseMax(1.0).cwiseInverse();
+    Eigen::Matrix3d scaled = scale.asDiagonal() * m_XtX * scale.asDiagonal();
+    scaled.diagonal().array() += 1e-8;
+    features_t solution = scaled.ldlt().solve(scale.cwiseProduct(m_XtY));
+    if(solution.allFinite()) {
+        m_Coefficients = scale.cwiseProduct(solution);
+    }
+}
+
+std::vector<long> LabelCostModel::schedule(label_id_t begin, label_id_t end, long num_threads) {
+    return parallel::interleave_across_threads(order_by_cost(begin, end), num_threads);
+}
+
+std::vector<long> LabelCostModel::order_by_cost(label_id_t begin, label_id_t end) {
+    refit();
+
+    std::vector<double> costs;
+    costs.reserve(end - begin);
+    for(label_id_t label = begin; label < end; ++label) {
+        costs.push_back(estimate(label));
+    }
+
+    std::vector<long> order(costs.size());
+    std::iota(order.begin(), order.end(), 0l);
+    std::stable_sort(order.begin(), order.end(), [&](long a, long b) {
+        return costs[a] > costs[b];
+    });
+    return order;
+}
+
+DonorFirstSchedule::DonorFirstSchedule(std::shared_ptr<const init::LabelSimilarity> similarity, real_t min_similarity) :
+    LabelCostModel(similarity->get_data()), m_Similarity(std::move(similarity)), m_MinSimilarity(min_similarity) {
+}
+
+std::vector<long> DonorFirstSchedule::schedule(label_id_t begin, label_id_t end, long num_threads) {
+    std::vector<long> by_cost = order_by_cost(begin, end);
+    long num_labels = end - begin;
+    std::vector<long> rank(num_labels);
+    for(long i = 0; i < num_labels; ++i) {
+        rank[by_cost[i]] = i;
+    }
+
+    // the donor of each label is the most similar label in the range
+    std::vector<long> donor(num_labels, -1);
+    std::vector<init::LabelSimilarity::Neighbour> neighbours;
+    for(long offset = 0; offset < num_labels; ++offset) {
+        m_Similarity->find_similar(begin + offset, neighbours);
+        for(const auto& candidate : neighbours) {
+            if(candidate.Similarity < m_MinSimilarity) {
+                break;
+            }
+            if(begin <= candidate.Label && candidate.Label < end) {
+                donor[offset] = candidate.Label - begin;
+                break;
+            }
+        }
+    }
+
+    // if two labels are each other's donor, the more expensive one becomes the root
+    for(long offset = 0; offset < num_labels; ++offset) {
+        long other = donor[offset];
+        if(other >= 0 && donor[other] == offset && rank[offset] < rank[other]) {
+            donor[offset] = -1;
+        }
+    }
+
+    std::vector<std::vector<long>> children(num_labels);
+    for(long offset : by_cost) {
+        if(donor[offset] >= 0) {
+            children[donor[offset]].push_back(offset);
+        }
+    }
+
+    std::vector<long> order;
+    order.reserve(num_labels);
+    std::vector<bool> visited(num_labels, false);
+    std::vector<long> stack;
+    auto traverse = [&](long root) {
+        stack.push_back(root);
+        while(!stack.empty()) {
+            long current = stack.back();
+            stack.pop_back();
+            if(visited[current]) {
+                continue;
+            }
+            visited[current] = true;
+            order.push_back(current);
+            stack.insert(stack.end(), children[current].rbegin(), children[current].rend());
+        }
+    };
+
+    for(long offset : by_cost) {
+        if(donor[offset] < 0) {
+            traverse(offset);
+        }
+    }
+    // ties in the similarities could lead to longer cycles of donors, which are not reachable from any root
+    for(long offset : by_cost) {
+        if(!visited[offset]) {
+            traverse(offset);
+        }
+    }
+    return order;
+}
+
+#include "doctest.h"
+
+TEST_CASE("label cost model") {
+    SparseFeatures features(6, 10);
+    // instance i has i + 1 nonzeros
+    for(int i = 0; i < 6; ++i) {
+        for(int j = 0; j <= i; ++j) {
+            features.insert(i, j) = 1.0;
+        }
+    }
+    features.makeCompressed();
+    std::vector<std::vector<long>> labels = {{0}, {5}, {0, 1}, {}, {3, 4, 5}};
+    auto data = std::make_shared<MultiLabelData>(features, labels);
+
+    LabelCostModel model(data);
+    CHECK(model.estimate(label_id_t{0}) == 2.0);
+    CHECK(model.estimate(label_id_t{1}) == 7.0);
+    CHECK(model.estimate(label_id_t{2}) == 5.0);
+    CHECK(model.estimate(label_id_t{3}) == 0.0);
+    CHECK(model.estimate(label_id_t{4}) == 18.0);
+
+    CHECK(model.schedule(label_id_t{0}, label_id_t{5}, 1) == std::vector<long>{4, 1, 2, 0, 3});
+    CHECK(model.schedule(label_id_t{1}, label_id_t{4}, 1) == std::vector<long>{0, 1, 2});
+
+    // if the measurements show that the duration only depends on the number of positives, the order changes
+    for(int i = 0; i < COST_MODEL_MIN_RECORDS; ++i) {
+        for(int l = 0; l < 5; ++l) {
+            model.record(label_id_t{l}, std::chrono::milliseconds(10 + 100 * data->num_positives(label_id_t{l})));
+        }
+    }
+    // labels 0 and 1 have the same number of positives, so their relative order is not determined.
+    auto order = model.schedule(label_id_t{0}, label_id_t{5}, 1);
+    CHECK(order[0] == 4);
+    CHECK(order[1] == 2);
+    CHECK(order[4] == 3);
+    CHECK(model.estimate(label_id_t{2}) == doctest::Approx(210.0).epsilon(1e-3));
+    CHECK(model.estimate(label_id_t{1}) == doctest::Approx(110.0).epsilon(1e-3));
+}
+
+/*! \test This checks that the most expensive labels are spread over the initial ranges of the threads.
+ */
+TEST_CASE("label cost model with threads") {
+    SparseFeatures features(6, 6);
+    for(int i = 0; i < 6; ++i) {
+        features.insert(i, i) = 1.0;
+    }
+    features.makeCompressed();
+    // label i has i positives
+    std::vector<std::vector<long>> labels = {{}, {0}, {0, 1}, {0, 1, 2}, {0, 1, 2, 3}, {0, 1, 2, 3, 4}};
+    auto data = std::make_shared<MultiLabelData>(features, labels);
+    LabelCostModel model(data);
+
+    auto order = model.schedule(label_id_t{0}, label_id_t{6}, 2);
+    REQUIRE(order.size() == 6);
+    // the two heaviest labels start the two initial ranges [0, 3) and [3, 6)
+    CHECK(order[parallel::initial_range_begin(6, 2, 0)] == 5);
+    CHECK(order[parallel::initial_range_begin(6, 2, 1)] == 4);
+    CHECK(order == std::vector<long>{5, 3, 1, 4, 2, 0});
+}
+
+TEST_CASE("donor first schedule") {
+    SparseFeatures features(7, 7);
+    for(int i = 0; i < 7; ++i) {
+        features.insert(i, i) = 1.0;
+    }
+    features.makeCompressed();
+    std::vector<std::vector<long>> labels = {{0, 1, 2}, {0, 1}, {3, 4}, {3, 4, 5}, {6}};
+    auto similarity = std::make_shared<init::LabelSimilarity>(std::make_shared<MultiLabelData>(features, labels));
+
+    // 0 and 1, as well as 2 and 3, are each other's most similar label. The label with more positives is the donor,
+    // and the other label directly follows it.
+    DonorFirstSchedule schedule(similarity, 0.5);
+    CHECK(schedule.schedule(label_id_t{0}, label_id_t{5}, 1) == std::vector<long>{0, 1, 3, 2, 4});
+    // donors outside of the range are not considered
+    CHECK(schedule.schedule(label_id_t{1}, label_id_t{4}, 1) == std::vector<long>{2, 1, 0});
+
+    // without donors, this is just the cost-based order
+    DonorFirstSchedule no_donors(similarity, 0.9);
+    CHECK(no_donors.schedule(label_id_t{0}, label_id_t{5}, 1) == std::vector<long>{0, 3, 1, 2, 4});
+}
@@ -0,0 +1,92 @@
+// Copyright (c) 2021, Aalto University, developed by Erik Schultheis
+// All rights reserved.
+//
+// SPDX-License-Identifier: MIT
+
+#ifndef DISMEC_SRC_TRAINING_SCHEDULE_H
+#define DISMEC_SRC_TRAINING_SCHEDULE_H
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "matrix_types.h"
+#include "fwd.h"
+
+namespace dismec {
+    /*!
+     * \brief Estimates how long the training of each label will take, so that expensive labels can be started first.
+     * \details The cost of a label is modelled as a linear function \f$ c_0 + c_1 p + c_2 z \f$ of the number of
+     * positive instances \f$ p \f$, and the total number of nonzero features \f$ z \f$ in these instances. Initially,
+     * every positive and every nonzero counts as one unit. Once enough training durations have been recorded (see
+     * `record()`), the coefficients are re-fitted by least squares, so that later batches are scheduled based on
+     * the actual behaviour of the solver.
+     */
+    class LabelCostModel {
+    public:
+        explicit LabelCostModel(std::shared_ptr<const DatasetBase> data);
+        virtual ~LabelCostModel() = default;
+
+        /// Returns the estimated cost for training the classifier of `label`.
+        [[nodiscard]] double estimate(label_id_t label) const;
+
+        /*!
+         * \brief Records the time it took to train the classifier of `label`.
+         * \details This function may be called concurrently from multiple threads. The new measurements will be taken
+         * into account at the next call to `schedule()`.
+         */
+        void record(label_id_t label, std::chrono::milliseconds duration);
+
+        /*!
+         * \brief Returns the order in which the labels in `[begin, end)` should be trained by `num_threads` threads.
+         * \details The result contains the offsets `label - begin` of all labels in the range. These are sorted by
+         * decreasing estimated cost, and then interleaved across the initial ranges of the `ParallelRunner` (see
+         * \ref parallel::interleave_across_threads), so that the expensive labels are not all given to the first thread.
+         */
+        [[nodiscard]] virtual std::vector<long> schedule(label_id_t begin, label_id_t end, long num_threads);
+    protected:
+        /// Returns the offsets `label - begin` of all labels in `[begin, end)`, sorted by decreasing estimated cost.
+        [[nodiscard]] std::vector<long> order_by_cost(label_id_t begin, label_id_t end);
+    private:
+        using features_t = Eigen::Vector3d;
+
+        /// Calculates the vector of `(1, p, z)` for `label`.
+        [[nodiscard]] features_t label_features(label_id_t label) const;
+
+        /// Updates `m_Coefficients` from the recorded durations.
+        void refit();
+
+        std::shared_ptr<const DatasetBase> m_Data;
+        features_t m_Coefficients;
+
+        // sufficient statistics for the least-squares fit
+        std::mutex m_RecordLock;
+        Eigen::Matrix3d m_XtX = Eigen::Matrix3d::Zero();
+        features_t m_XtY = features_t::Zero();
+        long m_NumRecords = 0;
+    };
+
+    /*!
+     * \brief Schedules labels such that the labels which serve as initialization for similar labels are trained first.
+     * \details This is meant to be used together with \ref init::create_similar_label_initializer. Each label in the
+     * range is assigned the most similar other label in the range as its donor, if their similarity is at least
+     * `min_similarity`. Donor relations form a forest (mutual donors are resolved in favour of the more expensive
+     * label), which is traversed depth-first. Thus, each donor is scheduled before the labels that use it, and
+     * these follow shortly after, so the donor weights are still in the cache of recently finished labels.
+     * Roots and siblings are ordered by decreasing estimated cost. In contrast to the base class, the order is not
+     * interleaved across threads, because then a donor would be trained concurrently with the labels that use it.
+     * Each tree thus remains within the range of one thread, and imbalances are left to the work stealing of the
+     * `ParallelRunner`.
+     */
+    class DonorFirstSchedule : public LabelCostModel {
+    public:
+        DonorFirstSchedule(std::shared_ptr<const init::LabelSimilarity> similarity, real_t min_similarity);
+
+        [[nodiscard]] std::vector<long> schedule(label_id_t begin, label_id_t end, long num_threads) override;
+    private:
+        std::shared_ptr<const init::LabelSimilarity> m_Similarity;
+        real_t m_MinSimilarity;
+    };
+}
+
+#endif //DISMEC_SRC_TRAINING_SCHEDULE_H
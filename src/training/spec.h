@@ -55,6 +55,23 @@ namespace dismec
          */
         [[nodiscard]] virtual std::unique_ptr<init::WeightsInitializer> make_initializer() const = 0;
 
+        /*!
+         * \brief Replaces the strategy that is used by `make_initializer()`.
+         * \details This allows to change the initialization between batches (e.g. to use the pretrained weights for
+         * the next batch of labels) without having to recreate the `TrainingSpec`. Initializers that have already been
+         * created are not affected, see `TrainingTaskGenerator::reset_initializers()`.
+         * The default implementation throws a `std::logic_error`.
+         */
+        virtual void set_initialization_strategy(std::shared_ptr<init::WeightInitializationStrategy> strategy);
+
+        /*!
+         * \brief Multiplies the strength of the regularizer by `scale` for all objectives that are updated afterwards.
+         * \details This allows to train the same labels for a sequence of regularization strengths (see
+         * \ref regularization-path) without having to recreate the `TrainingSpec`.
+         * The default implementation throws a `std::logic_error`.
+         */
+        virtual void set_regularization_scale(real_t scale);
+
         /*!
          * \brief Makes a \ref PostProcessor object.
          * \details This is called before the actual work of the training threads starts, so that we can pre-allocate
@@ -133,8 +150,37 @@ namespace dismec
         HINGE
     };
 
+    enum class SolverType {
+        NEWTON,             //!< Truncated newton with line search, see \ref solvers::NewtonWithLineSearch
+        TRUST_REGION,       //!< Trust-region newton, see \ref solvers::TrustRegionNewton
+        LBFGS,              //!< Limited-memory BFGS, see \ref solvers::LBFGS
+        DUAL_CD,            //!< Dual coordinate descent, see \ref solvers::DualCoordinateDescent
+        ACTIVE_SET          //!< Newton on a working set of nonzero weights for L1, see \ref solvers::ActiveSetNewton
+    };
+
     using real_t = float;
 
+    enum class PreconditionerType {
+        DIAGONAL,           //!< The diagonal of the hessian, see \ref solvers::DiagonalPreconditioner
+        BLOCK_DIAGONAL,     //!< Correlations within blocks of features, see \ref solvers::BlockDiagonalPreconditioner
+        LOW_RANK            //!< Low-rank feature correlations, see \ref solvers::LowRankPreconditioner
+    };
+
+    /// Configures the CG preconditioner of the newton solver.
+    struct PreconditionerConfig {
+        PreconditionerType Type = PreconditionerType::DIAGONAL;
+        long Size = 32;                 //!< The block size, or the rank of the low-rank approximation.
+        real_t Strength = 0.2;          //!< Interpolation between identity (0) and feature correlations (1).
+    };
+
+    /// Configures early stopping based on the scores of a random subset of the instances, which is held out of the
+    /// training objectives, see \ref solvers::Minimizer::set_validation_stopping
+    struct ValidationStoppingConfig {
+        long NumInstances = 0;          //!< Number of held-out instances. If this is zero, early stopping is disabled.
+        long Interval = 5;              //!< Number of iterations between two checks of the scores.
+        real_t Tolerance = 1e-3;        //!< Maximum relative change of the scores for which the minimization is stopped.
+    };
+
     std::shared_ptr<objective::Objective> make_loss(
             LossType type,
             std::shared_ptr<const GenericFeatureMatrix> X,
@@ -150,6 +196,14 @@ namespace dismec
         bool Sparse;
         RegularizerSpec Regularizer;
         LossType Loss;
+        /// If set, each label is trained only on its positives and the negatives selected by this sampler.
+        std::shared_ptr<NegativeSampler> NegativeSampling;
+        SolverType Solver = SolverType::NEWTON;
+        PreconditionerConfig Preconditioner;
+        ValidationStoppingConfig EarlyStopping;
+        /// If set, labels whose instances are all negative (or all positive) get their closed-form solution without
+        /// training, see \ref init::WeightsInitializer::enable_label_screening
+        bool ScreenLabels = false;
     };
 
     struct CascadeTrainingConfig {
@@ -44,20 +44,27 @@ void TrainingStatsGatherer::setup_postproc(thread_id_t thread, stats::Tracked& p
 }
 
 void TrainingStatsGatherer::finalize() {
+    std::lock_guard<std::mutex> lck{m_Lock};
     // Outer loop iterates over thread indices.
     for(auto&& entries : m_PerThreadCollections) {
         // inner loop iterates over map keys
         for (auto&& accu : entries) {
-            for (auto&& meta : accu.second->get_statistics_meta()) {
-                if (!accu.second->is_enabled_by_name(meta.Name)) continue;
-                std::string qualified_name = accu.first + '.'+ meta.Name;
-                if (m_Merged.count(qualified_name) == 0) {
-                    m_Merged[qualified_name] = {meta, accu.second->get_stat(meta.Name).clone()};
-                }
-
-                m_Merged.at(qualified_name).Stat->merge(accu.second->get_stat(meta.Name));
-            }
+            merge_collection(accu.first, *accu.second);
         }
+        // the collections have been merged, so they must not contribute to a subsequent call to finalize()
+        entries.clear();
+    }
+}
+
+void TrainingStatsGatherer::merge_collection(const std::string& key, const stats::StatisticsCollection& collection) {
+    for (auto&& meta : collection.get_statistics_meta()) {
+        if (!collection.is_enabled_by_name(meta.Name)) continue;
+        std::string qualified_name = key + '.'+ meta.Name;
+        if (m_Merged.count(qualified_name) == 0) {
+            m_Merged[qualified_name] = {meta, collection.get_stat(meta.Name).clone()};
+        }
+
+        m_Merged.at(qualified_name).Stat->merge(collection.get_stat(meta.Name));
     }
 }
 
@@ -178,7 +185,10 @@ void TrainingStatsGatherer::add_accu(const std::string& key, parallel::thread_id
     }
     auto result = m_PerThreadCollections.at(thread.to_index()).emplace(key, accumulator);
     if(!result.second) {
-        THROW_EXCEPTION(std::runtime_error, "Could not emplace key {} for statistics collection", key);
+        // the thread has replaced one of its objects (e.g. a re-created initializer). Keep the statistics of the
+        // old object, and continue with the new one.
+        merge_collection(key, *result.first->second);
+        result.first->second = accumulator;
     }
 
     if(m_Config->contains(key)) {
@@ -58,6 +58,9 @@ namespace dismec
 
         void add_accu(const std::string& key, thread_id_t thread, const std::shared_ptr<stats::StatisticsCollection>& accumulator);
 
+        /// merges the statistics of `collection` into `m_Merged`. Needs to be called with `m_Lock` held.
+        void merge_collection(const std::string& key, const stats::StatisticsCollection& collection);
+
         std::unique_ptr<nlohmann::json> m_Config;
     };
 }
@@ -13,7 +13,10 @@
 #include "initializer.h"
 #include "postproc.h"
 #include "statistics.h"
+#include "schedule.h"
+#include "io/checkpoint.h"
 #include "utils/eigen_generic.h"
+#include "utils/conversion.h"
 
 using namespace dismec;
 
@@ -21,8 +24,22 @@ TrainingTaskGenerator::TrainingTaskGenerator(std::shared_ptr<TrainingSpec> spec,
                                              label_id_t begin_label, label_id_t end_label) :
         m_TaskSpec(std::move(spec)),
         m_LabelRangeBegin(begin_label),
-        m_LabelRangeEnd(end_label.to_index() > 0 ? end_label : label_id_t{m_TaskSpec->get_data().num_labels()})
+        m_LabelRangeEnd(end_label)
 {
+    set_label_range(begin_label, end_label);
+}
+
+TrainingTaskGenerator::~TrainingTaskGenerator() {
+    if(m_HasThreads) {
+        m_TaskSpec->get_statistics_gatherer().finalize();
+    }
+}
+
+void TrainingTaskGenerator::set_label_range(label_id_t begin_label, label_id_t end_label) {
+    m_LabelRangeBegin = begin_label;
+    m_LabelRangeEnd = end_label.to_index() > 0 ? end_label : label_id_t{m_TaskSpec->get_data().num_labels()};
+
+    m_Results.clear();
     m_Results.resize(m_LabelRangeEnd - m_LabelRangeBegin);
 
     model::PartialModelSpec model_spec{m_LabelRangeBegin,
@@ -32,7 +49,35 @@ TrainingTaskGenerator::TrainingTaskGenerator(std::shared_ptr<TrainingSpec> spec,
     m_Model = m_TaskSpec->make_model(m_TaskSpec->num_features(), model_spec);
 }
 
-TrainingTaskGenerator::~TrainingTaskGenerator() = default;
+void TrainingTaskGenerator::reset_initializers() {
+    for(auto& init : m_ThreadLocalWeightInit) {
+        init.reset();
+    }
+}
+
+void TrainingTaskGenerator::set_cost_model(std::shared_ptr<LabelCostModel> cost_model) {
+    m_CostModel = std::move(cost_model);
+}
+
+void TrainingTaskGenerator::set_checkpoint_writer(std::shared_ptr<io::LabelCheckpointWriter> writer) {
+    m_CheckpointWriter = std::move(writer);
+}
+
+void TrainingTaskGenerator::set_known_weights(std::shared_ptr<const io::LabelCheckpoint> known) {
+    m_KnownWeights = std::move(known);
+}
+
+label_id_t TrainingTaskGenerator::first_unfinished_label(long next_task) const {
+    if(m_TaskOrder.empty()) {
+        return m_LabelRangeBegin + std::min(next_task, num_tasks());
+    }
+
+    long first = num_tasks();
+    for(long t = next_task; t < ssize(m_TaskOrder); ++t) {
+        first = std::min(first, m_TaskOrder[t]);
+    }
+    return m_LabelRangeBegin + first;
+}
 
 void TrainingTaskGenerator::run_tasks(long begin, long end, thread_id_t thread_id) {
     for(long t = begin; t < end; ++t) {
@@ -41,10 +86,26 @@ void TrainingTaskGenerator::run_tasks(long begin, long end, thread_id_t thread_i
 }
 
 void TrainingTaskGenerator::run_task(long task_id, thread_id_t thread_id) {
-    label_id_t label_id = m_LabelRangeBegin + task_id;
+    long offset = m_TaskOrder.empty() ? task_id : m_TaskOrder[task_id];
+    label_id_t label_id = m_LabelRangeBegin + offset;
     assert(0 <= label_id.to_index());
     assert(label_id.to_index() < m_TaskSpec->get_data().num_labels());
-    m_Results.at(task_id) = train_label(label_id, thread_id);
+    auto& result = m_Results.at(offset);
+    if(m_KnownWeights) {
+        if(const auto* known = m_KnownWeights->find(label_id); known) {
+            DenseRealVector& target = m_ThreadLocalWorkingVector.at(thread_id.to_index());
+            target.resize(m_TaskSpec->num_features());
+            known->to_dense(target);
+            m_Model->set_weights_for_label(label_id, model::Model::WeightVectorIn{target});
+            result = {solvers::MinimizerStatus::SUCCESS, 0, 0.0, 0.0, 0.0, 0.0};
+            return;
+        }
+    }
+
+    result = train_label(label_id, thread_id);
+    if(m_CostModel) {
+        m_CostModel->record(label_id, result.Duration);
+    }
 }
 
 solvers::MinimizationResult TrainingTaskGenerator::train_label(label_id_t label_id, thread_id_t thread_id) {
@@ -58,14 +119,21 @@ solvers::MinimizationResult TrainingTaskGenerator::train_label(label_id_t label_
 
     // get a reference to the thread-local weight buffer and initialize the weight.
     DenseRealVector& target = m_ThreadLocalWorkingVector.at(thread_id.to_index());
-    m_ThreadLocalWeightInit.at(thread_id.to_index())->get_initial_weight(label_id, target, *objective);
+    bool screened = m_ThreadLocalWeightInit.at(thread_id.to_index())->initialize(label_id, target, *objective);
     m_ResultGatherers.at(thread_id.to_index())->start_training(target);
 
-    // run the minimizer and update the weights in the model
-    auto result = minimizer->minimize(*objective, target);
+    // run the minimizer, unless the initial weights are already known to be optimal, and update the weights in the model
+    solvers::MinimizationResult result{solvers::MinimizerStatus::SUCCESS, 0, 0.0, 0.0, 0.0, 0.0};
+    if(!screened) {
+        result = minimizer->minimize(*objective, target);
+    }
     m_ResultGatherers.at(thread_id.to_index())->record_result(target, result);
+    m_ThreadLocalWeightInit.at(thread_id.to_index())->on_label_finished(label_id, target);
     m_ThreadLocalPostProc.at(thread_id.to_index())->process(label_id, target, result);
     m_Model->set_weights_for_label(label_id, model::Model::WeightVectorIn{target});
+    if(m_CheckpointWriter) {
+        m_CheckpointWriter->add(label_id, target);
+    }
 
     // some logging
     if(result.Outcome != solvers::MinimizerStatus::SUCCESS) {
@@ -82,37 +150,53 @@ solvers::MinimizationResult TrainingTaskGenerator::train_label(label_id_t label_
 }
 
 void TrainingTaskGenerator::prepare(long num_threads, long chunk_size) {
-    m_ThreadLocalWorkingVector.resize(num_threads);
-    m_ThreadLocalMinimizer.resize(num_threads);
-    m_ThreadLocalObjective.resize(num_threads);
-    m_ThreadLocalWeightInit.resize(num_threads);
-    m_ThreadLocalPostProc.resize(num_threads);
-    m_ResultGatherers.resize(num_threads);
+    if(m_CostModel) {
+        m_TaskOrder = m_CostModel->schedule(m_LabelRangeBegin, m_LabelRangeEnd, num_threads);
+    } else {
+        m_TaskOrder.clear();
+    }
+
+    // the buffers may only grow, so that we can keep the objects of threads that are not used in this run
+    if(num_threads > ssize(m_ThreadLocalObjective)) {
+        m_ThreadLocalWorkingVector.resize(num_threads);
+        m_ThreadLocalMinimizer.resize(num_threads);
+        m_ThreadLocalObjective.resize(num_threads);
+        m_ThreadLocalWeightInit.resize(num_threads);
+        m_ThreadLocalPostProc.resize(num_threads);
+        m_ResultGatherers.resize(num_threads);
+    }
 }
 
 void TrainingTaskGenerator::init_thread(thread_id_t thread_id)
 {
-    m_ThreadLocalWorkingVector.at(thread_id.to_index()) = DenseRealVector::Zero(m_TaskSpec->num_features());
-    m_ThreadLocalMinimizer.at(thread_id.to_index()) = m_TaskSpec->make_minimizer();
-    m_ThreadLocalObjective.at(thread_id.to_index()) = m_TaskSpec->make_objective();
-    m_ThreadLocalWeightInit.at(thread_id.to_index()) = m_TaskSpec->make_initializer();
-    m_ThreadLocalPostProc.at(thread_id.to_index()) = m_TaskSpec->make_post_processor(m_ThreadLocalObjective.at(thread_id.to_index()));
-    m_ResultGatherers.at(thread_id.to_index()) = m_TaskSpec->get_statistics_gatherer().create_results_gatherer(thread_id, m_TaskSpec);
+    auto& stats = m_TaskSpec->get_statistics_gatherer();
+    auto index = thread_id.to_index();
 
-    m_TaskSpec->get_statistics_gatherer().setup_minimizer(thread_id, *m_ThreadLocalMinimizer.at(thread_id.to_index()));
-    m_TaskSpec->get_statistics_gatherer().setup_initializer(thread_id, *m_ThreadLocalWeightInit.at(thread_id.to_index()));
-    m_TaskSpec->get_statistics_gatherer().setup_objective(thread_id, *m_ThreadLocalObjective.at(thread_id.to_index()));
-    m_TaskSpec->get_statistics_gatherer().setup_postproc(thread_id, *m_ThreadLocalPostProc.at(thread_id.to_index()));
+    // the initializer may have been reset since the last run
+    if(!m_ThreadLocalWeightInit.at(index)) {
+        m_ThreadLocalWeightInit.at(index) = m_TaskSpec->make_initializer();
+        stats.setup_initializer(thread_id, *m_ThreadLocalWeightInit.at(index));
+    }
+
+    // everything else is kept from previous runs
+    if(m_ThreadLocalObjective.at(index)) {
+        return;
+    }
+
+    m_ThreadLocalWorkingVector.at(index) = DenseRealVector::Zero(m_TaskSpec->num_features());
+    m_ThreadLocalMinimizer.at(index) = m_TaskSpec->make_minimizer();
+    m_ThreadLocalObjective.at(index) = m_TaskSpec->make_objective();
+    m_ThreadLocalPostProc.at(index) = m_TaskSpec->make_post_processor(m_ThreadLocalObjective.at(index));
+    m_ResultGatherers.at(index) = stats.create_results_gatherer(thread_id, m_TaskSpec);
+
+    stats.setup_minimizer(thread_id, *m_ThreadLocalMinimizer.at(index));
+    stats.setup_objective(thread_id, *m_ThreadLocalObjective.at(index));
+    stats.setup_postproc(thread_id, *m_ThreadLocalPostProc.at(index));
 }
 
 void TrainingTaskGenerator::finalize() {
-    m_ThreadLocalWorkingVector.clear();
-    m_ThreadLocalMinimizer.clear();
-    m_ThreadLocalObjective.clear();
-    m_ThreadLocalWeightInit.clear();
-    m_ThreadLocalPostProc.clear();
-
-    m_TaskSpec->get_statistics_gatherer().finalize();
+    // the thread-local objects are kept for the next run, and the statistics are merged in the destructor
+    m_HasThreads = true;
 }
 
 long TrainingTaskGenerator::num_tasks() const {
@@ -123,6 +207,10 @@ TrainingResult dismec::run_training(parallel::ParallelRunner& runner, std::share
                             label_id_t begin_label, label_id_t end_label)
 {
     auto task = TrainingTaskGenerator(std::move(spec), begin_label, end_label);
+    return run_training(runner, task);
+}
+
+TrainingResult dismec::run_training(parallel::ParallelRunner& runner, TrainingTaskGenerator& task) {
     auto result = runner.run(task);
 
     real_t total_loss = 0.0;
@@ -139,7 +227,7 @@ TrainingResult dismec::run_training(parallel::ParallelRunner& runner, std::share
     {
         using SubWrapperType = model::SubModelWrapper<std::shared_ptr<model::Model>>;
         model = std::make_shared<SubWrapperType>(model, model->labels_begin(),
-                                                 label_id_t{result.NextTask});
+                                                 task.first_unfinished_label(result.NextTask));
     }
 
     return {result.IsFinished, std::move(model), total_loss, total_grad};
@@ -22,6 +22,11 @@ namespace dismec
      *  for the different labels. The tasks are generated as specified by a `TrainingSpec`:
      *  Each thread generates a minimizer, an objective, and an initializer. The objective and optimizer
      *  are updated for each new label using the corresponding functions of the `TrainingSpec` object.
+     *
+     *  The per-thread objects are created when a thread runs for the first time, and are kept alive for subsequent
+     *  runs. This means that the same generator can be used to train several batches of labels (see
+     *  `set_label_range()`) without having to set up the objectives, minimizers, and their buffers again.
+     *  Statistics are merged when the generator is destroyed.
      */
     class TrainingTaskGenerator : public parallel::TaskGenerator {
     public:
@@ -29,6 +34,53 @@ namespace dismec
                               label_id_t end_label=label_id_t{-1});
         ~TrainingTaskGenerator() override;
 
+        /*!
+         * \brief Sets the range of labels that will be trained by the next run, and creates a new model for the
+         * results.
+         * \details The model of the previous run is not modified, so it can still be in use (e.g. for saving) while
+         * the next batch is trained.
+         */
+        void set_label_range(label_id_t begin_label, label_id_t end_label);
+
+        /*!
+         * \brief Causes the weight initializers to be re-created from the `TrainingSpec` at the start of the next run.
+         * \details This needs to be called if the initialization strategy of the `TrainingSpec` has been changed.
+         */
+        void reset_initializers();
+
+        /*!
+         * \brief Sets a cost model that determines the order in which labels are trained.
+         * \details If a cost model is given, the labels of each run are dispatched in the order given by
+         * `LabelCostModel::schedule()`, so that the most expensive labels are started first, and are spread over all
+         * threads instead of delaying the end of the batch. The measured training
+         * durations are recorded in the cost model, so the estimates improve for later batches.
+         * Set to `nullptr` to train labels in order of their ids.
+         */
+        void set_cost_model(std::shared_ptr<LabelCostModel> cost_model);
+
+        /*!
+         * \brief Gets the first label whose training has not been completed.
+         * \details If the run was interrupted before `next_task`, then all labels before the returned one have been
+         * trained. If labels are scheduled by a cost model, this takes into account the order in which labels have been
+         * dispatched.
+         * \param next_task The `RunResult::NextTask` of the run.
+         */
+        [[nodiscard]] label_id_t first_unfinished_label(long next_task) const;
+
+        /*!
+         * \brief Sets a writer to which the weights of each label are appended as soon as its training is finished.
+         * \details This allows to resume an interrupted run without losing the labels that were already finished
+         * (see \ref label-checkpoints). Set to `nullptr` to disable the checkpoint log.
+         */
+        void set_checkpoint_writer(std::shared_ptr<io::LabelCheckpointWriter> writer);
+
+        /*!
+         * \brief Sets weights that are already known from a previous run.
+         * \details Labels for which `known` contains weights are not trained again. Instead, these weights are copied
+         * into the model, and the corresponding result is reported as successful with zero iterations.
+         */
+        void set_known_weights(std::shared_ptr<const io::LabelCheckpoint> known);
+
         void run_tasks(long begin, long end, thread_id_t thread_id) override;
         void prepare(long num_threads, long chunk_size) override;
         void init_thread(thread_id_t thread_id) override;
@@ -60,6 +112,15 @@ namespace dismec
         std::shared_ptr<model::Model> m_Model;
         std::vector<solvers::MinimizationResult> m_Results;
 
+        // scheduling
+        std::shared_ptr<LabelCostModel> m_CostModel;
+        /// The offset into the label range for each task. If this is empty, the tasks are run in order of the labels.
+        std::vector<long> m_TaskOrder;
+
+        // checkpointing
+        std::shared_ptr<io::LabelCheckpointWriter> m_CheckpointWriter;
+        std::shared_ptr<const io::LabelCheckpoint> m_KnownWeights;
+
         // thread-local caches
         std::vector<DenseRealVector> m_ThreadLocalWorkingVector;
         std::vector<std::unique_ptr<solvers::Minimizer>> m_ThreadLocalMinimizer;
@@ -67,6 +128,9 @@ namespace dismec
         std::vector<std::unique_ptr<init::WeightsInitializer>> m_ThreadLocalWeightInit;
         std::vector<std::unique_ptr<postproc::PostProcessor>> m_ThreadLocalPostProc;
         std::vector<std::unique_ptr<ResultStatsGatherer>> m_ResultGatherers;
+
+        /// whether any thread has been initialized, i.e. whether there are statistics to be merged.
+        bool m_HasThreads = false;
     };
 
     struct TrainingResult {
@@ -79,6 +143,13 @@ namespace dismec
     TrainingResult run_training(parallel::ParallelRunner& runner, std::shared_ptr<TrainingSpec> spec,
                                 label_id_t begin_label=label_id_t{0}, label_id_t end_label=label_id_t{-1});
 
+    /*!
+     * \brief Runs the training for the current label range of `task`.
+     * \details In contrast to the overload above, this does not create a new `TrainingTaskGenerator`, so the
+     * per-thread objects of `task` are reused if it has been run before.
+     */
+    TrainingResult run_training(parallel::ParallelRunner& runner, TrainingTaskGenerator& task);
+
 }
 
 #endif //DISMEC_TRAINING_H
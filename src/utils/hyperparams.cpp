@@ -47,6 +47,19 @@ auto HyperParameters::get(const std::string& name) const -> hyper_param_t {
     return m_Values.at(name);
 }
 
+bool HyperParameters::has(const std::string& name) const {
+    return m_Values.count(name) != 0;
+}
+
+std::vector<std::string> HyperParameters::names() const {
+    std::vector<std::string> result;
+    result.reserve(m_Values.size());
+    for(const auto& hp : m_Values) {
+        result.push_back(hp.first);
+    }
+    return result;
+}
+
 void HyperParameters::apply(HyperParameterBase& target) const {
     for(const auto& hp : m_Values) {
         std::visit([&](auto&& value) {
@@ -195,6 +208,7 @@ TEST_CASE("HyperParameters nested") {
     HyperParameters hps;
     hps.set("so.a", 1.0);
     hps.set("so.b", 5l);
+    CHECK(hps.names().size() == 2);
     NestedTestObject object;
     hps.apply(object);
     CHECK(object.sub.direct_hp == 1.0);
@@ -249,6 +249,12 @@ namespace dismec
         /// Gets the hyper-parameter with the given name, or throws if it does not exist.
         [[nodiscard]] hyper_param_t get(const std::string& name) const;
 
+        /// Checks whether a value has been set for the hyper-parameter with the given name.
+        [[nodiscard]] bool has(const std::string& name) const;
+
+        /// Returns the names of all hyper-parameters for which a value has been set.
+        [[nodiscard]] std::vector<std::string> names() const;
+
         /// Applies the hyper-parameter values to `target`. It is valid to call this if not all hyper-parameters
         /// in target are part of this hyper-parameter set, but an error if additional parameters are present.
         void apply(HyperParameterBase& target) const;
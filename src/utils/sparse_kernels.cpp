@@ -0,0 +1,482 @@
+// Copyright (c) 2021, Aalto University, developed by Erik Schultheis
+// All rights reserved.
+//
+// SPDX-License-Identifier: MIT
+
+#include "sparse_kernels.h"
+#include "utils/throw_error.h"
+#include "spdlog/spdlog.h"
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define DISMEC_X86_KERNELS 1
+#include <immintrin.h>
+#else
+#define DISMEC_X86_KERNELS 0
+#endif
+
+using namespace dismec;
+using namespace dismec::kernels;
+
+namespace {
+    // -----------------------------------------------------------------------------------------------------------------
+    //                                         scalar implementation
+    // -----------------------------------------------------------------------------------------------------------------
+    real_t dot_scalar(const real_t* values, const index_t* indices, long nnz, const real_t* dense) {
+        // use four independent accumulators, so that consecutive additions do not depend on each other
+        real_t a = 0;
+        real_t b = 0;
+        real_t c = 0;
+        real_t d = 0;
+        long i = 0;
+        for (; i + 4 <= nnz; i += 4) {
+            a += values[i] * dense[indices[i]];
+            b += values[i + 1] * dense[indices[i + 1]];
+            c += values[i + 2] * dense[indices[i + 2]];
+            d += values[i + 3] * dense[indices[i + 3]];
+        }
+        real_t result = (a + b) + (c + d);
+        for (; i < nnz; ++i) {
+            result += values[i] * dense[indices[i]];
+        }
+        return result;
+    }
+
+    void axpy_scalar(real_t factor, const real_t* values, const index_t* indices, long nnz, real_t* dense) {
+        for (long i = 0; i < nnz; ++i) {
+            dense[indices[i]] += factor * values[i];
+        }
+    }
+
+    void sq_axpy_scalar(real_t factor, const real_t* values, const index_t* indices, long nnz, real_t* dense) {
+        for (long i = 0; i < nnz; ++i) {
+            dense[indices[i]] += factor * values[i] * values[i];
+        }
+    }
+
+    long margin_violators_scalar(const real_t* scores, const std::int8_t* labels, long n, int* positions, real_t* values) {
+        // branch-free: always write the candidate, but only advance the output position for violators. This is safe
+        // because the output position never exceeds the input position.
+        long count = 0;
+        for (long i = 0; i < n; ++i) {
+            real_t d = real_t{1} - static_cast<real_t>(labels[i]) * scores[i];
+            positions[count] = static_cast<int>(i);
+            values[count] = d;
+            count += d > 0 ? 1 : 0;
+        }
+        return count;
+    }
+
+    constexpr SparseKernels SCALAR_KERNELS{dot_scalar, axpy_scalar, sq_axpy_scalar, margin_violators_scalar,
+                                           KernelISA::SCALAR};
+
+#if DISMEC_X86_KERNELS
+    // -----------------------------------------------------------------------------------------------------------------
+    //                                          AVX2 implementation
+    // -----------------------------------------------------------------------------------------------------------------
+    // AVX2 only has gather instructions, so the write-back of the axpy kernels is done with scalar stores.
+
+    __attribute__((target("avx2,fma")))
+    real_t dot_avx2(const real_t* values, const index_t* indices, long nnz, const real_t* dense) {
+        __m256 acc_a = _mm256_setzero_ps();
+        __m256 acc_b = _mm256_setzero_ps();
+        long i = 0;
+        for (; i + 16 <= nnz; i += 16) {
+            __m256i idx_a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(indices + i));
+            __m256i idx_b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(indices + i + 8));
+            acc_a = _mm256_fmadd_ps(_mm256_loadu_ps(values + i), _mm256_i32gather_ps(dense, idx_a, 4), acc_a);
+            acc_b = _mm256_fmadd_ps(_mm256_loadu_ps(values + i + 8), _mm256_i32gather_ps(dense, idx_b, 4), acc_b);
+        }
+        for (; i + 8 <= nnz; i += 8) {
+            __m256i idx = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(indices + i));
+            acc_a = _mm256_fmadd_ps(_mm256_loadu_ps(values + i), _mm256_i32gather_ps(dense, idx, 4), acc_a);
+        }
+        __m256 acc = _mm256_add_ps(acc_a, acc_b);
+        __m128 sum = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+        sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+        sum = _mm_add_ss(sum, _mm_movehdup_ps(sum));
+        real_t result = _mm_cvtss_f32(sum);
+        for (; i < nnz; ++i) {
+            result += values[i] * dense[indices[i]];
+        }
+        return result;
+    }
+
+    template<bool Square>
+    __attribute__((target("avx2,fma")))
+    void axpy_avx2_tpl(real_t factor, const real_t* values, const index_t* indices, long nnz, real_t* dense) {
+        const __m256 factor_v = _mm256_set1_ps(factor);
+        alignas(32) real_t result[8];
+        long i = 0;
+        for (; i + 8 <= nnz; i += 8) {
+            __m256i idx = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(indices + i));
+            __m256 val = _mm256_loadu_ps(values + i);
+            if constexpr (Square) {
+                val = _mm256_mul_ps(val, val);
+            }
+            __m256 old = _mm256_i32gather_ps(dense, idx, 4);
+            _mm256_store_ps(result, _mm256_fmadd_ps(factor_v, val, old));
+            for (int j = 0; j < 8; ++j) {
+                dense[indices[i + j]] = result[j];
+            }
+        }
+        for (; i < nnz; ++i) {
+            if constexpr (Square) {
+                dense[indices[i]] += factor * values[i] * values[i];
+            } else {
+                dense[indices[i]] += factor * values[i];
+            }
+        }
+    }
+
+    void axpy_avx2(real_t factor, const real_t* values, const index_t* indices, long nnz, real_t* dense) {
+        axpy_avx2_tpl<false>(factor, values, indices, nnz, dense);
+    }
+
+    void sq_axpy_avx2(real_t factor, const real_t* values, const index_t* indices, long nnz, real_t* dense) {
+        axpy_avx2_tpl<true>(factor, values, indices, nnz, dense);
+    }
+
+    /// Lookup table that, for each 8-bit mask, contains the permutation that moves the selected lanes to the front.
+    struct CompressTable {
+        alignas(32) std::int32_t Permutation[256][8];
+    };
+
+    constexpr CompressTable make_compress_table() {
+        CompressTable table{};
+        for (int mask = 0; mask < 256; ++mask) {
+            int target = 0;
+            for (int lane = 0; lane < 8; ++lane) {
+                if (mask & (1 << lane)) {
+                    table.Permutation[mask][target] = lane;
+                    ++target;
+                }
+            }
+        }
+        return table;
+    }
+
+    constexpr CompressTable COMPRESS_TABLE = make_compress_table();
+
+    // AVX2 has no compress instruction, so we permute the selected lanes to the front and store the full vector.
+    // As the output position never exceeds the input position, this cannot write past the end of the buffers.
+    __attribute__((target("avx2,fma")))
+    long margin_violators_avx2(const real_t* scores, const std::int8_t* labels, long n, int* positions, real_t* values) {
+        const __m256 one = _mm256_set1_ps(1.f);
+        const __m256i lane_ids = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+        long count = 0;
+        long i = 0;
+        for (; i + 8 <= n; i += 8) {
+            __m128i lbl_bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(labels + i));
+            __m256 lbl = _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(lbl_bytes));
+            __m256 d = _mm256_fnmadd_ps(lbl, _mm256_loadu_ps(scores + i), one);
+            int mask = _mm256_movemask_ps(_mm256_cmp_ps(d, _mm256_setzero_ps(), _CMP_GT_OQ));
+            __m256i perm = _mm256_load_si256(reinterpret_cast<const __m256i*>(COMPRESS_TABLE.Permutation[mask]));
+            __m256i idx = _mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(i)), lane_ids);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(positions + count), _mm256_permutevar8x32_epi32(idx, perm));
+            _mm256_storeu_ps(values + count, _mm256_permutevar8x32_ps(d, perm));
+            count += __builtin_popcount(mask);
+        }
+        for (; i < n; ++i) {
+            real_t d = real_t{1} - static_cast<real_t>(labels[i]) * scores[i];
+            positions[count] = static_cast<int>(i);
+            values[count] = d;
+            count += d > 0 ? 1 : 0;
+        }
+        return count;
+    }
+
+    constexpr SparseKernels AVX2_KERNELS{dot_avx2, axpy_avx2, sq_axpy_avx2, margin_violators_avx2, KernelISA::AVX2};
+
+    // -----------------------------------------------------------------------------------------------------------------
+    //                                         AVX-512 implementation
+    // -----------------------------------------------------------------------------------------------------------------
+    // The remainder of each row is handled with masked instructions, so there is no scalar tail loop.
+
+    __attribute__((target("avx512f")))
+    real_t dot_avx512(const real_t* values, const index_t* indices, long nnz, const real_t* dense) {
+        __m512 acc = _mm512_setzero_ps();
+        long i = 0;
+        for (; i + 16 <= nnz; i += 16) {
+            __m512i idx = _mm512_loadu_si512(indices + i);
+            acc = _mm512_fmadd_ps(_mm512_loadu_ps(values + i), _mm512_i32gather_ps(idx, dense, 4), acc);
+        }
+        if (i < nnz) {
+            const __mmask16 mask = (1u << (nnz - i)) - 1u;
+            __m512i idx = _mm512_maskz_loadu_epi32(mask, indices + i);
+            __m512 gathered = _mm512_mask_i32gather_ps(_mm512_setzero_ps(), mask, idx, dense, 4);
+            acc = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, values + i), gathered, acc);
+        }
+        return _mm512_reduce_add_ps(acc);
+    }
+
+    template<bool Square>
+    __attribute__((target("avx512f")))
+    void axpy_avx512_tpl(real_t factor, const real_t* values, const index_t* indices, long nnz, real_t* dense) {
+        const __m512 factor_v = _mm512_set1_ps(factor);
+        long i = 0;
+        for (; i + 16 <= nnz; i += 16) {
+            __m512i idx = _mm512_loadu_si512(indices + i);
+            __m512 val = _mm512_loadu_ps(values + i);
+            if constexpr (Square) {
+                val = _mm512_mul_ps(val, val);
+            }
+            __m512 old = _mm512_i32gather_ps(idx, dense, 4);
+            _mm512_i32scatter_ps(dense, idx, _mm512_fmadd_ps(factor_v, val, old), 4);
+        }
+        if (i < nnz) {
+            const __mmask16 mask = (1u << (nnz - i)) - 1u;
+            __m512i idx = _mm512_maskz_loadu_epi32(mask, indices + i);
+            __m512 val = _mm512_maskz_loadu_ps(mask, values + i);
+            if constexpr (Square) {
+                val = _mm512_mul_ps(val, val);
+            }
+            __m512 old = _mm512_mask_i32gather_ps(_mm512_setzero_ps(), mask, idx, dense, 4);
+            _mm512_mask_i32scatter_ps(dense, mask, idx, _mm512_fmadd_ps(factor_v, val, old), 4);
+        }
+    }
+
+    void axpy_avx512(real_t factor, const real_t* values, const index_t* indices, long nnz, real_t* dense) {
+        axpy_avx512_tpl<false>(factor, values, indices, nnz, dense);
+    }
+
+    void sq_axpy_avx512(real_t factor, const real_t* values, const index_t* indices, long nnz, real_t* dense) {
+        axpy_avx512_tpl<true>(factor, values, indices, nnz, dense);
+    }
+
+    // The full blocks compress in registers and store the entire vector, which is faster than `compressstoreu` on
+    // many CPUs. For the last, partial block we use masked instructions, so that nothing is written past `n`.
+    __attribute__((target("avx512f")))
+    long margin_violators_avx512(const real_t* scores, const std::int8_t* labels, long n, int* positions, real_t* values) {
+        const __m512 one = _mm512_set1_ps(1.f);
+        const __m512i lane_ids = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+        long count = 0;
+        long i = 0;
+        for (; i + 16 <= n; i += 16) {
+            __m128i lbl_bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(labels + i));
+            __m512 lbl = _mm512_cvtepi32_ps(_mm512_cvtepi8_epi32(lbl_bytes));
+            __m512 d = _mm512_fnmadd_ps(lbl, _mm512_loadu_ps(scores + i), one);
+            __mmask16 mask = _mm512_cmp_ps_mask(d, _mm512_setzero_ps(), _CMP_GT_OQ);
+            __m512i idx = _mm512_add_epi32(_mm512_set1_epi32(static_cast<int>(i)), lane_ids);
+            _mm512_storeu_si512(positions + count, _mm512_maskz_compress_epi32(mask, idx));
+            _mm512_storeu_ps(values + count, _mm512_maskz_compress_ps(mask, d));
+            count += __builtin_popcount(mask);
+        }
+        if (i < n) {
+            const __mmask16 valid = (1u << (n - i)) - 1u;
+            // masked byte loads would require AVX512BW, so copy the remaining labels to a buffer instead
+            alignas(16) std::int8_t label_tail[16] = {};
+            std::memcpy(label_tail, labels + i, n - i);
+            __m128i lbl_bytes = _mm_load_si128(reinterpret_cast<const __m128i*>(label_tail));
+            __m512 lbl = _mm512_cvtepi32_ps(_mm512_cvtepi8_epi32(lbl_bytes));
+            __m512 d = _mm512_fnmadd_ps(lbl, _mm512_maskz_loadu_ps(valid, scores + i), one);
+            __mmask16 mask = _mm512_mask_cmp_ps_mask(valid, d, _mm512_setzero_ps(), _CMP_GT_OQ);
+            __m512i idx = _mm512_add_epi32(_mm512_set1_epi32(static_cast<int>(i)), lane_ids);
+            _mm512_mask_compressstoreu_epi32(positions + count, mask, idx);
+            _mm512_mask_compressstoreu_ps(values + count, mask, d);
+            count += __builtin_popcount(mask);
+        }
+        return count;
+    }
+
+    constexpr SparseKernels AVX512_KERNELS{dot_avx512, axpy_avx512, sq_axpy_avx512, margin_violators_avx512,
+                                           KernelISA::AVX512};
+#endif
+
+    const SparseKernels& select_best_kernels() {
+        // explicit selection through the environment
+        if(const char* requested = std::getenv("DISMEC_KERNEL_ISA"); requested) {
+            // this runs while initializing a static, so we must not throw here: that would fail again at every
+            // subsequent call. Anything that cannot be used falls back to the automatic selection.
+            bool known = false;
+            for(auto isa : {KernelISA::SCALAR, KernelISA::AVX2, KernelISA::AVX512}) {
+                if(std::strcmp(requested, to_string(isa)) != 0) {
+                    continue;
+                }
+                known = true;
+                if(is_supported(isa)) {
+                    spdlog::info("Using {} kernels for sparse row operations", to_string(isa));
+                    return get_kernels(isa);
+                }
+                spdlog::warn("Kernel ISA '{}' requested in DISMEC_KERNEL_ISA is not supported on this CPU", requested);
+            }
+            if(!known) {
+                spdlog::warn("Unknown kernel ISA '{}' requested in DISMEC_KERNEL_ISA", requested);
+            }
+        }
+
+        // AVX2 is preferred over AVX-512: For short rows, the masked remainder handling and the (on some CPUs
+        // microcode-mitigated) 16-wide gathers do not pay off, and the scatter does not help much for the axpy
+        // kernels, as these are limited by the random accesses to the dense vector.
+        const SparseKernels& selected = is_supported(KernelISA::AVX2) ? get_kernels(KernelISA::AVX2) :
+                                        is_supported(KernelISA::AVX512) ? get_kernels(KernelISA::AVX512) :
+                                        SCALAR_KERNELS;
+        spdlog::info("Using {} kernels for sparse row operations", to_string(selected.ISA));
+        return selected;
+    }
+}
+
+const char* kernels::to_string(KernelISA isa) {
+    switch (isa) {
+        case KernelISA::SCALAR:
+            return "scalar";
+        case KernelISA::AVX2:
+            return "AVX2";
+        case KernelISA::AVX512:
+            return "AVX-512";
+    }
+    return "unknown";
+}
+
+bool kernels::is_supported(KernelISA isa) {
+    switch (isa) {
+        case KernelISA::SCALAR:
+            return true;
+#if DISMEC_X86_KERNELS
+        case KernelISA::AVX2:
+            return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+        case KernelISA::AVX512:
+            return __builtin_cpu_supports("avx512f");
+#endif
+        default:
+            return false;
+    }
+}
+
+const SparseKernels& kernels::get_kernels(KernelISA isa) {
+    if(!is_supported(isa)) {
+        THROW_EXCEPTION(std::invalid_argument, "Kernels for ISA {} are not supported on this CPU", to_string(isa));
+    }
+    switch (isa) {
+#if DISMEC_X86_KERNELS
+        case KernelISA::AVX2:
+            return AVX2_KERNELS;
+        case KernelISA::AVX512:
+            return AVX512_KERNELS;
+#endif
+        default:
+            return SCALAR_KERNELS;
+    }
+}
+
+const SparseKernels& kernels::best_kernels() {
+    static const SparseKernels& kernels = select_best_kernels();
+    return kernels;
+}
+
+
+#ifndef DOCTEST_CONFIG_DISABLE
+#include "doctest.h"
+#include "utils/test_utils.h"
+#include "utils/conversion.h"
+
+TEST_CASE("sparse row kernels") {
+    // rows of different lengths, so that we hit full vectors as well as all kinds of remainders
+    for (int nnz : {0, 1, 3, 7, 8, 9, 15, 16, 17, 31, 33, 64, 100}) {
+        SparseFeatures matrix = make_uniform_sparse_matrix(1, 100, nnz);
+        Eigen::Map<DenseRealVector>(matrix.valuePtr(), matrix.nonZeros()).setRandom();
+        DenseRealVector dense = DenseRealVector::Random(100);
+        const auto* values = matrix.valuePtr();
+        const auto* indices = matrix.innerIndexPtr();
+        const long num = matrix.nonZeros();
+
+        real_t ref_dot = dot_scalar(values, indices, num, dense.data());
+        DenseRealVector ref_axpy = dense;
+        axpy_scalar(0.7, values, indices, num, ref_axpy.data());
+        DenseRealVector ref_sq_axpy = dense;
+        sq_axpy_scalar(0.7, values, indices, num, ref_sq_axpy.data());
+
+        for (auto isa: {KernelISA::SCALAR, KernelISA::AVX2, KernelISA::AVX512}) {
+            if (!is_supported(isa)) {
+                continue;
+            }
+            INFO(to_string(isa));
+            CAPTURE(nnz);
+            const SparseKernels& k = get_kernels(isa);
+            CHECK(k.dot(values, indices, num, dense.data()) == doctest::Approx(ref_dot));
+
+            DenseRealVector axpy = dense;
+            k.axpy(0.7, values, indices, num, axpy.data());
+            DenseRealVector sq_axpy = dense;
+            k.sq_axpy(0.7, values, indices, num, sq_axpy.data());
+            for (int i = 0; i < dense.size(); ++i) {
+                REQUIRE(axpy.coeff(i) == doctest::Approx(ref_axpy.coeff(i)));
+                REQUIRE(sq_axpy.coeff(i) == doctest::Approx(ref_sq_axpy.coeff(i)));
+            }
+        }
+    }
+}
+
+TEST_CASE("margin violators kernel") {
+    for (int n : {0, 1, 7, 8, 9, 15, 16, 17, 33, 100}) {
+        DenseRealVector scores = DenseRealVector::Random(n) * 2;
+        BinaryLabelVector labels(n);
+        for (int i = 0; i < n; ++i) {
+            labels.coeffRef(i) = i % 3 == 0 ? 1 : -1;
+        }
+
+        std::vector<int> expected_pos;
+        std::vector<real_t> expected_val;
+        for (int i = 0; i < n; ++i) {
+            real_t d = real_t{1} - labels.coeff(i) * scores.coeff(i);
+            if (d > 0) {
+                expected_pos.push_back(i);
+                expected_val.push_back(d);
+            }
+        }
+
+        for (auto isa: {KernelISA::SCALAR, KernelISA::AVX2, KernelISA::AVX512}) {
+            if (!is_supported(isa)) {
+                continue;
+            }
+            INFO(to_string(isa));
+            CAPTURE(n);
+            std::vector<int> positions(n);
+            std::vector<real_t> values(n);
+            long count = get_kernels(isa).margin_violators(scores.data(), labels.data(), n, positions.data(), values.data());
+            REQUIRE(count == ssize(expected_pos));
+            for (long i = 0; i < count; ++i) {
+                REQUIRE(positions[i] == expected_pos[i]);
+                REQUIRE(values[i] == expected_val[i]);
+            }
+        }
+    }
+}
+
+TEST_CASE("unsupported kernels") {
+    for (auto isa: {KernelISA::AVX2, KernelISA::AVX512}) {
+        if (!is_supported(isa)) {
+            CHECK_THROWS(get_kernels(isa));
+        }
+    }
+    CHECK(is_supported(best_kernels().ISA));
+}
+
+/*!
+ * \test This checks that an ISA requested through `DISMEC_KERNEL_ISA` is only used if the CPU supports it. Otherwise,
+ * including for unknown names, the selection falls back to the best supported kernels instead of throwing.
+ */
+TEST_CASE("kernel selection from the environment") {
+    const char* previous = std::getenv("DISMEC_KERNEL_ISA");
+    std::string backup = previous ? previous : "";
+
+    ::unsetenv("DISMEC_KERNEL_ISA");
+    KernelISA automatic = select_best_kernels().ISA;
+    CHECK(is_supported(automatic));
+    for (auto isa: {KernelISA::SCALAR, KernelISA::AVX2, KernelISA::AVX512}) {
+        ::setenv("DISMEC_KERNEL_ISA", to_string(isa), 1);
+        const SparseKernels* selected = nullptr;
+        REQUIRE_NOTHROW(selected = &select_best_kernels());
+        CHECK(selected->ISA == (is_supported(isa) ? isa : automatic));
+    }
+    ::setenv("DISMEC_KERNEL_ISA", "SSE9", 1);
+    CHECK(select_best_kernels().ISA == automatic);
+
+    if(previous) {
+        ::setenv("DISMEC_KERNEL_ISA", backup.c_str(), 1);
+    } else {
+        ::unsetenv("DISMEC_KERNEL_ISA");
+    }
+}
+#endif
@@ -0,0 +1,98 @@
+// Copyright (c) 2021, Aalto University, developed by Erik Schultheis
+// All rights reserved.
+//
+// SPDX-License-Identifier: MIT
+
+#ifndef DISMEC_SRC_UTILS_SPARSE_KERNELS_H
+#define DISMEC_SRC_UTILS_SPARSE_KERNELS_H
+
+#include "matrix_types.h"
+
+/*! \file sparse_kernels.h
+ * \brief Low-level kernels for combining a single row of a sparse matrix with a dense vector.
+ * \details These operations are at the heart of the gradient and Hessian-vector product calculations of the
+ * linear objectives. They are implemented for several instruction sets (scalar, AVX2, AVX-512), and the best
+ * implementation supported by the CPU is selected at runtime. The vectorized implementations use gather
+ * (and for AVX-512 also scatter) instructions to access the dense vector. Scatter is safe here, because the
+ * column indices within a single row of a compressed sparse matrix are unique.
+ *
+ * The same dispatch mechanism is used for the stream compaction that finds the margin violators of the hinge-type
+ * losses.
+ */
+
+namespace dismec::kernels {
+    using index_t = SparseFeatures::StorageIndex;
+
+    /// Enumeration of the available implementations of the kernels.
+    enum class KernelISA {
+        SCALAR,     //!< Portable implementation, always available.
+        AVX2,       //!< Uses AVX2 gather and FMA instructions.
+        AVX512      //!< Uses AVX-512F gather and scatter instructions.
+    };
+
+    /// Returns a human-readable name for the ISA.
+    const char* to_string(KernelISA isa);
+
+    /*!
+     * \brief Table of function pointers for one particular instruction set.
+     * \details Each function operates on a sparse vector given by `nnz` `values` at the positions `indices`, and a
+     * dense vector `dense`.
+     */
+    struct SparseKernels {
+        /// Calculates \f$ \sum_i values[i] * dense[indices[i]] \f$
+        real_t (*dot)(const real_t* values, const index_t* indices, long nnz, const real_t* dense);
+        /// Performs \f$ dense[indices[i]] += factor * values[i] \f$
+        void (*axpy)(real_t factor, const real_t* values, const index_t* indices, long nnz, real_t* dense);
+        /// Performs \f$ dense[indices[i]] += factor * values[i]^2 \f$
+        void (*sq_axpy)(real_t factor, const real_t* values, const index_t* indices, long nnz, real_t* dense);
+        /*!
+         * \brief Finds all `i < n` with \f$ d_i = 1 - labels[i] * scores[i] > 0 \f$, and writes `i` to `positions`
+         * and `d_i` to `values`, in increasing order of `i`.
+         * \return The number of margin violators.
+         * \attention The vectorized implementations store full vectors, so the entries of `positions` and `values`
+         * after the returned count may be overwritten. Both buffers need to have space for `n` elements.
+         */
+        long (*margin_violators)(const real_t* scores, const std::int8_t* labels, long n, int* positions, real_t* values);
+        /// The ISA of this implementation.
+        KernelISA ISA;
+    };
+
+    /// Checks whether the given ISA is supported by the CPU on which the program is running.
+    bool is_supported(KernelISA isa);
+
+    /*!
+     * \brief Gets the kernels for the given ISA.
+     * \throws std::invalid_argument if the `isa` is not supported.
+     */
+    const SparseKernels& get_kernels(KernelISA isa);
+
+    /*!
+     * \brief Gets the kernels for the best ISA that is supported by the CPU.
+     * \details The selection happens once, on the first call of this function. It can be overridden by setting the
+     * environment variable `DISMEC_KERNEL_ISA` to the name of the ISA, as given by `to_string()`.
+     */
+    const SparseKernels& best_kernels();
+
+    /// Calculates the dot product of row `row` of `matrix` with the dense vector `dense`.
+    inline real_t sparse_row_dot(const SparseFeatures& matrix, Eigen::Index row, const DenseRealVector& dense) {
+        const auto start = matrix.outerIndexPtr()[row];
+        const auto end = matrix.outerIndexPtr()[row + 1];
+        return best_kernels().dot(matrix.valuePtr() + start, matrix.innerIndexPtr() + start, end - start, dense.data());
+    }
+
+    /// Adds `factor` times row `row` of `matrix` to `dense`.
+    inline void sparse_row_axpy(real_t factor, const SparseFeatures& matrix, Eigen::Index row, Eigen::Ref<DenseRealVector> dense) {
+        const auto start = matrix.outerIndexPtr()[row];
+        const auto end = matrix.outerIndexPtr()[row + 1];
+        best_kernels().axpy(factor, matrix.valuePtr() + start, matrix.innerIndexPtr() + start, end - start, dense.data());
+    }
+
+    /// Adds `factor` times the element-wise square of row `row` of `matrix` to `dense`.
+    inline void sparse_row_sq_axpy(real_t factor, const SparseFeatures& matrix, Eigen::Index row, Eigen::Ref<DenseRealVector> dense) {
+        const auto start = matrix.outerIndexPtr()[row];
+        const auto end = matrix.outerIndexPtr()[row + 1];
+        best_kernels().sq_axpy(factor, matrix.valuePtr() + start, matrix.innerIndexPtr() + start, end - start, dense.data());
+    }
+}
+
+#endif //DISMEC_SRC_UTILS_SPARSE_KERNELS_H
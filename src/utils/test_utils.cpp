@@ -4,6 +4,10 @@
 // SPDX-License-Identifier: MIT
 
 #include "test_utils.h"
+#include "objective/regularizers_imp.h"
+#include "solver/newton.h"
+#include "utils/eigen_generic.h"
+#include <tuple>
 
 dismec::SparseFeatures dismec::make_uniform_sparse_matrix(int rows, int cols, int nonzeros_per_row) {
     SparseFeatures matrix(rows, cols);
@@ -18,3 +22,31 @@ dismec::SparseFeatures dismec::make_uniform_sparse_matrix(int rows, int cols, in
     matrix.makeCompressed();
     return matrix;
 }
+
+dismec::SolverTestProblem dismec::make_solver_test_problem(real_t negative_cost, real_t scale_0, real_t scale_1) {
+    SparseFeatures features(8, 3);
+    std::vector<std::tuple<int, int, real_t>> entries = {{0, 0, 1.0}, {0, 2, 1.0}, {1, 1, 2.0}, {1, 2, 1.0},
+                                                         {2, 0, -1.0}, {2, 2, 1.0}, {3, 1, -0.5}, {3, 2, 1.0},
+                                                         {4, 0, 0.5}, {4, 1, 0.5}, {4, 2, 1.0}, {5, 0, -2.0},
+                                                         {5, 2, 1.0}, {6, 1, 1.0}, {6, 2, 1.0}, {7, 0, 0.2}, {7, 2, 1.0}};
+    for(auto [row, col, value] : entries) {
+        real_t scale = col == 0 ? scale_0 : (col == 1 ? scale_1 : real_t{1});
+        features.insert(row, col) = scale * value;
+    }
+    features.makeCompressed();
+    BinaryLabelVector labels(8);
+    labels << 1, 1, -1, -1, 1, -1, 1, -1;
+
+    auto shared = std::make_shared<const GenericFeatureMatrix>(features);
+    auto objective = std::make_shared<objective::Regularized_SquaredHingeSVC>(
+            shared, std::make_unique<objective::SquaredNormRegularizer>(0.5));
+    objective->get_label_ref() = labels;
+    objective->update_costs(1.0, negative_cost);
+
+    DenseRealVector reference = DenseRealVector::Zero(3);
+    solvers::NewtonWithLineSearch newton(3);
+    newton.set_epsilon(1e-6);
+    newton.minimize(*objective, reference);
+
+    return {std::move(features), std::move(labels), std::move(objective), std::move(reference)};
+}
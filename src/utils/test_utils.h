@@ -7,6 +7,8 @@
 #define DISMEC_TEST_UTILS_H
 
 #include "matrix_types.h"
+#include "objective/reg_sq_hinge.h"
+#include <memory>
 
 namespace dismec {
     /*!
@@ -18,6 +20,25 @@ namespace dismec {
      * \return The resulting sparse matrix.
      */
     SparseFeatures make_uniform_sparse_matrix(int rows, int cols, int non_zeros_per_row);
+
+    /// A small binary classification problem for testing the solvers, see \ref make_solver_test_problem.
+    struct SolverTestProblem {
+        SparseFeatures Features;
+        BinaryLabelVector Labels;
+        std::shared_ptr<objective::Regularized_SquaredHingeSVC> Objective;
+        /// The minimum of `Objective`, as found by `NewtonWithLineSearch` with an epsilon of 1e-6.
+        DenseRealVector Reference;
+    };
+
+    /*!
+     * \brief Creates a squared hinge problem with 8 instances and 3 features, and an L2 regularizer of strength 0.5.
+     * \details The last feature is a bias feature. The costs are 1 for the positive and `negative_cost` for the
+     * negative instances.
+     * \param scale_0 Factor for the values of the first feature.
+     * \param scale_1 Factor for the values of the second feature. Together with `scale_0`, this can be used to make
+     * the problem ill-conditioned.
+     */
+    SolverTestProblem make_solver_test_problem(real_t negative_cost = 1, real_t scale_0 = 1, real_t scale_1 = 1);
 }
 
 